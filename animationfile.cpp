@@ -1,6 +1,12 @@
 #include "animationfile.h"
+#include "imageutil.h"
+#include "mippyramid.h"
+#include "layercache.h"
+#include "compositegraph.h"
+#include "onionskin.h"
 #include <QtWidgets>
 #include <QtXml/QtXml>
+#include <string.h>
 
 //**************************************LayerModel**************************************
 LayerModel::LayerModel(const QString& absPath, const QString& path, const QString& name, LayerType type)
@@ -8,6 +14,7 @@ LayerModel::LayerModel(const QString& absPath, const QString& path, const QStrin
     ,mPath(path)
     ,mName(name)
     ,mType(type)
+    ,mBlendMode(BlendNormal)
 {
 }
 
@@ -16,6 +23,11 @@ LayerModel::~LayerModel()
 
 }
 
+void LayerModel::SetBlendMode(BlendMode value)
+{
+    mBlendMode = value >= BlendNormal && value < BlendReplace ? value : BlendNormal;
+}
+
 //**************************************RasterFrameModel**************************************
 RasterFrameModel::RasterFrameModel(RasterLayerModel* layer, const QString& absImagePath, const QString& imagePath, int exposure)
     :mLayer(layer)
@@ -23,24 +35,30 @@ RasterFrameModel::RasterFrameModel(RasterLayerModel* layer, const QString& absIm
     ,mImagePath(imagePath)
     ,mExposure(exposure)
     ,mImage(NULL)
+    ,mVersion(0)
+    ,mOnionVersion(-1)
+    ,mOnionColor(0)
+    ,mOnionWeight(0)
+    ,mMips(NULL)
 {
     QFile f(absImagePath);
     if (f.exists())
     {
-        mImage = new QImage(absImagePath);
+        mImage = new QImage(QImage(absImagePath).convertToFormat(QImage::Format_RGBA8888));
+        // unknown content, the layer file provides the real bounds
+        mBounds = mImage->rect();
     }
     else
     {
+        // written by the next save, a frame which is removed before that never reaches the disk
         mImage = new QImage(layer->GetWidth(), layer->GetHeight(), QImage::Format_RGBA8888);
-        QPainter p(mImage);
-        p.setCompositionMode(QPainter::CompositionMode_Source);
-        p.fillRect(0, 0, mImage->width(), mImage->height(), QBrush(QColor(0xFF, 0xFF, 0xFF, 0)));
-        mImage->save(mAbsImagePath);
+        mImage->fill(0);
     }
 }
 
 RasterFrameModel::~RasterFrameModel()
 {
+    delete mMips;
     delete mImage;
 }
 
@@ -58,6 +76,96 @@ void RasterFrameModel::Save()
     mImage->save(mAbsImagePath);
 }
 
+void RasterFrameModel::UpdateBounds(const QRect& dirtyRect)
+{
+    if (!mImage)
+    {
+        return;
+    }
+
+    QRect dirty = dirtyRect.intersected(mImage->rect());
+    if (dirty.isEmpty())
+    {
+        return;
+    }
+
+    QRect bounds = mBounds.united(GetContentBounds(mImage, dirty));
+    if (dirty.intersects(mBounds))
+    {
+        // old content may have been erased, rescan inside the candidate box only
+        bounds = GetContentBounds(mImage, bounds);
+    }
+    mBounds = bounds;
+    ++mVersion;
+    if (mMips)
+    {
+        mMips->Invalidate(dirty);
+    }
+}
+
+void RasterFrameModel::RecomputeBounds()
+{
+    if (!mImage)
+    {
+        mBounds = QRect();
+        return;
+    }
+    mBounds = GetContentBounds(mImage, mImage->rect());
+    ++mVersion;
+    if (mMips)
+    {
+        mMips->Invalidate(mImage->rect());
+    }
+}
+
+const QImage* RasterFrameModel::GetMipLevel(int& level)
+{
+    if (level <= 0)
+    {
+        level = 0;
+        return mImage;
+    }
+    if (!mMips)
+    {
+        mMips = new MipPyramid();
+    }
+    return mMips->GetLevel(mImage, level);
+}
+
+const QImage& RasterFrameModel::GetOnionImage(const QColor& color, int weight)
+{
+    if (mOnionVersion == mVersion && mOnionColor == color.rgb() && mOnionWeight == weight)
+    {
+        return mOnionImage;
+    }
+
+    mOnionVersion = mVersion;
+    mOnionColor = color.rgb();
+    mOnionWeight = weight;
+    if (!mImage || mBounds.isEmpty())
+    {
+        mOnionImage = QImage();
+        return mOnionImage;
+    }
+
+    QImage alpha = mImage->format() == QImage::Format_RGBA8888 ? *mImage : mImage->convertToFormat(QImage::Format_RGBA8888);
+    mOnionImage = QImage(mBounds.width(), mBounds.height(), QImage::Format_RGBA8888_Premultiplied);
+    std::vector<uchar> mask(mBounds.width());
+    for (int y = 0; y < mBounds.height(); ++y)
+    {
+        const uchar* src = alpha.constScanLine(mBounds.top() + y) + mBounds.left() * 4 + 3;
+        for (int x = 0; x < mBounds.width(); ++x)
+        {
+            mask[x] = src[x * 4];
+        }
+        // the tint over transparent is the premultiplied tint
+        uchar* dst = mOnionImage.scanLine(y);
+        memset(dst, 0, mBounds.width() * 4);
+        BlendOnionSpan(dst, &mask[0], mBounds.width(), color, weight);
+    }
+    return mOnionImage;
+}
+
 //**************************************RasterLayerModel**************************************
 RasterLayerModel::RasterLayerModel(const QString& absPath, const QString& path, int width, int height)
     :LayerModel(absPath, path, "", LayerTypeRaster)
@@ -117,6 +225,10 @@ RasterLayerModel* RasterLayerModel::New(const QString& absPath, const QString& p
     fd.setAttribute("version", "1.0");
     fd.setAttribute("exposure", frame->GetExposure());
     fd.setAttribute("imagePath", imgPath);
+    fd.setAttribute("boundsX", 0);
+    fd.setAttribute("boundsY", 0);
+    fd.setAttribute("boundsWidth", 0);
+    fd.setAttribute("boundsHeight", 0);
     root.appendChild(fd);
     root.setAttribute("nextImageId", layer->mNextImageId);
 
@@ -162,6 +274,7 @@ RasterLayerModel* RasterLayerModel::Open(const QString& absPath, const QString&
         return NULL;
     }
     layer->mNextImageId = docElem.attribute("nextImageId").toInt();
+    layer->SetBlendMode((BlendMode)docElem.attribute("blend", "0").toInt());
 
     const QDomNodeList& nodes = docElem.elementsByTagName("frame");
     for (int i = 0; i < nodes.size(); ++i)
@@ -174,6 +287,17 @@ RasterLayerModel* RasterLayerModel::Open(const QString& absPath, const QString&
         QString imagePath = n.attribute("imagePath");
         int exposure = n.attribute("exposure").toInt();
         RasterFrameModel* frame = new RasterFrameModel(layer, absPath + "/" + imagePath, imagePath, exposure);
+        if (n.hasAttribute("boundsWidth"))
+        {
+            frame->SetBounds(QRect(n.attribute("boundsX").toInt(),
+                                   n.attribute("boundsY").toInt(),
+                                   n.attribute("boundsWidth").toInt(),
+                                   n.attribute("boundsHeight").toInt()));
+        }
+        else
+        {
+            frame->RecomputeBounds();
+        }
         layer->mFrames.push_back(frame);
     }
 
@@ -198,6 +322,7 @@ void RasterLayerModel::Save()
     QDomElement root = doc.createElement("layer");
     root.setAttribute("version", "1.0");
     root.setAttribute("type", (int)LayerTypeRaster);
+    root.setAttribute("blend", (int)mBlendMode);
     root.setAttribute("width", mWidth);
     root.setAttribute("height", mHeight);
     root.setAttribute("nextImageId", mNextImageId);
@@ -212,12 +337,32 @@ void RasterLayerModel::Save()
         elem.setAttribute("version", "1.0");
         elem.setAttribute("exposure", frame->GetExposure());
         elem.setAttribute("imagePath", frame->GetImagePath());
+        const QRect& bounds = frame->GetBounds();
+        elem.setAttribute("boundsX", bounds.x());
+        elem.setAttribute("boundsY", bounds.y());
+        elem.setAttribute("boundsWidth", bounds.width());
+        elem.setAttribute("boundsHeight", bounds.height());
         root.appendChild(elem);
     }
 
     QTextStream stream(&file);
     doc.save(stream, 4);
     file.close();
+
+    // images of removed frames are only deleted here, undo keeps the frames in memory until then
+    QStringList images = dir.entryList(QStringList() << "*.png", QDir::Files);
+    for (int i = 0; i < images.size(); ++i)
+    {
+        bool used = false;
+        for (size_t j = 0; j < mFrames.size() && !used; ++j)
+        {
+            used = mFrames[j]->GetImagePath() == images[i];
+        }
+        if (!used)
+        {
+            dir.remove(images[i]);
+        }
+    }
 }
 
 void RasterLayerModel::AddFrame(int frameIndex)
@@ -282,18 +427,18 @@ void RasterLayerModel::AddFrame(int frameIndex)
     }
 }
 
-void RasterLayerModel::RemoveFrame(int index)
+RasterFrameModel* RasterLayerModel::RemoveFrame(int index)
 {
     if (mFrames.size() == 0)
     {
-        return;
+        return NULL;
     }
     int imgIndex = GetImageIndexFromFrameIndex(index);
     std::vector<RasterFrameModel*>::iterator where = mFrames.begin();
     where += imgIndex;
     RasterFrameModel* frame = *where;
     mFrames.erase(where);
-    delete frame;
+    return frame;
 }
 
 void RasterLayerModel::ModExposure(int index, int delta)
@@ -386,6 +531,42 @@ int RasterLayerModel::GetNextImageIndex(int index)
     return idx;
 }
 
+void RasterLayerModel::GetOnionFrames(int frameIndex, int before, int after,
+                                      std::vector<RasterFrameModel*>& prevFrames, std::vector<RasterFrameModel*>& nextFrames)
+{
+    prevFrames.clear();
+    nextFrames.clear();
+
+    int n = (int)mFrames.size();
+    if (n < 2)
+    {
+        return;
+    }
+
+    // show no drawing twice and never the current one
+    while (before + after > n - 1)
+    {
+        if (before > after)
+        {
+            --before;
+        }
+        else
+        {
+            --after;
+        }
+    }
+
+    int current = GetImageIndexFromFrameIndex(frameIndex);
+    for (int i = 1; i <= before; ++i)
+    {
+        prevFrames.push_back(mFrames[(current - i + n) % n]);
+    }
+    for (int i = 1; i <= after; ++i)
+    {
+        nextFrames.push_back(mFrames[(current + i) % n]);
+    }
+}
+
 QImage* RasterLayerModel::GetImage(int frameIndex)
 {
     if (mFrames.size() == 0)
@@ -396,6 +577,16 @@ QImage* RasterLayerModel::GetImage(int frameIndex)
     return mFrames[idx]->GetImage();
 }
 
+QRect RasterLayerModel::GetBounds(int frameIndex)
+{
+    if (mFrames.size() == 0)
+    {
+        return QRect();
+    }
+    int idx = GetImageIndexFromFrameIndex(frameIndex);
+    return mFrames[idx]->GetBounds();
+}
+
 
 bool RasterLayerModel::IsOnionEnabled()
 {
@@ -604,6 +795,11 @@ QImage* TraceLayerModel::GetImage(int frameIndex)
     return NULL;
 }
 
+QRect TraceLayerModel::GetBounds(int frameIndex)
+{
+    return QRect();
+}
+
 
 bool TraceLayerModel::IsOnionEnabled()
 {
@@ -635,75 +831,155 @@ void TraceLayerModel::Enable(bool enable)
     mEnabled = enable;
 }
 
-//**************************************SceneModel**************************************
-SceneModel::SceneModel(const QString& absPath, const QString& path, int width, int height, int fps)
-    :mAbsPath(absPath)
-    ,mPath(path)
-    ,mWidth(width)
-    ,mHeight(height)
-    ,mFps(fps)
+//**************************************BlurLayerModel**************************************
+BlurLayerModel::BlurLayerModel(const QString& absPath, const QString& path)
+    :LayerModel(absPath, path, "", LayerTypeBlur)
+    ,mOpacity(0xFF)
+    ,mEnabled(true)
+    ,mRadius(8)
+    ,mCache(new LayerCache())
+{
+}
+
+BlurLayerModel::~BlurLayerModel()
 {
+}
 
+BlurLayerModel* BlurLayerModel::New(const QString& absPath, const QString& path, int radius)
+{
+    BlurLayerModel* layer = new BlurLayerModel(absPath, path);
+    layer->mRadius = radius;
+    layer->Save();
+    return layer;
 }
 
-SceneModel::~SceneModel()
+BlurLayerModel* BlurLayerModel::Open(const QString& absPath, const QString& path)
 {
-    for (size_t i = 0; i < mLayers.size(); ++i)
+    QDir dir(absPath);
+    if (!dir.exists())
     {
-        delete mLayers[i];
+        return NULL;
     }
 
-    for (size_t i = 0; i < mCompositeImages.size(); ++i)
+    QFile file(absPath + "/layer.xml");
+    if (!file.open(QIODevice::ReadOnly))
     {
-        delete mCompositeImages[i];
+        return NULL;
+    }
+
+    QDomDocument doc("");
+    if (!doc.setContent(&file)) {
+        file.close();
+        return NULL;
+    }
+    file.close();
+
+    QDomElement docElem = doc.documentElement();
+    if (docElem.isNull())
+    {
+        return NULL;
     }
+
+    BlurLayerModel* layer = new BlurLayerModel(absPath, path);
+    layer->SetBlendMode((BlendMode)docElem.attribute("blend", "0").toInt());
+    layer->mRadius = docElem.attribute("radius", "8").toInt();
+    layer->mSource = docElem.attribute("source");
+    return layer;
 }
 
-SceneModel* SceneModel::New(const QString& absPath, const QString& path, int width, int height, int fps)
+void BlurLayerModel::Save()
 {
-    QDir dir(absPath);
+    QDir dir(mAbsPath);
     if (!dir.exists())
     {
         dir.mkpath(".");
     }
 
-    QFile file(absPath + "/scene.xml");
+    QFile file(mAbsPath + "/layer.xml");
     if (!file.open(QIODevice::WriteOnly))
     {
-        return NULL;
+        return;
     }
 
     QDomDocument doc("");
-    QDomElement root = doc.createElement("scene");
+    QDomElement root = doc.createElement("layer");
     root.setAttribute("version", "1.0");
-    root.setAttribute("width", width);
-    root.setAttribute("height", height);
-    root.setAttribute("fps", fps);
+    root.setAttribute("type", (int)LayerTypeBlur);
+    root.setAttribute("blend", (int)mBlendMode);
+    root.setAttribute("radius", mRadius);
+    root.setAttribute("source", mSource);
     doc.appendChild(root);
 
-    RasterLayerModel* layer = RasterLayerModel::New(absPath + "/default", "default", width, height);
-    if (!layer)
-    {
-        return NULL;
-    }
-
-    QDomElement elem = doc.createElement("layer");
-    elem.setAttribute("version", "1.0");
-    elem.setAttribute("type", layer->GetType());
-    elem.setAttribute("path", layer->GetPath());
-    root.appendChild(elem);
-
-    SceneModel* scene = new SceneModel(absPath, path, width, height, fps);
-    scene->mLayers.push_back(layer);
-
     QTextStream stream(&file);
     doc.save(stream, 4);
     file.close();
+}
 
-    return scene;
+QImage* BlurLayerModel::GetImage(int frameIndex)
+{
+    return NULL;
 }
 
-SceneModel* SceneModel::Open(const QString& absPath, const QString& path)
+QRect BlurLayerModel::GetBounds(int frameIndex)
+{
+    return QRect();
+}
+
+unsigned char BlurLayerModel::GetOpacity()
+{
+    return mOpacity;
+}
+
+void BlurLayerModel::SetOpacity(unsigned char value)
+{
+    mOpacity = value;
+}
+
+bool BlurLayerModel::IsEnabled()
+{
+    return mEnabled;
+}
+
+void BlurLayerModel::Enable(bool enable)
+{
+    mEnabled = enable;
+}
+
+void BlurLayerModel::SetRadius(int value)
+{
+    mRadius = value < 0 ? 0 : value;
+}
+
+void BlurLayerModel::SetSource(const QString& value)
+{
+    mSource = value;
+}
+
+//**************************************TransformLayerModel**************************************
+TransformLayerModel::TransformLayerModel(const QString& absPath, const QString& path)
+    :LayerModel(absPath, path, "", LayerTypeTransform)
+    ,mOpacity(0xFF)
+    ,mEnabled(true)
+    ,mPivotX(0.0f)
+    ,mPivotY(0.0f)
+    ,mCache(new LayerCache())
+{
+}
+
+TransformLayerModel::~TransformLayerModel()
+{
+}
+
+TransformLayerModel* TransformLayerModel::New(const QString& absPath, const QString& path, float pivotX, float pivotY)
+{
+    TransformLayerModel* layer = new TransformLayerModel(absPath, path);
+    layer->mPivotX = pivotX;
+    layer->mPivotY = pivotY;
+    layer->Save();
+    return layer;
+}
+
+TransformLayerModel* TransformLayerModel::Open(const QString& absPath, const QString& path)
 {
     QDir dir(absPath);
     if (!dir.exists())
@@ -711,69 +987,53 @@ SceneModel* SceneModel::Open(const QString& absPath, const QString& path)
         return NULL;
     }
 
-    QFile projectInfo(absPath + "/scene.xml");
-    if (!projectInfo.open(QIODevice::ReadOnly))
+    QFile file(absPath + "/layer.xml");
+    if (!file.open(QIODevice::ReadOnly))
     {
         return NULL;
     }
 
     QDomDocument doc("");
-    if (!doc.setContent(&projectInfo)) {
-        projectInfo.close();
+    if (!doc.setContent(&file)) {
+        file.close();
         return NULL;
     }
-    projectInfo.close();
+    file.close();
 
     QDomElement docElem = doc.documentElement();
     if (docElem.isNull())
     {
         return NULL;
     }
-    int width = docElem.attribute("width", "1").toInt();
-    int height = docElem.attribute("height", "1").toInt();
-    int fps = docElem.attribute("fps", "24").toInt();
 
-    SceneModel* result = new SceneModel(absPath, path, width, height, fps);
+    TransformLayerModel* layer = new TransformLayerModel(absPath, path);
+    layer->SetBlendMode((BlendMode)docElem.attribute("blend", "0").toInt());
+    layer->mPivotX = docElem.attribute("pivotX", "0").toFloat();
+    layer->mPivotY = docElem.attribute("pivotY", "0").toFloat();
+    layer->mSource = docElem.attribute("source");
 
-    const QDomNodeList& sceneNodes = docElem.elementsByTagName("layer");
-    for (int i = 0; i < sceneNodes.size(); ++i)
+    const QDomNodeList& nodes = docElem.elementsByTagName("key");
+    for (int i = 0; i < nodes.size(); ++i)
     {
-        const QDomElement& n = sceneNodes.at(i).toElement();
+        const QDomElement& n = nodes.at(i).toElement();
         if (n.isNull())
         {
             continue;
         }
-        QString scenePath = n.attribute("path");
-        LayerModel::LayerType type = (LayerModel::LayerType)n.attribute("type").toInt();
-        switch (type)
-        {
-        case LayerModel::LayerTypeRaster:
-            {
-                RasterLayerModel* layer = RasterLayerModel::Open(absPath + "/" + scenePath, scenePath);
-                if (layer)
-                {
-                    result->mLayers.push_back(layer);
-                }
-            }
-            break;
-        case LayerModel::LayerTypeTrace:
-            {
-                TraceLayerModel* layer = TraceLayerModel::Open(absPath + "/" + scenePath, scenePath);
-                if (layer)
-                {
-                    result->mLayers.push_back(layer);
-                }
-            }
-            break;
-        default:
-            break;
-        }
+
+        Key key;
+        key.frameIndex = n.attribute("frame").toInt();
+        key.x = n.attribute("x", "0").toFloat();
+        key.y = n.attribute("y", "0").toFloat();
+        key.rotation = n.attribute("rotation", "0").toFloat();
+        key.scale = n.attribute("scale", "1").toFloat();
+        layer->SetKey(key);
     }
 
-    return result;
+    return layer;
 }
 
-void SceneModel::Save()
+void TransformLayerModel::Save()
 {
     QDir dir(mAbsPath);
     if (!dir.exists())
@@ -781,11 +1041,512 @@ void SceneModel::Save()
         dir.mkpath(".");
     }
 
-    QFile file(mAbsPath + "/scene.xml");
-    file.open(QIODevice::WriteOnly);
-
-    QDomDocument doc("");
-    QDomElement root = doc.createElement("scene");
+    QFile file(mAbsPath + "/layer.xml");
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return;
+    }
+
+    QDomDocument doc("");
+    QDomElement root = doc.createElement("layer");
+    root.setAttribute("version", "1.0");
+    root.setAttribute("type", (int)LayerTypeTransform);
+    root.setAttribute("blend", (int)mBlendMode);
+    root.setAttribute("pivotX", mPivotX);
+    root.setAttribute("pivotY", mPivotY);
+    root.setAttribute("source", mSource);
+    doc.appendChild(root);
+
+    for (size_t i = 0; i < mKeys.size(); ++i)
+    {
+        const Key& key = mKeys[i];
+        QDomElement elem = doc.createElement("key");
+        elem.setAttribute("frame", key.frameIndex);
+        elem.setAttribute("x", key.x);
+        elem.setAttribute("y", key.y);
+        elem.setAttribute("rotation", key.rotation);
+        elem.setAttribute("scale", key.scale);
+        root.appendChild(elem);
+    }
+
+    QTextStream stream(&file);
+    doc.save(stream, 4);
+    file.close();
+}
+
+int TransformLayerModel::GetMaxFrames()
+{
+    return mKeys.empty() ? 0 : mKeys.back().frameIndex + 1;
+}
+
+QImage* TransformLayerModel::GetImage(int frameIndex)
+{
+    return NULL;
+}
+
+QRect TransformLayerModel::GetBounds(int frameIndex)
+{
+    return QRect();
+}
+
+unsigned char TransformLayerModel::GetOpacity()
+{
+    return mOpacity;
+}
+
+void TransformLayerModel::SetOpacity(unsigned char value)
+{
+    mOpacity = value;
+}
+
+bool TransformLayerModel::IsEnabled()
+{
+    return mEnabled;
+}
+
+void TransformLayerModel::Enable(bool enable)
+{
+    mEnabled = enable;
+}
+
+void TransformLayerModel::SetKey(const Key& key)
+{
+    std::vector<Key>::iterator it = mKeys.begin();
+    while (it != mKeys.end() && it->frameIndex < key.frameIndex)
+    {
+        ++it;
+    }
+
+    if (it != mKeys.end() && it->frameIndex == key.frameIndex)
+    {
+        *it = key;
+    }
+    else
+    {
+        mKeys.insert(it, key);
+    }
+}
+
+void TransformLayerModel::RemoveKey(int frameIndex)
+{
+    for (std::vector<Key>::iterator it = mKeys.begin(); it != mKeys.end(); ++it)
+    {
+        if (it->frameIndex == frameIndex)
+        {
+            mKeys.erase(it);
+            return;
+        }
+    }
+}
+
+bool TransformLayerModel::HasKey(int frameIndex) const
+{
+    for (size_t i = 0; i < mKeys.size(); ++i)
+    {
+        if (mKeys[i].frameIndex == frameIndex)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+TransformLayerModel::Key TransformLayerModel::GetKeyAt(int frameIndex) const
+{
+    Key result;
+    result.frameIndex = frameIndex;
+    result.x = 0.0f;
+    result.y = 0.0f;
+    result.rotation = 0.0f;
+    result.scale = 1.0f;
+    if (mKeys.empty())
+    {
+        return result;
+    }
+
+    size_t next = 0;
+    while (next < mKeys.size() && mKeys[next].frameIndex <= frameIndex)
+    {
+        ++next;
+    }
+
+    if (next == 0 || next == mKeys.size())
+    {
+        result = mKeys[next == 0 ? 0 : next - 1];
+        result.frameIndex = frameIndex;
+        return result;
+    }
+
+    const Key& k0 = mKeys[next - 1];
+    const Key& k1 = mKeys[next];
+    float t = (float)(frameIndex - k0.frameIndex) / (k1.frameIndex - k0.frameIndex);
+    result.x = k0.x + (k1.x - k0.x) * t;
+    result.y = k0.y + (k1.y - k0.y) * t;
+    result.rotation = k0.rotation + (k1.rotation - k0.rotation) * t;
+    result.scale = k0.scale + (k1.scale - k0.scale) * t;
+    return result;
+}
+
+Matrix4 TransformLayerModel::GetTransform(int frameIndex) const
+{
+    Key key = GetKeyAt(frameIndex);
+    return Matrix4::BuildTranslate(mPivotX + key.x, mPivotY + key.y, 0.0f) *
+           Matrix4::BuildRotate(key.rotation * 3.1415926f / 180.0f, 0.0f, 0.0f, 1.0f) *
+           Matrix4::BuildScale(key.scale, key.scale, 1.0f) *
+           Matrix4::BuildTranslate(-mPivotX, -mPivotY, 0.0f);
+}
+
+void TransformLayerModel::SetPivot(float x, float y)
+{
+    mPivotX = x;
+    mPivotY = y;
+}
+
+void TransformLayerModel::SetSource(const QString& value)
+{
+    mSource = value;
+}
+
+//**************************************SceneLayerModel**************************************
+SceneLayerModel::SceneLayerModel(const QString& absPath, const QString& path)
+    :LayerModel(absPath, path, "", LayerTypeScene)
+    ,mOpacity(0xFF)
+    ,mEnabled(true)
+    ,mScene(NULL)
+    ,mOffset(0)
+    ,mLoop(LoopRepeat)
+{
+}
+
+SceneLayerModel::~SceneLayerModel()
+{
+}
+
+SceneLayerModel* SceneLayerModel::New(const QString& absPath, const QString& path, const QString& scenePath)
+{
+    SceneLayerModel* layer = new SceneLayerModel(absPath, path);
+    layer->mScenePath = scenePath;
+    layer->Save();
+    return layer;
+}
+
+SceneLayerModel* SceneLayerModel::Open(const QString& absPath, const QString& path)
+{
+    QDir dir(absPath);
+    if (!dir.exists())
+    {
+        return NULL;
+    }
+
+    QFile file(absPath + "/layer.xml");
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return NULL;
+    }
+
+    QDomDocument doc("");
+    if (!doc.setContent(&file)) {
+        file.close();
+        return NULL;
+    }
+    file.close();
+
+    QDomElement docElem = doc.documentElement();
+    if (docElem.isNull())
+    {
+        return NULL;
+    }
+
+    SceneLayerModel* layer = new SceneLayerModel(absPath, path);
+    layer->SetBlendMode((BlendMode)docElem.attribute("blend", "0").toInt());
+    layer->mScenePath = docElem.attribute("scene");
+    layer->mOffset = docElem.attribute("offset", "0").toInt();
+    int loop = docElem.attribute("loop", "1").toInt();
+    layer->mLoop = loop >= LoopOnce && loop <= LoopHold ? (Loop)loop : LoopRepeat;
+    return layer;
+}
+
+void SceneLayerModel::Save()
+{
+    QDir dir(mAbsPath);
+    if (!dir.exists())
+    {
+        dir.mkpath(".");
+    }
+
+    QFile file(mAbsPath + "/layer.xml");
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return;
+    }
+
+    QDomDocument doc("");
+    QDomElement root = doc.createElement("layer");
+    root.setAttribute("version", "1.0");
+    root.setAttribute("type", (int)LayerTypeScene);
+    root.setAttribute("blend", (int)mBlendMode);
+    root.setAttribute("scene", mScenePath);
+    root.setAttribute("offset", mOffset);
+    root.setAttribute("loop", (int)mLoop);
+    doc.appendChild(root);
+
+    QTextStream stream(&file);
+    doc.save(stream, 4);
+    file.close();
+}
+
+int SceneLayerModel::GetMaxFrames()
+{
+    int length = mScene ? mScene->GetMaxFrames() : 0;
+    return length > 0 ? qMax(0, mOffset + length) : 0;
+}
+
+QImage* SceneLayerModel::GetImage(int frameIndex)
+{
+    return NULL;
+}
+
+QRect SceneLayerModel::GetBounds(int frameIndex)
+{
+    return QRect();
+}
+
+unsigned char SceneLayerModel::GetOpacity()
+{
+    return mOpacity;
+}
+
+void SceneLayerModel::SetOpacity(unsigned char value)
+{
+    mOpacity = value;
+}
+
+bool SceneLayerModel::IsEnabled()
+{
+    return mEnabled;
+}
+
+void SceneLayerModel::Enable(bool enable)
+{
+    mEnabled = enable;
+}
+
+int SceneLayerModel::GetSceneFrame(int frameIndex)
+{
+    int length = mScene ? mScene->GetMaxFrames() : 0;
+    int t = frameIndex - mOffset;
+    if (length <= 0 || t < 0)
+    {
+        return -1;
+    }
+
+    switch (mLoop)
+    {
+    case LoopRepeat:
+        return t % length;
+    case LoopPingPong:
+        {
+            if (length == 1)
+            {
+                return 0;
+            }
+            // the ends are not repeated on the way back
+            int period = length * 2 - 2;
+            t %= period;
+            return t < length ? t : period - t;
+        }
+    case LoopHold:
+        return t < length ? t : length - 1;
+    default:
+        return t < length ? t : -1;
+    }
+}
+
+//**************************************SceneModel**************************************
+// Frames are cropped to their content, a few seconds of a character cycle fit
+#define SCENE_FRAME_CACHE_SIZE 64
+
+SceneModel::SceneModel(const QString& absPath, const QString& path, int width, int height, int fps)
+    :mAbsPath(absPath)
+    ,mPath(path)
+    ,mWidth(width)
+    ,mHeight(height)
+    ,mFps(fps)
+    ,mRevision(0)
+    ,mVisiting(false)
+    ,mFrameCache(new LayerCache(SCENE_FRAME_CACHE_SIZE))
+    ,mFrameCacheRevision(-1)
+{
+
+}
+
+SceneModel::~SceneModel()
+{
+    for (size_t i = 0; i < mLayers.size(); ++i)
+    {
+        delete mLayers[i];
+    }
+
+    for (size_t i = 0; i < mCompositeImages.size(); ++i)
+    {
+        delete mCompositeImages[i];
+    }
+}
+
+SceneModel* SceneModel::New(const QString& absPath, const QString& path, int width, int height, int fps)
+{
+    QDir dir(absPath);
+    if (!dir.exists())
+    {
+        dir.mkpath(".");
+    }
+
+    QFile file(absPath + "/scene.xml");
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return NULL;
+    }
+
+    QDomDocument doc("");
+    QDomElement root = doc.createElement("scene");
+    root.setAttribute("version", "1.0");
+    root.setAttribute("width", width);
+    root.setAttribute("height", height);
+    root.setAttribute("fps", fps);
+    doc.appendChild(root);
+
+    RasterLayerModel* layer = RasterLayerModel::New(absPath + "/default", "default", width, height);
+    if (!layer)
+    {
+        return NULL;
+    }
+
+    QDomElement elem = doc.createElement("layer");
+    elem.setAttribute("version", "1.0");
+    elem.setAttribute("type", layer->GetType());
+    elem.setAttribute("path", layer->GetPath());
+    root.appendChild(elem);
+
+    SceneModel* scene = new SceneModel(absPath, path, width, height, fps);
+    scene->mLayers.push_back(layer);
+
+    QTextStream stream(&file);
+    doc.save(stream, 4);
+    file.close();
+
+    return scene;
+}
+
+SceneModel* SceneModel::Open(const QString& absPath, const QString& path)
+{
+    QDir dir(absPath);
+    if (!dir.exists())
+    {
+        return NULL;
+    }
+
+    QFile projectInfo(absPath + "/scene.xml");
+    if (!projectInfo.open(QIODevice::ReadOnly))
+    {
+        return NULL;
+    }
+
+    QDomDocument doc("");
+    if (!doc.setContent(&projectInfo)) {
+        projectInfo.close();
+        return NULL;
+    }
+    projectInfo.close();
+
+    QDomElement docElem = doc.documentElement();
+    if (docElem.isNull())
+    {
+        return NULL;
+    }
+    int width = docElem.attribute("width", "1").toInt();
+    int height = docElem.attribute("height", "1").toInt();
+    int fps = docElem.attribute("fps", "24").toInt();
+
+    SceneModel* result = new SceneModel(absPath, path, width, height, fps);
+
+    const QDomNodeList& sceneNodes = docElem.elementsByTagName("layer");
+    for (int i = 0; i < sceneNodes.size(); ++i)
+    {
+        const QDomElement& n = sceneNodes.at(i).toElement();
+        if (n.isNull())
+        {
+            continue;
+        }
+        QString scenePath = n.attribute("path");
+        LayerModel::LayerType type = (LayerModel::LayerType)n.attribute("type").toInt();
+        switch (type)
+        {
+        case LayerModel::LayerTypeRaster:
+            {
+                RasterLayerModel* layer = RasterLayerModel::Open(absPath + "/" + scenePath, scenePath);
+                if (layer)
+                {
+                    result->mLayers.push_back(layer);
+                }
+            }
+            break;
+        case LayerModel::LayerTypeTrace:
+            {
+                TraceLayerModel* layer = TraceLayerModel::Open(absPath + "/" + scenePath, scenePath);
+                if (layer)
+                {
+                    result->mLayers.push_back(layer);
+                }
+            }
+            break;
+        case LayerModel::LayerTypeBlur:
+            {
+                BlurLayerModel* layer = BlurLayerModel::Open(absPath + "/" + scenePath, scenePath);
+                if (layer)
+                {
+                    result->mLayers.push_back(layer);
+                }
+            }
+            break;
+        case LayerModel::LayerTypeTransform:
+            {
+                TransformLayerModel* layer = TransformLayerModel::Open(absPath + "/" + scenePath, scenePath);
+                if (layer)
+                {
+                    result->mLayers.push_back(layer);
+                }
+            }
+            break;
+        case LayerModel::LayerTypeScene:
+            {
+                SceneLayerModel* layer = SceneLayerModel::Open(absPath + "/" + scenePath, scenePath);
+                if (layer)
+                {
+                    result->mLayers.push_back(layer);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return result;
+}
+
+void SceneModel::Save()
+{
+    QDir dir(mAbsPath);
+    if (!dir.exists())
+    {
+        dir.mkpath(".");
+    }
+
+    QFile file(mAbsPath + "/scene.xml");
+    file.open(QIODevice::WriteOnly);
+
+    QDomDocument doc("");
+    QDomElement root = doc.createElement("scene");
     root.setAttribute("version", "1.0");
     root.setAttribute("width", mWidth);
     root.setAttribute("height", mHeight);
@@ -845,6 +1606,61 @@ TraceLayerModel* SceneModel::AddTraceLayer(int index, const QString& name)
     return l;
 }
 
+BlurLayerModel* SceneModel::AddBlurLayer(int index, const QString& name, int radius)
+{
+    if (mLayers.size() == 0 || index < 0 || index > (int)mLayers.size())
+    {
+        return NULL;
+    }
+
+    QString absPath = mAbsPath + "/" + name;
+    BlurLayerModel* l = BlurLayerModel::New(absPath, name, radius);
+    if (l)
+    {
+        std::vector<LayerModel*>::iterator where = mLayers.begin();
+        where += index;
+        mLayers.insert(where, l);
+    }
+    return l;
+}
+
+TransformLayerModel* SceneModel::AddTransformLayer(int index, const QString& name)
+{
+    if (mLayers.size() == 0 || index < 0 || index > (int)mLayers.size())
+    {
+        return NULL;
+    }
+
+    QString absPath = mAbsPath + "/" + name;
+    TransformLayerModel* l = TransformLayerModel::New(absPath, name, mWidth * 0.5f, mHeight * 0.5f);
+    if (l)
+    {
+        std::vector<LayerModel*>::iterator where = mLayers.begin();
+        where += index;
+        mLayers.insert(where, l);
+    }
+    return l;
+}
+
+SceneLayerModel* SceneModel::AddSceneLayer(int index, const QString& name, SceneModel* scene)
+{
+    if (mLayers.size() == 0 || index < 0 || index > (int)mLayers.size() || !scene)
+    {
+        return NULL;
+    }
+
+    QString absPath = mAbsPath + "/" + name;
+    SceneLayerModel* l = SceneLayerModel::New(absPath, name, scene->GetPath());
+    if (l)
+    {
+        l->SetScene(scene);
+        std::vector<LayerModel*>::iterator where = mLayers.begin();
+        where += index;
+        mLayers.insert(where, l);
+    }
+    return l;
+}
+
 void SceneModel::RemoveLayer(int index)
 {
     if (mLayers.size() == 0 || index < 0 || index >= (int)mLayers.size())
@@ -882,29 +1698,12 @@ void SceneModel::Export(const QString& filePath)
     }
 
     QImage out(mWidth, mHeight, QImage::Format_RGBA8888);
-    QPainter pt(&out);
+    out.fill(0);
+    QRect dirty;
 
     for (int f = 0; f < maxFrames; ++f)
     {
-        pt.setCompositionMode(QPainter::CompositionMode_Source);
-        pt.fillRect(0, 0, mWidth, mHeight, QBrush(QColor(0, 0, 0, 0)));
-
-        for (size_t i = 0; i < mLayers.size(); ++i)
-        {
-            LayerModel* layer = mLayers[i];
-            if (!layer->IsEnabled() || layer->GetOpacity() == 0)
-            {
-                continue;
-            }
-            QImage* img = layer->GetImage(f);
-            if (!img)
-            {
-                continue;
-            }
-            pt.setCompositionMode(QPainter::CompositionMode_SourceOver);
-            pt.setOpacity(layer->GetOpacity() / 255.0f);
-            pt.drawImage(0, 0, *img);
-        }
+        dirty = GetCompositeImage(f, &out, dirty);
         QString idxStr;
         idxStr.sprintf("%06d", f);
         out.save(path + idxStr + ext);
@@ -914,6 +1713,12 @@ void SceneModel::Export(const QString& filePath)
 int SceneModel::GetMaxFrames()
 {
     int maxFrames = 0;
+    if (mVisiting)
+    {
+        return maxFrames;
+    }
+
+    mVisiting = true;
     for (size_t i = 0; i < mLayers.size(); ++i)
     {
         LayerModel* layer = mLayers[i];
@@ -927,6 +1732,7 @@ int SceneModel::GetMaxFrames()
             maxFrames = fs;
         }
     }
+    mVisiting = false;
 
     return maxFrames;
 }
@@ -969,19 +1775,28 @@ void SceneModel::MoveLayer(int oldIndex, int newIndex)
     mLayers[newIndex] = layer;
 }
 
-void SceneModel::GetCompositeImage(int frameIndex, QImage* result)
+QRect SceneModel::GetCompositeImage(int frameIndex, QImage* result, const QRect& dirtyRect)
 {
     if (frameIndex < 0 || frameIndex > GetMaxFrames() || !result)
     {
-        return;
+        return dirtyRect;
     }
 
-    QPainter p(result);
-    p.setCompositionMode(QPainter::CompositionMode_Source);
-    p.setBrush(QBrush(QColor(0,0,0,0)));
-    p.fillRect(0, 0, mWidth, mHeight, QColor(0,0,0,0));
-    p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-    for (size_t i = 0; i < mLayers.size(); ++i)
+    std::vector<CompositeLayer> layers;
+    GetCompositeLayers(frameIndex, layers);
+    return Composite(layers, result, dirtyRect);
+}
+
+void SceneModel::GetCompositeLayers(int frameIndex, std::vector<CompositeLayer>& layers, int count)
+{
+    layers.clear();
+    if (count < 0 || count > (int)mLayers.size())
+    {
+        count = (int)mLayers.size();
+    }
+
+    mVisiting = true;
+    for (int i = 0; i < count; ++i)
     {
         LayerModel* layer = mLayers[i];
         if (!layer->IsEnabled() || layer->GetOpacity() == 0)
@@ -989,21 +1804,154 @@ void SceneModel::GetCompositeImage(int frameIndex, QImage* result)
             continue;
         }
 
+        CompositeLayer cl;
+        cl.opacity = layer->GetOpacity();
+        cl.blendMode = layer->GetBlendMode();
+        QString source;
+        if (layer->GetType() == LayerModel::LayerTypeBlur)
+        {
+            BlurLayerModel* blur = (BlurLayerModel*)layer;
+            if (blur->GetRadius() < 1)
+            {
+                continue;
+            }
+            cl.adjustment = CompositeLayer::AdjustmentBlur;
+            cl.blurRadius = blur->GetRadius();
+            cl.cache = blur->GetCache();
+            source = blur->GetSource();
+        }
+        else if (layer->GetType() == LayerModel::LayerTypeTransform)
+        {
+            TransformLayerModel* transform = (TransformLayerModel*)layer;
+            cl.adjustment = CompositeLayer::AdjustmentTransform;
+            cl.transform = transform->GetTransform(frameIndex);
+            cl.cache = transform->GetCache();
+            source = transform->GetSource();
+        }
+        else if (layer->GetType() == LayerModel::LayerTypeScene)
+        {
+            SceneLayerModel* sceneLayer = (SceneLayerModel*)layer;
+            SceneModel* scene = sceneLayer->GetScene();
+            int sceneFrame = sceneLayer->GetSceneFrame(frameIndex);
+            if (!scene || scene->mVisiting || sceneFrame < 0)
+            {
+                continue;
+            }
+
+            cl.cache = scene->GetFrameCache();
+            cl.frameKey = HashCombine(HashCombine(HASH_SEED, scene->mFrameCacheRevision), sceneFrame);
+            if (cl.cache->Find(cl.frameKey, cl.image, cl.bounds))
+            {
+                // one blit, or nothing for an empty frame
+                if (!cl.image.isNull())
+                {
+                    layers.push_back(cl);
+                }
+                continue;
+            }
+
+            cl.bounds = QRect(0, 0, scene->GetWidth(), scene->GetHeight());
+            cl.children = QSharedPointer<std::vector<CompositeLayer> >(new std::vector<CompositeLayer>());
+            scene->GetCompositeLayers(sceneFrame, *cl.children);
+            layers.push_back(cl);
+            continue;
+        }
+
+        if (cl.adjustment != CompositeLayer::AdjustmentNone)
+        {
+            if (!source.isEmpty())
+            {
+                // the source is used even when hidden, so only the adjusted copy shows
+                LayerModel* sourceLayer = FindLayer(source);
+                QImage* img = sourceLayer ? sourceLayer->GetImage(frameIndex) : NULL;
+                QRect bounds = sourceLayer ? sourceLayer->GetBounds(frameIndex) : QRect();
+                if (!img || bounds.isEmpty())
+                {
+                    continue;
+                }
+                cl.image = *img;
+                cl.bounds = bounds;
+            }
+            layers.push_back(cl);
+            continue;
+        }
+
         QImage* img = layer->GetImage(frameIndex);
-        if (img)
+        QRect bounds = layer->GetBounds(frameIndex);
+        if (img && !bounds.isEmpty())
+        {
+            cl.image = *img;
+            cl.bounds = bounds;
+            layers.push_back(cl);
+        }
+    }
+    mVisiting = false;
+}
+
+qint64 SceneModel::GetRevision()
+{
+    qint64 revision = mRevision;
+    if (mVisiting)
+    {
+        return revision;
+    }
+
+    mVisiting = true;
+    for (size_t i = 0; i < mLayers.size(); ++i)
+    {
+        if (mLayers[i]->GetType() == LayerModel::LayerTypeScene)
+        {
+            SceneModel* scene = ((SceneLayerModel*)mLayers[i])->GetScene();
+            if (scene)
+            {
+                // revisions only grow, so the sum changes with any of them
+                revision += scene->GetRevision();
+            }
+        }
+    }
+    mVisiting = false;
+    return revision;
+}
+
+const QSharedPointer<LayerCache>& SceneModel::GetFrameCache()
+{
+    qint64 revision = GetRevision();
+    if (revision != mFrameCacheRevision)
+    {
+        // frames a worker inserts later are keyed with the old revision and age out
+        mFrameCache->Clear();
+        mFrameCacheRevision = revision;
+    }
+    return mFrameCache;
+}
+
+LayerModel* SceneModel::FindLayer(const QString& path)
+{
+    for (size_t i = 0; i < mLayers.size(); ++i)
+    {
+        if (mLayers[i]->GetPath() == path)
         {
-            p.setOpacity(layer->GetOpacity() / 255.0f);
-            p.drawImage(0, 0, *img);
+            return mLayers[i];
         }
     }
+    return NULL;
+}
+
+QRect SceneModel::Composite(const std::vector<CompositeLayer>& layers, QImage* result, const QRect& dirtyRect, const QRect& region)
+{
+    CompositeGraph graph(layers);
+    return graph.Evaluate(result, dirtyRect, region.isNull() ? result->rect() : region);
 }
 
 //**************************************AnimationProject**************************************
+#define DEFAULT_UNDO_BUDGET (256 * 1024 * 1024)
+
 AnimationProject::AnimationProject(const QString& path, int width, int height, int fps)
     :mPath(path)
     ,mWidth(width)
     ,mHeight(height)
     ,mFps(fps)
+    ,mUndoBudget(DEFAULT_UNDO_BUDGET)
 {
 
 }
@@ -1033,6 +1981,7 @@ AnimationProject* AnimationProject::New(const QString& path, int width, int heig
     root.setAttribute("width", width);
     root.setAttribute("height", height);
     root.setAttribute("fps", fps);
+    root.setAttribute("undoBudget", DEFAULT_UNDO_BUDGET);
     doc.appendChild(root);
 
     QString absPath = dir.absolutePath() + "/" + "default";
@@ -1089,6 +2038,7 @@ AnimationProject* AnimationProject::Open(const QString& path)
 
     QString absPath = dir.absolutePath();
     AnimationProject* result = new AnimationProject(absPath, width, height, fps);
+    result->mUndoBudget = docElem.attribute("undoBudget", QString::number(DEFAULT_UNDO_BUDGET)).toLongLong();
 
     const QDomNodeList& sceneNodes = docElem.elementsByTagName("scene");
     for (int i = 0; i < sceneNodes.size(); ++i)
@@ -1105,10 +2055,54 @@ AnimationProject* AnimationProject::Open(const QString& path)
             result->mScenes.push_back(scene);
         }
     }
+    result->ResolveSceneLayers();
 
     return result;
 }
 
+SceneModel* AnimationProject::AddScene(const QString& name)
+{
+    if (FindScene(name))
+    {
+        return NULL;
+    }
+
+    SceneModel* scene = SceneModel::New(mPath + "/" + name, name, mWidth, mHeight, mFps);
+    if (scene)
+    {
+        mScenes.push_back(scene);
+    }
+    return scene;
+}
+
+SceneModel* AnimationProject::FindScene(const QString& path)
+{
+    for (size_t i = 0; i < mScenes.size(); ++i)
+    {
+        if (mScenes[i]->GetPath() == path)
+        {
+            return mScenes[i];
+        }
+    }
+    return NULL;
+}
+
+void AnimationProject::ResolveSceneLayers()
+{
+    for (size_t i = 0; i < mScenes.size(); ++i)
+    {
+        std::vector<LayerModel*>& layers = mScenes[i]->GetLayers();
+        for (size_t j = 0; j < layers.size(); ++j)
+        {
+            if (layers[j]->GetType() == LayerModel::LayerTypeScene)
+            {
+                SceneLayerModel* layer = (SceneLayerModel*)layers[j];
+                layer->SetScene(FindScene(layer->GetScenePath()));
+            }
+        }
+    }
+}
+
 void AnimationProject::Save()
 {
     QDir dir(mPath);
@@ -1126,6 +2120,7 @@ void AnimationProject::Save()
     root.setAttribute("width", mWidth);
     root.setAttribute("height", mHeight);
     root.setAttribute("fps", mFps);
+    root.setAttribute("undoBudget", mUndoBudget);
     doc.appendChild(root);
 
     for (size_t i = 0; i < mScenes.size(); ++i)
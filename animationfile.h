@@ -5,10 +5,16 @@
 #include <vector>
 #include <map>
 #include <QImage>
+#include <QSharedPointer>
+#include "openglrenderer.h"
+#include "pixelkernels.h"
 
 class SceneModel;
 class AnimationProject;
 class RasterLayerModel;
+class MipPyramid;
+class LayerCache;
+class ReplayChain;
 
 class LayerModel
 {
@@ -30,6 +36,7 @@ public:
 
     virtual void Save() = 0;
     virtual QImage* GetImage(int frameIndex) = 0;
+    virtual QRect GetBounds(int frameIndex) = 0;
     virtual bool IsEnabled() = 0;
     virtual unsigned char GetOpacity() = 0;
     virtual int GetMaxFrames() = 0;
@@ -39,12 +46,16 @@ public:
     LayerType GetType() const { return mType; }
     const QString& GetAbsolutePath() const { return mAbsPath; }
     const QString& GetPath() const { return mPath; }
+    BlendMode GetBlendMode() const { return mBlendMode; }
+    // Any of the modes up to BlendErase, others fall back to BlendNormal
+    void SetBlendMode(BlendMode value);
 
 protected:
     QString mAbsPath;
     QString mPath;
     QString mName;
     LayerType mType;
+    BlendMode mBlendMode;
 };
 
 
@@ -60,12 +71,37 @@ public:
     QImage* GetImage();
     void Save();
 
+    // Tight bounding box of the non-transparent pixels
+    const QRect& GetBounds() const { return mBounds; }
+    void SetBounds(const QRect& value) { mBounds = value; }
+    void UpdateBounds(const QRect& dirtyRect);
+    void RecomputeBounds();
+
+    // Bumped on every edit, caches derived from the image compare against it
+    int GetVersion() const { return mVersion; }
+    // Bounds area in color, with weight / 255 of the alpha, premultiplied. Rebuilt after edits
+    // and when the tint or weight change.
+    const QImage& GetOnionImage(const QColor& color, int weight);
+    // Reduced copy of the image for drawing zoomed out, level may be lowered
+    const QImage* GetMipLevel(int& level);
+    // Replay chain the next edit of the frame continues, it goes away with the frame
+    QSharedPointer<ReplayChain> GetReplayChain() const { return mReplayChain.toStrongRef(); }
+    void SetReplayChain(const QSharedPointer<ReplayChain>& chain) { mReplayChain = chain; }
+
 private:
     RasterLayerModel* mLayer;
     QString mAbsImagePath;
     QString mImagePath;
     int mExposure;
     QImage* mImage;
+    QRect mBounds;
+    int mVersion;
+    QImage mOnionImage;
+    int mOnionVersion;
+    QRgb mOnionColor;
+    int mOnionWeight;
+    MipPyramid* mMips;
+    QWeakPointer<ReplayChain> mReplayChain;
 };
 
 class RasterLayerModel:
@@ -86,12 +122,17 @@ public:
     int GetMaxFrames();
 
     void AddFrame(int insertIndex);
-    void RemoveFrame(int index);
+    // Takes the frame out of the layer without deleting it, the caller owns it
+    RasterFrameModel* RemoveFrame(int index);
     void ModExposure(int index, int delta);
     RasterFrameModel* GetFrameAt(int index);
     int GetPrevImageIndex(int index);
     int GetNextImageIndex(int index);
+    // Up to before/after drawings around frameIndex, nearest first, wrapping around the layer
+    void GetOnionFrames(int frameIndex, int before, int after,
+                        std::vector<RasterFrameModel*>& prevFrames, std::vector<RasterFrameModel*>& nextFrames);
     QImage* GetImage(int frameIndex);
+    QRect GetBounds(int frameIndex);
     bool IsOnionEnabled();
     void EnableOnion(bool enable);
     unsigned char GetOpacity();
@@ -126,6 +167,7 @@ public:
     QPoint* GetFrameAt(int index);
     
     QImage* GetImage(int frameIndex);
+    QRect GetBounds(int frameIndex);
     bool IsOnionEnabled();
     void EnableOnion(bool enable);
     unsigned char GetOpacity();
@@ -142,6 +184,182 @@ private:
     std::map<int, QPoint> mFrames;
 };
 
+// Adjustment layer blurring everything beneath it, or only the layer at the source path
+class BlurLayerModel:
+    public LayerModel
+{
+public:
+    BlurLayerModel(const QString& absPath, const QString& path);
+    ~BlurLayerModel();
+
+    static BlurLayerModel* New(const QString& absPath, const QString& path, int radius);
+    static BlurLayerModel* Open(const QString& absPath, const QString& path);
+
+    void Save();
+    int GetMaxFrames() { return 0; }
+    QImage* GetImage(int frameIndex);
+    QRect GetBounds(int frameIndex);
+    unsigned char GetOpacity();
+    void SetOpacity(unsigned char value);
+    bool IsEnabled();
+    void Enable(bool enable);
+
+    int GetRadius() const { return mRadius; }
+    void SetRadius(int value);
+    // Path of the blurred layer, empty for everything beneath
+    const QString& GetSource() const { return mSource; }
+    void SetSource(const QString& value);
+    const QSharedPointer<LayerCache>& GetCache() const { return mCache; }
+
+private:
+    unsigned char mOpacity;
+    bool mEnabled;
+    int mRadius;
+    QString mSource;
+    // Shared with composite snapshots which may outlive the layer
+    QSharedPointer<LayerCache> mCache;
+};
+
+// Adjustment layer moving everything beneath it, or only the layer at the source path,
+// by keyframed translation, rotation and scale around a pivot
+class TransformLayerModel:
+    public LayerModel
+{
+public:
+    struct Key
+    {
+        int frameIndex;
+        float x;
+        float y;
+        // degrees, clockwise on screen
+        float rotation;
+        float scale;
+    };
+
+    TransformLayerModel(const QString& absPath, const QString& path);
+    ~TransformLayerModel();
+
+    static TransformLayerModel* New(const QString& absPath, const QString& path, float pivotX, float pivotY);
+    static TransformLayerModel* Open(const QString& absPath, const QString& path);
+
+    void Save();
+    // Up to the last key
+    int GetMaxFrames();
+    QImage* GetImage(int frameIndex);
+    QRect GetBounds(int frameIndex);
+    unsigned char GetOpacity();
+    void SetOpacity(unsigned char value);
+    bool IsEnabled();
+    void Enable(bool enable);
+
+    // Sorted by frame index
+    const std::vector<Key>& GetKeys() const { return mKeys; }
+    // Adds or replaces the key at key.frameIndex
+    void SetKey(const Key& key);
+    void RemoveKey(int frameIndex);
+    bool HasKey(int frameIndex) const;
+    // Linear between keys, held before the first and after the last
+    Key GetKeyAt(int frameIndex) const;
+    // Maps scene pixels of the source to scene pixels of the result
+    Matrix4 GetTransform(int frameIndex) const;
+
+    float GetPivotX() const { return mPivotX; }
+    float GetPivotY() const { return mPivotY; }
+    void SetPivot(float x, float y);
+    const QString& GetSource() const { return mSource; }
+    void SetSource(const QString& value);
+    const QSharedPointer<LayerCache>& GetCache() const { return mCache; }
+
+private:
+    unsigned char mOpacity;
+    bool mEnabled;
+    float mPivotX;
+    float mPivotY;
+    QString mSource;
+    std::vector<Key> mKeys;
+    QSharedPointer<LayerCache> mCache;
+};
+
+// Layer showing another scene of the project, shifted in time and looped
+class SceneLayerModel:
+    public LayerModel
+{
+public:
+    enum Loop
+    {
+        // Shown for one run of the scene
+        LoopOnce,
+        LoopRepeat,
+        LoopPingPong,
+        // The last frame stays after one run
+        LoopHold
+    };
+
+    SceneLayerModel(const QString& absPath, const QString& path);
+    ~SceneLayerModel();
+
+    static SceneLayerModel* New(const QString& absPath, const QString& path, const QString& scenePath);
+    static SceneLayerModel* Open(const QString& absPath, const QString& path);
+
+    void Save();
+    // One run of the scene from the offset
+    int GetMaxFrames();
+    QImage* GetImage(int frameIndex);
+    QRect GetBounds(int frameIndex);
+    unsigned char GetOpacity();
+    void SetOpacity(unsigned char value);
+    bool IsEnabled();
+    void Enable(bool enable);
+
+    // Path of the scene in the project, resolved by AnimationProject
+    const QString& GetScenePath() const { return mScenePath; }
+    SceneModel* GetScene() const { return mScene; }
+    void SetScene(SceneModel* scene) { mScene = scene; }
+    int GetOffset() const { return mOffset; }
+    void SetOffset(int value) { mOffset = value; }
+    Loop GetLoop() const { return mLoop; }
+    void SetLoop(Loop value) { mLoop = value; }
+    // Frame of the scene shown at frameIndex, -1 if there is none
+    int GetSceneFrame(int frameIndex);
+
+private:
+    unsigned char mOpacity;
+    bool mEnabled;
+    QString mScenePath;
+    SceneModel* mScene;
+    int mOffset;
+    Loop mLoop;
+};
+
+
+// Snapshot of one layer for a frame, safe to composite on a worker thread
+// because the image is an implicitly shared copy.
+struct CompositeLayer
+{
+    enum Adjustment
+    {
+        AdjustmentNone,
+        AdjustmentBlur,
+        AdjustmentTransform
+    };
+
+    CompositeLayer() : opacity(0xFF), blendMode(BlendNormal), adjustment(AdjustmentNone), blurRadius(0), frameKey(0) {}
+
+    QImage image;
+    QRect bounds;
+    unsigned char opacity;
+    // Adjustments of what is beneath always replace it
+    BlendMode blendMode;
+    // Adjustment layers change image, or the composite beneath when image is null
+    Adjustment adjustment;
+    int blurRadius;
+    Matrix4 transform;
+    QSharedPointer<LayerCache> cache;
+    // Nested scenes: non-zero key of the frame in cache. Until the frame is cached
+    // image is null, bounds is the scene rect and children are composited into it.
+    quint64 frameKey;
+    QSharedPointer<std::vector<CompositeLayer> > children;
+};
 
 class SoundLayerModel
 {
@@ -169,12 +387,29 @@ public:
     std::vector<LayerModel*>& GetLayers() { return mLayers; }
     RasterLayerModel* AddRasterLayer(int index, const QString& name, int width, int height);
     TraceLayerModel* AddTraceLayer(int index, const QString& name);
+    BlurLayerModel* AddBlurLayer(int index, const QString& name, int radius);
+    TransformLayerModel* AddTransformLayer(int index, const QString& name);
+    SceneLayerModel* AddSceneLayer(int index, const QString& name, SceneModel* scene);
     void RemoveLayer(int index);
+    LayerModel* FindLayer(const QString& path);
     void Save();
     void Export(const QString& path);
     int GetMaxFrames();
     void MoveLayer(int oldIndex, int newIndex);
-    void GetCompositeImage(int frameIndex, QImage* result);
+    // Only clears dirtyRect of result and returns the bounds of the new composite
+    QRect GetCompositeImage(int frameIndex, QImage* result, const QRect& dirtyRect);
+    // Snapshots the first count layers, all of them if count is negative
+    void GetCompositeLayers(int frameIndex, std::vector<CompositeLayer>& layers, int count = -1);
+    // Composites the region of result, all of it when region is null, see CompositeGraph
+    static QRect Composite(const std::vector<CompositeLayer>& layers, QImage* result, const QRect& dirtyRect,
+                           const QRect& region = QRect());
+
+    // Called on every edit, scenes nesting this one drop their cached frames of it
+    void NotifyChanged() { ++mRevision; }
+    // Changes with this scene or any scene nested in it
+    qint64 GetRevision();
+    // Composites of this scene's frames, shared by the scene layers showing it
+    const QSharedPointer<LayerCache>& GetFrameCache();
 
 private:
     QString mAbsPath;
@@ -192,6 +427,11 @@ private:
     std::vector<QImage*> mCompositeImages;
     // Cached final sound layer
     QString mSound;
+    qint64 mRevision;
+    // Guards against scenes nesting themselves
+    bool mVisiting;
+    QSharedPointer<LayerCache> mFrameCache;
+    qint64 mFrameCacheRevision;
 };
 
 class AnimationProject
@@ -203,9 +443,14 @@ public:
     void Save();
 
     std::vector<SceneModel*>& GetScenes() { return mScenes; }
+    SceneModel* AddScene(const QString& name);
+    SceneModel* FindScene(const QString& path);
     int GetWidth() const { return mWidth; }
     int GetHeight() const { return mHeight; }
     int GetFps() const { return mFps; }
+    // RAM for undo records before they go to disk, in bytes
+    qint64 GetUndoBudget() const { return mUndoBudget; }
+    void SetUndoBudget(qint64 bytes) { mUndoBudget = bytes; }
 
 signals:
 
@@ -213,12 +458,14 @@ public slots:
 
 private:
     explicit AnimationProject(const QString& path, int width, int height, int fps);
+    void ResolveSceneLayers();
 
 private:
     QString mPath;
     int mWidth;
     int mHeight;
     int mFps;
+    qint64 mUndoBudget;
     std::vector<SceneModel*> mScenes;
 };
 
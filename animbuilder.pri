@@ -0,0 +1,126 @@
+#-------------------------------------------------
+#
+# Sources of AnimBuilder but main.cpp, shared with
+# the benchmark
+#
+#-------------------------------------------------
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/mainwindow.cpp \
+    $$PWD/rasterimageeditor.cpp \
+    $$PWD/timeline.cpp \
+    $$PWD/rasterlayer.cpp \
+    $$PWD/timelinenavbar.cpp \
+    $$PWD/wavfile.cpp \
+    $$PWD/soundlayer.cpp \
+    $$PWD/animationfile.cpp \
+    $$PWD/command.cpp \
+    $$PWD/brushpropertywindow.cpp \
+    $$PWD/cachedimage.cpp \
+    $$PWD/brushtool.cpp \
+    $$PWD/layer.cpp \
+    $$PWD/strokepoint.cpp \
+    $$PWD/timelinewindow.cpp \
+    $$PWD/pantool.cpp \
+    $$PWD/zoomtool.cpp \
+    $$PWD/rotatetool.cpp \
+    $$PWD/ringcolorpicker.cpp \
+    $$PWD/colorpicker.cpp \
+    $$PWD/filltool.cpp \
+    $$PWD/regiontool.cpp \
+    $$PWD/colortool.cpp \
+    $$PWD/newprojectdialog.cpp \
+    $$PWD/splinetool.cpp \
+    $$PWD/tracelayer.cpp \
+    $$PWD/tracetool.cpp \
+    $$PWD/openglwindow.cpp \
+    $$PWD/renderwindow.cpp \
+    $$PWD/openglrenderer.cpp \
+    $$PWD/renderer.cpp \
+    $$PWD/softrenderer.cpp \
+    $$PWD/imageutil.cpp \
+    $$PWD/playbackcache.cpp \
+    $$PWD/undohistory.cpp \
+    $$PWD/playbackclock.cpp \
+    $$PWD/onionskin.cpp \
+    $$PWD/mippyramid.cpp \
+    $$PWD/pixelkernels.cpp \
+    $$PWD/parallel.cpp \
+    $$PWD/fastblur.cpp \
+    $$PWD/layercache.cpp \
+    $$PWD/compositegraph.cpp \
+    $$PWD/blurlayer.cpp \
+    $$PWD/transformlayer.cpp \
+    $$PWD/scenelayer.cpp \
+    $$PWD/strokerasterizer.cpp \
+    $$PWD/dabbrush.cpp \
+    $$PWD/latencyprobe.cpp \
+    $$PWD/tabletqueue.cpp \
+    $$PWD/strokerecording.cpp \
+    $$PWD/headlesscanvas.cpp \
+    $$PWD/glew.c
+
+HEADERS += $$PWD/mainwindow.h \
+    $$PWD/rasterimageeditor.h \
+    $$PWD/timeline.h \
+    $$PWD/rasterlayer.h \
+    $$PWD/timelinenavbar.h \
+    $$PWD/wavfile.h \
+    $$PWD/soundlayer.h \
+    $$PWD/animationfile.h \
+    $$PWD/command.h \
+    $$PWD/brushpropertywindow.h \
+    $$PWD/canvastool.h \
+    $$PWD/cachedimage.h \
+    $$PWD/brushtool.h \
+    $$PWD/layer.h \
+    $$PWD/strokepoint.h \
+    $$PWD/timelinewindow.h \
+    $$PWD/pantool.h \
+    $$PWD/zoomtool.h \
+    $$PWD/rotatetool.h \
+    $$PWD/ringcolorpicker.h \
+    $$PWD/filltool.h \
+    $$PWD/regiontool.h \
+    $$PWD/colorpicker.h \
+    $$PWD/colortool.h \
+    $$PWD/newprojectdialog.h \
+    $$PWD/splinetool.h \
+    $$PWD/strokepoint.h \
+    $$PWD/tracelayer.h \
+    $$PWD/tracetool.h \
+    $$PWD/openglwindow.h \
+    $$PWD/renderwindow.h \
+    $$PWD/openglrenderer.h \
+    $$PWD/renderer.h \
+    $$PWD/softrenderer.h \
+    $$PWD/imageutil.h \
+    $$PWD/playbackcache.h \
+    $$PWD/undohistory.h \
+    $$PWD/playbackclock.h \
+    $$PWD/onionskin.h \
+    $$PWD/mippyramid.h \
+    $$PWD/pixelkernels.h \
+    $$PWD/parallel.h \
+    $$PWD/fastblur.h \
+    $$PWD/layercache.h \
+    $$PWD/compositegraph.h \
+    $$PWD/blurlayer.h \
+    $$PWD/transformlayer.h \
+    $$PWD/scenelayer.h \
+    $$PWD/strokerasterizer.h \
+    $$PWD/dabbrush.h \
+    $$PWD/latencyprobe.h \
+    $$PWD/tabletqueue.h \
+    $$PWD/strokerecording.h \
+    $$PWD/headlesscanvas.h
+
+FORMS += $$PWD/mainwindow.ui \
+    $$PWD/brushpropertywindow.ui \
+    $$PWD/timelinewindow.ui \
+    $$PWD/colorpicker.ui \
+    $$PWD/newprojectdialog.ui
+
+RESOURCES += \
+    $$PWD/resources.qrc
@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Each benchmark prints its own results
+void RunRasterizerBenchmark();
+void RunDabBenchmark();
+void RunSplineBenchmark();
+void RunLatencyBenchmark();
+void RunBlurBenchmark();
+
+#endif // BENCHMARK_H
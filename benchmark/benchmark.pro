@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Headless benchmarks of the drawing code, run as
+# benchmark [name...] [recording.strokes]
+#
+#-------------------------------------------------
+
+QT       += core gui xml opengl
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = benchmark
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+DEFINES += GLEW_STATIC
+
+SOURCES += main.cpp \
+    rasterizerbenchmark.cpp \
+    dabbenchmark.cpp \
+    splinebenchmark.cpp \
+    latencybenchmark.cpp \
+    blurbenchmark.cpp \
+    ../replay/corpus.cpp
+
+HEADERS  += benchmark.h \
+    ../replay/replay.h
+
+include(../animbuilder.pri)
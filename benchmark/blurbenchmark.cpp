@@ -0,0 +1,87 @@
+#include "benchmark.h"
+#include "fastblur.h"
+#include <QImage>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <stdio.h>
+#include <string.h>
+
+#define IMAGE_WIDTH 512
+#define IMAGE_HEIGHT 384
+#define REPEAT 5
+
+// Fixed sequence, so every run blurs the same image
+static unsigned int sSeed = 1;
+
+static int Random(int range)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (int)((sSeed >> 8) & 0xFFFF) % range;
+}
+
+// Opaque and translucent shapes on a transparent background, edges and colors for the blur to spread
+static void BuildImage(QImage& image)
+{
+    sSeed = 1;
+    image.fill(0);
+    QPainter p(&image);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.setPen(Qt::NoPen);
+    for (int i = 0; i < 60; ++i)
+    {
+        int x = Random(IMAGE_WIDTH);
+        int y = Random(IMAGE_HEIGHT);
+        int w = 4 + Random(120);
+        int h = 4 + Random(120);
+        int r = Random(256);
+        int g = Random(256);
+        int b = Random(256);
+        int a = i % 3 == 0 ? 0xFF : 40 + Random(200);
+        p.setBrush(QColor(r, g, b, a));
+        if (i % 2)
+        {
+            p.drawEllipse(x, y, w, h);
+        }
+        else
+        {
+            p.drawRect(x, y, w, h);
+        }
+    }
+}
+
+// Fastest of REPEAT runs of a blur on a fresh copy of the source, in ms
+static double TimeBlur(void (*blur)(unsigned char*, int, int, int, float), const QImage& source, QImage& result, float sigma)
+{
+    qint64 best = 0;
+    for (int i = 0; i < REPEAT; ++i)
+    {
+        memcpy(result.bits(), source.constBits(), source.byteCount());
+        QElapsedTimer timer;
+        timer.start();
+        blur(result.bits(), result.width(), result.height(), result.bytesPerLine(), sigma);
+        qint64 elapsed = timer.nsecsElapsed();
+        best = i == 0 || elapsed < best ? elapsed : best;
+    }
+    return best / 1000000.0;
+}
+
+// FastBlur against the exact gaussian, the error in 8 bit premultiplied levels
+void RunBlurBenchmark()
+{
+    static const float sigmas[] = { 2.0f, 5.0f, 10.0f, 30.0f, 60.0f };
+
+    QImage source(IMAGE_WIDTH, IMAGE_HEIGHT, QImage::Format_RGBA8888);
+    BuildImage(source);
+    QImage fast(source.size(), source.format());
+    QImage exact(source.size(), source.format());
+
+    printf("%dx%d image, best of %d\n", IMAGE_WIDTH, IMAGE_HEIGHT, REPEAT);
+    printf("%8s %10s %10s %10s %10s\n", "sigma", "fast ms", "exact ms", "max", "rms");
+    for (int i = 0; i < 5; ++i)
+    {
+        double fastMs = TimeBlur(FastBlur, source, fast, sigmas[i]);
+        double exactMs = TimeBlur(GaussianBlur, source, exact, sigmas[i]);
+        BlurError error = CompareBlur(fast.constBits(), exact.constBits(), IMAGE_WIDTH, IMAGE_HEIGHT, source.bytesPerLine());
+        printf("%8.0f %10.2f %10.2f %10.0f %10.2f\n", sigmas[i], fastMs, exactMs, error.maxError, error.rmsError);
+    }
+}
@@ -0,0 +1,76 @@
+#include "benchmark.h"
+#include "dabbrush.h"
+#include <QImage>
+#include <QElapsedTimer>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define CANVAS_WIDTH 1920
+#define CANVAS_HEIGHT 1080
+// Samples a drag event adds at fast pen speed
+#define EVENT_SAMPLES 16
+#define EVENT_COUNT 2000
+// Samples queued behind a stalled frame, a small tip stamps over a thousand dabs for them
+#define BURST_SAMPLES 1024
+#define BURST_COUNT 30
+
+static void RunCase(const char* name, BrushTip tip, float size, const std::vector<StrokePoint>& samples,
+                    int eventSamples, int eventCount, QImage& image)
+{
+    image.fill(0);
+    DabBrush brush;
+    brush.Begin(tip, size, QColor(30, 30, 30, 0xFF), BlendNormal);
+
+    qint64 total = 0;
+    qint64 worst = 0;
+    for (int e = 0; e < eventCount; ++e)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        brush.Stroke(&image, QPoint(0, 0), &samples[e * eventSamples], eventSamples);
+        qint64 elapsed = timer.nsecsElapsed();
+        total += elapsed;
+        worst = qMax(worst, elapsed);
+    }
+
+    double ms = total / 1000000.0;
+    printf("%10s %6.0f %10d %12d %12.3f %12.3f %12.1f\n", name, size, brush.GetDabCount(),
+           brush.GetDabCount() / eventCount, ms / eventCount, worst / 1000000.0,
+           ms > 0 ? brush.GetDabCount() / ms : 0.0);
+}
+
+void RunDabBenchmark()
+{
+    static const BrushTip tips[] = { BrushTipRound, BrushTipTextured, BrushTipPencil };
+    static const char* names[] = { "round", "textured", "pencil" };
+    static const float sizes[] = { 4.0f, 16.0f, 64.0f };
+
+    // a spiral, one sample every 2 pixels like the spline sampler gives
+    std::vector<StrokePoint> samples;
+    for (int i = 0; i < EVENT_SAMPLES * EVENT_COUNT; ++i)
+    {
+        float t = i * 0.002f;
+        StrokePoint p;
+        p.x = CANVAS_WIDTH * 0.5f + cosf(t * 7.0f) * (100.0f + 4.0f * t * 20.0f);
+        p.y = CANVAS_HEIGHT * 0.5f + sinf(t * 7.0f) * (100.0f + 4.0f * t * 20.0f);
+        p.pressure = 0.3f + 0.7f * fabsf(sinf(t * 3.0f));
+        samples.push_back(p);
+    }
+
+    QImage image(CANVAS_WIDTH, CANVAS_HEIGHT, QImage::Format_RGBA8888);
+    printf("%10s %6s %10s %12s %12s %12s %12s\n", "tip", "size", "dabs", "dabs/event", "ms/event", "max ms", "dabs/ms");
+    for (int t = 0; t < 3; ++t)
+    {
+        for (int s = 0; s < 3; ++s)
+        {
+            RunCase(names[t], tips[t], sizes[s], samples, EVENT_SAMPLES, EVENT_COUNT, image);
+        }
+    }
+
+    printf("bursts of %d samples\n", BURST_SAMPLES);
+    for (int t = 0; t < 3; ++t)
+    {
+        RunCase(names[t], tips[t], sizes[0], samples, BURST_SAMPLES, BURST_COUNT, image);
+    }
+}
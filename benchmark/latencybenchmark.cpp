@@ -0,0 +1,213 @@
+#include "benchmark.h"
+#include "brushtool.h"
+#include "headlesscanvas.h"
+#include "tabletqueue.h"
+#include "../replay/replay.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QUndoStack>
+#include <stdio.h>
+#include <vector>
+
+#define DISPLAY_RATE 60
+#define STROKE_COUNT 2
+// ms between the strokes, the pen is up
+#define PAUSE_MS 250
+
+// Strokes of the recording given on the command line, or the first of the generated
+// round brush corpus. Returns false if there is none to read.
+static bool LoadRecording(StrokeRecording& recording, QString& name)
+{
+    QStringList args = QCoreApplication::arguments();
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args[i].endsWith(".strokes"))
+        {
+            name = args[i];
+            return recording.Load(name);
+        }
+    }
+
+    QTemporaryDir dir;
+    if (!dir.isValid() || GenerateCorpus(dir.path()) == 0)
+    {
+        return false;
+    }
+    StrokeRecording corpus;
+    name = "brush_round corpus";
+    if (!corpus.Load(QDir(dir.path()).filePath("brush_round.strokes")))
+    {
+        return false;
+    }
+    recording.SetCanvasSize(corpus.GetWidth(), corpus.GetHeight());
+    const std::vector<RecordedStroke>& strokes = corpus.GetStrokes();
+    for (size_t i = 0; i < strokes.size() && i < STROKE_COUNT; ++i)
+    {
+        recording.AddStroke(strokes[i]);
+    }
+    return true;
+}
+
+// The recorded points as pen samples at the time they were recorded, strokes one after the
+// other with a pause between. times are ns from the start.
+static void BuildInput(const StrokeRecording& recording, std::vector<TabletSample>& events, std::vector<qint64>& times)
+{
+    events.clear();
+    times.clear();
+    qint64 start = 0;
+    const std::vector<RecordedStroke>& strokes = recording.GetStrokes();
+    for (size_t s = 0; s < strokes.size(); ++s)
+    {
+        const std::vector<RecordedPoint>& points = strokes[s].points;
+        int n = (int)points.size();
+        for (int i = 0; i < n; ++i)
+        {
+            TabletSample e;
+            e.type = i == 0 ? TabletSamplePress : (i == n - 1 ? TabletSampleRelease : TabletSampleMove);
+            e.x = points[i].point.x;
+            e.y = points[i].point.y;
+            e.pressure = points[i].point.pressure;
+            e.xTilt = 0;
+            e.yTilt = 0;
+            e.timestamp = (unsigned long)(start / 1000000 + points[i].time);
+            events.push_back(e);
+            times.push_back(start + points[i].time * 1000000LL);
+        }
+        if (n > 0)
+        {
+            start += (points[n - 1].time + PAUSE_MS) * 1000000LL;
+        }
+    }
+}
+
+static void WaitUntil(const QElapsedTimer& timer, qint64 time)
+{
+    // spinning keeps the replay on time to well under a millisecond
+    while (timer.nsecsElapsed() < time)
+    {
+    }
+}
+
+static void Send(BrushTool& tool, const TabletSample& e)
+{
+    if (e.type == TabletSamplePress)
+    {
+        tool.OnDragBegin(qRound(e.x), qRound(e.y), e.pressure);
+    }
+    else if (e.type == TabletSampleMove)
+    {
+        tool.OnDrag(qRound(e.x), qRound(e.y), e.pressure);
+    }
+    else
+    {
+        tool.OnDragEnd(qRound(e.x), qRound(e.y), e.pressure);
+    }
+}
+
+// Draws the frame and the tool overlay the way the editor does, without the window system
+static void Present(HeadlessCanvas& canvas, BrushTool& tool, QImage& screen)
+{
+    LatencyProbe* probe = canvas.GetLatencyProbe();
+    probe->BeginStage(LatencyComposite);
+    QPainter p(&screen);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    p.fillRect(screen.rect(), QColor(0xFF, 0xFF, 0xFF, 0xFF));
+    p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    QRect preview = tool.GetPreviewRect();
+    p.save();
+    p.setClipRegion(QRegion(screen.rect()).subtracted(preview));
+    p.drawImage(0, 0, *canvas.GetImage());
+    p.restore();
+    tool.DrawPreview(p);
+    tool.OnPaint(p);
+    probe->EndStage(LatencyComposite);
+
+    // nothing to swap, present is only ending the painter
+    probe->BeginStage(LatencyPresent);
+    p.end();
+    probe->EndStage(LatencyPresent);
+    probe->OnPresent();
+}
+
+// Replays recorded input in real time through BrushTool for each tip, showing a frame at every
+// display refresh which has input since the last one. The tool takes the input event by event
+// like mouse moves, then drained per frame from a TabletQueue like the editor does.
+void RunLatencyBenchmark()
+{
+    static const BrushTip tips[] = { BrushTipOutline, BrushTipRound, BrushTipPencil };
+    static const char* names[] = { "outline", "round", "pencil" };
+
+    StrokeRecording recording;
+    QString name;
+    if (!LoadRecording(recording, name) || recording.GetStrokes().empty() || recording.GetWidth() <= 0 || recording.GetHeight() <= 0)
+    {
+        printf("no recording to replay\n");
+        return;
+    }
+    std::vector<TabletSample> events;
+    std::vector<qint64> times;
+    BuildInput(recording, events, times);
+    qint64 framePeriod = 1000000000LL / DISPLAY_RATE;
+    printf("%d strokes of %d points from %s, %d Hz display\n", (int)recording.GetStrokes().size(),
+           recording.GetPointCount(), name.toUtf8().constData(), DISPLAY_RATE);
+
+    for (int t = 0; t < 3; ++t)
+    {
+        for (int coalesce = 0; coalesce < 2; ++coalesce)
+        {
+            HeadlessCanvas canvas(recording.GetWidth(), recording.GetHeight());
+            QUndoStack undoStack;
+            BrushTool tool(&canvas, &undoStack);
+            tool.SetBrushSize(24.0f);
+            tool.SetColor(QColor(40, 80, 160, 0xFF));
+            tool.SetTip(tips[t]);
+            QImage screen(recording.GetWidth(), recording.GetHeight(), QImage::Format_ARGB32_Premultiplied);
+            LatencyProbe* probe = canvas.GetLatencyProbe();
+            TabletQueue queue;
+
+            QElapsedTimer timer;
+            timer.start();
+            qint64 nextFrame = framePeriod;
+            size_t next = 0;
+            while (next < events.size())
+            {
+                const TabletSample& e = events[next];
+                qint64 time = times[next];
+                if (nextFrame <= time)
+                {
+                    WaitUntil(timer, nextFrame);
+                    if (coalesce)
+                    {
+                        queue.Drain(&tool);
+                    }
+                    Present(canvas, tool, screen);
+                    nextFrame += framePeriod;
+                    continue;
+                }
+
+                WaitUntil(timer, time);
+                probe->OnInput();
+                if (coalesce)
+                {
+                    queue.Push(e);
+                }
+                else
+                {
+                    Send(tool, e);
+                }
+                ++next;
+            }
+            WaitUntil(timer, nextFrame);
+            queue.Drain(&tool);
+            Present(canvas, tool, screen);
+
+            printf("-- %s, %s\n%s", names[t], coalesce ? "per frame" : "per event",
+                   probe->Dump().toUtf8().constData());
+        }
+    }
+}
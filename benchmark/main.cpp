@@ -0,0 +1,49 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <stdio.h>
+#include "benchmark.h"
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark sBenchmarks[] =
+{
+    { "rasterizer", RunRasterizerBenchmark },
+    { "dabs", RunDabBenchmark },
+    { "spline", RunSplineBenchmark },
+    { "latency", RunLatencyBenchmark },
+    { "blur", RunBlurBenchmark },
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    int count = sizeof(sBenchmarks) / sizeof(sBenchmarks[0]);
+    int run = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (args.size() > 1 && !args.contains(sBenchmarks[i].name))
+        {
+            continue;
+        }
+        printf("== %s\n", sBenchmarks[i].name);
+        sBenchmarks[i].run();
+        ++run;
+    }
+
+    if (run == 0)
+    {
+        printf("usage: benchmark [name...] [recording.strokes]\n");
+        for (int i = 0; i < count; ++i)
+        {
+            printf("  %s\n", sBenchmarks[i].name);
+        }
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "benchmark.h"
+#include "strokerasterizer.h"
+#include <QImage>
+#include <QPainter>
+#include <QPainterPath>
+#include <QElapsedTimer>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define CANVAS_WIDTH 1920
+#define CANVAS_HEIGHT 1080
+#define STROKE_COUNT 200
+
+// Fixed sequence, so every run draws the same strokes
+static unsigned int sSeed = 1;
+
+static float Random()
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return ((sSeed >> 8) & 0xFFFF) / 65535.0f;
+}
+
+// Wandering stroke with the sample spacing of the spline sampler and varying pressure
+static void BuildStroke(int length, std::vector<StrokePoint>& samples)
+{
+    samples.clear();
+    StrokePoint p;
+    p.x = Random() * CANVAS_WIDTH;
+    p.y = Random() * CANVAS_HEIGHT;
+    float angle = Random() * 6.2831853f;
+    for (int i = 0; i < length; ++i)
+    {
+        p.pressure = 0.2f + 0.8f * fabsf(sinf(i * 0.03f + angle));
+        samples.push_back(p);
+        angle += (Random() - 0.5f) * 0.4f;
+        float step = 2.0f + Random() * 3.0f;
+        p.x += cosf(angle) * step;
+        p.y += sinf(angle) * step;
+    }
+}
+
+// The route BrushTool used before the rasterizer, a polygon and a joint ellipse per segment
+static void DrawPath(QImage* image, const std::vector<StrokePoint>& samples, float brushSize, const QColor& color)
+{
+    QPainterPath path;
+    path.setFillRule(Qt::WindingFill);
+    for (size_t j = 1; j < samples.size(); ++j)
+    {
+        QPointF quad[4];
+        float joint = GetStrokeSegmentOutline(samples[j - 1], samples[j], brushSize, quad);
+        path.addPolygon(QPolygonF() << quad[0] << quad[1] << quad[2] << quad[3]);
+        if (joint > 0)
+        {
+            path.addEllipse(QPointF(samples[j - 1].x, samples[j - 1].y), joint, joint);
+        }
+    }
+    QPainter p(image);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.fillPath(path, QBrush(color));
+}
+
+static void DrawRasterizer(QImage* image, const std::vector<StrokePoint>& samples, float brushSize, const QColor& color)
+{
+    StrokeRasterizer rasterizer;
+    for (size_t j = 1; j < samples.size(); ++j)
+    {
+        rasterizer.AddStrokeSegment(samples[j - 1], samples[j], brushSize);
+    }
+    rasterizer.Fill(image, color, QPainter::CompositionMode_SourceOver);
+}
+
+// Largest and mean alpha difference over the pixels either route touched
+static void CompareAlpha(const QImage& a, const QImage& b, int& maxDiff, double& meanDiff)
+{
+    maxDiff = 0;
+    qint64 total = 0;
+    qint64 count = 0;
+    for (int y = 0; y < a.height(); ++y)
+    {
+        const uchar* pa = a.constScanLine(y);
+        const uchar* pb = b.constScanLine(y);
+        for (int x = 0; x < a.width(); ++x)
+        {
+            int da = pa[x * 4 + 3];
+            int db = pb[x * 4 + 3];
+            if (da == 0 && db == 0)
+            {
+                continue;
+            }
+            int diff = da > db ? da - db : db - da;
+            maxDiff = qMax(maxDiff, diff);
+            total += diff;
+            ++count;
+        }
+    }
+    meanDiff = count > 0 ? (double)total / count : 0.0;
+}
+
+void RunRasterizerBenchmark()
+{
+    static const float sizes[] = { 4.0f, 16.0f, 64.0f };
+    static const int lengths[] = { 50, 500 };
+    QColor color(40, 80, 160, 0xFF);
+
+    printf("%8s %8s %12s %12s %8s %8s %8s\n", "size", "samples", "path ms", "raster ms", "speedup", "max da", "mean da");
+    for (int s = 0; s < 3; ++s)
+    {
+        for (int l = 0; l < 2; ++l)
+        {
+            sSeed = 1;
+            std::vector<std::vector<StrokePoint> > strokes(STROKE_COUNT);
+            for (int i = 0; i < STROKE_COUNT; ++i)
+            {
+                BuildStroke(lengths[l], strokes[i]);
+            }
+
+            QImage pathImage(CANVAS_WIDTH, CANVAS_HEIGHT, QImage::Format_RGBA8888);
+            QImage rasterImage(CANVAS_WIDTH, CANVAS_HEIGHT, QImage::Format_RGBA8888);
+            qint64 pathTime = 0;
+            qint64 rasterTime = 0;
+            int maxDiff = 0;
+            double meanDiff = 0;
+            for (int i = 0; i < STROKE_COUNT; ++i)
+            {
+                pathImage.fill(0);
+                rasterImage.fill(0);
+
+                QElapsedTimer timer;
+                timer.start();
+                DrawPath(&pathImage, strokes[i], sizes[s], color);
+                pathTime += timer.nsecsElapsed();
+
+                timer.restart();
+                DrawRasterizer(&rasterImage, strokes[i], sizes[s], color);
+                rasterTime += timer.nsecsElapsed();
+
+                // one stroke on a clear canvas each, so the difference is the coverage alone
+                int strokeMax = 0;
+                double strokeMean = 0;
+                CompareAlpha(pathImage, rasterImage, strokeMax, strokeMean);
+                maxDiff = qMax(maxDiff, strokeMax);
+                meanDiff += strokeMean / STROKE_COUNT;
+            }
+
+            double pathMs = pathTime / 1000000.0 / STROKE_COUNT;
+            double rasterMs = rasterTime / 1000000.0 / STROKE_COUNT;
+            printf("%8.0f %8d %12.3f %12.3f %7.2fx %8d %8.2f\n", sizes[s], lengths[l], pathMs, rasterMs,
+                   rasterMs > 0 ? pathMs / rasterMs : 0.0, maxDiff, meanDiff);
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#include "benchmark.h"
+#include "strokepoint.h"
+#include <QElapsedTimer>
+#include <list>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define POINT_COUNT 20000
+#define REPEAT 20
+
+// The recursive list-based sampler StrokePoint::CatmulRomSpline used to be, kept to compare against
+struct ListSplineContext
+{
+    float x[4];
+    float y[4];
+    float z[4];
+    std::list<StrokePoint> points;
+};
+
+static void ListSubdivide(ListSplineContext& ctx, std::list<StrokePoint>::iterator endIt, float beginT, float endT)
+{
+    if (endT - beginT < 0.001f)
+    {
+        return;
+    }
+    float t = (beginT + endT) * 0.5f;
+    float t2 = t * t;
+    float t3 = t2 * t;
+    StrokePoint pt;
+    pt.x = ctx.x[0] + ctx.x[1] * t + ctx.x[2] * t2 + ctx.x[3] * t3;
+    pt.y = ctx.y[0] + ctx.y[1] * t + ctx.y[2] * t2 + ctx.y[3] * t3;
+    pt.pressure = ctx.z[0] + ctx.z[1] * t + ctx.z[2] * t2 + ctx.z[3] * t3;
+
+    std::list<StrokePoint>::iterator beginIt = endIt;
+    beginIt--;
+    float dx = endIt->x - beginIt->x;
+    float dy = endIt->y - beginIt->y;
+    if (sqrtf(dx * dx + dy * dy) > 5.0f)
+    {
+        std::list<StrokePoint>::iterator it = ctx.points.insert(endIt, pt);
+        ListSubdivide(ctx, it, beginT, t);
+        ListSubdivide(ctx, endIt, t, endT);
+    }
+}
+
+static void Coefficients(float p0, float p1, float p2, float p3, float c[4])
+{
+    c[0] = p1;
+    c[1] = (-p0 + p2) * 0.5f;
+    c[2] = p0 - 2.5f * p1 + 2.0f * p2 - 0.5f * p3;
+    c[3] = -0.5f * p0 + 1.5f * p1- 1.5f * p2 + 0.5f * p3;
+}
+
+static void ListSpline(const StrokePoint& P0, const StrokePoint& P1, const StrokePoint& P2, const StrokePoint& P3, std::vector<StrokePoint>& result)
+{
+    ListSplineContext ctx;
+    Coefficients(P0.x, P1.x, P2.x, P3.x, ctx.x);
+    Coefficients(P0.y, P1.y, P2.y, P3.y, ctx.y);
+    Coefficients(P0.pressure, P1.pressure, P2.pressure, P3.pressure, ctx.z);
+
+    ctx.points.push_back(P1);
+    ctx.points.push_back(P2);
+    std::list<StrokePoint>::iterator it = ctx.points.begin();
+    it++;
+    ListSubdivide(ctx, it, 0.0f, 1.0f);
+    for (std::list<StrokePoint>::iterator i = ctx.points.begin(); i != ctx.points.end(); ++i)
+    {
+        if (result.size() == 0 || result.back() != *i)
+        {
+            result.push_back(*i);
+        }
+    }
+}
+
+typedef void (*SplineFunction)(const StrokePoint&, const StrokePoint&, const StrokePoint&, const StrokePoint&, std::vector<StrokePoint>&);
+
+// Samples of the whole polyline, the way BrushTool walks it
+static void Sample(SplineFunction spline, const std::vector<StrokePoint>& points, std::vector<StrokePoint>& samples)
+{
+    int n = (int)points.size();
+    for (int i = 1; i < n; ++i)
+    {
+        const StrokePoint& p1 = points[i - 1];
+        const StrokePoint& p2 = points[i];
+        const StrokePoint& p0 = i - 2 >= 0 ? points[i - 2] : p1;
+        const StrokePoint& p3 = i + 1 < n ? points[i + 1] : p2;
+        spline(p0, p1, p2, p3, samples);
+    }
+}
+
+void RunSplineBenchmark()
+{
+    // mouse events of a fast stroke, 5 to 60 pixels apart
+    unsigned int seed = 1;
+    std::vector<StrokePoint> points;
+    StrokePoint p;
+    p.x = 0;
+    p.y = 0;
+    float angle = 0;
+    for (int i = 0; i < POINT_COUNT; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        float r = ((seed >> 8) & 0xFFFF) / 65535.0f;
+        angle += (r - 0.5f) * 1.5f;
+        p.x += cosf(angle) * (5.0f + 55.0f * r);
+        p.y += sinf(angle) * (5.0f + 55.0f * r);
+        p.pressure = r;
+        points.push_back(p);
+    }
+
+    SplineFunction functions[2] = { ListSpline, StrokePoint::CatmulRomSpline };
+    const char* names[2] = { "list", "stack" };
+    std::vector<StrokePoint> samples[2];
+    printf("%8s %12s %12s %12s\n", "sampler", "samples", "ns/segment", "ns/sample");
+    for (int f = 0; f < 2; ++f)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int r = 0; r < REPEAT; ++r)
+        {
+            samples[f].clear();
+            Sample(functions[f], points, samples[f]);
+        }
+        double ns = (double)timer.nsecsElapsed() / REPEAT;
+        printf("%8s %12d %12.1f %12.2f\n", names[f], (int)samples[f].size(),
+               ns / (POINT_COUNT - 1), ns / samples[f].size());
+    }
+
+    // both split at the same t, so the samples only differ where the chord test rounds differently
+    if (samples[0].size() != samples[1].size())
+    {
+        printf("sample counts differ\n");
+        return;
+    }
+    float maxDiff = 0;
+    for (size_t i = 0; i < samples[0].size(); ++i)
+    {
+        maxDiff = qMax(maxDiff, fabsf(samples[0][i].x - samples[1][i].x));
+        maxDiff = qMax(maxDiff, fabsf(samples[0][i].y - samples[1][i].y));
+        maxDiff = qMax(maxDiff, fabsf(samples[0][i].pressure - samples[1][i].pressure));
+    }
+    printf("max difference %g\n", maxDiff);
+}
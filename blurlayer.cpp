@@ -0,0 +1,198 @@
+#include "blurlayer.h"
+#include <QPainter>
+#include <QWidget>
+#include <QMouseEvent>
+#include <QHBoxLayout>
+#include <QSlider>
+#include <QCheckBox>
+#include <QSpinBox>
+#include "timeline.h"
+#include "animationfile.h"
+
+BlurPropertyWindow::BlurPropertyWindow(Timeline* timeline, BlurLayer* layer)
+    :mTimeline(timeline)
+    ,mLayer(layer)
+{
+    setLayout(new QHBoxLayout);
+    layout()->setMargin(0);
+    layout()->setSpacing(0);
+
+    QSlider* slider = new QSlider(Qt::Horizontal);
+    slider->setMaximum(255);
+    slider->setValue(layer->GetOpacity());
+    layout()->addWidget(slider);
+    connect(slider, SIGNAL(valueChanged(int)),
+            this, SLOT(SetOpacity(int)));
+
+    QCheckBox* enableBox = new QCheckBox;
+    enableBox->setIcon(QIcon(":/icons/visible.png"));
+    enableBox->setChecked(layer->IsEnabled());
+    connect(enableBox, SIGNAL(toggled(bool)),
+            this, SLOT(Enable(bool)));
+    layout()->addWidget(enableBox);
+
+    QSpinBox* radiusBox = new QSpinBox;
+    radiusBox->setRange(0, 500);
+    radiusBox->setValue(layer->GetRadius());
+    radiusBox->setToolTip("Blur radius");
+    connect(radiusBox, SIGNAL(valueChanged(int)),
+            this, SLOT(SetRadius(int)));
+    layout()->addWidget(radiusBox);
+
+    setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Fixed);
+}
+
+BlurPropertyWindow::~BlurPropertyWindow()
+{
+
+}
+
+QSize BlurPropertyWindow::sizeHint() const
+{
+    return QSize(200, mTimeline->GetCellSize().height());
+}
+
+QSize BlurPropertyWindow::minimumSizeHint() const
+{
+    return QSize(200, mTimeline->GetCellSize().height());
+}
+
+void BlurPropertyWindow::SetOpacity(int value)
+{
+    mLayer->SetOpacity((unsigned char) value);
+}
+
+void BlurPropertyWindow::Enable(bool value)
+{
+    mLayer->Enable(value);
+}
+
+void BlurPropertyWindow::SetRadius(int value)
+{
+    mLayer->SetRadius(value);
+}
+
+BlurLayer::BlurLayer(Timeline* timeline, BlurLayerModel* layerModel, QWidget *parent) :
+    Layer(parent),
+    mLayerModel(layerModel),
+    mTimeline(timeline),
+    mSelected(false)
+{
+    setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+    mPropertyWindow = new BlurPropertyWindow(timeline, this);
+}
+
+BlurLayer::~BlurLayer()
+{
+}
+
+QSize BlurLayer::sizeHint() const
+{
+    return QSize(mTimeline->GetCellSize().width() * mTimeline->GetMaxFrames(), mTimeline->GetCellSize().height());
+}
+
+QSize BlurLayer::minimumSizeHint() const
+{
+    return QSize(mTimeline->GetCellSize().width() * mTimeline->GetMaxFrames(), mTimeline->GetCellSize().height());
+}
+
+void BlurLayer::mousePressEvent(QMouseEvent *ev)
+{
+    mTimeline->SetLayer(this);
+    mTimeline->SetFrameIndex((ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width());
+    this->grabMouse();
+}
+
+void BlurLayer::mouseReleaseEvent(QMouseEvent *)
+{
+    this->releaseMouse();
+}
+
+void BlurLayer::mouseMoveEvent(QMouseEvent *ev)
+{
+    mTimeline->SetFrameIndex((ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width());
+}
+
+void BlurLayer::paintEvent(QPaintEvent *)
+{
+    QSize cellSize = mTimeline->GetCellSize();
+
+    QPainter p(this);
+    p.setPen(Qt::NoPen);
+    if (mSelected)
+    {
+        p.setBrush(QBrush(QColor(250, 250, 250)));
+    }
+    else
+    {
+        p.setBrush(QBrush(QColor(200, 200, 200)));
+    }
+    p.drawRect(0, 0, width(), cellSize.height());
+
+    // one bar over all frames, the blur applies to each of them
+    int length = cellSize.width() * mTimeline->GetMaxFrames() - mTimeline->GetOffset();
+    p.setBrush(QBrush(QColor(160, 180, 220)));
+    p.setPen(QPen(QColor(0, 0, 0)));
+    p.drawRect(0, 2, length - 1, cellSize.height() - 5);
+}
+
+void BlurLayer::SetSelected(bool selected)
+{
+    mSelected = selected;
+    update();
+}
+
+void BlurLayer::OnFrameChanged(int frameIndex)
+{
+
+}
+
+QImage* BlurLayer::GetImage(int frameIndex)
+{
+    return NULL;
+}
+
+unsigned char BlurLayer::GetOpacity()
+{
+    return mLayerModel->GetOpacity();
+}
+
+void BlurLayer::SetOpacity(unsigned char value)
+{
+    if (value != mLayerModel->GetOpacity())
+    {
+        mLayerModel->SetOpacity(value);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+bool BlurLayer::IsEnabled()
+{
+    return mLayerModel->IsEnabled();
+}
+
+void BlurLayer::Enable(bool enable)
+{
+    if (mLayerModel->IsEnabled() != enable)
+    {
+        mLayerModel->Enable(enable);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+int BlurLayer::GetRadius()
+{
+    return mLayerModel->GetRadius();
+}
+
+void BlurLayer::SetRadius(int value)
+{
+    if (value != mLayerModel->GetRadius())
+    {
+        mLayerModel->SetRadius(value);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
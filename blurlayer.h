@@ -0,0 +1,72 @@
+#ifndef BLURLAYER_H
+#define BLURLAYER_H
+
+#include "layer.h"
+#include <QWidget>
+
+class Timeline;
+class BlurLayer;
+class BlurLayerModel;
+
+class BlurPropertyWindow : public QWidget
+{
+    Q_OBJECT
+public:
+    BlurPropertyWindow(Timeline* timeline, BlurLayer* layer);
+    ~BlurPropertyWindow();
+
+    public slots:
+        void SetOpacity(int value);
+        void Enable(bool value);
+        void SetRadius(int value);
+
+protected:
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+private:
+    Timeline* mTimeline;
+    BlurLayer* mLayer;
+};
+
+// Row of a blur adjustment layer, it spans the whole timeline
+class BlurLayer : public Layer
+{
+    Q_OBJECT
+public:
+    explicit BlurLayer(Timeline* timeline, BlurLayerModel* layerModel, QWidget *parent = 0);
+    ~BlurLayer();
+
+    LayerType GetType() { return LayerTypeBlur; }
+    void SetSelected(bool selected);
+    void OnFrameChanged(int frameIndex);
+    QImage* GetImage(int frameIndex);
+    bool IsOnionEnabled() { return false; }
+    void EnableOnion(bool enable) {}
+    unsigned char GetOpacity();
+    void SetOpacity(unsigned char value);
+    bool IsEnabled();
+    void Enable(bool enable);
+    int GetRadius();
+    void SetRadius(int value);
+    QWidget* GetPropertyWindow() { return mPropertyWindow; }
+    int GetMaxFrames() { return 0; }
+
+public:
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+protected:
+    void mousePressEvent(QMouseEvent *);
+    void mouseReleaseEvent(QMouseEvent *);
+    void mouseMoveEvent(QMouseEvent *);
+    void paintEvent(QPaintEvent *);
+
+private:
+    BlurLayerModel* mLayerModel;
+    Timeline* mTimeline;
+    bool mSelected;
+    BlurPropertyWindow* mPropertyWindow;
+};
+
+#endif // BLURLAYER_H
@@ -17,6 +17,12 @@ BrushPropertyWindow::BrushPropertyWindow(QWidget *parent) :
 
     connect(ui->modeControl, SIGNAL(currentTextChanged(QString)),
             this, SLOT(OnModeChanged(QString)));
+
+    connect(ui->tipControl, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(OnTipChanged(int)));
+
+    connect(ui->stabilizeControl, SIGNAL(valueChanged(int)),
+            this, SLOT(OnStabilizeChanged(int)));
 }
 
 BrushPropertyWindow::~BrushPropertyWindow()
@@ -64,3 +70,14 @@ void BrushPropertyWindow::OnModeChanged(QString mode)
 
     emit modeChanged(cm);
 }
+
+void BrushPropertyWindow::OnTipChanged(int index)
+{
+    // items are in BrushTip order
+    emit tipChanged(index);
+}
+
+void BrushPropertyWindow::OnStabilizeChanged(int value)
+{
+    emit stabilizeChanged(value);
+}
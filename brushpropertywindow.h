@@ -19,11 +19,15 @@ public slots:
     void OnBrushSizeChanged(double);
     void OnSmoothChanged(int);
     void OnModeChanged(QString mode);
+    void OnTipChanged(int index);
+    void OnStabilizeChanged(int value);
 
 signals:
     void brushSizeChanged(float);
     void smoothChanged(int);
     void modeChanged(QPainter::CompositionMode);
+    void tipChanged(int);
+    void stabilizeChanged(int);
 private:
     Ui::BrushPropertyWindow *ui;
 };
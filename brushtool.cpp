@@ -1,18 +1,133 @@
 #include "brushtool.h"
-#include "rasterimageeditor.h"
 #include "openglrenderer.h"
 #include "command.h"
+#include "imageutil.h"
+#include "strokerasterizer.h"
+#include "latencyprobe.h"
+#include "strokerecording.h"
+#include "rasterimageeditor.h"
+#include <string.h>
+
+// Coverage of mask joined into the coverage of dst at pos, both Alpha8
+static void UniteCoverage(QImage* dst, const QPoint& pos, const QImage& mask)
+{
+    for (int y = 0; y < mask.height(); ++y)
+    {
+        const uchar* src = mask.constScanLine(y);
+        uchar* d = dst->scanLine(pos.y() + y) + pos.x();
+        for (int x = 0; x < mask.width(); ++x)
+        {
+            d[x] = (uchar)(d[x] + src[x] - (d[x] * src[x] + 127) / 255);
+        }
+    }
+}
+
+// Stroke kept as the input points, the outline is built again on every replay
+class BrushEdit : public RasterEdit
+{
+public:
+    BrushEdit(const std::vector<StrokePoint>& points, float brushSize, int smooth,
+              const QColor& color, QPainter::CompositionMode mode, BrushTip tip)
+        :mPoints(points)
+        ,mBrushSize(brushSize)
+        ,mSmooth(smooth)
+        ,mColor(color)
+        ,mMode(mode)
+        ,mTip(tip)
+    {
+        if (mTip == BrushTipOutline)
+        {
+            StrokeRasterizer rasterizer;
+            BrushTool::BuildStrokeOutline(mPoints, mBrushSize, mSmooth, rasterizer);
+            mRect = rasterizer.GetBounds();
+        }
+        else
+        {
+            std::vector<StrokePoint> samples;
+            BrushTool::BuildStrokeSamples(mPoints, mSmooth, samples);
+            mRect = DabBrush::GetBounds(samples, mBrushSize);
+        }
+    }
+
+    QRect GetRect() const { return mRect; }
 
-BrushTool::BrushTool(RasterImageEditor* editor, QUndoStack* undoStack)
+    void Draw(QImage* image) const
+    {
+        if (mTip == BrushTipOutline)
+        {
+            StrokeRasterizer rasterizer;
+            BrushTool::BuildStrokeOutline(mPoints, mBrushSize, mSmooth, rasterizer);
+            rasterizer.Fill(image, mColor, mMode);
+            return;
+        }
+
+        std::vector<StrokePoint> samples;
+        BrushTool::BuildStrokeSamples(mPoints, mSmooth, samples);
+        if (samples.empty())
+        {
+            return;
+        }
+        QColor color = mColor;
+        BlendMode blend = GetBrushBlendMode(mMode, color);
+        DabBrush brush;
+        if (blend != BlendReplace)
+        {
+            brush.Begin(mTip, mBrushSize, color, blend);
+            brush.Stroke(image, QPoint(0, 0), &samples[0], (int)samples.size());
+            return;
+        }
+
+        // modes the kernels do not have get the dabs on a layer first
+        QRect rect = mRect.intersected(image->rect());
+        if (rect.isEmpty())
+        {
+            return;
+        }
+        QImage layer(rect.size(), QImage::Format_RGBA8888);
+        layer.fill(0);
+        brush.Begin(mTip, mBrushSize, color, BlendNormal);
+        brush.Stroke(&layer, rect.topLeft(), &samples[0], (int)samples.size());
+        QPainter p(image);
+        p.setCompositionMode(mMode);
+        p.drawImage(rect.topLeft(), layer);
+    }
+
+private:
+    std::vector<StrokePoint> mPoints;
+    float mBrushSize;
+    int mSmooth;
+    QColor mColor;
+    QPainter::CompositionMode mMode;
+    BrushTip mTip;
+    QRect mRect;
+};
+
+BrushTool::BrushTool(CanvasHost* editor, QUndoStack* undoStack)
     :mEditor(editor)
     ,mUndoStack(undoStack)
     ,mBrushSize(1.0f)
     ,mSmooth(0)
     ,mBrushMode(QPainter::CompositionMode_SourceOver)
+    ,mTip(BrushTipOutline)
+    ,mStabilize(0)
+    ,mStableSegments(0)
+    ,mPushed(0)
+    ,mBlend(BlendNormal)
+    ,mPreviewDrawn(false)
 {
 }
 
 void BrushTool::OnDragBegin(int x, int y, float pressure)
+{
+    BeginStroke(x, y, pressure);
+}
+
+void BrushTool::OnSampleBegin(const TabletSample& sample)
+{
+    BeginStroke(sample.x, sample.y, sample.pressure);
+}
+
+void BrushTool::BeginStroke(float x, float y, float pressure)
 {
     if (!mEditor->GetImage())
     {
@@ -20,9 +135,26 @@ void BrushTool::OnDragBegin(int x, int y, float pressure)
     }
 
     mPoints.clear();
-    QPainterPath p;
-    mTempPath.swap(p);
-    mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
+    mSamples.clear();
+    mSmoothed.clear();
+    mStableSegments = 0;
+    mPushed = 0;
+    mSmoother.Reset(mSmooth);
+    StrokePoint pen = mEditor->ScreenToLocal(x, y, pressure);
+    mStabilizer.Reset(pen, mStabilize);
+    mPoints.push_back(pen);
+
+    mBlendColor = mColor;
+    mBlend = GetBrushBlendMode(mBrushMode, mBlendColor);
+    mPreview = QImage();
+    mStrokeLayer = QImage();
+    mStrokeRect = QRect();
+    mTail = QImage();
+    mTailRect = QRect();
+    if (mTip != BrushTipOutline)
+    {
+        mDabBrush.Begin(mTip, mBrushSize, mBlendColor, IsLayered() ? BlendNormal : mBlend);
+    }
 }
 
 void BrushTool::OnDrag(int x, int y, float pressure)
@@ -32,119 +164,388 @@ void BrushTool::OnDrag(int x, int y, float pressure)
         return;
     }
 
-    mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
+    StrokePoint point;
+    if (!mStabilizer.Pull(mEditor->ScreenToLocal(x, y, pressure), point))
+    {
+        return;
+    }
+    mPoints.push_back(point);
     DrawLastStroke();
 }
 
-void BrushTool::OnDragEnd(int x, int y, float pressure)
+void BrushTool::OnDragSamples(const TabletSample* samples, int count)
 {
-    if (!mEditor->GetImage())
+    if (!mEditor->GetImage() || mPoints.empty())
     {
         return;
     }
 
-    mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
-    DrawLastStroke();
+    int n = (int)mPoints.size();
+    for (int i = 0; i < count; ++i)
+    {
+        const TabletSample& s = samples[i];
+        StrokePoint point;
+        if (mStabilizer.Pull(mEditor->ScreenToLocal(s.x, s.y, s.pressure), point))
+        {
+            mPoints.push_back(point);
+        }
+    }
+    if ((int)mPoints.size() > n)
+    {
+        DrawLastStroke();
+    }
+}
 
-    QImage* oldImage = new QImage(mEditor->GetImage()->width(),mEditor->GetImage()->height(), QImage::Format_RGBA8888);
-    QImage* newImage = new QImage(mEditor->GetImage()->width(),mEditor->GetImage()->height(), QImage::Format_RGBA8888);
+void BrushTool::OnDragEnd(int x, int y, float pressure)
+{
+    EndStroke(x, y, pressure);
+}
 
-    QPainter hp(oldImage);
-    hp.setCompositionMode(QPainter::CompositionMode_Source);
-    hp.drawImage(0, 0, *mEditor->GetImage());
+void BrushTool::OnSampleEnd(const TabletSample& sample)
+{
+    EndStroke(sample.x, sample.y, sample.pressure);
+}
+
+void BrushTool::EndStroke(float x, float y, float pressure)
+{
+    if (!mEditor->GetImage())
+    {
+        return;
+    }
+
+    StrokePoint point = mEditor->ScreenToLocal(x, y, pressure);
+    if (mStabilize > 0)
+    {
+        // the stroke ends where the string left it
+        StrokePoint pen = point;
+        if (!mStabilizer.Pull(pen, point))
+        {
+            point = mPoints.back();
+        }
+    }
+    mPoints.push_back(point);
 
-    QPainter np(newImage);
-    np.setCompositionMode(QPainter::CompositionMode_Source);
-    np.drawImage(0, 0, *mEditor->GetImage());
-    np.setCompositionMode(mBrushMode);
-    np.setRenderHint(QPainter::Antialiasing, true);
-    QBrush brush(mColor);
-    np.fillPath(mTempPath, brush);
-    mUndoStack->push(new DrawCommand(mEditor, newImage, oldImage));
+    {
+        // pushing draws the stroke
+        LatencyScope scope(mEditor->GetLatencyProbe(), LatencyRasterize);
+        mUndoStack->push(new ReplayCommand(mEditor, new BrushEdit(mPoints, mBrushSize, mSmooth, mColor, mBrushMode, mTip)));
+    }
 
     mPoints.clear();
-    QPainterPath path;
-    mTempPath.swap(path);
-    mEditor->update();
+    mPreview = QImage();
+    mStrokeLayer = QImage();
+    mStrokeRect = QRect();
+    mTail = QImage();
+    mTailRect = QRect();
+    mEditor->UpdateView();
 }
 
 void BrushTool::OnPaint(QPainter &p)
 {
-    if (!mEditor->GetImage() || mPoints.size() == 0)
+    // the timeline draws the preview in place of the frame, unless the frame is only shown
+    // composited beneath an adjustment, then it goes over the composite
+    if (!mPreviewDrawn && !mPoints.empty())
     {
-        return;
+        p.setOpacity(1.0f);
+        p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        DrawPreview(p);
     }
-    p.setOpacity(1.0f);
-    p.setRenderHint(QPainter::Antialiasing, true);
-    p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-    p.fillPath(mTempPath, QBrush(mColor));
+    mPreviewDrawn = false;
 }
 
-void BrushTool::BuildDrawSegment(const StrokePoint& p0, const StrokePoint& p1, QPainterPath& path)
+QRect BrushTool::GetPreviewRect()
 {
-    QPointF pts[4];
-    float r0 = p0.pressure * mBrushSize * 0.5f;
-    float r1 = p1.pressure * mBrushSize * 0.5f;
-    Vector2 dir(p1.x - p0.x, p1.y - p0.y);
-    Vector2 perp0 = dir.GetPerpendicular().GetNormalized() * r0;
-    Vector2 perp1 = dir.GetPerpendicular().GetNormalized() * r1;
-    Vector2 v0(p0.x, p0.y);
-    Vector2 v1(p1.x, p1.y);
+    return mPoints.empty() ? QRect() : mStrokeRect;
+}
 
-    pts[0].setX(v0.x - perp0.x);
-    pts[0].setY(v0.y - perp0.y);
-    pts[1].setX(v1.x - perp1.x);
-    pts[1].setY(v1.y - perp1.y);
-    pts[2].setX(v1.x + perp1.x);
-    pts[2].setY(v1.y + perp1.y);
-    pts[3].setX(v0.x + perp0.x);
-    pts[3].setY(v0.y + perp0.y);
+void BrushTool::DrawPreview(QPainter& painter)
+{
+    mPreviewDrawn = true;
+    if (mStrokeRect.isEmpty())
+    {
+        return;
+    }
+    QVector<QRect> rects = QRegion(mStrokeRect).subtracted(mTailRect).rects();
+    for (int i = 0; i < rects.size(); ++i)
+    {
+        painter.drawImage(rects[i].topLeft(), mPreview, rects[i].translated(-mStrokeRect.topLeft()));
+    }
+    if (!mTailRect.isEmpty())
+    {
+        painter.drawImage(mTailRect.topLeft(), mTail);
+    }
+}
 
+bool BrushTool::GetStrokeParams(StrokeToolParams& params)
+{
+    params.tool = StrokeToolBrush;
+    params.brushSize = mBrushSize;
+    params.smooth = mSmooth;
+    params.mode = mBrushMode;
+    params.tip = mTip;
+    params.stabilize = mStabilize;
+    params.color = mColor.rgba();
+    return true;
+}
 
-    QPolygonF polygon;
-    polygon.append(pts[0]);
-    polygon.append(pts[1]);
-    polygon.append(pts[2]);
-    polygon.append(pts[3]);
-    path.addPolygon(polygon);
-    if (r0 > 3.0f)
+void BrushTool::BuildStrokeSamples(const std::vector<StrokePoint>& points, int smooth, std::vector<StrokePoint>& samples)
+{
+    int n = (int)points.size();
+    if (n < 2)
     {
-        path.addEllipse(QPointF(v0.x, v0.y), r0, r0);
+        return;
+    }
+
+    for(int i = 1; i < n; ++i)
+    {
+        const StrokePoint& p1 = points[i - 1];
+        const StrokePoint& p2 = points[i];
+        const StrokePoint& p0 = i - 2 >= 0 ? points[i - 2] : p1;
+        const StrokePoint& p3 = i + 1 < n ? points[i + 1] : p2;
+
+        StrokePoint::CatmulRomSpline(p0, p1, p2, p3, samples);
+        if (i < n - 1)
+        {
+            samples.pop_back();
+        }
     }
+    StrokePoint::Smooth(samples, smooth);
+}
 
+void BrushTool::BuildStrokeOutline(const std::vector<StrokePoint>& points, float brushSize, int smooth, StrokeRasterizer& rasterizer)
+{
+    std::vector<StrokePoint> samples;
+    BuildStrokeSamples(points, smooth, samples);
+    for(int j = 1; j < (int)samples.size(); ++j)
+    {
+        rasterizer.AddStrokeSegment(samples[j - 1], samples[j], brushSize);
+    }
 }
 
+// Same samples and segments as BuildStrokeOutline, but only the tail which may still change is
+// rebuilt, so the cost of an event does not grow with the stroke
 void BrushTool::DrawLastStroke()
 {
     int n = (int)mPoints.size();
-    if (n >= 2)
+    if (n < 2)
     {
-        QPainterPath path;
-        path.setFillRule(Qt::WindingFill);
+        return;
+    }
 
-        std::vector<StrokePoint> samples;
+    LatencyProbe* probe = mEditor->GetLatencyProbe();
+    if (probe)
+    {
+        probe->BeginStage(LatencyTessellate);
+    }
+    for (; mStableSegments < n - 2; ++mStableSegments)
+    {
+        int i = mStableSegments + 1;
+        const StrokePoint& p1 = mPoints[i - 1];
+        const StrokePoint& p2 = mPoints[i];
+        const StrokePoint& p0 = i - 2 >= 0 ? mPoints[i - 2] : p1;
+        const StrokePoint& p3 = mPoints[i + 1];
+        StrokePoint::CatmulRomSpline(p0, p1, p2, p3, mSamples);
+        mSamples.pop_back();
+    }
+    int stable = (int)mSamples.size();
+
+    const StrokePoint& p1 = mPoints[n - 2];
+    const StrokePoint& p2 = mPoints[n - 1];
+    const StrokePoint& p0 = n - 3 >= 0 ? mPoints[n - 3] : p1;
+    StrokePoint::CatmulRomSpline(p0, p1, p2, p2, mSamples);
+    int count = (int)mSamples.size();
 
-        for(int i = 1; i < n; ++i)
+    // only the new stable samples go through the smoother
+    int first = (int)mSmoothed.size();
+    for (; mPushed < stable; ++mPushed)
+    {
+        mSmoother.Push(mSamples[mPushed], mSmoothed);
+    }
+    int frozen = (int)mSmoothed.size();
+    if (probe)
+    {
+        probe->EndStage(LatencyTessellate);
+        probe->BeginStage(LatencyRasterize);
+    }
+    if (frozen > first && mTip != BrushTipOutline)
+    {
+        std::vector<StrokePoint> dabs(mSmoothed.begin() + first, mSmoothed.begin() + frozen);
+        GrowStroke(DabBrush::GetBounds(dabs, mBrushSize));
+        QPoint origin = mStrokeRect.topLeft();
+        QRect rect = mDabBrush.Stroke(IsLayered() ? &mStrokeLayer : &mPreview, origin, &dabs[0], (int)dabs.size());
+        if (IsLayered())
+        {
+            ComposeStroke(rect.translated(origin));
+        }
+    }
+    else if (frozen > first)
+    {
+        StrokeRasterizer rasterizer;
+        for (int j = qMax(first, 1); j < frozen; ++j)
         {
-            StrokePoint& p1 = mPoints[i - 1];
-            StrokePoint& p2 = mPoints[i];
-            StrokePoint& p0 = i - 2 >= 0 ? mPoints[i - 2] : p1;
-            StrokePoint& p3 = i + 1 < n ? mPoints[i + 1] : p2;
+            rasterizer.AddStrokeSegment(mSmoothed[j - 1], mSmoothed[j], mBrushSize);
+        }
+        GrowStroke(rasterizer.GetBounds());
 
-            StrokePoint::CatmulRomSpline(p0, p1, p2, p3, samples);
-            if (i < n - 1)
-            {
-                samples.pop_back();
-            }
+        QRect rect;
+        QImage mask = rasterizer.Rasterize(mStrokeRect, rect);
+        if (!rect.isEmpty())
+        {
+            UniteCoverage(&mStrokeLayer, rect.topLeft() - mStrokeRect.topLeft(), mask);
+            ComposeStroke(rect);
         }
-        StrokePoint::Smooth(samples, mSmooth);
-        for(int j = 1; j < (int)samples.size(); ++j)
+    }
+    if (probe)
+    {
+        probe->EndStage(LatencyRasterize);
+        probe->BeginStage(LatencyTessellate);
+    }
+
+    std::vector<StrokePoint> rest;
+    if (!mSmoothed.empty())
+    {
+        rest.push_back(mSmoothed.back());
+    }
+    mSmoother.Finish(count > stable ? &mSamples[stable] : NULL, count - stable, rest);
+    if (probe)
+    {
+        probe->EndStage(LatencyTessellate);
+        probe->BeginStage(LatencyRasterize);
+    }
+    DrawTail(rest);
+
+    mSamples.resize(stable);
+    if (probe)
+    {
+        probe->EndStage(LatencyRasterize);
+    }
+    mEditor->UpdateView();
+}
+
+// The rest of the stroke still changes, it goes onto a copy of its area of the preview through the
+// same brush and rasterizer, continuing from the frozen part as the committed stroke does
+void BrushTool::DrawTail(const std::vector<StrokePoint>& rest)
+{
+    mTail = QImage();
+    mTailRect = QRect();
+    if (rest.empty())
+    {
+        return;
+    }
+
+    if (mTip != BrushTipOutline)
+    {
+        QRect bounds = DabBrush::GetBounds(rest, mBrushSize);
+        GrowStroke(bounds);
+        QRect rect = bounds.intersected(mStrokeRect);
+        if (rect.isEmpty())
         {
-            BuildDrawSegment(samples[j - 1], samples[j], path);
+            return;
         }
+        QRect local = rect.translated(-mStrokeRect.topLeft());
+        DabBrush brush = mDabBrush;
+        if (IsLayered())
+        {
+            QImage layer = mStrokeLayer.copy(local);
+            brush.Stroke(&layer, rect.topLeft(), &rest[0], (int)rest.size());
+            mTail = ComposeLayer(rect, layer);
+        }
+        else
+        {
+            mTail = mPreview.copy(local);
+            brush.Stroke(&mTail, rect.topLeft(), &rest[0], (int)rest.size());
+        }
+        mTailRect = rect;
+        return;
+    }
+
+    StrokeRasterizer rasterizer;
+    for (int j = 1; j < (int)rest.size(); ++j)
+    {
+        rasterizer.AddStrokeSegment(rest[j - 1], rest[j], mBrushSize);
+    }
+    GrowStroke(rasterizer.GetBounds());
+    QRect rect;
+    QImage mask = rasterizer.Rasterize(mStrokeRect, rect);
+    if (rect.isEmpty())
+    {
+        return;
+    }
+    QImage coverage = mStrokeLayer.copy(rect.translated(-mStrokeRect.topLeft()));
+    UniteCoverage(&coverage, QPoint(0, 0), mask);
+    mTail = ComposeLayer(rect, coverage);
+    mTailRect = rect;
+}
+
+void BrushTool::GrowStroke(const QRect& rect)
+{
+    QImage* image = mEditor->GetImage();
+    QRect grown = (mStrokeRect | rect).intersected(image->rect());
+    if (grown.isEmpty() || mStrokeRect.contains(grown))
+    {
+        return;
+    }
+
+    // whole tiles, so a stroke is not copied again for every pixel it grows by
+    int x0 = grown.left() / CANVAS_TILE_SIZE * CANVAS_TILE_SIZE;
+    int y0 = grown.top() / CANVAS_TILE_SIZE * CANVAS_TILE_SIZE;
+    int x1 = (grown.right() / CANVAS_TILE_SIZE + 1) * CANVAS_TILE_SIZE;
+    int y1 = (grown.bottom() / CANVAS_TILE_SIZE + 1) * CANVAS_TILE_SIZE;
+    grown = QRect(x0, y0, x1 - x0, y1 - y0).intersected(image->rect());
+
+    QImage preview = image->copy(grown);
+    QImage layer;
+    if (IsLayered())
+    {
+        layer = QImage(grown.size(), mTip == BrushTipOutline ? QImage::Format_Alpha8 : QImage::Format_RGBA8888);
+        layer.fill(0);
+    }
+    if (!mStrokeRect.isEmpty())
+    {
+        QPoint offset = mStrokeRect.topLeft() - grown.topLeft();
+        for (int y = 0; y < mStrokeRect.height(); ++y)
+        {
+            memcpy(preview.scanLine(offset.y() + y) + offset.x() * 4, mPreview.constScanLine(y), mStrokeRect.width() * 4);
+            if (IsLayered())
+            {
+                int depth = layer.depth() / 8;
+                memcpy(layer.scanLine(offset.y() + y) + offset.x() * depth, mStrokeLayer.constScanLine(y), mStrokeRect.width() * depth);
+            }
+        }
+    }
+    mPreview = preview;
+    mStrokeLayer = layer;
+    mStrokeRect = grown;
+}
 
-        mTempPath.swap(path);
-        mEditor->update();
+QImage BrushTool::ComposeLayer(const QRect& rect, const QImage& layer)
+{
+    QImage image = mEditor->GetImage()->copy(rect);
+    if (layer.format() == QImage::Format_Alpha8)
+    {
+        FillMask(&image, QPoint(0, 0), layer, mColor, mBrushMode);
+    }
+    else
+    {
+        QPainter p(&image);
+        p.setCompositionMode(mBrushMode);
+        p.drawImage(0, 0, layer);
+    }
+    return image;
+}
+
+void BrushTool::ComposeStroke(const QRect& rect)
+{
+    QRect area = rect.intersected(mStrokeRect);
+    if (area.isEmpty())
+    {
+        return;
+    }
+    QRect local = area.translated(-mStrokeRect.topLeft());
+    QImage image = ComposeLayer(area, mStrokeLayer.copy(local));
+    for (int y = 0; y < area.height(); ++y)
+    {
+        memcpy(mPreview.scanLine(local.top() + y) + local.left() * 4, image.constScanLine(y), area.width() * 4);
     }
 }
 
@@ -183,3 +584,13 @@ void BrushTool::SetMode(QPainter::CompositionMode mode)
 {
     mBrushMode = mode;
 }
+
+void BrushTool::SetStabilize(float length)
+{
+    mStabilize = length > 0 ? length : 0;
+}
+
+void BrushTool::SetTip(BrushTip tip)
+{
+    mTip = tip;
+}
@@ -5,30 +5,59 @@
 #include <QPainter>
 #include <vector>
 #include <QUndoStack>
+#include "dabbrush.h"
 
-class RasterImageEditor;
+class StrokeRasterizer;
 
 class BrushTool : public CanvasTool
 {
 public:
-    BrushTool(RasterImageEditor* editor, QUndoStack* undoStack);
+    BrushTool(CanvasHost* editor, QUndoStack* undoStack);
 
     void OnDragBegin(int x, int y, float pressure);
     void OnDrag(int x, int y, float pressure);
     void OnDragEnd(int x, int y, float pressure);
+    // Adds every sample at its sub-pixel position, the stroke is tessellated once for them all
+    void OnDragSamples(const TabletSample* samples, int count);
+    void OnSampleBegin(const TabletSample& sample);
+    void OnSampleEnd(const TabletSample& sample);
     void OnPaint(QPainter &painter);
+    QRect GetPreviewRect();
+    void DrawPreview(QPainter& painter);
+    bool GetStrokeParams(StrokeToolParams& params);
     void SetUndoStack(QUndoStack* stack) { mUndoStack = stack; }
     void SetBrushSize(float value);
     void SetColor(const QColor& color);
     void SetSmooth(int value);
     void SetMode(QPainter::CompositionMode mode);
+    // Length of the string the pen pulls the stroke with, 0 draws at the pen
+    void SetStabilize(float length);
+    // Outline fills the stroke, the other tips stamp dabs along it
+    void SetTip(BrushTip tip);
     float GetBrushSize() { return mBrushSize; }
     int GetSmooth() { return mSmooth; }
     QPainter::CompositionMode GetMode() { return mBrushMode; }
+    BrushTip GetTip() { return mTip; }
+    float GetStabilize() { return mStabilize; }
+
+    // Outline of a stroke through points, the same points always give the same outline
+    static void BuildStrokeOutline(const std::vector<StrokePoint>& points, float brushSize, int smooth, StrokeRasterizer& rasterizer);
+    // Smoothed spline samples the outline goes through
+    static void BuildStrokeSamples(const std::vector<StrokePoint>& points, int smooth, std::vector<StrokePoint>& samples);
 
 private:
+    void BeginStroke(float x, float y, float pressure);
+    void EndStroke(float x, float y, float pressure);
     void DrawLastStroke();
-    void BuildDrawSegment(const StrokePoint& p0, const StrokePoint& p1, QPainterPath& path);
+    // The stroke is drawn onto mStrokeLayer and blended from there, not straight onto the preview
+    bool IsLayered() const { return mTip == BrushTipOutline || mBlend == BlendReplace; }
+    // Grows the preview to cover rect, in tiles
+    void GrowStroke(const QRect& rect);
+    // Frame pixels of rect with layer applied, layer covers rect
+    QImage ComposeLayer(const QRect& rect, const QImage& layer);
+    // Rebuilds rect of the preview from the frame and mStrokeLayer
+    void ComposeStroke(const QRect& rect);
+    void DrawTail(const std::vector<StrokePoint>& rest);
 
 signals:
 
@@ -36,14 +65,41 @@ public slots:
 
 
 private:
-    RasterImageEditor* mEditor;
+    CanvasHost* mEditor;
     QUndoStack* mUndoStack;
     float mBrushSize;
     QColor mColor;
     int mSmooth;
     QPainter::CompositionMode mBrushMode;
+    BrushTip mTip;
+    float mStabilize;
+    StrokeStabilizer mStabilizer;
     std::vector<StrokePoint> mPoints;
-    QPainterPath mTempPath;
+    // Spline samples of the segments which have both neighbour points, they do not change any more
+    std::vector<StrokePoint> mSamples;
+    int mStableSegments;
+    // Stable samples are pushed into the smoother once, mPushed of them so far
+    StrokeSmoother mSmoother;
+    int mPushed;
+    // Smoothed samples whose smoothing window lies in the stable samples
+    std::vector<StrokePoint> mSmoothed;
+    // Colour and kernel mode the stroke is committed with
+    QColor mBlendColor;
+    BlendMode mBlend;
+    // Frame pixels of mStrokeRect with the frozen part of the stroke applied the way committing
+    // applies it. Only the area the stroke reaches is held, grown a tile at a time.
+    QImage mPreview;
+    QRect mStrokeRect;
+    // For layered strokes the frozen part as it is before blending onto the frame, the coverage
+    // of an outline or the dabs of a mode the kernels lack, over mStrokeRect
+    QImage mStrokeLayer;
+    // Preview of mTailRect with the rest of the stroke applied too, rebuilt on every event
+    QImage mTail;
+    QRect mTailRect;
+    // Stamps the dabs of mSmoothed as they freeze
+    DabBrush mDabBrush;
+    // The timeline drew the preview since the last OnPaint
+    bool mPreviewDrawn;
 };
 
 #endif // BRUSHTOOL_H
@@ -1,7 +1,32 @@
 #ifndef CANVASTOOL_H
 #define CANVASTOOL_H
-#include "StrokePoint.h"
+#include "strokepoint.h"
 #include <QPainter>
+#include "tabletqueue.h"
+
+class RasterFrameModel;
+class UndoHistory;
+class LatencyProbe;
+struct StrokeToolParams;
+
+// What tools draw on, the editor or a headless canvas
+class CanvasHost
+{
+public:
+    virtual ~CanvasHost() {}
+    virtual QImage* GetImage() = 0;
+    // All visible layers of the frame, what fills look at
+    virtual QImage* GetCompositeImage() = 0;
+    virtual RasterFrameModel* GetFrame() = 0;
+    virtual UndoHistory* GetUndoHistory() = 0;
+    // NULL when nothing is measuring
+    virtual LatencyProbe* GetLatencyProbe() = 0;
+    virtual StrokePoint ScreenToLocal(float x, float y, float pressure) = 0;
+    // Something drawn over the image changed
+    virtual void UpdateView() = 0;
+    // The frame image changed, caches of it are stale
+    virtual void OnImageChanged() = 0;
+};
 
 class CanvasTool
 {
@@ -10,7 +35,30 @@ public:
     virtual void OnDragBegin(int x, int y, float pressure) = 0;
     virtual void OnDrag(int x, int y, float pressure) = 0;
     virtual void OnDragEnd(int x, int y, float pressure) = 0;
+    // Tablet moves of one display frame, by default each is a drag at the nearest pixel
+    virtual void OnDragSamples(const TabletSample* samples, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            OnDrag(qRound(samples[i].x), qRound(samples[i].y), samples[i].pressure);
+        }
+    }
+    // Tablet press and release, by default at the nearest pixel too
+    virtual void OnSampleBegin(const TabletSample& sample)
+    {
+        OnDragBegin(qRound(sample.x), qRound(sample.y), sample.pressure);
+    }
+    virtual void OnSampleEnd(const TabletSample& sample)
+    {
+        OnDragEnd(qRound(sample.x), qRound(sample.y), sample.pressure);
+    }
     virtual void OnPaint(QPainter& painter) = 0;
+    // Canvas area where the frame is shown with the edit in progress, empty if there is none
+    virtual QRect GetPreviewRect() { return QRect(); }
+    // Draws the frame pixels of the preview rect with the edit applied, in place of the frame
+    virtual void DrawPreview(QPainter& painter) {}
+    // Settings to record strokes of the tool with, false if its strokes are not recorded
+    virtual bool GetStrokeParams(StrokeToolParams& params) { return false; }
 };
 
 #endif
@@ -1,129 +1,609 @@
 #include "command.h"
 #include "rasterimageeditor.h"
 #include "rasterlayer.h"
-#include "cachedimage.h"
+#include "animationfile.h"
+#include "timeline.h"
+#include "undohistory.h"
+#include "imageutil.h"
+#include <QElapsedTimer>
+#include <string.h>
 
-DrawCommand::DrawCommand(RasterImageEditor* editor, QImage* newImage, QImage* oldImage)
-    :QUndoCommand("fill")
+static QByteArray ReadTile(const QImage* image, const QRect& rect)
+{
+    int rowBytes = rect.width() * 4;
+    QByteArray raw(rowBytes * rect.height(), 0);
+    char* dst = raw.data();
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
+    {
+        memcpy(dst, image->constScanLine(y) + rect.left() * 4, rowBytes);
+        dst += rowBytes;
+    }
+    return raw;
+}
+
+static void WriteTile(QImage* image, const QRect& rect, const char* src)
+{
+    int rowBytes = rect.width() * 4;
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
+    {
+        memcpy(image->scanLine(y) + rect.left() * 4, src, rowBytes);
+        src += rowBytes;
+    }
+}
+
+DrawCommand::DrawCommand(CanvasHost* editor, const QRect& rect)
+    :QUndoCommand("draw")
     ,mEditor(editor)
-    ,mNewImage(newImage)
-    ,mOldImage(oldImage)
+    ,mFrame(editor->GetFrame())
+    ,mHistory(editor->GetUndoHistory())
+    ,mBeforeId(-1)
+    ,mAfterId(-1)
+    ,mFinished(false)
 {
+    QImage* image = mFrame ? mFrame->GetImage() : NULL;
+    if (!image)
+    {
+        return;
+    }
+
+    mRect = rect.intersected(image->rect());
+    if (mRect.isEmpty())
+    {
+        return;
+    }
+
+    int x0 = mRect.left() / CANVAS_TILE_SIZE;
+    int y0 = mRect.top() / CANVAS_TILE_SIZE;
+    int x1 = mRect.right() / CANVAS_TILE_SIZE;
+    int y1 = mRect.bottom() / CANVAS_TILE_SIZE;
+    for (int ty = y0; ty <= y1; ++ty)
+    {
+        for (int tx = x0; tx <= x1; ++tx)
+        {
+            Tile tile;
+            tile.rect = QRect(tx * CANVAS_TILE_SIZE, ty * CANVAS_TILE_SIZE, CANVAS_TILE_SIZE, CANVAS_TILE_SIZE).intersected(mRect);
+            tile.before = ReadTile(image, tile.rect);
+            mTiles.push_back(tile);
+        }
+    }
 }
 
 DrawCommand::~DrawCommand()
 {
-    delete mOldImage;
-    delete mNewImage;
+    if (mHistory)
+    {
+        mHistory->Remove(mBeforeId);
+        mHistory->Remove(mAfterId);
+    }
+}
+
+void DrawCommand::Finish()
+{
+    QImage* image = mFrame ? mFrame->GetImage() : NULL;
+    if (mFinished || !image)
+    {
+        return;
+    }
+    mFinished = true;
+
+    // tiles the edit did not change are dropped, so memory follows the area touched
+    std::vector<Tile> tiles;
+    QByteArray before;
+    QByteArray after;
+    for (size_t i = 0; i < mTiles.size(); ++i)
+    {
+        Tile& tile = mTiles[i];
+        QByteArray data = ReadTile(image, tile.rect);
+        if (data == tile.before)
+        {
+            continue;
+        }
+        before.append(tile.before);
+        after.append(data);
+        tile.before = QByteArray();
+        tiles.push_back(tile);
+    }
+    mTiles.swap(tiles);
+
+    if (mHistory)
+    {
+        mBeforeId = mHistory->Store(before);
+        mAfterId = mHistory->Store(after);
+    }
+    else
+    {
+        mBefore = before;
+        mAfter = after;
+    }
 }
 
 void DrawCommand::undo()
 {
-    QPainter p(mEditor->GetImage());
-    p.setCompositionMode(QPainter::CompositionMode_Source);
-    p.drawImage(0, 0, *mOldImage);
-    mEditor->update();
+    Apply(false);
 }
 
 void DrawCommand::redo()
 {
-    QPainter p(mEditor->GetImage());
-    p.setCompositionMode(QPainter::CompositionMode_Source);
-    p.drawImage(0, 0 , *mNewImage);
-    mEditor->update();
-}
-
-
-//AddFrameCommand::AddFrameCommand(RasterImageEditor* editor, RasterLayer* rasterLayer, const QString& path, int frameIndex)
-//    :QUndoCommand("add frame")
-//    ,mEditor(editor)
-//    ,mRasterLayer(rasterLayer)
-//    ,mNewImage(NULL)
-//    ,mFrameIndex(frameIndex)
-//    ,mExecuted(false)
-//{
-//    mNewImage = new CachedImage(path, rasterLayer->GetWidth(), rasterLayer->GetHeight());
-//}
-
-//AddFrameCommand::~AddFrameCommand()
-//{
-//    if (!mExecuted)
-//    {
-//        delete mNewImage;
-//    }
-//}
-
-
-//void AddFrameCommand::undo()
-//{
-//    mRasterLayer->RemoveFrame(mFrameIndex);
-//    mRasterLayer->update();
-//    mExecuted = false;
-//}
-
-//void AddFrameCommand::redo()
-//{
-//    mRasterLayer->AddFrame(mFrameIndex, mNewImage);
-//    mRasterLayer->update();
-//    mExecuted = true;
-//}
-
-//RemoveFrameCommand::RemoveFrameCommand(RasterImageEditor* editor, RasterLayer* rasterLayer, CachedImage* image, int frameIndex)
-//    :QUndoCommand("add frame")
-//    ,mEditor(editor)
-//    ,mRasterLayer(rasterLayer)
-//    ,mImage(image)
-//    ,mFrameIndex(frameIndex)
-//    ,mExecuted(false)
-//{
-//}
-
-//RemoveFrameCommand::~RemoveFrameCommand()
-//{
-//    if (mExecuted)
-//    {
-//        delete mImage;
-//    }
-//}
-
-
-//void RemoveFrameCommand::undo()
-//{
-//    mRasterLayer->AddFrame(mFrameIndex, mImage);
-//    mRasterLayer->update();
-//    mExecuted = false;
-//}
-
-//void RemoveFrameCommand::redo()
-//{
-//    mRasterLayer->RemoveFrame(mFrameIndex);
-//    mRasterLayer->update();
-//    mExecuted = true;
-//}
-
-
-ModifyExposureCommand::ModifyExposureCommand(RasterImageEditor* editor, RasterLayer* rasterLayer, int frameIndex, int delta)
-    :QUndoCommand("modify exposure")
+    Apply(true);
+}
+
+void DrawCommand::Apply(bool after)
+{
+    RasterFrameModel* frame = mFrame;
+    if (!frame || !mFinished)
+    {
+        return;
+    }
+
+    QByteArray data;
+    if (mHistory)
+    {
+        data = mHistory->Load(after ? mAfterId : mBeforeId);
+    }
+    else
+    {
+        data = after ? mAfter : mBefore;
+    }
+
+    QImage* image = frame->GetImage();
+    int offset = 0;
+    for (size_t i = 0; i < mTiles.size(); ++i)
+    {
+        const QRect& rect = mTiles[i].rect;
+        int size = rect.width() * rect.height() * 4;
+        if (offset + size > data.size())
+        {
+            break;
+        }
+        WriteTile(image, rect, data.constData() + offset);
+        offset += size;
+    }
+    frame->UpdateBounds(mRect);
+    mEditor->OnImageChanged();
+}
+
+
+// A new snapshot is taken before the edit once this many edits or this many ms of drawing
+// would have to be replayed from the last one, which bounds the cost of an undo
+#define REPLAY_SNAPSHOT_INTERVAL 16
+#define REPLAY_SNAPSHOT_COST 50
+
+class ReplayChain
+{
+public:
+    ReplayChain(RasterFrameModel* frame, UndoHistory* history);
+    ~ReplayChain();
+
+    // False once the frame was changed by something else than the chain
+    bool Continues() const { return mFrame->GetVersion() == mVersion; }
+    // Drops the undone edits and returns the id of the new one
+    int Append(RasterEdit* edit);
+    void Redo(int id);
+    void Undo(int id);
+    // The command of the edit is gone, edits no command can undo any more are freed
+    void Release(int id);
+
+private:
+    struct Entry
+    {
+        int id;
+        QSharedPointer<RasterEdit> edit;
+        bool alive;
+        // ms the last Draw took
+        qint64 cost;
+        // Bounds area of the frame before the edit, if snapshotted
+        bool hasSnapshot;
+        QRect snapshotRect;
+        int snapshotId;
+        QByteArray snapshot;
+    };
+
+    void TakeSnapshot(Entry& entry);
+    void RestoreSnapshot(const Entry& entry, const QRect& rect);
+    void FreeSnapshot(Entry& entry);
+    void Draw(Entry& entry);
+    int Find(int id) const;
+
+    RasterFrameModel* mFrame;
+    UndoHistory* mHistory;
+    // Oldest first, ids grow
+    std::vector<Entry> mEntries;
+    // The first mApplied entries are on the frame
+    int mApplied;
+    int mNextId;
+    int mVersion;
+};
+
+ReplayChain::ReplayChain(RasterFrameModel* frame, UndoHistory* history)
+    :mFrame(frame)
+    ,mHistory(history)
+    ,mApplied(0)
+    ,mNextId(0)
+    ,mVersion(frame->GetVersion())
+{
+}
+
+ReplayChain::~ReplayChain()
+{
+    for (size_t i = 0; i < mEntries.size(); ++i)
+    {
+        FreeSnapshot(mEntries[i]);
+    }
+}
+
+int ReplayChain::Append(RasterEdit* edit)
+{
+    while ((int)mEntries.size() > mApplied)
+    {
+        FreeSnapshot(mEntries.back());
+        mEntries.pop_back();
+    }
+
+    int count = 0;
+    qint64 cost = 0;
+    for (int i = (int)mEntries.size() - 1; i >= 0; --i)
+    {
+        ++count;
+        cost += mEntries[i].cost;
+        if (mEntries[i].hasSnapshot)
+        {
+            break;
+        }
+    }
+
+    Entry entry;
+    entry.id = mNextId++;
+    entry.edit = QSharedPointer<RasterEdit>(edit);
+    entry.alive = true;
+    entry.cost = 0;
+    entry.hasSnapshot = false;
+    entry.snapshotId = -1;
+    if (mEntries.empty() || count >= REPLAY_SNAPSHOT_INTERVAL || cost >= REPLAY_SNAPSHOT_COST)
+    {
+        TakeSnapshot(entry);
+    }
+    mEntries.push_back(entry);
+    return entry.id;
+}
+
+void ReplayChain::Redo(int id)
+{
+    int i = Find(id);
+    if (i < 0 || i != mApplied)
+    {
+        return;
+    }
+
+    Entry& entry = mEntries[i];
+    Draw(entry);
+    mFrame->UpdateBounds(entry.edit->GetRect());
+    mApplied = i + 1;
+    mVersion = mFrame->GetVersion();
+}
+
+void ReplayChain::Undo(int id)
+{
+    int i = Find(id);
+    if (i < 0 || i + 1 != mApplied)
+    {
+        return;
+    }
+
+    int first = i;
+    while (first > 0 && !mEntries[first].hasSnapshot)
+    {
+        --first;
+    }
+
+    // only the area of the edits since the snapshot differs from it
+    QRect rect;
+    for (int j = first; j <= i; ++j)
+    {
+        rect |= mEntries[j].edit->GetRect();
+    }
+    RestoreSnapshot(mEntries[first], rect);
+    for (int j = first; j < i; ++j)
+    {
+        Draw(mEntries[j]);
+    }
+    mFrame->UpdateBounds(rect);
+    mApplied = i;
+    mVersion = mFrame->GetVersion();
+}
+
+void ReplayChain::Release(int id)
+{
+    int i = Find(id);
+    if (i < 0)
+    {
+        return;
+    }
+    mEntries[i].alive = false;
+
+    int first = 0;
+    while (first < (int)mEntries.size() && !mEntries[first].alive)
+    {
+        ++first;
+    }
+    if (first == (int)mEntries.size())
+    {
+        return;
+    }
+
+    // the oldest command left still needs the snapshot before it and the edits in between
+    while (first > 0 && !mEntries[first].hasSnapshot)
+    {
+        --first;
+    }
+    for (int j = 0; j < first; ++j)
+    {
+        FreeSnapshot(mEntries[j]);
+    }
+    mEntries.erase(mEntries.begin(), mEntries.begin() + first);
+    mApplied = qMax(0, mApplied - first);
+}
+
+void ReplayChain::TakeSnapshot(Entry& entry)
+{
+    QImage* image = mFrame->GetImage();
+    if (!image)
+    {
+        return;
+    }
+
+    entry.hasSnapshot = true;
+    entry.snapshotRect = mFrame->GetBounds().intersected(image->rect());
+    if (entry.snapshotRect.isEmpty())
+    {
+        return;
+    }
+    QByteArray data = ReadTile(image, entry.snapshotRect);
+    if (mHistory)
+    {
+        entry.snapshotId = mHistory->Store(data);
+    }
+    else
+    {
+        entry.snapshot = data;
+    }
+}
+
+void ReplayChain::RestoreSnapshot(const Entry& entry, const QRect& rect)
+{
+    QImage* image = mFrame->GetImage();
+    QRect area = rect.intersected(image->rect());
+    ClearRect(image, area);
+
+    // pixels outside the snapshot rect were transparent
+    QRect copy = area.intersected(entry.snapshotRect);
+    if (copy.isEmpty())
+    {
+        return;
+    }
+
+    QByteArray data = mHistory ? mHistory->Load(entry.snapshotId) : entry.snapshot;
+    int rowBytes = entry.snapshotRect.width() * 4;
+    if (data.size() != rowBytes * entry.snapshotRect.height())
+    {
+        return;
+    }
+    const char* src = data.constData() + (copy.top() - entry.snapshotRect.top()) * rowBytes
+            + (copy.left() - entry.snapshotRect.left()) * 4;
+    for (int y = copy.top(); y <= copy.bottom(); ++y)
+    {
+        memcpy(image->scanLine(y) + copy.left() * 4, src, copy.width() * 4);
+        src += rowBytes;
+    }
+}
+
+void ReplayChain::FreeSnapshot(Entry& entry)
+{
+    if (mHistory && entry.snapshotId >= 0)
+    {
+        mHistory->Remove(entry.snapshotId);
+    }
+    entry.hasSnapshot = false;
+    entry.snapshotId = -1;
+    entry.snapshot = QByteArray();
+}
+
+void ReplayChain::Draw(Entry& entry)
+{
+    QElapsedTimer timer;
+    timer.start();
+    entry.edit->Draw(mFrame->GetImage());
+    entry.cost = timer.elapsed();
+}
+
+int ReplayChain::Find(int id) const
+{
+    int lo = 0;
+    int hi = (int)mEntries.size() - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (mEntries[mid].id == id)
+        {
+            return mid;
+        }
+        if (mEntries[mid].id < id)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+ReplayCommand::ReplayCommand(CanvasHost* editor, RasterEdit* edit)
+    :QUndoCommand("draw")
     ,mEditor(editor)
+    ,mId(-1)
+{
+    RasterFrameModel* frame = editor->GetFrame();
+    if (!frame || !frame->GetImage())
+    {
+        delete edit;
+        return;
+    }
+
+    mChain = frame->GetReplayChain();
+    if (!mChain || !mChain->Continues())
+    {
+        mChain = QSharedPointer<ReplayChain>(new ReplayChain(frame, editor->GetUndoHistory()));
+        frame->SetReplayChain(mChain);
+    }
+    mId = mChain->Append(edit);
+}
+
+ReplayCommand::~ReplayCommand()
+{
+    if (mChain)
+    {
+        mChain->Release(mId);
+    }
+}
+
+void ReplayCommand::undo()
+{
+    if (mChain)
+    {
+        mChain->Undo(mId);
+        Update();
+    }
+}
+
+void ReplayCommand::redo()
+{
+    if (mChain)
+    {
+        mChain->Redo(mId);
+        Update();
+    }
+}
+
+void ReplayCommand::Update()
+{
+    mEditor->OnImageChanged();
+}
+
+
+FrameListCommand::FrameListCommand(const QString& text, RasterLayer* rasterLayer)
+    :QUndoCommand(text)
     ,mRasterLayer(rasterLayer)
+    ,mExecuted(false)
+    ,mDone(false)
+{
+}
+
+FrameListCommand::~FrameListCommand()
+{
+    if (mDone)
+    {
+        DeleteMissing(mBefore, mAfter);
+    }
+    else
+    {
+        DeleteMissing(mAfter, mBefore);
+    }
+}
+
+void FrameListCommand::undo()
+{
+    Write(mBefore);
+    mDone = false;
+}
+
+void FrameListCommand::redo()
+{
+    if (!mExecuted)
+    {
+        Read(mBefore);
+        Execute(mRasterLayer->GetModel());
+        Read(mAfter);
+        mExecuted = true;
+        mRasterLayer->UpdateFrames();
+    }
+    else
+    {
+        Write(mAfter);
+    }
+    mDone = true;
+}
+
+void FrameListCommand::Read(std::vector<FrameState>& state)
+{
+    std::vector<RasterFrameModel*>& frames = mRasterLayer->GetModel()->GetFrames();
+    state.resize(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        state[i].frame = frames[i];
+        state[i].exposure = frames[i]->GetExposure();
+    }
+}
+
+void FrameListCommand::Write(const std::vector<FrameState>& state)
+{
+    std::vector<RasterFrameModel*>& frames = mRasterLayer->GetModel()->GetFrames();
+    frames.resize(state.size());
+    for (size_t i = 0; i < state.size(); ++i)
+    {
+        frames[i] = state[i].frame;
+        frames[i]->SetExposure(state[i].exposure);
+    }
+    mRasterLayer->UpdateFrames();
+}
+
+void FrameListCommand::DeleteMissing(const std::vector<FrameState>& from, const std::vector<FrameState>& to)
+{
+    for (size_t i = 0; i < from.size(); ++i)
+    {
+        bool found = false;
+        for (size_t j = 0; j < to.size() && !found; ++j)
+        {
+            found = to[j].frame == from[i].frame;
+        }
+        if (!found)
+        {
+            delete from[i].frame;
+        }
+    }
+}
+
+AddFrameCommand::AddFrameCommand(RasterLayer* rasterLayer, int frameIndex)
+    :FrameListCommand("add frame", rasterLayer)
     ,mFrameIndex(frameIndex)
-    ,mDelta(delta)
 {
 }
 
-ModifyExposureCommand::~ModifyExposureCommand()
+void AddFrameCommand::Execute(RasterLayerModel* layer)
+{
+    layer->AddFrame(mFrameIndex);
+}
+
+RemoveFrameCommand::RemoveFrameCommand(RasterLayer* rasterLayer, int frameIndex)
+    :FrameListCommand("remove frame", rasterLayer)
+    ,mFrameIndex(frameIndex)
 {
 }
 
+void RemoveFrameCommand::Execute(RasterLayerModel* layer)
+{
+    // the frame stays alive in the command, see FrameListCommand
+    layer->RemoveFrame(mFrameIndex);
+}
 
-void ModifyExposureCommand::undo()
+ModifyExposureCommand::ModifyExposureCommand(RasterLayer* rasterLayer, int frameIndex, int delta)
+    :FrameListCommand("modify exposure", rasterLayer)
+    ,mFrameIndex(frameIndex)
+    ,mDelta(delta)
 {
-    mRasterLayer->ModExposure(mFrameIndex, -mDelta);
-    mRasterLayer->update();
 }
 
-void ModifyExposureCommand::redo()
+void ModifyExposureCommand::Execute(RasterLayerModel* layer)
 {
-    mRasterLayer->ModExposure(mFrameIndex, mDelta);
-    mRasterLayer->update();
+    layer->ModExposure(mFrameIndex, mDelta);
 }
@@ -4,69 +4,153 @@
 #include <QWidget>
 #include <QPainter>
 #include <openglrenderer.h>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <vector>
 
-class RasterImageEditor;
+class CanvasHost;
 class RasterLayer;
-class CachedImage;
+class RasterLayerModel;
+class RasterFrameModel;
+class UndoHistory;
+class ReplayChain;
 
+// Undo record of a raster edit holding only the tiles inside the damaged rect, before and after.
+// Create it before drawing into the editor image, call Finish once the edit is drawn, then push it.
+// The pixels live in the editor's UndoHistory, which keeps them within its memory budget.
 class DrawCommand: public QUndoCommand
 {
 public:
-    DrawCommand(RasterImageEditor* editor, QImage* newImage, QImage* oldImage);
+    DrawCommand(CanvasHost* editor, const QRect& rect);
     ~DrawCommand();
+    void Finish();
     void undo();
     void redo();
 
 private:
-    RasterImageEditor* mEditor;
-    QImage* mNewImage;
-    QImage* mOldImage;
+    struct Tile
+    {
+        // Part of a CANVAS_TILE_SIZE cell of the image grid inside the damaged rect
+        QRect rect;
+        // Rows of rect until Finish
+        QByteArray before;
+    };
 
+    void Apply(bool after);
+
+    CanvasHost* mEditor;
+    // Frame the edit was drawn on, frame commands keep it alive while this can be undone
+    RasterFrameModel* mFrame;
+    UndoHistory* mHistory;
+    // Damaged area, pixels outside are not changed by the edit
+    QRect mRect;
+    // Changed tiles, their rows are stored one after another in tile order
+    std::vector<Tile> mTiles;
+    int mBeforeId;
+    int mAfterId;
+    // Used instead of mHistory when the editor has none
+    QByteArray mBefore;
+    QByteArray mAfter;
+    bool mFinished;
+};
+
+// Input of a raster edit. Draw must put down the same pixels every time it is given the same image.
+class RasterEdit
+{
+public:
+    virtual ~RasterEdit() {}
+    // Area Draw may change
+    virtual QRect GetRect() const = 0;
+    virtual void Draw(QImage* image) const = 0;
+};
+
+// Undo record of a raster edit kept as its input instead of pixels. Consecutive edits of a frame share
+// a chain which snapshots the frame now and then; undo restores the nearest snapshot and replays the
+// edits after it. Push it instead of drawing the edit, redo draws it.
+class ReplayCommand: public QUndoCommand
+{
+public:
+    // Takes ownership of edit
+    ReplayCommand(CanvasHost* editor, RasterEdit* edit);
+    ~ReplayCommand();
+    void undo();
+    void redo();
+
+private:
+    void Update();
+
+    CanvasHost* mEditor;
+    QSharedPointer<ReplayChain> mChain;
+    // Edit in the chain
+    int mId;
 };
 
-//class AddFrameCommand: public QUndoCommand
-//{
-//public:
-//    AddFrameCommand(RasterImageEditor* editor, RasterLayer* rasterLayer, const QString& path, int frameIndex);
-//    ~AddFrameCommand();
-//    void undo();
-//    void redo();
-
-//private:
-//    RasterImageEditor* mEditor;
-//    RasterLayer* mRasterLayer;
-//    CachedImage* mNewImage;
-//    int mFrameIndex;
-//    bool mExecuted;
-//};
-
-//class RemoveFrameCommand: public QUndoCommand
-//{
-//public:
-//    RemoveFrameCommand(RasterImageEditor* editor, RasterLayer* rasterLayer, CachedImage* image, int frameIndex);
-//    ~RemoveFrameCommand();
-//    void undo();
-//    void redo();
-
-//private:
-//    RasterImageEditor* mEditor;
-//    RasterLayer* mRasterLayer;
-//    CachedImage* mImage;
-//    int mFrameIndex;
-//    bool mExecuted;
-//};
-
-class ModifyExposureCommand: public QUndoCommand
+// Undo record of a change to the frame list of a raster layer. Frames move in and out of the layer
+// as they are, without copying pixels; the command owns the ones its current state leaves out.
+class FrameListCommand: public QUndoCommand
 {
 public:
-    ModifyExposureCommand(RasterImageEditor* editor, RasterLayer* rasterLayer, int frameIndex, int delta);
-    ~ModifyExposureCommand();
+    FrameListCommand(const QString& text, RasterLayer* rasterLayer);
+    ~FrameListCommand();
     void undo();
     void redo();
 
+protected:
+    // Changes the frame list, only the first redo calls it
+    virtual void Execute(RasterLayerModel* layer) = 0;
+
 private:
-    RasterImageEditor* mEditor;
+    struct FrameState
+    {
+        RasterFrameModel* frame;
+        int exposure;
+    };
+
+    void Read(std::vector<FrameState>& state);
+    void Write(const std::vector<FrameState>& state);
+    // Deletes the frames of from which are not in to
+    static void DeleteMissing(const std::vector<FrameState>& from, const std::vector<FrameState>& to);
+
     RasterLayer* mRasterLayer;
+    std::vector<FrameState> mBefore;
+    std::vector<FrameState> mAfter;
+    bool mExecuted;
+    bool mDone;
+};
+
+class AddFrameCommand: public FrameListCommand
+{
+public:
+    AddFrameCommand(RasterLayer* rasterLayer, int frameIndex);
+
+protected:
+    void Execute(RasterLayerModel* layer);
+
+private:
+    int mFrameIndex;
+};
+
+class RemoveFrameCommand: public FrameListCommand
+{
+public:
+    RemoveFrameCommand(RasterLayer* rasterLayer, int frameIndex);
+
+protected:
+    void Execute(RasterLayerModel* layer);
+
+private:
+    int mFrameIndex;
+};
+
+class ModifyExposureCommand: public FrameListCommand
+{
+public:
+    ModifyExposureCommand(RasterLayer* rasterLayer, int frameIndex, int delta);
+
+protected:
+    void Execute(RasterLayerModel* layer);
+
+private:
     int mFrameIndex;
     int mDelta;
 };
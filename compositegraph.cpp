@@ -0,0 +1,304 @@
+#include "compositegraph.h"
+#include "imageutil.h"
+#include "layercache.h"
+#include "parallel.h"
+#include <string.h>
+
+quint64 HashCombine(quint64 hash, qint64 value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        hash ^= (quint64)(value >> (i * 8)) & 0xFF;
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static quint64 HashRect(quint64 hash, const QRect& rect)
+{
+    hash = HashCombine(hash, rect.x());
+    hash = HashCombine(hash, rect.y());
+    hash = HashCombine(hash, rect.width());
+    return HashCombine(hash, rect.height());
+}
+
+// Parameters of an adjustment, they key its cached result together with the input
+static quint64 HashAdjustment(quint64 hash, const CompositeLayer& layer)
+{
+    hash = HashCombine(hash, layer.adjustment);
+    if (layer.adjustment == CompositeLayer::AdjustmentBlur)
+    {
+        hash = HashCombine(hash, layer.blurRadius);
+    }
+    else if (layer.adjustment == CompositeLayer::AdjustmentTransform)
+    {
+        const float m[6] = { layer.transform.m00, layer.transform.m01, layer.transform.m03,
+                             layer.transform.m10, layer.transform.m11, layer.transform.m13 };
+        for (int i = 0; i < 6; ++i)
+        {
+            qint32 bits;
+            memcpy(&bits, &m[i], sizeof(bits));
+            hash = HashCombine(hash, bits);
+        }
+    }
+    return hash;
+}
+
+// Identity of the pixels of a layer snapshot, images change their cache key whenever they are edited
+static quint64 HashInput(quint64 hash, const CompositeLayer& layer)
+{
+    // a nested scene frame has the same identity before and after it is cached
+    hash = HashCombine(hash, layer.frameKey ? layer.frameKey : layer.image.cacheKey());
+    return HashRect(hash, layer.bounds);
+}
+
+// Identity of a layer snapshot with how it is blended and adjusted
+static quint64 HashLayer(quint64 hash, const CompositeLayer& layer)
+{
+    hash = HashInput(hash, layer);
+    hash = HashCombine(hash, layer.opacity);
+    hash = HashCombine(hash, layer.blendMode);
+    return HashAdjustment(hash, layer);
+}
+
+// Area of the input an adjustment reads to produce region
+static QRect GetInputRegion(const CompositeLayer& layer, const QRect& region)
+{
+    if (region.isEmpty())
+    {
+        return QRect();
+    }
+
+    if (layer.adjustment == CompositeLayer::AdjustmentBlur)
+    {
+        int extent = GetBlurExtent(layer.blurRadius);
+        return region.adjusted(-extent, -extent, extent, extent);
+    }
+
+    // inverse of the affine part
+    const Matrix4& m = layer.transform;
+    float det = m.m00 * m.m11 - m.m01 * m.m10;
+    if (det == 0.0f)
+    {
+        return QRect();
+    }
+    Matrix4 inverse;
+    inverse.m00 = m.m11 / det;
+    inverse.m01 = -m.m01 / det;
+    inverse.m10 = -m.m10 / det;
+    inverse.m11 = m.m00 / det;
+    inverse.m03 = -(inverse.m00 * m.m03 + inverse.m01 * m.m13);
+    inverse.m13 = -(inverse.m10 * m.m03 + inverse.m11 * m.m13);
+    return TransformRect(region, inverse);
+}
+
+// Area an adjustment of input can cover
+static QRect GetOutputRegion(const CompositeLayer& layer, const QRect& input)
+{
+    if (layer.adjustment == CompositeLayer::AdjustmentBlur)
+    {
+        int extent = GetBlurExtent(layer.blurRadius);
+        return input.adjusted(-extent, -extent, extent, extent);
+    }
+    return TransformRect(input, layer.transform);
+}
+
+// Area a layer blended over rect leaves possibly non-transparent
+static QRect BlendBounds(const QRect& bounds, const QRect& rect, BlendMode mode)
+{
+    return mode == BlendErase ? bounds : bounds.united(rect);
+}
+
+CompositeGraph::CompositeGraph(const std::vector<CompositeLayer>& layers)
+{
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        const CompositeLayer& layer = layers[i];
+        Node node;
+        node.layer = &layer;
+        node.branch = -1;
+        node.key = 0;
+
+        if (layer.adjustment != CompositeLayer::AdjustmentNone && layer.image.isNull())
+        {
+            node.type = NodeAdjustBeneath;
+            mChain.push_back((int)mNodes.size());
+            mNodes.push_back(node);
+            continue;
+        }
+
+        if (layer.adjustment != CompositeLayer::AdjustmentNone)
+        {
+            node.type = NodeAdjust;
+            // the input hashed with the parameters, as LayerCache keys are
+            node.key = HashAdjustment(HashInput(0, layer), layer);
+        }
+        else if (layer.frameKey && layer.image.isNull())
+        {
+            node.type = NodeScene;
+            node.key = layer.frameKey;
+        }
+        else
+        {
+            // a scene frame cached at snapshot time is cropped like the layer bounds
+            node.type = NodeLayer;
+            node.image = layer.image;
+            node.rect = layer.bounds;
+            node.origin = layer.frameKey ? layer.bounds.topLeft() : QPoint(0, 0);
+        }
+        int branch = (int)mNodes.size();
+        mNodes.push_back(node);
+
+        Node link;
+        link.type = NodeBlend;
+        link.layer = &layer;
+        link.branch = branch;
+        link.key = 0;
+        mChain.push_back((int)mNodes.size());
+        mNodes.push_back(link);
+    }
+}
+
+void CompositeGraph::Demand(const QRect& region)
+{
+    mPending.clear();
+    QRect demand = region.intersected(mFrame);
+    for (int i = (int)mChain.size() - 1; i >= 0; --i)
+    {
+        Node& link = mNodes[mChain[i]];
+        link.demand = demand;
+        if (demand.isEmpty())
+        {
+            continue;
+        }
+
+        if (link.type == NodeAdjustBeneath)
+        {
+            demand = demand.united(GetInputRegion(*link.layer, demand)).intersected(mFrame);
+            continue;
+        }
+
+        Node& branch = mNodes[link.branch];
+        branch.demand = demand;
+        if (branch.type == NodeAdjust)
+        {
+            if (GetOutputRegion(*branch.layer, branch.layer->bounds).intersects(demand))
+            {
+                mPending.push_back(link.branch);
+            }
+        }
+        else if (branch.type == NodeScene)
+        {
+            if (branch.layer->bounds.intersects(demand))
+            {
+                mPending.push_back(link.branch);
+            }
+        }
+    }
+}
+
+void CompositeGraph::EvaluateBranch(Node& node)
+{
+    const CompositeLayer& layer = *node.layer;
+    if (layer.cache->Find(node.key, node.image, node.rect))
+    {
+        node.origin = node.rect.topLeft();
+        return;
+    }
+
+    if (node.type == NodeAdjust)
+    {
+        if (layer.adjustment == CompositeLayer::AdjustmentBlur)
+        {
+            node.image = BlurRect(layer.image, layer.bounds, layer.blurRadius, node.rect);
+        }
+        else
+        {
+            node.rect = TransformRect(layer.bounds, layer.transform).intersected(mFrame);
+            node.image = TransformImage(layer.image, layer.bounds, layer.transform, node.rect);
+        }
+    }
+    else
+    {
+        // nested scenes are cached whole, whatever part of them is asked for
+        QImage full(layer.bounds.width(), layer.bounds.height(), QImage::Format_RGBA8888);
+        full.fill(0);
+        CompositeGraph graph(*layer.children);
+        node.rect = graph.Evaluate(&full, QRect(), full.rect());
+        node.image = node.rect.isEmpty() ? QImage() : full.copy(node.rect);
+    }
+    node.origin = node.rect.topLeft();
+    // two threads missing the same key both compute it, the later insert wins
+    layer.cache->Insert(node.key, node.image, node.rect);
+}
+
+void CompositeGraph::EvaluateBranches(int begin, int end, void* context)
+{
+    CompositeGraph* graph = (CompositeGraph*)context;
+    for (int i = begin; i < end; ++i)
+    {
+        graph->EvaluateBranch(graph->mNodes[graph->mPending[i]]);
+    }
+}
+
+QRect CompositeGraph::Evaluate(QImage* result, const QRect& dirtyRect, const QRect& region)
+{
+    mFrame = result->rect();
+    Demand(region);
+    ParallelFor((int)mPending.size(), EvaluateBranches, this, 1);
+
+    ClearRect(result, dirtyRect);
+    QRect bounds;
+    // Identity of what has been drawn so far, keys adjustments of everything beneath
+    quint64 key = HashCombine(HASH_SEED, result->width());
+    key = HashCombine(key, result->height());
+    QRect below;
+
+    for (size_t i = 0; i < mChain.size(); ++i)
+    {
+        Node& link = mNodes[mChain[i]];
+        const CompositeLayer& layer = *link.layer;
+        if (link.type == NodeBlend)
+        {
+            const Node& branch = mNodes[link.branch];
+            QRect area = branch.rect.intersected(link.demand);
+            if (!branch.image.isNull() && !area.isEmpty())
+            {
+                BlendImage(result, area.topLeft(), branch.image, area.translated(-branch.origin), layer.opacity, layer.blendMode);
+                bounds = BlendBounds(bounds, area, layer.blendMode);
+            }
+        }
+        else if (!link.demand.isEmpty())
+        {
+            // the composite beneath is final where the link below was asked for
+            QRect sourceBounds = bounds.intersected(below);
+            quint64 adjustedKey = HashAdjustment(HashRect(key, sourceBounds), layer);
+            QRect rect;
+            QImage adjusted;
+            if (!sourceBounds.isEmpty() && !layer.cache->Find(adjustedKey, adjusted, rect))
+            {
+                if (layer.adjustment == CompositeLayer::AdjustmentBlur)
+                {
+                    adjusted = BlurRect(*result, sourceBounds, layer.blurRadius, rect);
+                }
+                else
+                {
+                    // what is beneath is replaced, so the result also covers where it was
+                    rect = TransformRect(sourceBounds, layer.transform).intersected(mFrame).united(sourceBounds);
+                    adjusted = TransformImage(*result, sourceBounds, layer.transform, rect);
+                }
+                layer.cache->Insert(adjustedKey, adjusted, rect);
+            }
+            QRect area = rect.intersected(link.demand);
+            if (!adjusted.isNull() && !area.isEmpty())
+            {
+                // replace with opacity mixes the result into what is beneath instead of over it
+                BlendImage(result, area.topLeft(), adjusted, area.translated(-rect.topLeft()), layer.opacity, BlendReplace);
+                bounds = bounds.united(area);
+            }
+        }
+        key = HashLayer(key, layer);
+        below = link.demand;
+    }
+    return bounds;
+}
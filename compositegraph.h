@@ -0,0 +1,73 @@
+#ifndef COMPOSITEGRAPH_H
+#define COMPOSITEGRAPH_H
+
+#include <QImage>
+#include <QRect>
+#include <vector>
+#include "animationfile.h"
+
+#define HASH_SEED Q_UINT64_C(14695981039346656037)
+
+// FNV-1a step over the bytes of value
+quint64 HashCombine(quint64 hash, qint64 value);
+
+// The layer snapshots of a frame compiled into a DAG of compositing nodes.
+// Each layer is a link blending onto the composite of the links beneath it. Its second input
+// is a branch: the layer image, an adjustment of a source layer or a nested scene frame.
+// Branches do not depend on each other and are evaluated in parallel on the pool, then the
+// chain runs bottom up. Adjustment and scene nodes keep their output in the layer's cache,
+// keyed by a hash of their inputs and parameters.
+// Evaluation is demand driven. The requested region is pulled down the chain, growing where an
+// adjustment reads around it, and nodes outside it are not evaluated.
+class CompositeGraph
+{
+public:
+    // layers must outlive the graph
+    explicit CompositeGraph(const std::vector<CompositeLayer>& layers);
+
+    // Clears dirtyRect of result and composites the region of it. Returns the bounds of what
+    // was drawn, which may reach past region with pixels that are not final.
+    QRect Evaluate(QImage* result, const QRect& dirtyRect, const QRect& region);
+
+private:
+    enum NodeType
+    {
+        // Branches
+        NodeLayer,
+        NodeAdjust,
+        NodeScene,
+        // Links of the chain
+        NodeBlend,
+        NodeAdjustBeneath
+    };
+
+    struct Node
+    {
+        NodeType type;
+        const CompositeLayer* layer;
+        // Branch of a blend link
+        int branch;
+        // Content key of a branch output
+        quint64 key;
+        // Area of the output the nodes above read
+        QRect demand;
+        // Output of a branch, covering rect of the frame. Pixel (0, 0) is at origin.
+        QImage image;
+        QRect rect;
+        QPoint origin;
+    };
+
+    void Demand(const QRect& region);
+    void EvaluateBranch(Node& node);
+    static void EvaluateBranches(int begin, int end, void* context);
+
+private:
+    std::vector<Node> mNodes;
+    // Links bottom to top, indices into mNodes
+    std::vector<int> mChain;
+    // Branches to evaluate for the current region
+    std::vector<int> mPending;
+    QRect mFrame;
+};
+
+#endif // COMPOSITEGRAPH_H
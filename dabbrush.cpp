@@ -0,0 +1,351 @@
+#include "dabbrush.h"
+#include <math.h>
+#include <string.h>
+
+// Dabs are never closer than this, in pixels
+#define DAB_MIN_STEP 0.5f
+
+static unsigned int Hash(int x, int y)
+{
+    unsigned int h = (unsigned int)x * 374761393u + (unsigned int)y * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+// Value noise in [0, 1] with a lattice point every cell pixels, repeating every period cells
+static float Noise(int x, int y, int cell, int period)
+{
+    float gx = (x + 0.5f) / cell;
+    float gy = (y + 0.5f) / cell;
+    int ix = (int)floorf(gx);
+    int iy = (int)floorf(gy);
+    float fx = gx - ix;
+    float fy = gy - iy;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fy = fy * fy * (3.0f - 2.0f * fy);
+
+    int x0 = ((ix % period) + period) % period;
+    int y0 = ((iy % period) + period) % period;
+    int x1 = (x0 + 1) % period;
+    int y1 = (y0 + 1) % period;
+    float v00 = (Hash(x0, y0) & 0xFF) / 255.0f;
+    float v10 = (Hash(x1, y0) & 0xFF) / 255.0f;
+    float v01 = (Hash(x0, y1) & 0xFF) / 255.0f;
+    float v11 = (Hash(x1, y1) & 0xFF) / 255.0f;
+    float top = v00 + (v10 - v00) * fx;
+    float bottom = v01 + (v11 - v01) * fx;
+    return top + (bottom - top) * fy;
+}
+
+static float Clamp01(float v)
+{
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+// Padded index of the texel at or before coordinate t of a level, and the 8 bit weight of the one after.
+// Outside the level both texels read the transparent border.
+static void GetTexel(float t, int size, int& index, int& weight)
+{
+    float f = floorf(t);
+    int i = (int)f;
+    if (i < -1)
+    {
+        index = 0;
+        weight = 0;
+    }
+    else if (i >= size)
+    {
+        index = size;
+        weight = 256;
+    }
+    else
+    {
+        index = i + 1;
+        weight = (int)((t - f) * 256.0f + 0.5f);
+    }
+}
+
+const DabTip DabTip::sTips[BrushTipPencil] =
+{
+    DabTip(BrushTipRound),
+    DabTip(BrushTipTextured),
+    DabTip(BrushTipPencil)
+};
+
+DabTip::DabTip(BrushTip tip)
+    :mSpacing(0.1f)
+{
+    Level level;
+    level.size = DAB_TIP_MAX_SIZE;
+    level.mask.resize(level.size * level.size);
+    for (int y = 0; y < level.size; ++y)
+    {
+        for (int x = 0; x < level.size; ++x)
+        {
+            float dx = (x + 0.5f) * 2.0f / level.size - 1.0f;
+            float dy = (y + 0.5f) * 2.0f / level.size - 1.0f;
+            float rho = sqrtf(dx * dx + dy * dy);
+            float a;
+            if (tip == BrushTipTextured)
+            {
+                a = Clamp01((1.0f - rho) * 2.0f) * (0.3f + 0.7f * Noise(x, y, 8, 16));
+            }
+            else if (tip == BrushTipPencil)
+            {
+                // hard edge a texel wide, the grain makes the texture
+                a = Clamp01((1.0f - rho) * level.size * 0.5f);
+            }
+            else
+            {
+                a = Clamp01((1.0f - rho) / 0.3f);
+            }
+            level.mask[y * level.size + x] = (unsigned char)(a * 255.0f + 0.5f);
+        }
+    }
+    mLevels.push_back(level);
+
+    // each level is the 2x2 box average of the one above
+    while (mLevels.back().size > DAB_TIP_MIN_SIZE)
+    {
+        const Level& src = mLevels.back();
+        Level dst;
+        dst.size = src.size / 2;
+        dst.mask.resize(dst.size * dst.size);
+        for (int y = 0; y < dst.size; ++y)
+        {
+            const unsigned char* r0 = &src.mask[(y * 2) * src.size];
+            const unsigned char* r1 = r0 + src.size;
+            for (int x = 0; x < dst.size; ++x)
+            {
+                dst.mask[y * dst.size + x] = (unsigned char)((r0[x * 2] + r0[x * 2 + 1] + r1[x * 2] + r1[x * 2 + 1] + 2) / 4);
+            }
+        }
+        mLevels.push_back(dst);
+    }
+
+    for (size_t i = 0; i < mLevels.size(); ++i)
+    {
+        Level& level = mLevels[i];
+        int stride = level.size + 2;
+        std::vector<unsigned char> padded(stride * stride, 0);
+        for (int y = 0; y < level.size; ++y)
+        {
+            memcpy(&padded[(y + 1) * stride + 1], &level.mask[y * level.size], level.size);
+        }
+        level.mask.swap(padded);
+    }
+
+    if (tip == BrushTipTextured)
+    {
+        mSpacing = 0.2f;
+    }
+    else if (tip == BrushTipPencil)
+    {
+        mGrain.resize(DAB_GRAIN_SIZE * DAB_GRAIN_SIZE);
+        for (int y = 0; y < DAB_GRAIN_SIZE; ++y)
+        {
+            for (int x = 0; x < DAB_GRAIN_SIZE; ++x)
+            {
+                float g = 0.5f * Noise(x, y, 4, DAB_GRAIN_SIZE / 4) + 0.5f * (Hash(x, y) & 0xFF) / 255.0f;
+                mGrain[y * DAB_GRAIN_SIZE + x] = (unsigned char)(Clamp01(0.2f + g) * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+const DabTip* DabTip::Get(BrushTip tip)
+{
+    if (tip <= BrushTipOutline || tip > BrushTipPencil)
+    {
+        tip = BrushTipRound;
+    }
+    return &sTips[tip - BrushTipRound];
+}
+
+const DabTip::Level& DabTip::GetLevel(float diameter) const
+{
+    for (int i = (int)mLevels.size() - 1; i > 0; --i)
+    {
+        if (mLevels[i].size >= diameter)
+        {
+            return mLevels[i];
+        }
+    }
+    return mLevels[0];
+}
+
+DabBrush::DabBrush()
+    :mTip(NULL)
+    ,mBrushSize(1.0f)
+    ,mMode(BlendNormal)
+    ,mStarted(false)
+    ,mNext(0)
+    ,mDabCount(0)
+{
+    mLast.x = 0;
+    mLast.y = 0;
+    mLast.pressure = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        mColor[i] = 0;
+        mPremultiplied[i] = 0;
+    }
+}
+
+void DabBrush::Begin(BrushTip tip, float brushSize, const QColor& color, BlendMode mode)
+{
+    mTip = DabTip::Get(tip);
+    mBrushSize = brushSize;
+    mMode = mode;
+    mStarted = false;
+    mNext = 0;
+    mDabCount = 0;
+
+    mColor[0] = color.redF();
+    mColor[1] = color.greenF();
+    mColor[2] = color.blueF();
+    mColor[3] = color.alphaF();
+    // ARGB32 pixels are B, G, R, A in memory on the little endian targets this builds for
+    mPremultiplied[0] = mColor[2] * mColor[3];
+    mPremultiplied[1] = mColor[1] * mColor[3];
+    mPremultiplied[2] = mColor[0] * mColor[3];
+    mPremultiplied[3] = mColor[3];
+}
+
+float DabBrush::GetStep(float pressure) const
+{
+    float step = mTip->GetSpacing() * mBrushSize * pressure;
+    return step > DAB_MIN_STEP ? step : DAB_MIN_STEP;
+}
+
+QRect DabBrush::Stroke(QImage* image, const QPoint& origin, const StrokePoint* samples, int count)
+{
+    QRect rect;
+    if (!mTip)
+    {
+        return rect;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        const StrokePoint& p = samples[i];
+        if (!mStarted)
+        {
+            mStarted = true;
+            mLast = p;
+            Stamp(image, origin, p, rect);
+            mNext = GetStep(p.pressure);
+            continue;
+        }
+
+        float dx = p.x - mLast.x;
+        float dy = p.y - mLast.y;
+        float length = sqrtf(dx * dx + dy * dy);
+        while (mNext <= length)
+        {
+            float t = mNext / length;
+            StrokePoint dab;
+            dab.x = mLast.x + dx * t;
+            dab.y = mLast.y + dy * t;
+            dab.pressure = mLast.pressure + (p.pressure - mLast.pressure) * t;
+            Stamp(image, origin, dab, rect);
+            mNext += GetStep(dab.pressure);
+        }
+        mNext -= length;
+        mLast = p;
+    }
+    return rect;
+}
+
+void DabBrush::Stamp(QImage* image, const QPoint& origin, const StrokePoint& p, QRect& rect)
+{
+    float diameter = mBrushSize * p.pressure;
+    diameter = diameter > 1.0f ? diameter : 1.0f;
+    float left = p.x - origin.x() - diameter * 0.5f;
+    float top = p.y - origin.y() - diameter * 0.5f;
+    int x0 = (int)floorf(left);
+    int y0 = (int)floorf(top);
+    int x1 = (int)ceilf(left + diameter);
+    int y1 = (int)ceilf(top + diameter);
+    QRect dab = QRect(x0, y0, x1 - x0, y1 - y0).intersected(image->rect());
+    if (dab.isEmpty())
+    {
+        return;
+    }
+
+    ++mDabCount;
+    const DabTip::Level& level = mTip->GetLevel(diameter);
+    const unsigned char* mask = &level.mask[0];
+    const unsigned char* grain = mTip->GetGrain();
+    int size = level.size;
+    int stride = size + 2;
+    float scale = size / diameter;
+    // texel coordinates of the pixel centres, texel centres are at n + 0.5
+    float u0 = (dab.left() + 0.5f - left) * scale - 0.5f;
+    bool premultiplied = image->format() == QImage::Format_ARGB32_Premultiplied;
+    int width = dab.width();
+    mDab.resize(width);
+    mColumns.resize(width);
+    mWeights.resize(width);
+    for (int i = 0; i < width; ++i)
+    {
+        GetTexel(u0 + i * scale, size, mColumns[i], mWeights[i]);
+    }
+    unsigned char* coverage = &mDab[0];
+    const int* columns = &mColumns[0];
+    const int* weights = &mWeights[0];
+
+    for (int y = dab.top(); y <= dab.bottom(); ++y)
+    {
+        int ty;
+        int wy;
+        GetTexel((y + 0.5f - top) * scale - 0.5f, size, ty, wy);
+        const unsigned char* row0 = mask + ty * stride;
+        const unsigned char* row1 = row0 + stride;
+        for (int i = 0; i < width; ++i)
+        {
+            int tx = columns[i];
+            int wx = weights[i];
+            int c0 = row0[tx] * (256 - wx) + row0[tx + 1] * wx;
+            int c1 = row1[tx] * (256 - wx) + row1[tx + 1] * wx;
+            coverage[i] = (unsigned char)((c0 * (256 - wy) + c1 * wy + 32768) >> 16);
+        }
+        if (grain)
+        {
+            const unsigned char* grainRow = grain + ((y + origin.y()) & (DAB_GRAIN_SIZE - 1)) * DAB_GRAIN_SIZE;
+            int gx = dab.left() + origin.x();
+            for (int i = 0; i < width; ++i)
+            {
+                coverage[i] = (unsigned char)(coverage[i] * grainRow[(gx + i) & (DAB_GRAIN_SIZE - 1)] / 255);
+            }
+        }
+
+        unsigned char* dst = image->scanLine(y) + dab.left() * 4;
+        if (premultiplied)
+        {
+            KernelBlendColorPremultiplied(dst, coverage, width, mPremultiplied);
+        }
+        else
+        {
+            KernelBlendColor(dst, coverage, width, mColor, mMode);
+        }
+    }
+    rect |= dab;
+}
+
+QRect DabBrush::GetBounds(const std::vector<StrokePoint>& samples, float brushSize)
+{
+    QRect rect;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        const StrokePoint& p = samples[i];
+        float radius = brushSize * p.pressure * 0.5f;
+        radius = radius > 0.5f ? radius : 0.5f;
+        int x0 = (int)floorf(p.x - radius);
+        int y0 = (int)floorf(p.y - radius);
+        int x1 = (int)ceilf(p.x + radius);
+        int y1 = (int)ceilf(p.y + radius);
+        rect |= QRect(x0, y0, x1 - x0, y1 - y0);
+    }
+    return rect;
+}
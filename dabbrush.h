@@ -0,0 +1,102 @@
+#ifndef DABBRUSH_H
+#define DABBRUSH_H
+#include <QImage>
+#include <QRect>
+#include <QPoint>
+#include <QColor>
+#include <vector>
+#include "strokepoint.h"
+#include "pixelkernels.h"
+
+// Tip masks are built at this size and halved down to DAB_TIP_MIN_SIZE
+#define DAB_TIP_MAX_SIZE 128
+#define DAB_TIP_MIN_SIZE 4
+// Side of the tiling paper grain of the pencil tip
+#define DAB_GRAIN_SIZE 64
+
+enum BrushTip
+{
+    // Filled outline of the stroke, no dabs
+    BrushTipOutline,
+    BrushTipRound,
+    BrushTipTextured,
+    BrushTipPencil
+};
+
+// Coverage masks of one tip shape at a few mip levels, built once and shared.
+// All levels together are about 23 KB, so stamping stays in cache.
+class DabTip
+{
+public:
+    struct Level
+    {
+        int size;
+        // size + 2 texels square, the outer ones transparent so sampling needs no bounds checks
+        std::vector<unsigned char> mask;
+    };
+
+    static const DabTip* Get(BrushTip tip);
+
+    // Smallest level at least diameter pixels wide, the largest if none is
+    const Level& GetLevel(float diameter) const;
+    // Distance between dabs as a fraction of their diameter
+    float GetSpacing() const { return mSpacing; }
+    // Tiling grain in canvas space, multiplied into every dab. NULL if the tip has none.
+    const unsigned char* GetGrain() const { return mGrain.empty() ? NULL : &mGrain[0]; }
+
+private:
+    DabTip(BrushTip tip);
+
+private:
+    // One per tip with dabs, built before main so threads share them without locking
+    static const DabTip sTips[BrushTipPencil];
+
+    // Largest first
+    std::vector<Level> mLevels;
+    std::vector<unsigned char> mGrain;
+    float mSpacing;
+};
+
+// Stamps dabs of a tip along stroke samples, at a spacing which follows the pressure.
+// The spacing carries over between calls, so a stroke stamped piece by piece while it is
+// drawn gets the same dabs as when stamped at once.
+class DabBrush
+{
+public:
+    DabBrush();
+
+    void Begin(BrushTip tip, float brushSize, const QColor& color, BlendMode mode);
+    // Stamps the dabs along samples, continuing from the samples of the previous call.
+    // image is RGBA8888, or ARGB32_Premultiplied which is always blended normal.
+    // origin is the canvas position of the image's top left pixel. Returns the touched rect.
+    QRect Stroke(QImage* image, const QPoint& origin, const StrokePoint* samples, int count);
+    // Dabs stamped since Begin
+    int GetDabCount() const { return mDabCount; }
+
+    // Pixels the dabs along samples may touch
+    static QRect GetBounds(const std::vector<StrokePoint>& samples, float brushSize);
+
+private:
+    void Stamp(QImage* image, const QPoint& origin, const StrokePoint& p, QRect& rect);
+    float GetStep(float pressure) const;
+
+private:
+    const DabTip* mTip;
+    float mBrushSize;
+    // Straight RGBA for RGBA8888 images, premultiplied in memory order for premultiplied ones
+    float mColor[4];
+    float mPremultiplied[4];
+    BlendMode mMode;
+    bool mStarted;
+    StrokePoint mLast;
+    // Distance from mLast to the next dab
+    float mNext;
+    int mDabCount;
+    // One dab's coverage, reused for every stamp
+    std::vector<unsigned char> mDab;
+    // Padded texel column and 8 bit weight of the next column for each pixel of the dab
+    std::vector<int> mColumns;
+    std::vector<int> mWeights;
+};
+
+#endif // DABBRUSH_H
@@ -0,0 +1,311 @@
+#include "fastblur.h"
+#include "pixelkernels.h"
+#include "parallel.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#define BOX_COUNT 3
+// Columns of the vertical pass one task filters together
+#define BLUR_STRIP_WIDTH 32
+// Below this the boxes are too narrow to look gaussian and the exact kernel is cheap anyway
+#define FAST_BLUR_MIN_SIGMA 2.0f
+
+// Box sizes whose cascade has the variance of the gaussian, after Kovesi
+static void GetBoxRadii(float sigma, int radii[BOX_COUNT])
+{
+    double variance = 12.0 * sigma * sigma;
+    int wl = (int)floor(sqrt(variance / BOX_COUNT + 1.0));
+    if (wl % 2 == 0)
+    {
+        --wl;
+    }
+    if (wl < 1)
+    {
+        wl = 1;
+    }
+    int m = (int)floor((variance - BOX_COUNT * wl * wl - 4 * BOX_COUNT * wl - 3 * BOX_COUNT) / (-4.0 * wl - 4.0) + 0.5);
+    for (int i = 0; i < BOX_COUNT; ++i)
+    {
+        int size = i < m ? wl : wl + 2;
+        radii[i] = (size - 1) / 2;
+    }
+}
+
+struct FastBlurContext
+{
+    unsigned char* pixels;
+    int width;
+    int height;
+    int stride;
+    int radii[BOX_COUNT];
+    // Edge pixels repeated on each side so the cascade sees the same clamped input as one wide kernel
+    int padding;
+    // Premultiplied rows after the horizontal boxes
+    float* buffer;
+};
+
+static void BoxRows(int begin, int end, void* context)
+{
+    FastBlurContext* c = (FastBlurContext*)context;
+    int w = c->width;
+    int pad = c->padding;
+    int n = w + pad * 2;
+    std::vector<float> temp(n * 8);
+    float* a = &temp[0];
+    float* b = &temp[n * 4];
+    for (int y = begin; y < end; ++y)
+    {
+        KernelPremultiply(a + pad * 4, c->pixels + y * c->stride, w);
+        for (int x = 0; x < pad; ++x)
+        {
+            memcpy(a + x * 4, a + pad * 4, 4 * sizeof(float));
+            memcpy(a + (w + pad + x) * 4, a + (w + pad - 1) * 4, 4 * sizeof(float));
+        }
+        KernelBoxRow(b, a, n, c->radii[0]);
+        KernelBoxRow(a, b, n, c->radii[1]);
+        KernelBoxRow(b, a, n, c->radii[2]);
+        memcpy(c->buffer + y * w * 4, b + pad * 4, w * 4 * sizeof(float));
+    }
+}
+
+// Box along the columns of a strip of n pixels per row, a running sum of rows
+static void BoxColumns(float* out, const float* src, int height, int n, int radius, float* sum)
+{
+    int pitch = n * 4;
+    KernelScale(sum, src, n, (float)(radius + 1));
+    for (int i = 1; i <= radius; ++i)
+    {
+        int y = i < height ? i : height - 1;
+        KernelAccumulate(sum, src + y * pitch, n, 1.0f);
+    }
+
+    float scale = 1.0f / (2 * radius + 1);
+    for (int y = 0; y < height; ++y)
+    {
+        KernelScale(out + y * pitch, sum, n, scale);
+        int add = y + radius + 1;
+        int sub = y - radius;
+        add = add < height ? add : height - 1;
+        sub = sub > 0 ? sub : 0;
+        KernelSlide(sum, src + add * pitch, src + sub * pitch, n);
+    }
+}
+
+static void BoxStrips(int begin, int end, void* context)
+{
+    FastBlurContext* c = (FastBlurContext*)context;
+    int w = c->width;
+    int h = c->height;
+    int pad = c->padding;
+    int rows = h + pad * 2;
+    std::vector<float> temp((rows * 2 + 1) * BLUR_STRIP_WIDTH * 4);
+    float* a = &temp[0];
+    float* b = &temp[rows * BLUR_STRIP_WIDTH * 4];
+    float* sum = &temp[rows * BLUR_STRIP_WIDTH * 8];
+    for (int strip = begin; strip < end; ++strip)
+    {
+        int x = strip * BLUR_STRIP_WIDTH;
+        int n = w - x < BLUR_STRIP_WIDTH ? w - x : BLUR_STRIP_WIDTH;
+        int pitch = n * 4;
+        for (int y = 0; y < rows; ++y)
+        {
+            int sy = y - pad;
+            sy = sy < 0 ? 0 : (sy >= h ? h - 1 : sy);
+            memcpy(a + y * pitch, c->buffer + (sy * w + x) * 4, pitch * sizeof(float));
+        }
+
+        BoxColumns(b, a, rows, n, c->radii[0], sum);
+        BoxColumns(a, b, rows, n, c->radii[1], sum);
+        BoxColumns(b, a, rows, n, c->radii[2], sum);
+
+        for (int y = 0; y < h; ++y)
+        {
+            KernelUnpremultiply(c->pixels + y * c->stride + x * 4, b + (y + pad) * pitch, n);
+        }
+    }
+}
+
+void FastBlur(unsigned char* pixels, int width, int height, int stride, float sigma)
+{
+    if (width <= 0 || height <= 0 || sigma <= 0.0f)
+    {
+        return;
+    }
+    if (sigma < FAST_BLUR_MIN_SIGMA)
+    {
+        GaussianBlur(pixels, width, height, stride, sigma);
+        return;
+    }
+
+    std::vector<float> buffer((size_t)width * height * 4);
+    FastBlurContext context;
+    context.pixels = pixels;
+    context.width = width;
+    context.height = height;
+    context.stride = stride;
+    context.buffer = &buffer[0];
+    GetBoxRadii(sigma, context.radii);
+    context.padding = 0;
+    for (int i = 0; i < BOX_COUNT; ++i)
+    {
+        context.padding += context.radii[i];
+    }
+
+    ParallelFor(height, BoxRows, &context);
+    ParallelFor((width + BLUR_STRIP_WIDTH - 1) / BLUR_STRIP_WIDTH, BoxStrips, &context, 1);
+}
+
+struct GaussianContext
+{
+    unsigned char* pixels;
+    int width;
+    int height;
+    int stride;
+    int radius;
+    const float* weights;
+    float* buffer;
+};
+
+static void GaussianRows(int begin, int end, void* context)
+{
+    GaussianContext* c = (GaussianContext*)context;
+    int w = c->width;
+    int r = c->radius;
+    std::vector<float> padded((w + 2 * r) * 4);
+    for (int y = begin; y < end; ++y)
+    {
+        KernelPremultiply(&padded[r * 4], c->pixels + y * c->stride, w);
+        for (int x = 0; x < r; ++x)
+        {
+            memcpy(&padded[x * 4], &padded[r * 4], 4 * sizeof(float));
+            memcpy(&padded[(w + r + x) * 4], &padded[(w + r - 1) * 4], 4 * sizeof(float));
+        }
+
+        float* out = c->buffer + y * w * 4;
+        memset(out, 0, w * 4 * sizeof(float));
+        for (int k = -r; k <= r; ++k)
+        {
+            KernelAccumulate(out, &padded[(r + k) * 4], w, c->weights[k + r]);
+        }
+    }
+}
+
+static void GaussianColumns(int begin, int end, void* context)
+{
+    GaussianContext* c = (GaussianContext*)context;
+    int w = c->width;
+    int h = c->height;
+    int r = c->radius;
+    std::vector<float> sum(w * 4);
+    for (int y = begin; y < end; ++y)
+    {
+        memset(&sum[0], 0, sum.size() * sizeof(float));
+        for (int k = -r; k <= r; ++k)
+        {
+            int sy = y + k;
+            sy = sy < 0 ? 0 : (sy >= h ? h - 1 : sy);
+            KernelAccumulate(&sum[0], c->buffer + sy * w * 4, w, c->weights[k + r]);
+        }
+        KernelUnpremultiply(c->pixels + y * c->stride, &sum[0], w);
+    }
+}
+
+void GaussianBlur(unsigned char* pixels, int width, int height, int stride, float sigma)
+{
+    if (width <= 0 || height <= 0 || sigma <= 0.0f)
+    {
+        return;
+    }
+
+    int radius = (int)ceil(sigma * 3.0f);
+    std::vector<float> weights(radius * 2 + 1);
+    double total = 0;
+    for (int i = -radius; i <= radius; ++i)
+    {
+        weights[i + radius] = (float)exp(-0.5 * i * i / ((double)sigma * sigma));
+        total += weights[i + radius];
+    }
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = (float)(weights[i] / total);
+    }
+
+    std::vector<float> buffer((size_t)width * height * 4);
+    GaussianContext context;
+    context.pixels = pixels;
+    context.width = width;
+    context.height = height;
+    context.stride = stride;
+    context.radius = radius;
+    context.weights = &weights[0];
+    context.buffer = &buffer[0];
+
+    ParallelFor(height, GaussianRows, &context);
+    ParallelFor(height, GaussianColumns, &context);
+}
+
+void GetBlurWeights(int radius, float* weights)
+{
+    double total = 0;
+    for (int i = 0; i <= radius; ++i)
+    {
+        int off = i > 0 ? -1 : 0;
+        float v = (float)cos((i + off) / (double)radius);
+        weights[radius + i] = v;
+        weights[radius - i] = v;
+        total += i > 0 ? 2 * v : v;
+    }
+    for (int i = 0; i < radius * 2 + 1; ++i)
+    {
+        weights[i] = (float)(weights[i] / total);
+    }
+}
+
+float GetBlurSigma(int radius)
+{
+    if (radius < 1)
+    {
+        return 0.0f;
+    }
+
+    std::vector<float> weights(radius * 2 + 1);
+    GetBlurWeights(radius, &weights[0]);
+    double variance = 0;
+    for (int i = -radius; i <= radius; ++i)
+    {
+        variance += weights[i + radius] * (double)i * i;
+    }
+    return (float)sqrt(variance);
+}
+
+BlurError CompareBlur(const unsigned char* a, const unsigned char* b, int width, int height, int stride)
+{
+    BlurError error;
+    error.maxError = 0.0f;
+    error.rmsError = 0.0f;
+
+    double sum = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* pa = a + y * stride;
+        const unsigned char* pb = b + y * stride;
+        for (int x = 0; x < width * 4; x += 4)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                float va = i < 3 ? pa[x + i] * pa[x + 3] / 255.0f : pa[x + i];
+                float vb = i < 3 ? pb[x + i] * pb[x + 3] / 255.0f : pb[x + i];
+                float d = fabsf(va - vb);
+                error.maxError = d > error.maxError ? d : error.maxError;
+                sum += d * d;
+            }
+        }
+    }
+
+    if (width > 0 && height > 0)
+    {
+        error.rmsError = (float)sqrt(sum / ((double)width * height * 4));
+    }
+    return error;
+}
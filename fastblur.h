@@ -0,0 +1,26 @@
+#ifndef FASTBLUR_H
+#define FASTBLUR_H
+
+// Blurs of straight alpha RGBA8888 pixels in place, filtered premultiplied so
+// transparent pixels do not bleed their color. Rows are stride bytes apart, edges are clamped.
+
+// Gaussian approximated by three box blurs with running sums, the cost per pixel does not depend on sigma
+void FastBlur(unsigned char* pixels, int width, int height, int stride, float sigma);
+// Separable gaussian truncated at 3 sigma, the reference FastBlur is measured against
+void GaussianBlur(unsigned char* pixels, int width, int height, int stride, float sigma);
+
+// The 2 * radius + 1 normalized weights of the cosine kernel of BlurProgram
+void GetBlurWeights(int radius, float* weights);
+// Standard deviation of that kernel, to blur the same amount with FastBlur
+float GetBlurSigma(int radius);
+
+// Difference of two images in 8 bit levels of premultiplied channels
+struct BlurError
+{
+    float maxError;
+    float rmsError;
+};
+
+BlurError CompareBlur(const unsigned char* a, const unsigned char* b, int width, int height, int stride);
+
+#endif // FASTBLUR_H
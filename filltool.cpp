@@ -3,6 +3,7 @@
 #include "command.h"
 #include "timeline.h"
 #include "animationfile.h"
+#include "strokerecording.h"
 
 
 typedef struct {		/* window: a discrete 2-D rectangle */
@@ -16,6 +17,7 @@ static Pixel* pixelBuffer = NULL;
 static unsigned char* maskBuffer = NULL;
 static int pixelBufferWidth = 0;
 static int pixelBufferHeight = 0;
+static Window fillBounds;
 
 inline Pixel pixelread(int x, int y)
 {
@@ -72,6 +74,10 @@ inline bool pixelEquals(int x, int y, Pixel p0, int threshold)
 void pixelwrite(int x, int y)
 {
     maskBuffer[y * pixelBufferWidth + x] = 0xFF;
+    if (x < fillBounds.x0) fillBounds.x0 = x;
+    if (x > fillBounds.x1) fillBounds.x1 = x;
+    if (y < fillBounds.y0) fillBounds.y0 = y;
+    if (y > fillBounds.y1) fillBounds.y1 = y;
 }
 
 typedef struct {short y, xl, xr, dy;} Segment;
@@ -157,7 +163,10 @@ skip:	    for (x++; x<=x2 && !pixelEquals(x, y, ov, threshold); x++)
     }
 }
 
-void fill(unsigned int* pixels, int width, int height, int x, int y, int threshold, unsigned char* mask)
+/*
+* Returns the bounding box of the filled pixels, empty if nothing was filled.
+*/
+QRect fill(unsigned int* pixels, int width, int height, int x, int y, int threshold, unsigned char* mask)
 {
     Window win;
     win.x0 = 0;
@@ -168,10 +177,56 @@ void fill(unsigned int* pixels, int width, int height, int x, int y, int thresho
     maskBuffer = mask;
     pixelBufferWidth = width;
     pixelBufferHeight = height;
+    fillBounds.x0 = width;
+    fillBounds.y0 = height;
+    fillBounds.x1 = -1;
+    fillBounds.y1 = -1;
+    if (x < 0 || x >= width || y < 0 || y >= height)
+    {
+        return QRect();
+    }
     fill(x, y, &win, threshold);
+    if (fillBounds.x1 < fillBounds.x0)
+    {
+        return QRect();
+    }
+    return QRect(QPoint(fillBounds.x0, fillBounds.y0), QPoint(fillBounds.x1, fillBounds.y1));
 }
 
-FillTool::FillTool(RasterImageEditor* editor, QUndoStack* undoStack)
+// Fill kept as its coverage rather than the seed, since the seed point depends on the
+// composite of every layer. A single colour mask compresses to almost nothing.
+class FillEdit : public RasterEdit
+{
+public:
+    FillEdit(const QRect& rect, const QImage& mask, QPainter::CompositionMode mode)
+        :mRect(rect)
+        ,mMode(mode)
+    {
+        mMask = qCompress(mask.constBits(), mask.byteCount(), 1);
+    }
+
+    QRect GetRect() const { return mRect; }
+
+    void Draw(QImage* image) const
+    {
+        QByteArray data = qUncompress(mMask);
+        if (data.size() != mRect.width() * mRect.height() * 4)
+        {
+            return;
+        }
+        QImage mask((const uchar*)data.constData(), mRect.width(), mRect.height(), QImage::Format_RGBA8888);
+        QPainter painter(image);
+        painter.setCompositionMode(mMode);
+        painter.drawImage(mRect.topLeft(), mask);
+    }
+
+private:
+    QRect mRect;
+    QByteArray mMask;
+    QPainter::CompositionMode mMode;
+};
+
+FillTool::FillTool(CanvasHost* editor, QUndoStack* undoStack)
     :mEditor(editor)
     ,mUndoStack(undoStack)
     ,mColor(0,0,0,0xFF)
@@ -198,13 +253,23 @@ void FillTool::OnDrag(int x, int y, float pressure)
 }
 
 void FillTool::OnDragEnd(int x, int y, float pressure)
+{
+    Fill(x, y, pressure);
+}
+
+void FillTool::OnSampleEnd(const TabletSample& sample)
+{
+    Fill(sample.x, sample.y, sample.pressure);
+}
+
+void FillTool::Fill(float x, float y, float pressure)
 {
     if (!mEditor->GetImage())
     {
         return;
     }
 
-    QImage* img = mEditor->GetTimeline()->GetCompositeImage();
+    QImage* img = mEditor->GetCompositeImage();
     if (!img)
     {
         return;
@@ -215,19 +280,23 @@ void FillTool::OnDragEnd(int x, int y, float pressure)
     int w = img->width();
     int h = img->height();
 
-    QImage* hi = new QImage(w, h, QImage::Format_RGBA8888);
-    QPainter hp(hi);
-    hp.setCompositionMode(QPainter::CompositionMode_Source);
-    hp.drawImage(0, 0, *mEditor->GetImage());
-
     unsigned char* mask = new unsigned char[w * h];
     memset(mask, 0, w * h);
-    fill((unsigned int*) img->bits(), w, h, (int)sp.x, (int)sp.y, 0, mask);
+    QRect fillRect = fill((unsigned int*) img->bits(), w, h, (int)sp.x, (int)sp.y, 0, mask);
+    if (fillRect.isEmpty())
+    {
+        delete[] mask;
+        return;
+    }
 
-    QImage maskImg(w, h, QImage::Format_RGBA8888);
-    for (int y = 0; y < h; ++y)
+    // only the filled area grown by the expand distance can change
+    QRect rect = fillRect.adjusted(-mExpand, -mExpand, mExpand, mExpand).intersected(QRect(0, 0, w, h));
+    QImage maskImg(rect.width(), rect.height(), QImage::Format_RGBA8888);
+    maskImg.fill(0);
+    QRgb fillColor = QColor(mColor.red(), mColor.green(), mColor.blue(), mColor.alpha()).rgba();
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
     {
-        for (int x = 0; x < w; ++x)
+        for (int x = rect.left(); x <= rect.right(); ++x)
         {
             bool hit = false;
             for (int dy = -mExpand; dy <= mExpand; ++dy)
@@ -255,10 +324,11 @@ void FillTool::OnDragEnd(int x, int y, float pressure)
             done:
             if (hit)
             {
-                maskImg.setPixel(x, y, QColor(mColor.red(), mColor.green(), mColor.blue(), mColor.alpha()).rgba());
+                maskImg.setPixel(x - rect.left(), y - rect.top(), fillColor);
             }
         }
     }
+    delete[] mask;
 
 //    int* depthMask = new int[w * h];
 //    for (int y = 0; y < h; ++y)
@@ -409,14 +479,9 @@ void FillTool::OnDragEnd(int x, int y, float pressure)
 //    debugImg.save("d:/debug.png");
 //    delete[] depthMask;
 
-    QImage* newImage = new QImage(w, h, QImage::Format_RGBA8888);
-    QPainter painter(newImage);
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.drawImage(0, 0, *mEditor->GetImage());
-    painter.setCompositionMode(mBrushMode);
-    painter.drawImage(0, 0, maskImg);
-    mUndoStack->push(new DrawCommand(mEditor, newImage, hi));
-    mEditor->update();
+    // pushing draws the fill
+    mUndoStack->push(new ReplayCommand(mEditor, new FillEdit(rect, maskImg, mBrushMode)));
+    mEditor->UpdateView();
 }
 
 void FillTool::OnPaint(QPainter &p)
@@ -424,6 +489,18 @@ void FillTool::OnPaint(QPainter &p)
 
 }
 
+bool FillTool::GetStrokeParams(StrokeToolParams& params)
+{
+    params.tool = StrokeToolFill;
+    params.brushSize = 0;
+    params.smooth = mSmooth;
+    params.mode = mBrushMode;
+    params.tip = 0;
+    params.stabilize = 0;
+    params.color = mColor.rgba();
+    return true;
+}
+
 void FillTool::SetColor(const QColor& color)
 {
     if (color == mColor)
@@ -6,17 +6,17 @@
 #include <vector>
 #include <QUndoStack>
 
-class RasterImageEditor;
-
 class FillTool : public CanvasTool
 {
 public:
-    FillTool(RasterImageEditor* editor, QUndoStack* undoStack);
+    FillTool(CanvasHost* editor, QUndoStack* undoStack);
 
     void OnDragBegin(int x, int y, float pressure);
     void OnDrag(int x, int y, float pressure);
     void OnDragEnd(int x, int y, float pressure);
+    void OnSampleEnd(const TabletSample& sample);
     void OnPaint(QPainter &painter);
+    bool GetStrokeParams(StrokeToolParams& params);
     void SetUndoStack(QUndoStack* stack) { mUndoStack = stack; }
     void SetColor(const QColor& color);
     void SetSmooth(int value);
@@ -24,13 +24,16 @@ public:
     int GetSmooth() { return mSmooth; }
     QPainter::CompositionMode GetMode() { return mBrushMode; }
 
+private:
+    void Fill(float x, float y, float pressure);
+
 signals:
 
 public slots:
 
 
 private:
-    RasterImageEditor* mEditor;
+    CanvasHost* mEditor;
     QUndoStack* mUndoStack;
     QColor mColor;
     int mSmooth;
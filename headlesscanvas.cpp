@@ -0,0 +1,16 @@
+#include "headlesscanvas.h"
+
+HeadlessCanvas::HeadlessCanvas(int width, int height)
+    :mLayer(QString(), QString(), width, height)
+{
+    mLayer.AddFrame(0);
+}
+
+StrokePoint HeadlessCanvas::ScreenToLocal(float x, float y, float pressure)
+{
+    StrokePoint p;
+    p.x = x;
+    p.y = y;
+    p.pressure = pressure;
+    return p;
+}
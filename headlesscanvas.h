@@ -0,0 +1,31 @@
+#ifndef HEADLESSCANVAS_H
+#define HEADLESSCANVAS_H
+#include "canvastool.h"
+#include "animationfile.h"
+#include "undohistory.h"
+#include "latencyprobe.h"
+
+// Canvas of a single frame without a window, for driving tools from benchmarks and replays.
+// Screen and canvas space are the same, there is no view to update and no timeline to invalidate.
+class HeadlessCanvas : public CanvasHost
+{
+public:
+    HeadlessCanvas(int width, int height);
+
+    QImage* GetImage() { return GetFrame()->GetImage(); }
+    // One layer, so the frame is all there is to composite
+    QImage* GetCompositeImage() { return GetImage(); }
+    RasterFrameModel* GetFrame() { return mLayer.GetFrameAt(0); }
+    UndoHistory* GetUndoHistory() { return &mHistory; }
+    LatencyProbe* GetLatencyProbe() { return &mProbe; }
+    StrokePoint ScreenToLocal(float x, float y, float pressure);
+    void UpdateView() {}
+    void OnImageChanged() {}
+
+private:
+    UndoHistory mHistory;
+    RasterLayerModel mLayer;
+    LatencyProbe mProbe;
+};
+
+#endif // HEADLESSCANVAS_H
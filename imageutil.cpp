@@ -0,0 +1,384 @@
+#include "imageutil.h"
+#include "fastblur.h"
+#include "pixelkernels.h"
+#include "parallel.h"
+#include "openglrenderer.h"
+#include <math.h>
+#include <string.h>
+
+static inline bool IsRowEmpty(const QImage* image, int y, int x0, int x1)
+{
+    const unsigned char* row = image->constScanLine(y);
+    for (int x = x0; x <= x1; ++x)
+    {
+        // RGBA8888 keeps alpha in the 4th byte
+        if (row[x * 4 + 3])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static QRect GetContentBoundsSlow(const QImage* image, const QRect& rect)
+{
+    int xMin = rect.right() + 1;
+    int xMax = rect.left() - 1;
+    int yMin = rect.bottom() + 1;
+    int yMax = rect.top() - 1;
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
+    {
+        for (int x = rect.left(); x <= rect.right(); ++x)
+        {
+            if (qAlpha(image->pixel(x, y)))
+            {
+                xMin = qMin(xMin, x);
+                xMax = qMax(xMax, x);
+                yMin = qMin(yMin, y);
+                yMax = qMax(yMax, y);
+            }
+        }
+    }
+    if (xMin > xMax)
+    {
+        return QRect();
+    }
+    return QRect(QPoint(xMin, yMin), QPoint(xMax, yMax));
+}
+
+QRect GetContentBounds(const QImage* image, const QRect& rect)
+{
+    if (!image)
+    {
+        return QRect();
+    }
+
+    QRect r = rect.intersected(image->rect());
+    if (r.isEmpty())
+    {
+        return QRect();
+    }
+
+    QImage::Format format = image->format();
+    if (format != QImage::Format_RGBA8888 && format != QImage::Format_RGBA8888_Premultiplied)
+    {
+        return GetContentBoundsSlow(image, r);
+    }
+
+    int x0 = r.left();
+    int x1 = r.right();
+    int top = r.top();
+    int bottom = r.bottom();
+
+    while (top <= bottom && IsRowEmpty(image, top, x0, x1))
+    {
+        ++top;
+    }
+    if (top > bottom)
+    {
+        return QRect();
+    }
+    while (bottom > top && IsRowEmpty(image, bottom, x0, x1))
+    {
+        --bottom;
+    }
+
+    // shrink the horizontal range row by row, every row only scans the margins
+    int left = x1;
+    int right = x0;
+    for (int y = top; y <= bottom; ++y)
+    {
+        const unsigned char* row = image->constScanLine(y);
+        for (int x = x0; x < left; ++x)
+        {
+            if (row[x * 4 + 3])
+            {
+                left = x;
+                break;
+            }
+        }
+        for (int x = x1; x > right; --x)
+        {
+            if (row[x * 4 + 3])
+            {
+                right = x;
+                break;
+            }
+        }
+    }
+
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+int GetBlurExtent(int radius)
+{
+    return (int)ceilf(GetBlurSigma(radius) * 3.0f);
+}
+
+QImage BlurRect(const QImage& source, const QRect& bounds, int radius, QRect& rect)
+{
+    int extent = GetBlurExtent(radius);
+    rect = bounds.adjusted(-extent, -extent, extent, extent).intersected(source.rect());
+    if (rect.isEmpty())
+    {
+        return QImage();
+    }
+
+    QImage image = source.copy(rect).convertToFormat(QImage::Format_RGBA8888);
+    FastBlur(image.bits(), image.width(), image.height(), image.bytesPerLine(), GetBlurSigma(radius));
+    return image;
+}
+
+QRect TransformRect(const QRect& rect, const Matrix4& transform)
+{
+    if (rect.isEmpty())
+    {
+        return QRect();
+    }
+
+    float xs[2] = { (float)rect.left(), (float)(rect.right() + 1) };
+    float ys[2] = { (float)rect.top(), (float)(rect.bottom() + 1) };
+    float x0 = 1e30f;
+    float y0 = 1e30f;
+    float x1 = -1e30f;
+    float y1 = -1e30f;
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = xs[i & 1];
+        float y = ys[i >> 1];
+        float tx = transform.m00 * x + transform.m01 * y + transform.m03;
+        float ty = transform.m10 * x + transform.m11 * y + transform.m13;
+        x0 = tx < x0 ? tx : x0;
+        y0 = ty < y0 ? ty : y0;
+        x1 = tx > x1 ? tx : x1;
+        y1 = ty > y1 ? ty : y1;
+    }
+
+    // bilinear filtering reaches half a pixel further
+    int left = (int)floorf(x0 - 0.5f);
+    int top = (int)floorf(y0 - 0.5f);
+    int right = (int)ceilf(x1 + 0.5f);
+    int bottom = (int)ceilf(y1 + 0.5f);
+    return QRect(left, top, right - left, bottom - top);
+}
+
+struct TransformContext
+{
+    const unsigned char* src;
+    int srcWidth;
+    int srcHeight;
+    int srcStride;
+    unsigned char* dst;
+    int dstWidth;
+    int dstStride;
+    // Source position of the center of destination pixel (x, y): u = u0 + ux * x + uy * y
+    float u0;
+    float ux;
+    float uy;
+    float v0;
+    float vx;
+    float vy;
+};
+
+// Narrows [x0, x1) to where f0 + fx * x is within [lo, hi)
+static void ClipSpan(float f0, float fx, float lo, float hi, int& x0, int& x1)
+{
+    if (fx == 0.0f)
+    {
+        if (f0 < lo || f0 >= hi)
+        {
+            x1 = x0;
+        }
+        return;
+    }
+
+    float a = (lo - f0) / fx;
+    float b = (hi - f0) / fx;
+    if (a > b)
+    {
+        float t = a;
+        a = b;
+        b = t;
+    }
+    int first = (int)floorf(a);
+    int last = (int)ceilf(b) + 1;
+    x0 = first > x0 ? first : x0;
+    x1 = last < x1 ? last : x1;
+}
+
+static void TransformRows(int begin, int end, void* context)
+{
+    TransformContext* c = (TransformContext*)context;
+    for (int y = begin; y < end; ++y)
+    {
+        float u = c->u0 + c->uy * y;
+        float v = c->v0 + c->vy * y;
+        int x0 = 0;
+        int x1 = c->dstWidth;
+        // samples further than half a pixel outside the source are transparent
+        ClipSpan(u, c->ux, -0.5f, c->srcWidth + 0.5f, x0, x1);
+        ClipSpan(v, c->vx, -0.5f, c->srcHeight + 0.5f, x0, x1);
+        if (x1 > x0)
+        {
+            KernelSampleBilinear(c->dst + y * c->dstStride + x0 * 4, c->src, c->srcWidth, c->srcHeight, c->srcStride,
+                                 u + c->ux * x0, v + c->vx * x0, c->ux, c->vx, x1 - x0);
+        }
+    }
+}
+
+QImage TransformImage(const QImage& source, const QRect& bounds, const Matrix4& transform, const QRect& target)
+{
+    QRect area = bounds.intersected(source.rect());
+    if (target.isEmpty() || area.isEmpty())
+    {
+        return QImage();
+    }
+
+    QImage image(target.size(), QImage::Format_RGBA8888);
+    image.fill(0);
+
+    float a = transform.m00;
+    float b = transform.m01;
+    float c = transform.m10;
+    float d = transform.m11;
+    float det = a * d - b * c;
+    if (det == 0.0f)
+    {
+        return image;
+    }
+    float ia = d / det;
+    float ib = -b / det;
+    float ic = -c / det;
+    float id = a / det;
+
+    // destination pixel center relative to the translation, then into the area of the source
+    float px = target.left() + 0.5f - transform.m03;
+    float py = target.top() + 0.5f - transform.m13;
+
+    TransformContext context;
+    context.src = source.constScanLine(area.top()) + area.left() * 4;
+    context.srcWidth = area.width();
+    context.srcHeight = area.height();
+    context.srcStride = source.bytesPerLine();
+    context.dst = image.bits();
+    context.dstWidth = image.width();
+    context.dstStride = image.bytesPerLine();
+    context.u0 = ia * px + ib * py - area.left();
+    context.ux = ia;
+    context.uy = ib;
+    context.v0 = ic * px + id * py - area.top();
+    context.vx = ic;
+    context.vy = id;
+
+    ParallelFor(image.height(), TransformRows, &context);
+    return image;
+}
+
+void ClearRect(QImage* image, const QRect& rect)
+{
+    QRect area = rect.intersected(image->rect());
+    for (int y = area.top(); y <= area.bottom(); ++y)
+    {
+        memset(image->scanLine(y) + area.left() * 4, 0, area.width() * 4);
+    }
+}
+
+struct BlendContext
+{
+    unsigned char* dst;
+    int dstStride;
+    const unsigned char* src;
+    int srcStride;
+    int width;
+    float opacity;
+    BlendMode mode;
+};
+
+static void BlendRows(int begin, int end, void* context)
+{
+    BlendContext* c = (BlendContext*)context;
+    for (int y = begin; y < end; ++y)
+    {
+        KernelBlendLayer(c->dst + y * c->dstStride, c->src + y * c->srcStride, c->width, c->opacity, c->mode);
+    }
+}
+
+void BlendImage(QImage* target, const QPoint& pos, const QImage& source, const QRect& sourceRect,
+                unsigned char opacity, BlendMode mode)
+{
+    QRect area = sourceRect.intersected(source.rect());
+    // clip in target coordinates, then back to source
+    QRect dst = area.translated(pos - sourceRect.topLeft()).intersected(target->rect());
+    if (dst.isEmpty() || (opacity == 0 && mode != BlendReplace))
+    {
+        return;
+    }
+    QPoint src = dst.topLeft() - pos + sourceRect.topLeft();
+
+    BlendContext context;
+    // detaches once here rather than on the worker threads
+    context.dst = target->bits() + dst.top() * target->bytesPerLine() + dst.left() * 4;
+    context.dstStride = target->bytesPerLine();
+    context.src = source.constBits() + src.y() * source.bytesPerLine() + src.x() * 4;
+    context.srcStride = source.bytesPerLine();
+    context.width = dst.width();
+    context.opacity = opacity / 255.0f;
+    context.mode = mode;
+    ParallelFor(dst.height(), BlendRows, &context);
+}
+
+BlendMode GetBrushBlendMode(QPainter::CompositionMode mode, QColor& color)
+{
+    switch (mode)
+    {
+    case QPainter::CompositionMode_SourceOver:
+        return BlendNormal;
+    case QPainter::CompositionMode_DestinationOver:
+        return BlendBehind;
+    case QPainter::CompositionMode_Clear:
+        color = QColor(0, 0, 0, 0xFF);
+        return BlendErase;
+    case QPainter::CompositionMode_Plus:
+        return BlendAdd;
+    case QPainter::CompositionMode_Multiply:
+        return BlendMultiply;
+    case QPainter::CompositionMode_Screen:
+        return BlendScreen;
+    default:
+        return BlendReplace;
+    }
+}
+
+void FillMask(QImage* image, const QPoint& pos, const QImage& mask, const QColor& color, QPainter::CompositionMode mode)
+{
+    QColor fill = color;
+    BlendMode blend = GetBrushBlendMode(mode, fill);
+
+    // colour with the coverage as alpha, blended once
+    QImage layer(mask.size(), QImage::Format_RGBA8888);
+    int alpha = fill.alpha();
+    for (int y = 0; y < mask.height(); ++y)
+    {
+        const uchar* src = mask.constScanLine(y);
+        uchar* dst = layer.scanLine(y);
+        for (int x = 0; x < mask.width(); ++x)
+        {
+            dst[0] = fill.red();
+            dst[1] = fill.green();
+            dst[2] = fill.blue();
+            dst[3] = (uchar)((src[x] * alpha + 127) / 255);
+            dst += 4;
+        }
+    }
+
+    if (blend == BlendReplace)
+    {
+        QPainter p(image);
+        p.setCompositionMode(mode);
+        p.drawImage(pos, layer);
+    }
+    else
+    {
+        BlendImage(image, pos, layer, layer.rect(), 0xFF, blend);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef IMAGEUTIL_H
+#define IMAGEUTIL_H
+#include <QImage>
+#include <QRect>
+#include <QColor>
+#include <QPainter>
+#include "pixelkernels.h"
+
+class Matrix4;
+
+// Returns the tight bounding box of the pixels with alpha > 0 inside rect.
+// Returns an empty rect if every pixel in rect is transparent.
+QRect GetContentBounds(const QImage* image, const QRect& rect);
+
+// Pixels a blur of radius spreads content by
+int GetBlurExtent(int radius);
+// Blur of the bounds area of an RGBA8888 source, grown by the blur extent and clipped to the
+// source. The result covers rect, its top left pixel is rect.topLeft().
+QImage BlurRect(const QImage& source, const QRect& bounds, int radius, QRect& rect);
+
+// Bounding box of rect after transform, which maps source pixels to destination pixels
+QRect TransformRect(const QRect& rect, const Matrix4& transform);
+// Bilinear resampling of the bounds area of an RGBA8888 source through transform.
+// The result covers target and is transparent where the source does not land.
+QImage TransformImage(const QImage& source, const QRect& bounds, const Matrix4& transform, const QRect& target);
+
+// Sets the rect area of an RGBA8888 image to transparent
+void ClearRect(QImage* image, const QRect& rect);
+// Blends the sourceRect area of source onto target at pos, like QPainter::drawImage but in
+// place with one pass over the straight alpha pixels. Both images are RGBA8888.
+void BlendImage(QImage* target, const QPoint& pos, const QImage& source, const QRect& sourceRect,
+                unsigned char opacity, BlendMode mode);
+
+// BlendMode which painting color with a brush composition mode amounts to, BlendReplace if there
+// is none. Clear erases whatever the colour is, so color is made opaque black for it.
+BlendMode GetBrushBlendMode(QPainter::CompositionMode mode, QColor& color);
+// Paints color through an Alpha8 coverage mask onto an RGBA8888 image at pos with a brush
+// composition mode, in one blend pass. Strokes are committed with it.
+void FillMask(QImage* image, const QPoint& pos, const QImage& mask, const QColor& color, QPainter::CompositionMode mode);
+
+#endif // IMAGEUTIL_H
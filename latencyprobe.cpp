@@ -0,0 +1,116 @@
+#include "latencyprobe.h"
+#include <QTextStream>
+#include <algorithm>
+
+static const char* sStageNames[LatencyStageCount] = { "tessellate", "rasterize", "composite", "present" };
+
+LatencyProbe::LatencyProbe()
+{
+    mTimer.start();
+    Reset();
+}
+
+void LatencyProbe::OnInput()
+{
+    ++mInputs;
+    if (mPending.size() < LATENCY_MAX_PENDING)
+    {
+        mPending.push_back(mTimer.nsecsElapsed());
+    }
+}
+
+void LatencyProbe::BeginStage(LatencyStage stage)
+{
+    mStageBegin[stage] = mTimer.nsecsElapsed();
+}
+
+void LatencyProbe::EndStage(LatencyStage stage)
+{
+    if (mStageBegin[stage] >= 0)
+    {
+        mStageTime[stage] += mTimer.nsecsElapsed() - mStageBegin[stage];
+        mStageBegin[stage] = -1;
+    }
+}
+
+void LatencyProbe::OnPresent()
+{
+    qint64 now = mTimer.nsecsElapsed();
+    if (!mPending.empty())
+    {
+        ++mFrames;
+        for (size_t i = 0; i < mPending.size(); ++i)
+        {
+            Add(mInputLatency, (now - mPending[i]) / 1e6f);
+        }
+        for (int i = 0; i < LatencyStageCount; ++i)
+        {
+            Add(mStageLatency[i], mStageTime[i] / 1e6f);
+        }
+        mPending.clear();
+    }
+    for (int i = 0; i < LatencyStageCount; ++i)
+    {
+        mStageTime[i] = 0;
+    }
+}
+
+void LatencyProbe::Reset()
+{
+    for (int i = 0; i < LatencyStageCount; ++i)
+    {
+        mStageBegin[i] = -1;
+        mStageTime[i] = 0;
+        mStageLatency[i].samples.clear();
+        mStageLatency[i].next = 0;
+    }
+    mInputLatency.samples.clear();
+    mInputLatency.next = 0;
+    mPending.clear();
+    mFrames = 0;
+    mInputs = 0;
+}
+
+void LatencyProbe::Add(Series& series, float ms)
+{
+    if (series.samples.size() < LATENCY_MAX_SAMPLES)
+    {
+        series.samples.push_back(ms);
+        return;
+    }
+    series.samples[series.next] = ms;
+    series.next = (series.next + 1) % LATENCY_MAX_SAMPLES;
+}
+
+static void WritePercentiles(QTextStream& out, const char* name, std::vector<float> samples)
+{
+    out << "  " << name << ":";
+    if (samples.empty())
+    {
+        out << " no samples\n";
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    static const int percentiles[] = { 50, 90, 99 };
+    int n = (int)samples.size();
+    for (int i = 0; i < 3; ++i)
+    {
+        out << " p" << percentiles[i] << " " << QString::number(samples[(n - 1) * percentiles[i] / 100], 'f', 2);
+    }
+    out << " max " << QString::number(samples.back(), 'f', 2) << "\n";
+}
+
+QString LatencyProbe::Dump() const
+{
+    QString text;
+    QTextStream out(&text);
+    out << "input events: " << mInputs << "\n";
+    out << "frames with input: " << mFrames << "\n";
+    out << "latency ms:\n";
+    WritePercentiles(out, "input to present", mInputLatency.samples);
+    for (int i = 0; i < LatencyStageCount; ++i)
+    {
+        WritePercentiles(out, sStageNames[i], mStageLatency[i].samples);
+    }
+    return text;
+}
@@ -0,0 +1,96 @@
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <vector>
+
+// Samples kept per series, older ones are overwritten
+#define LATENCY_MAX_SAMPLES 4096
+// Inputs waiting for a present beyond this are not timed
+#define LATENCY_MAX_PENDING 1024
+
+enum LatencyStage
+{
+    // Spline sampling, smoothing and outline building of the stroke
+    LatencyTessellate,
+    // Coverage and blending into the stroke buffer or the frame
+    LatencyRasterize,
+    // Drawing the frame and the tool overlay into the view
+    LatencyComposite,
+    // Handing the frame to the window system until the swap returns
+    LatencyPresent,
+    LatencyStageCount
+};
+
+// Times the drawing path from input events to the frame showing them.
+// Stages add up over a frame, a frame is only sampled when it presents input,
+// so idle repaints do not water down the numbers.
+class LatencyProbe
+{
+public:
+    LatencyProbe();
+
+    // An input event arrived, it is on screen with the next present
+    void OnInput();
+    void BeginStage(LatencyStage stage);
+    void EndStage(LatencyStage stage);
+    // A frame went out, every input since the last one is on it
+    void OnPresent();
+
+    void Reset();
+    int GetFrameCount() const { return mFrames; }
+    int GetInputCount() const { return mInputs; }
+    // Percentiles in ms of input to present and of each stage per frame
+    QString Dump() const;
+
+private:
+    struct Series
+    {
+        std::vector<float> samples;
+        int next;
+    };
+
+    static void Add(Series& series, float ms);
+
+private:
+    QElapsedTimer mTimer;
+    qint64 mStageBegin[LatencyStageCount];
+    // Time spent in each stage since the last present
+    qint64 mStageTime[LatencyStageCount];
+    // Arrival of the inputs the next present shows
+    std::vector<qint64> mPending;
+    Series mInputLatency;
+    Series mStageLatency[LatencyStageCount];
+    int mFrames;
+    int mInputs;
+};
+
+// Times a stage for as long as it lives, does nothing without a probe
+class LatencyScope
+{
+public:
+    LatencyScope(LatencyProbe* probe, LatencyStage stage)
+        :mProbe(probe)
+        ,mStage(stage)
+    {
+        if (mProbe)
+        {
+            mProbe->BeginStage(mStage);
+        }
+    }
+
+    ~LatencyScope()
+    {
+        if (mProbe)
+        {
+            mProbe->EndStage(mStage);
+        }
+    }
+
+private:
+    LatencyProbe* mProbe;
+    LatencyStage mStage;
+};
+
+#endif // LATENCYPROBE_H
@@ -1,6 +1,21 @@
 #include "layer.h"
+#include <QComboBox>
 
 Layer::Layer(QWidget *parent) :
     QWidget(parent)
 {
 }
+
+QComboBox* Layer::CreateBlendModeBox(BlendMode mode)
+{
+    QComboBox* box = new QComboBox;
+    box->addItem("Normal");
+    box->addItem("Multiply");
+    box->addItem("Add");
+    box->addItem("Screen");
+    box->addItem("Behind");
+    box->addItem("Erase");
+    box->setCurrentIndex(mode);
+    box->setToolTip("Blend mode");
+    return box;
+}
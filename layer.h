@@ -2,11 +2,17 @@
 #define LAYER_H
 
 #include <QWidget>
+#include "pixelkernels.h"
+
+class QComboBox;
 
 enum LayerType
 {
     LayerTypeRaster,
     LayerTypeTrace,
+    LayerTypeBlur,
+    LayerTypeTransform,
+    LayerTypeScene,
     LayerTypeSound,
 };
 
@@ -28,6 +34,11 @@ public:
     virtual void Enable(bool enable) = 0;
     virtual QWidget* GetPropertyWindow() = 0;
     virtual int GetMaxFrames() = 0;
+    // Layers without their own pixels always blend normally
+    virtual BlendMode GetBlendMode() { return BlendNormal; }
+
+    // Combo box listing the layer blend modes in BlendMode order
+    static QComboBox* CreateBlendModeBox(BlendMode mode);
 
 signals:
 
@@ -0,0 +1,45 @@
+#include "layercache.h"
+#include <QMutexLocker>
+
+LayerCache::LayerCache(int capacity)
+    :mCapacity(capacity)
+{
+}
+
+bool LayerCache::Find(quint64 key, QImage& image, QRect& rect)
+{
+    QMutexLocker lock(&mMutex);
+    for (size_t i = 0; i < mEntries.size(); ++i)
+    {
+        if (mEntries[i].key == key)
+        {
+            Entry entry = mEntries[i];
+            mEntries.erase(mEntries.begin() + i);
+            mEntries.push_back(entry);
+            image = entry.image;
+            rect = entry.rect;
+            return true;
+        }
+    }
+    return false;
+}
+
+void LayerCache::Insert(quint64 key, const QImage& image, const QRect& rect)
+{
+    QMutexLocker lock(&mMutex);
+    Entry entry;
+    entry.key = key;
+    entry.image = image;
+    entry.rect = rect;
+    mEntries.push_back(entry);
+    if ((int)mEntries.size() > mCapacity)
+    {
+        mEntries.erase(mEntries.begin());
+    }
+}
+
+void LayerCache::Clear()
+{
+    QMutexLocker lock(&mMutex);
+    mEntries.clear();
+}
@@ -0,0 +1,35 @@
+#ifndef LAYERCACHE_H
+#define LAYERCACHE_H
+
+#include <QImage>
+#include <QRect>
+#include <QMutex>
+#include <vector>
+
+// Recent results of an adjustment layer, or frames of a nested scene. Keys hash the identity
+// of the input together with the parameters, so frames holding the same drawings share one result.
+// Used from the GUI thread and the playback workers at the same time.
+class LayerCache
+{
+public:
+    explicit LayerCache(int capacity = 8);
+
+    bool Find(quint64 key, QImage& image, QRect& rect);
+    void Insert(quint64 key, const QImage& image, const QRect& rect);
+    void Clear();
+
+private:
+    struct Entry
+    {
+        quint64 key;
+        QImage image;
+        QRect rect;
+    };
+
+    QMutex mMutex;
+    int mCapacity;
+    // Most recently used last
+    std::vector<Entry> mEntries;
+};
+
+#endif // LAYERCACHE_H
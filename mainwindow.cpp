@@ -2,6 +2,8 @@
 #include "ui_mainwindow.h"
 #include <QAction>
 #include <QFileDialog>
+#include <QFile>
+#include <QInputDialog>
 #include "soundlayer.h"
 #include <QWidget>
 #include "brushpropertywindow.h"
@@ -22,6 +24,11 @@
 #include "animationfile.h"
 #include "newprojectdialog.h"
 #include "renderwindow.h"
+#include "playbackcache.h"
+#include "undohistory.h"
+#include "playbackclock.h"
+#include "onionskin.h"
+#include "strokerecording.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -32,8 +39,12 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
 
     mUndoStack = new QUndoStack();
-    mUndoStack->setUndoLimit(10);
+    // memory is bounded by the history budget, the limit only bounds the spill file
+    mUndoStack->setUndoLimit(200);
+    mUndoHistory = new UndoHistory();
+    mRecording = new StrokeRecording();
     ui->rasterImageEditor->SetUndoStack(mUndoStack);
+    ui->rasterImageEditor->SetUndoHistory(mUndoHistory);
     ui->timeline->SetUndoStack(mUndoStack);
     ui->timeline->SetEditor(ui->rasterImageEditor);
     mUis.push_back(ui->timeline);
@@ -115,15 +126,42 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionShowOnion, SIGNAL(triggered()),
             ui->rasterImageEditor, SLOT(ToggleOnionSkin()));
 
+    connect(ui->actionMoreOnions, SIGNAL(triggered()),
+            this, SLOT(MoreOnions()));
+
+    connect(ui->actionFewerOnions, SIGNAL(triggered()),
+            this, SLOT(FewerOnions()));
+
     connect(ui->actionPlay, SIGNAL(triggered()),
             this, SLOT(Play()));
 
+    connect(ui->actionDumpPlaybackStats, SIGNAL(triggered()),
+            this, SLOT(DumpPlaybackStats()));
+
+    connect(ui->actionRecordStrokes, SIGNAL(toggled(bool)),
+            this, SLOT(RecordStrokes(bool)));
+
+    connect(ui->actionUndoBudget, SIGNAL(triggered()),
+            this, SLOT(SetUndoBudget()));
+
     connect(ui->actionAddRasterLayer, SIGNAL(triggered()),
             this, SLOT(AddRasterLayer()));
 
     connect(ui->actionAddTraceLayer, SIGNAL(triggered()),
             this, SLOT(AddTraceLayer()));
 
+    connect(ui->actionAddBlurLayer, SIGNAL(triggered()),
+            this, SLOT(AddBlurLayer()));
+
+    connect(ui->actionAddTransformLayer, SIGNAL(triggered()),
+            this, SLOT(AddTransformLayer()));
+
+    connect(ui->actionAddSceneLayer, SIGNAL(triggered()),
+            this, SLOT(AddSceneLayer()));
+
+    connect(ui->actionNextScene, SIGNAL(triggered()),
+            this, SLOT(NextScene()));
+
     connect(ui->actionRemoveLayer, SIGNAL(triggered()),
             this, SLOT(RemoveLayer()));
 
@@ -145,6 +183,10 @@ MainWindow::MainWindow(QWidget *parent) :
             this, SLOT(OnSmoothChanged(int)));
     connect(brushWindow, SIGNAL(modeChanged(QPainter::CompositionMode)),
             this, SLOT(OnModeChanged(QPainter::CompositionMode)));
+    connect(brushWindow, SIGNAL(tipChanged(int)),
+            this, SLOT(OnTipChanged(int)));
+    connect(brushWindow, SIGNAL(stabilizeChanged(int)),
+            this, SLOT(OnStabilizeChanged(int)));
 
     ColorPicker* colorPicker = new ColorPicker();
     this->addDockWidget(Qt::RightDockWidgetArea, colorPicker, Qt::Vertical);
@@ -156,6 +198,7 @@ MainWindow::MainWindow(QWidget *parent) :
 
     mTimer = new QTimer(this);
     mTimer->setTimerType(Qt::PreciseTimer);
+    mTimer->setSingleShot(true);
     connect(mTimer, SIGNAL(timeout()), this, SLOT(OnTimer()));
 
     mPenTool = new BrushTool(ui->rasterImageEditor, mUndoStack);
@@ -224,6 +267,11 @@ MainWindow::~MainWindow()
 {
     delete mProject;
 
+    // commands give their records back to the history
+    mUndoStack->clear();
+    delete mUndoHistory;
+    delete mRecording;
+
     delete mSplineTool;
     delete mColorTool;
     delete mFillTool;
@@ -258,6 +306,8 @@ void MainWindow::NewProject()
                 mProject = NULL;
             }
             mProject = project;
+            mUndoStack->clear();
+            mUndoHistory->SetMemoryBudget(project->GetUndoBudget());
         }
         else
         {
@@ -286,6 +336,8 @@ void MainWindow::OpenProject()
             mProject = NULL;
         }
         mProject = project;
+        mUndoStack->clear();
+        mUndoHistory->SetMemoryBudget(project->GetUndoBudget());
     }
     else
     {
@@ -446,23 +498,112 @@ void MainWindow::MoveDownLayer()
 
 void MainWindow::Play()
 {
-    if (mTimer->isActive())
+    if (ui->timeline->IsPlaying())
     {
         mTimer->stop();
+        ui->timeline->StopPlayback();
+        statusBar()->showMessage(ui->timeline->GetPlaybackClock()->GetSummary());
     }
     else
     {
-        mTimer->start((int)roundf(1000.0f / ui->timeline->GetFps()));
+        PlaybackClock* clock = ui->timeline->GetPlaybackClock();
+        clock->SetPolicy(ui->actionPlayEveryFrame->isChecked() ? PlaybackClock::PolicyPlayEveryFrame : PlaybackClock::PolicySkipFrames);
+        ui->timeline->StartPlayback(ui->actionRamPreview->isChecked());
+        mTimer->start(0);
     }
 }
 
 void MainWindow::OnTimer()
 {
-    ui->timeline->ModFrameIndex(1);
-    if (ui->timeline->GetFrameIndex() >= ui->timeline->GetMaxFrames())
+    int wait = ui->timeline->UpdatePlayback();
+    if (wait < 0)
+    {
+        return;
+    }
+
+    if (ui->timeline->IsCaching())
+    {
+        PlaybackCache* cache = ui->timeline->GetPlaybackCache();
+        statusBar()->showMessage(tr("Caching %1/%2").arg(cache->GetReadyCount()).arg(ui->timeline->GetMaxFrames()));
+    }
+    else
+    {
+        statusBar()->showMessage(ui->timeline->GetPlaybackClock()->GetSummary());
+    }
+    mTimer->start(wait);
+}
+
+void MainWindow::DumpPlaybackStats()
+{
+    QString path = QFileDialog::getSaveFileName(this, tr("Save"), tr("."), tr("text (*.txt)"));
+    if(path.isEmpty())
+    {
+        return;
+    }
+    QFile file(path);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        file.write(ui->timeline->GetPlaybackClock()->Dump().toUtf8());
+        file.write(QString("undo memory %1 KB of %2 KB, disk %3 KB\n")
+                   .arg(mUndoHistory->GetMemoryUsage() / 1024)
+                   .arg(mUndoHistory->GetMemoryBudget() / 1024)
+                   .arg(mUndoHistory->GetDiskUsage() / 1024).toUtf8());
+        file.write(QString("editor fps: %1\n").arg(ui->rasterImageEditor->GetFps()).toUtf8());
+        file.write(ui->rasterImageEditor->GetLatencyProbe()->Dump().toUtf8());
+    }
+}
+
+void MainWindow::RecordStrokes(bool checked)
+{
+    if (checked)
+    {
+        mRecording->Clear();
+        ui->rasterImageEditor->SetStrokeRecording(mRecording);
+        return;
+    }
+
+    ui->rasterImageEditor->SetStrokeRecording(NULL);
+    if (mRecording->GetStrokes().empty())
+    {
+        return;
+    }
+    QString path = QFileDialog::getSaveFileName(this, tr("Save"), tr("."), tr("strokes (*.strokes)"));
+    if (!path.isEmpty())
     {
-        ui->timeline->SetFrameIndex(0);
+        mRecording->Save(path);
     }
+    mRecording->Clear();
+}
+
+void MainWindow::SetUndoBudget()
+{
+    bool ok = false;
+    int megabytes = QInputDialog::getInt(this, tr("Undo Budget"), tr("Memory for undo, MB:"),
+                                         (int)(mUndoHistory->GetMemoryBudget() / (1024 * 1024)), 16, 65536, 16, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    qint64 bytes = (qint64)megabytes * 1024 * 1024;
+    mUndoHistory->SetMemoryBudget(bytes);
+    if (mProject)
+    {
+        mProject->SetUndoBudget(bytes);
+    }
+}
+
+void MainWindow::MoreOnions()
+{
+    OnionSkin* onion = ui->timeline->GetOnionSkin();
+    onion->SetDepth(onion->GetBefore() + 1, onion->GetAfter() + 1);
+    ui->rasterImageEditor->update();
+}
+
+void MainWindow::FewerOnions()
+{
+    OnionSkin* onion = ui->timeline->GetOnionSkin();
+    onion->SetDepth(onion->GetBefore() - 1, onion->GetAfter() - 1);
+    ui->rasterImageEditor->update();
 }
 
 void MainWindow::AddRasterLayer()
@@ -478,6 +619,87 @@ void MainWindow::AddTraceLayer()
     ui->timeline->AddTraceLayer(layerIndex + 1);
 }
 
+void MainWindow::AddBlurLayer()
+{
+    int layerIndex = ui->timeline->GetLayerIndex();
+    ui->timeline->AddBlurLayer(layerIndex + 1);
+}
+
+void MainWindow::AddTransformLayer()
+{
+    int layerIndex = ui->timeline->GetLayerIndex();
+    ui->timeline->AddTransformLayer(layerIndex + 1);
+}
+
+void MainWindow::AddSceneLayer()
+{
+    SceneModel* current = ui->timeline->GetScene();
+    if (!mProject || !current)
+    {
+        return;
+    }
+
+    QStringList items;
+    std::vector<SceneModel*>& scenes = mProject->GetScenes();
+    for (size_t i = 0; i < scenes.size(); ++i)
+    {
+        if (scenes[i] != current)
+        {
+            items.append(scenes[i]->GetPath());
+        }
+    }
+    QString newItem = tr("<new scene>");
+    items.append(newItem);
+
+    bool ok = false;
+    QString item = QInputDialog::getItem(this, tr("Add Scene Layer"), tr("Scene:"), items, 0, false, &ok);
+    if (!ok)
+    {
+        return;
+    }
+
+    SceneModel* scene = NULL;
+    if (item == newItem)
+    {
+        QString name;
+        name.sprintf("scene%d", (int)scenes.size());
+        name = QInputDialog::getText(this, tr("New Scene"), tr("Name:"), QLineEdit::Normal, name, &ok);
+        if (!ok || name.isEmpty())
+        {
+            return;
+        }
+        scene = mProject->AddScene(name);
+    }
+    else
+    {
+        scene = mProject->FindScene(item);
+    }
+
+    int layerIndex = ui->timeline->GetLayerIndex();
+    ui->timeline->AddSceneLayer(scene, layerIndex + 1);
+}
+
+void MainWindow::NextScene()
+{
+    SceneModel* current = ui->timeline->GetScene();
+    if (!mProject || !current)
+    {
+        return;
+    }
+
+    std::vector<SceneModel*>& scenes = mProject->GetScenes();
+    for (size_t i = 0; i < scenes.size(); ++i)
+    {
+        if (scenes[i] == current)
+        {
+            // commands hold layers of the scene which is no longer shown
+            mUndoStack->clear();
+            ui->timeline->SetScene(scenes[(i + 1) % scenes.size()]);
+            break;
+        }
+    }
+}
+
 void MainWindow::RemoveLayer()
 {
     ui->timeline->RemoveLayer();
@@ -578,3 +800,13 @@ void MainWindow::OnModeChanged(QPainter::CompositionMode mode)
     mSplineTool->SetMode(mode);
 }
 
+void MainWindow::OnTipChanged(int tip)
+{
+    mPenTool->SetTip((BrushTip)tip);
+}
+
+void MainWindow::OnStabilizeChanged(int value)
+{
+    mPenTool->SetStabilize((float)value);
+}
+
@@ -24,6 +24,8 @@ class SplineTool;
 class ColorPicker;
 class TraceTool;
 class RenderWindow;
+class UndoHistory;
+class StrokeRecording;
 
 class MainWindow : public QMainWindow
 {
@@ -56,8 +58,17 @@ public slots:
     void BrushSizeChanged(int value);
     void Play();
     void OnTimer();
+    void DumpPlaybackStats();
+    void RecordStrokes(bool checked);
+    void SetUndoBudget();
+    void MoreOnions();
+    void FewerOnions();
     void AddRasterLayer();
     void AddTraceLayer();
+    void AddBlurLayer();
+    void AddTransformLayer();
+    void AddSceneLayer();
+    void NextScene();
     void RemoveLayer();
     void ToggleUI();
     void ChangeToolPan();
@@ -74,11 +85,16 @@ public slots:
     void OnBrushSizeChanged(float value);
     void OnSmoothChanged(int value);
     void OnModeChanged(QPainter::CompositionMode mode);
+    void OnTipChanged(int tip);
+    void OnStabilizeChanged(int value);
 
 private:
     Ui::MainWindow *ui;
     AnimationProject* mProject;
     QUndoStack* mUndoStack;
+    UndoHistory* mUndoHistory;
+    // Strokes drawn while recording is on, saved when it is turned off
+    StrokeRecording* mRecording;
     QTimer* mTimer;
     bool mShowUI;
     std::vector<QWidget*> mUis;
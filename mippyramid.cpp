@@ -0,0 +1,153 @@
+#include "mippyramid.h"
+#include <math.h>
+
+// Levels stop once both sides are below this
+#define MIP_MIN_SIZE 32
+
+MipPyramid::MipPyramid()
+{
+}
+
+void MipPyramid::Invalidate(const QRect& rect)
+{
+    for (size_t i = 0; i < mDirty.size(); ++i)
+    {
+        mDirty[i] = mDirty[i].united(rect);
+    }
+}
+
+int MipPyramid::GetLevelForScale(float scale)
+{
+    if (scale >= 1.0f || scale <= 0.0f)
+    {
+        return 0;
+    }
+    // never sample a level smaller than the screen
+    return (int)floorf(log2f(1.0f / scale));
+}
+
+QRect MipPyramid::ScaleRect(const QRect& rect, int level)
+{
+    if (rect.isEmpty())
+    {
+        return QRect();
+    }
+    int left = rect.left() >> level;
+    int top = rect.top() >> level;
+    int right = rect.right() >> level;
+    int bottom = rect.bottom() >> level;
+    return QRect(left, top, right - left + 1, bottom - top + 1);
+}
+
+const QImage* MipPyramid::GetLevel(const QImage* source, int& level)
+{
+    if (!source || level <= 0)
+    {
+        level = 0;
+        return source;
+    }
+
+    int w = source->width();
+    int h = source->height();
+    int maxLevel = 0;
+    while ((w > MIP_MIN_SIZE || h > MIP_MIN_SIZE) && maxLevel < level)
+    {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        ++maxLevel;
+    }
+    level = maxLevel;
+    if (level == 0)
+    {
+        return source;
+    }
+
+    Update(source, level);
+    return &mLevels[level - 1];
+}
+
+static inline void Premultiply(const unsigned char* p, unsigned int* sum)
+{
+    unsigned int a = p[3];
+    sum[0] += (p[0] * a + 127) / 255;
+    sum[1] += (p[1] * a + 127) / 255;
+    sum[2] += (p[2] * a + 127) / 255;
+    sum[3] += a;
+}
+
+static inline void Accumulate(const unsigned char* p, unsigned int* sum)
+{
+    sum[0] += p[0];
+    sum[1] += p[1];
+    sum[2] += p[2];
+    sum[3] += p[3];
+}
+
+// 2x2 box filter of src into rect of dst, samples past the edge of src are clamped
+static void Downsample(const QImage& src, QImage& dst, const QRect& rect, bool premultiply)
+{
+    int maxX = src.width() - 1;
+    int maxY = src.height() - 1;
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
+    {
+        const unsigned char* row0 = src.constScanLine(qMin(y * 2, maxY));
+        const unsigned char* row1 = src.constScanLine(qMin(y * 2 + 1, maxY));
+        unsigned char* out = dst.scanLine(y) + rect.left() * 4;
+        for (int x = rect.left(); x <= rect.right(); ++x)
+        {
+            int x0 = qMin(x * 2, maxX) * 4;
+            int x1 = qMin(x * 2 + 1, maxX) * 4;
+            unsigned int sum[4] = { 0, 0, 0, 0 };
+            if (premultiply)
+            {
+                Premultiply(row0 + x0, sum);
+                Premultiply(row0 + x1, sum);
+                Premultiply(row1 + x0, sum);
+                Premultiply(row1 + x1, sum);
+            }
+            else
+            {
+                Accumulate(row0 + x0, sum);
+                Accumulate(row0 + x1, sum);
+                Accumulate(row1 + x0, sum);
+                Accumulate(row1 + x1, sum);
+            }
+            out[0] = (unsigned char)((sum[0] + 2) >> 2);
+            out[1] = (unsigned char)((sum[1] + 2) >> 2);
+            out[2] = (unsigned char)((sum[2] + 2) >> 2);
+            out[3] = (unsigned char)((sum[3] + 2) >> 2);
+            out += 4;
+        }
+    }
+}
+
+void MipPyramid::Update(const QImage* source, int level)
+{
+    while ((int)mLevels.size() < level)
+    {
+        const QImage& prev = mLevels.empty() ? *source : mLevels.back();
+        mLevels.push_back(QImage((prev.width() + 1) / 2, (prev.height() + 1) / 2, QImage::Format_RGBA8888_Premultiplied));
+        mDirty.push_back(source->rect());
+    }
+
+    for (int i = 1; i <= level; ++i)
+    {
+        QRect& dirty = mDirty[i - 1];
+        if (dirty.isEmpty())
+        {
+            continue;
+        }
+
+        QImage& dst = mLevels[i - 1];
+        QRect rect = ScaleRect(dirty, i).intersected(dst.rect());
+        if (i == 1)
+        {
+            Downsample(*source, dst, rect, source->format() != QImage::Format_RGBA8888_Premultiplied);
+        }
+        else
+        {
+            Downsample(mLevels[i - 2], dst, rect, false);
+        }
+        dirty = QRect();
+    }
+}
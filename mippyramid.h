@@ -0,0 +1,34 @@
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <vector>
+
+// Half resolution copies of an RGBA8888 image for drawing it zoomed out.
+// Levels are premultiplied, built on first use and refreshed only where the source changed.
+class MipPyramid
+{
+public:
+    MipPyramid();
+
+    // rect is in source coordinates
+    void Invalidate(const QRect& rect);
+    // Level 0 is the source itself, level n is 1/2^n of it.
+    // level is clamped to the levels the source is large enough for.
+    const QImage* GetLevel(const QImage* source, int& level);
+
+    static int GetLevelForScale(float scale);
+    // Pixels of level covering rect of the source
+    static QRect ScaleRect(const QRect& rect, int level);
+
+private:
+    void Update(const QImage* source, int level);
+
+private:
+    std::vector<QImage> mLevels;
+    // Per level, area of the source changed since the level was last updated
+    std::vector<QRect> mDirty;
+};
+
+#endif // MIPPYRAMID_H
@@ -0,0 +1,171 @@
+#include "onionskin.h"
+#include "animationfile.h"
+#include <QPainter>
+#include <string.h>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ONION_SSE2
+#endif
+
+static inline int Div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+#ifdef ONION_SSE2
+static inline __m128i Div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+#endif
+
+void BlendOnionSpan(unsigned char* dst, const unsigned char* mask, int count, const QColor& color, int weight)
+{
+    const int c[4] = { color.red(), color.green(), color.blue(), 255 };
+    int i = 0;
+
+#ifdef ONION_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16((short)weight);
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i tint = _mm_setr_epi16(c[0], c[1], c[2], c[3], c[0], c[1], c[2], c[3]);
+    for (; i + 4 <= count; i += 4)
+    {
+        int m;
+        memcpy(&m, mask + i, 4);
+        if (m == 0)
+        {
+            continue;
+        }
+
+        __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(m), zero);
+        a = Div255(_mm_mullo_epi16(a, w));
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i a01 = _mm_unpacklo_epi32(a, a);
+        __m128i a23 = _mm_unpackhi_epi32(a, a);
+
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i * 4));
+        __m128i d01 = _mm_unpacklo_epi8(d, zero);
+        __m128i d23 = _mm_unpackhi_epi8(d, zero);
+        d01 = _mm_add_epi16(Div255(_mm_mullo_epi16(tint, a01)), Div255(_mm_mullo_epi16(d01, _mm_sub_epi16(full, a01))));
+        d23 = _mm_add_epi16(Div255(_mm_mullo_epi16(tint, a23)), Div255(_mm_mullo_epi16(d23, _mm_sub_epi16(full, a23))));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_packus_epi16(d01, d23));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        int a = Div255(mask[i] * weight);
+        if (a == 0)
+        {
+            continue;
+        }
+        unsigned char* p = dst + i * 4;
+        for (int k = 0; k < 4; ++k)
+        {
+            p[k] = (unsigned char)(Div255(c[k] * a) + Div255(p[k] * (255 - a)));
+        }
+    }
+}
+
+static bool IsFurther(const OnionSkin::Onion& a, const OnionSkin::Onion& b)
+{
+    return a.distance > b.distance;
+}
+
+OnionSkin::OnionSkin()
+    :mBefore(2)
+    ,mAfter(2)
+    ,mBeforeColor(255, 60, 60)
+    ,mAfterColor(60, 200, 60)
+    ,mOpacity(0.25f)
+    ,mFalloff(0.6f)
+{
+}
+
+void OnionSkin::SetDepth(int before, int after)
+{
+    mBefore = qMax(0, before);
+    mAfter = qMax(0, after);
+}
+
+void OnionSkin::AddOnions(std::vector<Onion>& onions, const std::vector<RasterFrameModel*>& frames, const QColor& color)
+{
+    float opacity = mOpacity;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        RasterFrameModel* frame = frames[i];
+        int weight = (int)(opacity * 255.0f + 0.5f);
+        const QImage& image = frame->GetOnionImage(color, weight);
+        if (!image.isNull() && weight > 0)
+        {
+            Onion onion;
+            onion.image = &image;
+            onion.rect = frame->GetBounds();
+            onion.distance = (int)i + 1;
+            onions.push_back(onion);
+        }
+        opacity *= mFalloff;
+    }
+}
+
+void OnionSkin::Render(QPainter& painter, int width, int height, const QRect& visible,
+                       const std::vector<RasterFrameModel*>& before,
+                       const std::vector<RasterFrameModel*>& after)
+{
+    std::vector<Onion> onions;
+    AddOnions(onions, before, mBeforeColor);
+    AddOnions(onions, after, mAfterColor);
+    if (onions.empty())
+    {
+        return;
+    }
+
+    // furthest first so the nearest onions end up on top
+    std::stable_sort(onions.begin(), onions.end(), IsFurther);
+
+    std::vector<qint64> keys(onions.size());
+    QRect bounds;
+    for (size_t i = 0; i < onions.size(); ++i)
+    {
+        keys[i] = onions[i].image->cacheKey();
+        bounds = bounds.united(onions[i].rect);
+    }
+
+    if (mImage.width() != width || mImage.height() != height)
+    {
+        mImage = QImage(width, height, QImage::Format_RGBA8888_Premultiplied);
+        mImage.fill(0);
+        mImageBounds = QRect();
+        mImageKeys.clear();
+    }
+    if (keys != mImageKeys)
+    {
+        // all of the onions, panning around them does not need a rebuild
+        for (int y = mImageBounds.top(); y <= mImageBounds.bottom(); ++y)
+        {
+            memset(mImage.scanLine(y) + mImageBounds.left() * 4, 0, mImageBounds.width() * 4);
+        }
+        mImageBounds = bounds.intersected(mImage.rect());
+        mImageKeys = keys;
+
+        QPainter p(&mImage);
+        for (size_t i = 0; i < onions.size(); ++i)
+        {
+            p.drawImage(onions[i].rect.topLeft(), *onions[i].image);
+        }
+    }
+
+    QRect area = mImageBounds.intersected(visible);
+    if (area.isEmpty())
+    {
+        return;
+    }
+    qreal opacity = painter.opacity();
+    painter.setOpacity(1.0);
+    painter.drawImage(area.topLeft(), mImage, area);
+    painter.setOpacity(opacity);
+}
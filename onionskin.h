@@ -0,0 +1,59 @@
+#ifndef ONIONSKIN_H
+#define ONIONSKIN_H
+
+#include <QImage>
+#include <QColor>
+#include <vector>
+
+class QPainter;
+class RasterFrameModel;
+
+// Blends count pixels of a tint, weighted by mask * weight / 255, over premultiplied RGBA8888 dst
+void BlendOnionSpan(unsigned char* dst, const unsigned char* mask, int count, const QColor& color, int weight);
+
+// Draws the frames around the current one tinted, fading with distance.
+// Frames keep their tinted onion until edited, the onions are accumulated into one image which is
+// kept until a frame, tint or opacity changes, so a repaint draws a single image.
+class OnionSkin
+{
+public:
+    OnionSkin();
+
+    void SetDepth(int before, int after);
+    int GetBefore() const { return mBefore; }
+    int GetAfter() const { return mAfter; }
+    void SetColors(const QColor& before, const QColor& after) { mBeforeColor = before; mAfterColor = after; }
+    // Opacity of the nearest onion, each further one is multiplied by falloff
+    void SetOpacity(float value) { mOpacity = value; }
+    void SetFalloff(float value) { mFalloff = value; }
+
+    // before and after are ordered nearest first, only the visible area is blended
+    void Render(QPainter& painter, int width, int height, const QRect& visible,
+                const std::vector<RasterFrameModel*>& before,
+                const std::vector<RasterFrameModel*>& after);
+
+    struct Onion
+    {
+        // Tinted bounds area of the frame
+        const QImage* image;
+        QRect rect;
+        int distance;
+    };
+
+private:
+    void AddOnions(std::vector<Onion>& onions, const std::vector<RasterFrameModel*>& frames, const QColor& color);
+
+private:
+    int mBefore;
+    int mAfter;
+    QColor mBeforeColor;
+    QColor mAfterColor;
+    float mOpacity;
+    float mFalloff;
+    QImage mImage;
+    QRect mImageBounds;
+    // cacheKey of the onion images mImage holds, furthest first
+    std::vector<qint64> mImageKeys;
+};
+
+#endif // ONIONSKIN_H
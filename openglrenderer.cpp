@@ -51,8 +51,9 @@ GLRenderTarget::~GLRenderTarget()
     }
 }
 
-void GLRenderTarget::Blit(GLRenderTarget* src, bool smooth)
+void GLRenderTarget::Blit(IRenderTarget* target, bool smooth)
 {
+    GLRenderTarget* src = static_cast<GLRenderTarget*>(target);
     if (!src)
     {
         return;
@@ -729,9 +730,6 @@ void BlurProgram::BuildShaders()
     psH.append(fsBlur2);
     psV.append(fsBlur2);
 
-//    printf("%s", psH.c_str());fflush(stdout);
-//    printf("%s", psV.c_str());fflush(stdout);
-
     mHorizontalProgram = new GLShaderProgram(vsBlur, psH.c_str());
     mVerticalProgram = new GLShaderProgram(vsBlur, psV.c_str());
 }
@@ -881,9 +879,9 @@ GLRenderTarget* GLRenderer::CreateTarget(int width, int height, int* data, bool
     return new GLRenderTarget(new GLTexture(width, height, data, topDownOrder, 4, false, false, false));
 }
 
-void GLRenderer::Clear(GLRenderTarget* target, float r, float g, float b, float a)
+void GLRenderer::Clear(IRenderTarget* target, float r, float g, float b, float a)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, target ? target->mFrameBufferId : 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, target ? static_cast<GLRenderTarget*>(target)->mFrameBufferId : 0);
     glClearColor(r, g, b, a);
     glClear(GL_COLOR_BUFFER_BIT);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -895,6 +893,18 @@ void GLRenderer::SetScreenSize(int width, int height)
     mHeight = height;
 }
 
+void GLRenderer::EnableBlend(bool enable)
+{
+    if (enable)
+    {
+        glEnable(GL_BLEND);
+    }
+    else
+    {
+        glDisable(GL_BLEND);
+    }
+}
+
 void GLRenderer::UseProgram(GLShaderProgram* program)
 {
     glUseProgram(program ? program->mProgramId : 0);
@@ -915,9 +925,9 @@ void GLRenderer::SetRenderTarget(GLRenderTarget* target)
 
 }
 
-void GLRenderer::BlendSource(GLRenderTarget* target, GLTexture* src, float* mvp, float r, float g, float b, float a)
+void GLRenderer::BlendSource(IRenderTarget* target, ITexture* src, float* mvp, float r, float g, float b, float a)
 {
-    SetRenderTarget(target);
+    SetRenderTarget(static_cast<GLRenderTarget*>(target));
 
     float w = (float)src->GetWidth();
     float h = (float)src->GetHeight();
@@ -930,15 +940,15 @@ void GLRenderer::BlendSource(GLRenderTarget* target, GLTexture* src, float* mvp,
 
     glUseProgram(mBlendSourceProgram->mProgramId);
     mBlendSourceProgram->SetColor("color", r, g, b, a);
-    mBlendSourceProgram->SetTexture("srcTex", 0, src);
+    mBlendSourceProgram->SetTexture("srcTex", 0, static_cast<GLTexture*>(src));
     mBlendSourceProgram->SetMatrix("mvp", mvp);
     mBlendSourceProgram->SetAttribute("posTexcoord", 0, 4, vertices);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void GLRenderer::BlendSourceOver(GLRenderTarget* target, GLTexture* dst, GLTexture* src, float* mvp, float r, float g, float b, float a)
+void GLRenderer::BlendSourceOver(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a)
 {
-    SetRenderTarget(target);
+    SetRenderTarget(static_cast<GLRenderTarget*>(target));
 
     float w = (float)src->GetWidth();
     float h = (float)src->GetHeight();
@@ -951,16 +961,16 @@ void GLRenderer::BlendSourceOver(GLRenderTarget* target, GLTexture* dst, GLTextu
 
     glUseProgram(mBlendSourceOverProgram->mProgramId);
     mBlendSourceOverProgram->SetColor("color", r, g, b, a);
-    mBlendSourceOverProgram->SetTexture("srcTex", 0, src);
-    mBlendSourceOverProgram->SetTexture("srcTex", 1, dst);
+    mBlendSourceOverProgram->SetTexture("srcTex", 0, static_cast<GLTexture*>(src));
+    mBlendSourceOverProgram->SetTexture("dstTex", 1, static_cast<GLTexture*>(dst));
     mBlendSourceOverProgram->SetMatrix("mvp", mvp);
     mBlendSourceOverProgram->SetAttribute("posTexcoord", 0, 4, vertices);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void GLRenderer::BlendMultipy(GLRenderTarget* target, GLTexture* dst, GLTexture* src, float* mvp, float r, float g, float b, float a)
+void GLRenderer::BlendMultipy(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a)
 {
-    SetRenderTarget(target);
+    SetRenderTarget(static_cast<GLRenderTarget*>(target));
 
     float w = (float)src->GetWidth();
     float h = (float)src->GetHeight();
@@ -973,14 +983,14 @@ void GLRenderer::BlendMultipy(GLRenderTarget* target, GLTexture* dst, GLTexture*
 
     glUseProgram(mBlendMultiplyProgram->mProgramId);
     mBlendMultiplyProgram->SetColor("color", r, g, b, a);
-    mBlendMultiplyProgram->SetTexture("srcTex", 0, src);
-    mBlendMultiplyProgram->SetTexture("srcTex", 1, dst);
+    mBlendMultiplyProgram->SetTexture("srcTex", 0, static_cast<GLTexture*>(src));
+    mBlendMultiplyProgram->SetTexture("dstTex", 1, static_cast<GLTexture*>(dst));
     mBlendMultiplyProgram->SetMatrix("mvp", mvp);
     mBlendMultiplyProgram->SetAttribute("posTexcoord", 0, 4, vertices);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void GLRenderer::Blur(GLRenderTarget* target, GLRenderTarget* targetTemp, float* mvp, GLTexture* src, int radius)
+void GLRenderer::Blur(IRenderTarget* target, IRenderTarget* targetTemp, float* mvp, ITexture* src, int radius)
 {
     if (radius > MAX_BLUR_RADIUS)
     {
@@ -1007,27 +1017,27 @@ void GLRenderer::Blur(GLRenderTarget* target, GLRenderTarget* targetTemp, float*
     float texSizeInv[] = {1.0f / w, 1.0f /h};
 
     GLShaderProgram* hProg = prog->mHorizontalProgram;
-    SetRenderTarget(targetTemp);
+    SetRenderTarget(static_cast<GLRenderTarget*>(targetTemp));
     glUseProgram(hProg->mProgramId);
     hProg->SetMatrix("mvp", mvp);
-    hProg->SetTexture("srcTex", 0, src);
+    hProg->SetTexture("srcTex", 0, static_cast<GLTexture*>(src));
     hProg->SetFloat2("texSizeInv", texSizeInv);
     hProg->SetAttribute("posTexcoord", 0, 4, vertices);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
     GLShaderProgram* vProg = prog->mVerticalProgram;
-    SetRenderTarget(target);
+    SetRenderTarget(static_cast<GLRenderTarget*>(target));
     glUseProgram(vProg->mProgramId);
     vProg->SetMatrix("mvp", mvp);
-    vProg->SetTexture("srcTex", 0, targetTemp->mTexture);
+    vProg->SetTexture("srcTex", 0, static_cast<GLRenderTarget*>(targetTemp)->mTexture);
     vProg->SetFloat2("texSizeInv", texSizeInv);
     vProg->SetAttribute("posTexcoord", 0, 4, vertices);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void GLRenderer::Mask(GLRenderTarget* target, GLTexture* src, float* mvp, GLTexture* colorMask, GLTexture* alphaMask, float alpha)
+void GLRenderer::Mask(IRenderTarget* target, ITexture* src, float* mvp, ITexture* colorMask, ITexture* alphaMask, float alpha)
 {
-    SetRenderTarget(target);
+    SetRenderTarget(static_cast<GLRenderTarget*>(target));
 
     float w = (float)src->GetWidth();
     float h = (float)src->GetHeight();
@@ -1039,9 +1049,9 @@ void GLRenderer::Mask(GLRenderTarget* target, GLTexture* src, float* mvp, GLText
     };
 
     glUseProgram(mMaskProgram->mProgramId);
-    mMaskProgram->SetTexture("srcTex", 0, src);
-    mMaskProgram->SetTexture("colorMaskTex", 1, colorMask ? colorMask : mDefaultTexture);
-    mMaskProgram->SetTexture("alphaMaskTex", 2, alphaMask ? alphaMask : mDefaultTexture);
+    mMaskProgram->SetTexture("srcTex", 0, static_cast<GLTexture*>(src));
+    mMaskProgram->SetTexture("colorMaskTex", 1, colorMask ? static_cast<GLTexture*>(colorMask) : mDefaultTexture);
+    mMaskProgram->SetTexture("alphaMaskTex", 2, alphaMask ? static_cast<GLTexture*>(alphaMask) : mDefaultTexture);
     mMaskProgram->SetFloat("alpha", alpha);
     mMaskProgram->SetMatrix("mvp", mvp);
     mMaskProgram->SetAttribute("posTexcoord", 0, 4, vertices);
@@ -4,6 +4,7 @@
 #include <vector>
 #include <map>
 #include <math.h>
+#include "renderer.h"
 
 #define MAX_BLUR_RADIUS 2000
 class BlurProgram;
@@ -769,7 +770,7 @@ public:
 };
 
 
-class GLTexture
+class GLTexture : public ITexture
 {
     friend class GLRenderer;
     friend class GLRenderTarget;
@@ -789,14 +790,14 @@ private:
     int mTextureId;
 };
 
-class GLRenderTarget
+class GLRenderTarget : public IRenderTarget
 {
     friend class GLRenderer;
 public:
     ~GLRenderTarget();
     int GetWidth() const { return mWidth; }
     int GetHeight() const { return mHeight; }
-    void Blit(GLRenderTarget* src, bool smooth);
+    void Blit(IRenderTarget* src, bool smooth);
     GLTexture* GetTexture() { return mTexture; }
 
 private:
@@ -955,7 +956,7 @@ private:
     float mColor[4];
 };
 
-class GLRenderer
+class GLRenderer : public IRenderer
 {
 public:
     GLRenderer();
@@ -969,12 +970,13 @@ public:
     void UseProgram(GLShaderProgram* program);
     void SetRenderTarget(GLRenderTarget* target);
     void SetScreenSize(int width, int height);
-    void Clear(GLRenderTarget* target, float r, float g, float b, float a);
-    void BlendSource(GLRenderTarget* target, GLTexture* src, float* mvp, float r, float g, float b, float a);
-    void BlendSourceOver(GLRenderTarget* target, GLTexture* dst, GLTexture* src, float* mvp, float r, float g, float b, float a);
-    void BlendMultipy(GLRenderTarget* target, GLTexture* dst, GLTexture* src, float* mvp, float r, float g, float b, float a);
-    void Blur(GLRenderTarget* target, GLRenderTarget* targetTemp, float* mvp, GLTexture* src, int radius);
-    void Mask(GLRenderTarget* target, GLTexture* src, float* mvp, GLTexture* colorMask, GLTexture* alphaMask, float alpha);
+    void EnableBlend(bool enable);
+    void Clear(IRenderTarget* target, float r, float g, float b, float a);
+    void BlendSource(IRenderTarget* target, ITexture* src, float* mvp, float r, float g, float b, float a);
+    void BlendSourceOver(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a);
+    void BlendMultipy(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a);
+    void Blur(IRenderTarget* target, IRenderTarget* targetTemp, float* mvp, ITexture* src, int radius);
+    void Mask(IRenderTarget* target, ITexture* src, float* mvp, ITexture* colorMask, ITexture* alphaMask, float alpha);
 
 
 //    void ChangeColor(int r, int g, int b, int a);
@@ -0,0 +1,112 @@
+#include "parallel.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+
+struct ParallelState
+{
+    ParallelRangeFunc func;
+    void* context;
+    int count;
+    int chunkSize;
+    int chunks;
+    QAtomicInt next;
+    QAtomicInt done;
+    // Workers may start after the caller returned, the last reference deletes the state
+    QAtomicInt refs;
+    QMutex mutex;
+    QWaitCondition finished;
+};
+
+static void RunChunks(ParallelState* state)
+{
+    int done = 0;
+    for (;;)
+    {
+        int chunk = state->next.fetchAndAddOrdered(1);
+        if (chunk >= state->chunks)
+        {
+            break;
+        }
+        int begin = chunk * state->chunkSize;
+        int end = qMin(state->count, begin + state->chunkSize);
+        state->func(begin, end, state->context);
+        ++done;
+    }
+
+    if (done > 0 && state->done.fetchAndAddOrdered(done) + done == state->chunks)
+    {
+        QMutexLocker lock(&state->mutex);
+        state->finished.wakeAll();
+    }
+}
+
+static void Release(ParallelState* state)
+{
+    if (!state->refs.deref())
+    {
+        delete state;
+    }
+}
+
+class ParallelTask : public QRunnable
+{
+public:
+    ParallelTask(ParallelState* state) : mState(state) {}
+
+    void run()
+    {
+        RunChunks(mState);
+        Release(mState);
+    }
+
+private:
+    ParallelState* mState;
+};
+
+void ParallelFor(int count, ParallelRangeFunc func, void* context, int minChunk)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    QThreadPool* pool = QThreadPool::globalInstance();
+    int threads = pool->maxThreadCount();
+    if (minChunk < 1)
+    {
+        minChunk = 1;
+    }
+    int chunks = qMin(threads * 4, (count + minChunk - 1) / minChunk);
+    if (threads <= 1 || chunks <= 1)
+    {
+        func(0, count, context);
+        return;
+    }
+
+    ParallelState* state = new ParallelState();
+    state->func = func;
+    state->context = context;
+    state->count = count;
+    state->chunkSize = (count + chunks - 1) / chunks;
+    state->chunks = (count + state->chunkSize - 1) / state->chunkSize;
+
+    int helpers = qMin(threads, state->chunks) - 1;
+    state->refs.store(helpers + 1);
+    for (int i = 0; i < helpers; ++i)
+    {
+        pool->start(new ParallelTask(state));
+    }
+
+    RunChunks(state);
+    {
+        QMutexLocker lock(&state->mutex);
+        while (state->done.load() < state->chunks)
+        {
+            state->finished.wait(&state->mutex);
+        }
+    }
+    Release(state);
+}
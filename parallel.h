@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+typedef void (*ParallelRangeFunc)(int begin, int end, void* context);
+
+// Splits [0, count) into chunks of at least minChunk, runs them on the global
+// thread pool and the calling thread, and returns when all are done.
+// Safe to call from a pool thread, the caller takes chunks no worker has started.
+void ParallelFor(int count, ParallelRangeFunc func, void* context, int minChunk = 16);
+
+#endif // PARALLEL_H
@@ -0,0 +1,444 @@
+#include "pixelkernels.h"
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KERNELS_SSE2
+#endif
+
+#ifdef KERNELS_SSE2
+
+struct Vec4
+{
+    __m128 v;
+};
+
+static inline Vec4 MakeVec4(__m128 v)
+{
+    Vec4 r;
+    r.v = v;
+    return r;
+}
+
+static inline Vec4 Set(float r, float g, float b, float a) { return MakeVec4(_mm_setr_ps(r, g, b, a)); }
+static inline Vec4 Splat(float s) { return MakeVec4(_mm_set1_ps(s)); }
+static inline Vec4 Add(Vec4 a, Vec4 b) { return MakeVec4(_mm_add_ps(a.v, b.v)); }
+static inline Vec4 Sub(Vec4 a, Vec4 b) { return MakeVec4(_mm_sub_ps(a.v, b.v)); }
+static inline Vec4 Mul(Vec4 a, Vec4 b) { return MakeVec4(_mm_mul_ps(a.v, b.v)); }
+static inline Vec4 Div(Vec4 a, Vec4 b) { return MakeVec4(_mm_div_ps(a.v, b.v)); }
+static inline Vec4 Min(Vec4 a, Vec4 b) { return MakeVec4(_mm_min_ps(a.v, b.v)); }
+static inline Vec4 Alpha(Vec4 c) { return MakeVec4(_mm_shuffle_ps(c.v, c.v, _MM_SHUFFLE(3, 3, 3, 3))); }
+static inline Vec4 Red(Vec4 c) { return MakeVec4(_mm_shuffle_ps(c.v, c.v, _MM_SHUFFLE(0, 0, 0, 0))); }
+
+// rgb of c with the alpha lane of a
+static inline Vec4 WithAlpha(Vec4 c, Vec4 a)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    return MakeVec4(_mm_or_ps(_mm_and_ps(mask, c.v), _mm_andnot_ps(mask, a.v)));
+}
+
+static inline Vec4 Load(const unsigned char* p)
+{
+    int bits;
+    memcpy(&bits, p, 4);
+    __m128i zero = _mm_setzero_si128();
+    __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero);
+    x = _mm_unpacklo_epi16(x, zero);
+    return MakeVec4(_mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / 255.0f)));
+}
+
+static inline void Store(unsigned char* p, Vec4 c)
+{
+    // max first so NaN from 0/0 ends up as 0
+    __m128 x = _mm_min_ps(_mm_max_ps(c.v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128i i = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    int bits = _mm_cvtsi128_si32(i);
+    memcpy(p, &bits, 4);
+}
+
+static inline Vec4 LoadF(const float* p) { return MakeVec4(_mm_loadu_ps(p)); }
+static inline void StoreF(float* p, Vec4 c) { _mm_storeu_ps(p, c.v); }
+
+#else
+
+struct Vec4
+{
+    float v[4];
+};
+
+static inline Vec4 Set(float r, float g, float b, float a)
+{
+    Vec4 c;
+    c.v[0] = r;
+    c.v[1] = g;
+    c.v[2] = b;
+    c.v[3] = a;
+    return c;
+}
+
+static inline Vec4 Splat(float s) { return Set(s, s, s, s); }
+static inline Vec4 Add(Vec4 a, Vec4 b) { return Set(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]); }
+static inline Vec4 Sub(Vec4 a, Vec4 b) { return Set(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]); }
+static inline Vec4 Mul(Vec4 a, Vec4 b) { return Set(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]); }
+static inline Vec4 Div(Vec4 a, Vec4 b) { return Set(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]); }
+static inline Vec4 Min(Vec4 a, Vec4 b)
+{
+    return Set(a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+               a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]);
+}
+static inline Vec4 Alpha(Vec4 c) { return Splat(c.v[3]); }
+static inline Vec4 Red(Vec4 c) { return Splat(c.v[0]); }
+static inline Vec4 WithAlpha(Vec4 c, Vec4 a) { return Set(c.v[0], c.v[1], c.v[2], a.v[3]); }
+
+static inline Vec4 Load(const unsigned char* p)
+{
+    const float s = 1.0f / 255.0f;
+    return Set(p[0] * s, p[1] * s, p[2] * s, p[3] * s);
+}
+
+static inline void Store(unsigned char* p, Vec4 c)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = c.v[i];
+        // also catches NaN from 0/0
+        if (!(x > 0.0f))
+        {
+            x = 0.0f;
+        }
+        else if (x > 1.0f)
+        {
+            x = 1.0f;
+        }
+        p[i] = (unsigned char)(x * 255.0f + 0.5f);
+    }
+}
+
+static inline Vec4 LoadF(const float* p) { return Set(p[0], p[1], p[2], p[3]); }
+static inline void StoreF(float* p, Vec4 c) { memcpy(p, c.v, sizeof(c.v)); }
+
+#endif
+
+void KernelBlendSource(unsigned char* out, const unsigned char* src, int count, const float color[4])
+{
+    Vec4 tint = Set(color[0], color[1], color[2], color[3]);
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 c = Mul(Load(src + i * 4), tint);
+        // c.rgb * c.a / c.a
+        Vec4 a = Alpha(c);
+        Store(out + i * 4, WithAlpha(Div(Mul(c, a), a), c));
+    }
+}
+
+void KernelBlendSourceOver(unsigned char* out, const unsigned char* dst, const unsigned char* src, int count, const float color[4])
+{
+    Vec4 tint = Set(color[0], color[1], color[2], color[3]);
+    Vec4 one = Splat(1.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 s = Mul(Load(src + i * 4), tint);
+        Vec4 d = Load(dst + i * 4);
+        Vec4 sa = Alpha(s);
+        Vec4 da = Mul(Alpha(d), Sub(one, sa));
+        Vec4 a = Add(sa, da);
+        Vec4 c = Div(Add(Mul(s, sa), Mul(d, da)), a);
+        Store(out + i * 4, WithAlpha(c, a));
+    }
+}
+
+void KernelBlendMultiply(unsigned char* out, const unsigned char* dst, const unsigned char* src, int count, const float color[4])
+{
+    Vec4 tint = Set(color[0], color[1], color[2], color[3]);
+    Vec4 one = Splat(1.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 s = Mul(Load(src + i * 4), tint);
+        Vec4 d = Load(dst + i * 4);
+        Vec4 sa = Alpha(s);
+        Vec4 ps = Mul(s, sa);
+        Vec4 pd = Mul(d, Alpha(d));
+        Vec4 da = Mul(Alpha(d), Sub(one, sa));
+        Vec4 a = Add(sa, da);
+        Vec4 c = Div(Add(Mul(Mul(ps, pd), sa), Mul(pd, da)), a);
+        // the shader divides by alpha a second time
+        c = Div(c, a);
+        Store(out + i * 4, WithAlpha(c, a));
+    }
+}
+
+void KernelMask(unsigned char* out, const unsigned char* src, const unsigned char* colorMask, const unsigned char* alphaMask, int count, float alpha)
+{
+    Vec4 one = Splat(1.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 a = Splat(alpha);
+        if (colorMask)
+        {
+            a = Mul(a, Red(Load(colorMask + i * 4)));
+        }
+        if (alphaMask)
+        {
+            a = Mul(a, Alpha(Load(alphaMask + i * 4)));
+        }
+        Store(out + i * 4, Mul(Load(src + i * 4), WithAlpha(one, a)));
+    }
+}
+
+void KernelBlendAlpha(unsigned char* dst, const unsigned char* src, int count)
+{
+    Vec4 one = Splat(1.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 s = Load(src + i * 4);
+        Vec4 sa = Alpha(s);
+        Vec4 d = Load(dst + i * 4);
+        Store(dst + i * 4, Add(Mul(s, sa), Mul(d, Sub(one, sa))));
+    }
+}
+
+// Premultiplied s (opacity applied) and d, the alpha lanes follow from the same formula
+template <int Mode>
+static inline Vec4 BlendPremultiplied(Vec4 s, Vec4 d, Vec4 opacity)
+{
+    Vec4 one = Splat(1.0f);
+    switch (Mode)
+    {
+    case BlendMultiply:
+        return Add(Mul(s, d), Add(Mul(s, Sub(one, Alpha(d))), Mul(d, Sub(one, Alpha(s)))));
+    case BlendAdd:
+        return Min(Add(s, d), one);
+    case BlendScreen:
+        return Sub(Add(s, d), Mul(s, d));
+    case BlendBehind:
+        return Add(d, Mul(s, Sub(one, Alpha(d))));
+    case BlendErase:
+        return Mul(d, Sub(one, Alpha(s)));
+    case BlendReplace:
+        return Add(s, Mul(d, Sub(one, opacity)));
+    default:
+        return Add(s, Mul(d, Sub(one, Alpha(s))));
+    }
+}
+
+template <int Mode>
+static void BlendLayerRow(unsigned char* dst, const unsigned char* src, int count, float opacity)
+{
+    Vec4 o = Splat(opacity);
+    for (int i = 0; i < count; ++i)
+    {
+        const unsigned char* sp = src + i * 4;
+        unsigned char* dp = dst + i * 4;
+        // most of a layer is empty, and only replace changes dst there
+        if (Mode != BlendReplace && sp[3] == 0)
+        {
+            continue;
+        }
+        if (Mode == BlendNormal && sp[3] == 0xFF && opacity >= 1.0f)
+        {
+            memcpy(dp, sp, 4);
+            continue;
+        }
+
+        Vec4 s = Load(sp);
+        Vec4 sa = Mul(Alpha(s), o);
+        Vec4 d = Load(dp);
+        Vec4 c = BlendPremultiplied<Mode>(WithAlpha(Mul(s, sa), sa), WithAlpha(Mul(d, Alpha(d)), d), o);
+        Store(dp, WithAlpha(Div(c, Alpha(c)), c));
+    }
+}
+
+void KernelBlendLayer(unsigned char* dst, const unsigned char* src, int count, float opacity, BlendMode mode)
+{
+    switch (mode)
+    {
+    case BlendMultiply:
+        BlendLayerRow<BlendMultiply>(dst, src, count, opacity);
+        break;
+    case BlendAdd:
+        BlendLayerRow<BlendAdd>(dst, src, count, opacity);
+        break;
+    case BlendScreen:
+        BlendLayerRow<BlendScreen>(dst, src, count, opacity);
+        break;
+    case BlendBehind:
+        BlendLayerRow<BlendBehind>(dst, src, count, opacity);
+        break;
+    case BlendErase:
+        BlendLayerRow<BlendErase>(dst, src, count, opacity);
+        break;
+    case BlendReplace:
+        BlendLayerRow<BlendReplace>(dst, src, count, opacity);
+        break;
+    default:
+        BlendLayerRow<BlendNormal>(dst, src, count, opacity);
+        break;
+    }
+}
+
+template <int Mode>
+static void BlendColorRow(unsigned char* dst, const unsigned char* mask, int count, Vec4 color)
+{
+    Vec4 scale = Splat(1.0f / 255.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        if (mask[i] == 0)
+        {
+            continue;
+        }
+        unsigned char* dp = dst + i * 4;
+        Vec4 sa = Mul(Alpha(color), Mul(Splat((float)mask[i]), scale));
+        Vec4 d = Load(dp);
+        Vec4 c = BlendPremultiplied<Mode>(WithAlpha(Mul(color, sa), sa), WithAlpha(Mul(d, Alpha(d)), d), sa);
+        Store(dp, WithAlpha(Div(c, Alpha(c)), c));
+    }
+}
+
+void KernelBlendColor(unsigned char* dst, const unsigned char* mask, int count, const float color[4], BlendMode mode)
+{
+    Vec4 c = Set(color[0], color[1], color[2], color[3]);
+    switch (mode)
+    {
+    case BlendMultiply:
+        BlendColorRow<BlendMultiply>(dst, mask, count, c);
+        break;
+    case BlendAdd:
+        BlendColorRow<BlendAdd>(dst, mask, count, c);
+        break;
+    case BlendScreen:
+        BlendColorRow<BlendScreen>(dst, mask, count, c);
+        break;
+    case BlendBehind:
+        BlendColorRow<BlendBehind>(dst, mask, count, c);
+        break;
+    case BlendErase:
+        BlendColorRow<BlendErase>(dst, mask, count, c);
+        break;
+    case BlendReplace:
+        BlendColorRow<BlendReplace>(dst, mask, count, c);
+        break;
+    default:
+        BlendColorRow<BlendNormal>(dst, mask, count, c);
+        break;
+    }
+}
+
+void KernelBlendColorPremultiplied(unsigned char* dst, const unsigned char* mask, int count, const float color[4])
+{
+    Vec4 c = Set(color[0], color[1], color[2], color[3]);
+    Vec4 scale = Splat(1.0f / 255.0f);
+    Vec4 one = Splat(1.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        if (mask[i] == 0)
+        {
+            continue;
+        }
+        unsigned char* dp = dst + i * 4;
+        Vec4 s = Mul(c, Mul(Splat((float)mask[i]), scale));
+        Store(dp, Add(s, Mul(Load(dp), Sub(one, Alpha(s)))));
+    }
+}
+
+void KernelPremultiply(float* out, const unsigned char* src, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 c = Load(src + i * 4);
+        StoreF(out + i * 4, WithAlpha(Mul(c, Alpha(c)), c));
+    }
+}
+
+void KernelUnpremultiply(unsigned char* out, const float* src, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Vec4 c = LoadF(src + i * 4);
+        Store(out + i * 4, WithAlpha(Div(c, Alpha(c)), c));
+    }
+}
+
+void KernelAccumulate(float* out, const float* src, int count, float weight)
+{
+    Vec4 w = Splat(weight);
+    for (int i = 0; i < count; ++i)
+    {
+        StoreF(out + i * 4, Add(LoadF(out + i * 4), Mul(LoadF(src + i * 4), w)));
+    }
+}
+
+void KernelScale(float* out, const float* src, int count, float scale)
+{
+    Vec4 s = Splat(scale);
+    for (int i = 0; i < count; ++i)
+    {
+        StoreF(out + i * 4, Mul(LoadF(src + i * 4), s));
+    }
+}
+
+void KernelSlide(float* sum, const float* add, const float* sub, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        StoreF(sum + i * 4, Add(LoadF(sum + i * 4), Sub(LoadF(add + i * 4), LoadF(sub + i * 4))));
+    }
+}
+
+void KernelBoxRow(float* out, const float* src, int count, int radius)
+{
+    Vec4 scale = Splat(1.0f / (2 * radius + 1));
+    Vec4 sum = Mul(LoadF(src), Splat((float)(radius + 1)));
+    for (int i = 1; i <= radius; ++i)
+    {
+        int x = i < count ? i : count - 1;
+        sum = Add(sum, LoadF(src + x * 4));
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        StoreF(out + i * 4, Mul(sum, scale));
+        int add = i + radius + 1;
+        int sub = i - radius;
+        add = add < count ? add : count - 1;
+        sub = sub > 0 ? sub : 0;
+        sum = Add(sum, Sub(LoadF(src + add * 4), LoadF(src + sub * 4)));
+    }
+}
+
+static inline Vec4 LoadPremultiplied(const unsigned char* src, int width, int height, int stride, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= width || y >= height)
+    {
+        return Splat(0.0f);
+    }
+    Vec4 c = Load(src + y * stride + x * 4);
+    return WithAlpha(Mul(c, Alpha(c)), c);
+}
+
+void KernelSampleBilinear(unsigned char* out, const unsigned char* src, int width, int height, int stride,
+                          float u, float v, float du, float dv, int count)
+{
+    Vec4 one = Splat(1.0f);
+    for (int i = 0; i < count; ++i)
+    {
+        float x = u + du * i - 0.5f;
+        float y = v + dv * i - 0.5f;
+        float fx = floorf(x);
+        float fy = floorf(y);
+        int x0 = (int)fx;
+        int y0 = (int)fy;
+        Vec4 wx = Splat(x - fx);
+        Vec4 wy = Splat(y - fy);
+
+        Vec4 c00 = LoadPremultiplied(src, width, height, stride, x0, y0);
+        Vec4 c10 = LoadPremultiplied(src, width, height, stride, x0 + 1, y0);
+        Vec4 c01 = LoadPremultiplied(src, width, height, stride, x0, y0 + 1);
+        Vec4 c11 = LoadPremultiplied(src, width, height, stride, x0 + 1, y0 + 1);
+        Vec4 top = Add(Mul(c00, Sub(one, wx)), Mul(c10, wx));
+        Vec4 bottom = Add(Mul(c01, Sub(one, wx)), Mul(c11, wx));
+        Vec4 c = Add(Mul(top, Sub(one, wy)), Mul(bottom, wy));
+        Store(out + i * 4, WithAlpha(Div(c, Alpha(c)), c));
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+// Span kernels on straight alpha RGBA8888 pixels, computing the same as the GLRenderer shaders.
+// Pixels are processed as four float lanes, with SSE2 when the compiler targets it.
+
+// How a layer is combined with the composite beneath it, stored in layer.xml
+enum BlendMode
+{
+    BlendNormal,
+    BlendMultiply,
+    BlendAdd,
+    BlendScreen,
+    // Only shows where the composite beneath is transparent
+    BlendBehind,
+    // Cuts the composite beneath by the layer's alpha
+    BlendErase,
+    // Replaces the composite beneath, opacity mixes the two. Not offered for layers.
+    BlendReplace
+};
+
+void KernelBlendSource(unsigned char* out, const unsigned char* src, int count, const float color[4]);
+void KernelBlendSourceOver(unsigned char* out, const unsigned char* dst, const unsigned char* src, int count, const float color[4]);
+void KernelBlendMultiply(unsigned char* out, const unsigned char* dst, const unsigned char* src, int count, const float color[4]);
+// colorMask and alphaMask may be NULL and then count as white
+void KernelMask(unsigned char* out, const unsigned char* src, const unsigned char* colorMask, const unsigned char* alphaMask, int count, float alpha);
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) of src onto dst
+void KernelBlendAlpha(unsigned char* dst, const unsigned char* src, int count);
+// Layer src onto dst in place with opacity in [0, 1], blended premultiplied in one pass
+void KernelBlendLayer(unsigned char* dst, const unsigned char* src, int count, float opacity, BlendMode mode);
+// Straight color through 8 bit coverage onto dst in place, for stamping brush dabs
+void KernelBlendColor(unsigned char* dst, const unsigned char* mask, int count, const float color[4], BlendMode mode);
+// Source over of a premultiplied color through coverage onto premultiplied pixels, alpha last
+void KernelBlendColorPremultiplied(unsigned char* dst, const unsigned char* mask, int count, const float color[4]);
+
+// Premultiplied float RGBA from straight RGBA8888 and back
+void KernelPremultiply(float* out, const unsigned char* src, int count);
+void KernelUnpremultiply(unsigned char* out, const float* src, int count);
+// out += src * weight over count pixels of 4 floats
+void KernelAccumulate(float* out, const float* src, int count, float weight);
+// out = src * scale
+void KernelScale(float* out, const float* src, int count, float scale);
+// sum += add - sub, the step of a running box sum
+void KernelSlide(float* sum, const float* add, const float* sub, int count);
+// Box filter of 2 * radius + 1 pixels along a row of float pixels, edges clamped
+void KernelBoxRow(float* out, const float* src, int count, int radius);
+
+// Bilinear samples at (u, v) + i * (du, dv) in pixels of a width x height image, interpolated
+// premultiplied. Texels outside the image count as transparent so edges fade out.
+void KernelSampleBilinear(unsigned char* out, const unsigned char* src, int width, int height, int stride,
+                          float u, float v, float du, float dv, int count);
+
+#endif // PIXELKERNELS_H
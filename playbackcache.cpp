@@ -0,0 +1,473 @@
+#include "playbackcache.h"
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+
+class PlaybackJob : public QRunnable
+{
+public:
+    PlaybackJob(PlaybackCache* cache)
+        :mCache(cache)
+        ,mSlot(0)
+        ,mFrameIndex(0)
+        ,mGeneration(0)
+        ,mWidth(0)
+        ,mHeight(0)
+        ,mLevel(0)
+        ,mCompress(false)
+    {
+    }
+
+    void run();
+
+    PlaybackCache* mCache;
+    int mSlot;
+    int mFrameIndex;
+    int mGeneration;
+    int mWidth;
+    int mHeight;
+    // In: level wanted, out: level made
+    int mLevel;
+    bool mCompress;
+    std::vector<CompositeLayer> mLayers;
+    QImage mImage;
+    MipPyramid mMips;
+    // In: area of mImage to clear, out: bounds of the composite
+    QRect mBounds;
+    QByteArray mData;
+};
+
+void PlaybackJob::run()
+{
+    if (mImage.isNull())
+    {
+        mImage = QImage(mWidth, mHeight, QImage::Format_RGBA8888);
+        mImage.fill(0);
+        mBounds = QRect();
+    }
+
+    QRect cleared = mBounds;
+    mBounds = SceneModel::Composite(mLayers, &mImage, mBounds);
+    mLayers.clear();
+
+    // zoomed out the level is built here, so presenting draws a small image
+    mMips.Invalidate(cleared.united(mBounds));
+    const QImage* image = &mImage;
+    if (mLevel > 0)
+    {
+        image = mMips.GetLevel(&mImage, mLevel);
+    }
+
+    if (mCompress)
+    {
+        QRect rect = MipPyramid::ScaleRect(mBounds, mLevel);
+        int rowBytes = rect.width() * 4;
+        QByteArray raw(rowBytes * rect.height(), 0);
+        char* dst = raw.data();
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+        {
+            memcpy(dst, image->constScanLine(y) + rect.left() * 4, rowBytes);
+            dst += rowBytes;
+        }
+        mData = qCompress(raw, 1);
+        mImage = QImage();
+        mMips = MipPyramid();
+    }
+
+    mCache->OnJobDone(this);
+}
+
+PlaybackCache::PlaybackCache()
+    :mScene(NULL)
+    ,mMemoryBudget(512 * 1024 * 1024)
+    ,mFrameBytes(1)
+    ,mFirst(0)
+    ,mLast(-1)
+    ,mPlayhead(0)
+    ,mGeneration(0)
+    ,mPending(0)
+    ,mRamPreview(false)
+    ,mCompress(false)
+    ,mRunning(false)
+    ,mLevel(0)
+    ,mPresentFrame(-1)
+    ,mPresentLevel(0)
+{
+    mPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+PlaybackCache::~PlaybackCache()
+{
+    Stop();
+}
+
+void PlaybackCache::SetScene(SceneModel* scene)
+{
+    Stop();
+    mScene = scene;
+}
+
+qint64 PlaybackCache::GetMemoryUsage()
+{
+    QMutexLocker lock(&mMutex);
+    qint64 usage = mPresentImage.isNull() ? 0 : mFrameBytes;
+    for (size_t i = 0; i < mSlots.size(); ++i)
+    {
+        usage += GetSlotBytes(mSlots[i]);
+    }
+    return usage;
+}
+
+void PlaybackCache::SetLoopRange(int first, int last)
+{
+    QMutexLocker lock(&mMutex);
+    mFirst = first;
+    mLast = last;
+}
+
+void PlaybackCache::Start(int frameIndex)
+{
+    if (!mScene)
+    {
+        return;
+    }
+    Stop();
+
+    QMutexLocker lock(&mMutex);
+    mFrameBytes = (qint64)mScene->GetWidth() * mScene->GetHeight() * 4;
+    if (mFrameBytes <= 0)
+    {
+        mFrameBytes = 1;
+    }
+    qint64 rangeBytes = (qint64)(mLast - mFirst + 1) * mFrameBytes;
+    mCompress = mRamPreview && rangeBytes > mMemoryBudget;
+    mPlayhead = frameIndex;
+    mRunning = true;
+    Schedule();
+}
+
+void PlaybackCache::Stop()
+{
+    mMutex.lock();
+    mRunning = false;
+    mMutex.unlock();
+
+    // jobs which did not start are deleted without calling back
+    mPool.clear();
+    mPool.waitForDone();
+
+    QMutexLocker lock(&mMutex);
+    mSlots.clear();
+    mPending = 0;
+    mPresentImage = QImage();
+    mPresentBounds = QRect();
+    mPresentFrame = -1;
+}
+
+void PlaybackCache::SetPlayhead(int frameIndex)
+{
+    QMutexLocker lock(&mMutex);
+    mPlayhead = frameIndex;
+    Schedule();
+}
+
+void PlaybackCache::Invalidate()
+{
+    QMutexLocker lock(&mMutex);
+    ++mGeneration;
+    for (size_t i = 0; i < mSlots.size(); ++i)
+    {
+        Slot& slot = mSlots[i];
+        if (slot.state == SlotStateReady)
+        {
+            slot.state = SlotStateEmpty;
+            slot.data.clear();
+        }
+    }
+    mPresentFrame = -1;
+    Schedule();
+}
+
+void PlaybackCache::SetLevel(int level)
+{
+    {
+        QMutexLocker lock(&mMutex);
+        if (level == mLevel)
+        {
+            return;
+        }
+        mLevel = level;
+    }
+    Invalidate();
+}
+
+bool PlaybackCache::IsReady(int frameIndex)
+{
+    QMutexLocker lock(&mMutex);
+    int idx = FindSlot(frameIndex);
+    return idx >= 0 && mSlots[idx].state == SlotStateReady;
+}
+
+int PlaybackCache::GetReadyCount()
+{
+    QMutexLocker lock(&mMutex);
+    int count = 0;
+    for (size_t i = 0; i < mSlots.size(); ++i)
+    {
+        if (mSlots[i].state == SlotStateReady && mSlots[i].generation == mGeneration)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+int PlaybackCache::GetPendingCount()
+{
+    QMutexLocker lock(&mMutex);
+    return mPending;
+}
+
+bool PlaybackCache::GetFrame(int frameIndex, QImage& image, QRect& bounds, int& level)
+{
+    QMutexLocker lock(&mMutex);
+    int idx = FindSlot(frameIndex);
+    if (idx < 0 || mSlots[idx].state != SlotStateReady)
+    {
+        return false;
+    }
+
+    Slot& slot = mSlots[idx];
+    bounds = slot.bounds;
+    level = slot.level;
+    if (!slot.image.isNull())
+    {
+        // the levels are up to date, this only looks them up
+        image = *slot.mips.GetLevel(&slot.image, level);
+        return true;
+    }
+
+    if (mPresentFrame != frameIndex)
+    {
+        if (mPresentImage.isNull() || mPresentLevel != slot.level)
+        {
+            QRect rect = MipPyramid::ScaleRect(QRect(0, 0, mScene->GetWidth(), mScene->GetHeight()), slot.level);
+            mPresentImage = QImage(rect.width(), rect.height(),
+                                   slot.level > 0 ? QImage::Format_RGBA8888_Premultiplied : QImage::Format_RGBA8888);
+            mPresentImage.fill(0);
+            mPresentBounds = QRect();
+            mPresentLevel = slot.level;
+        }
+
+        for (int y = mPresentBounds.top(); y <= mPresentBounds.bottom(); ++y)
+        {
+            memset(mPresentImage.scanLine(y) + mPresentBounds.left() * 4, 0, mPresentBounds.width() * 4);
+        }
+
+        QByteArray raw = qUncompress(slot.data);
+        QRect rect = MipPyramid::ScaleRect(slot.bounds, slot.level);
+        int rowBytes = rect.width() * 4;
+        if (raw.size() == rowBytes * rect.height())
+        {
+            const char* src = raw.constData();
+            for (int y = rect.top(); y <= rect.bottom(); ++y)
+            {
+                memcpy(mPresentImage.scanLine(y) + rect.left() * 4, src, rowBytes);
+                src += rowBytes;
+            }
+            mPresentBounds = rect;
+        }
+        else
+        {
+            mPresentBounds = QRect();
+        }
+        mPresentFrame = frameIndex;
+    }
+
+    image = mPresentImage;
+    if (mPresentBounds.isEmpty())
+    {
+        bounds = QRect();
+    }
+    return true;
+}
+
+void PlaybackCache::Schedule()
+{
+    int n = mLast - mFirst + 1;
+    if (!mRunning || !mScene || n <= 0)
+    {
+        return;
+    }
+
+    if (mPlayhead < mFirst || mPlayhead > mLast)
+    {
+        mPlayhead = mFirst;
+    }
+
+    // Streaming only looks as far ahead as the budget holds, RAM preview wants the whole range
+    int window = n;
+    if (!mRamPreview)
+    {
+        window = (int)qMin((qint64)n, qMax((qint64)2, mMemoryBudget / mFrameBytes));
+    }
+
+    int maxPending = mPool.maxThreadCount() * 2;
+    for (int d = 0; d < window && mPending < maxPending; ++d)
+    {
+        int frameIndex = mFirst + (mPlayhead - mFirst + d) % n;
+        if (FindSlot(frameIndex) >= 0)
+        {
+            continue;
+        }
+
+        int idx = AcquireSlot(d);
+        if (idx < 0)
+        {
+            break;
+        }
+
+        Slot& slot = mSlots[idx];
+        slot.frameIndex = frameIndex;
+        slot.generation = mGeneration;
+        slot.state = SlotStatePending;
+        slot.data.clear();
+
+        PlaybackJob* job = new PlaybackJob(this);
+        job->mSlot = idx;
+        job->mFrameIndex = frameIndex;
+        job->mGeneration = mGeneration;
+        job->mWidth = mScene->GetWidth();
+        job->mHeight = mScene->GetHeight();
+        job->mLevel = mLevel;
+        job->mCompress = mCompress;
+        job->mImage.swap(slot.image);
+        std::swap(job->mMips, slot.mips);
+        job->mBounds = slot.bounds;
+        mScene->GetCompositeLayers(frameIndex, job->mLayers);
+
+        ++mPending;
+        mPool.start(job);
+    }
+}
+
+int PlaybackCache::GetDistance(int frameIndex) const
+{
+    int n = mLast - mFirst + 1;
+    if (n <= 0 || frameIndex < mFirst || frameIndex > mLast)
+    {
+        return INT_MAX;
+    }
+    return (frameIndex - mPlayhead + n) % n;
+}
+
+int PlaybackCache::FindSlot(int frameIndex)
+{
+    for (size_t i = 0; i < mSlots.size(); ++i)
+    {
+        const Slot& slot = mSlots[i];
+        if (slot.frameIndex == frameIndex && slot.generation == mGeneration && slot.state != SlotStateEmpty)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int PlaybackCache::AcquireSlot(int distance)
+{
+    qint64 usage = 0;
+    qint64 compressedBytes = 0;
+    int compressedCount = 0;
+    for (size_t i = 0; i < mSlots.size(); ++i)
+    {
+        const Slot& slot = mSlots[i];
+        if (slot.state == SlotStatePending)
+        {
+            usage += mFrameBytes;
+            continue;
+        }
+        if (slot.state == SlotStateEmpty || slot.generation != mGeneration)
+        {
+            return (int)i;
+        }
+        usage += GetSlotBytes(slot);
+        if (!slot.data.isEmpty())
+        {
+            compressedBytes += slot.data.size();
+            ++compressedCount;
+        }
+    }
+
+    qint64 estimate = mFrameBytes;
+    if (mCompress)
+    {
+        estimate = compressedCount > 0 ? compressedBytes / compressedCount : mFrameBytes / 4;
+    }
+    if (usage + estimate <= mMemoryBudget || mSlots.size() < 2)
+    {
+        Slot slot;
+        slot.frameIndex = -1;
+        slot.level = 0;
+        slot.generation = mGeneration;
+        slot.state = SlotStateEmpty;
+        mSlots.push_back(slot);
+        return (int)mSlots.size() - 1;
+    }
+
+    // Evict the ready frame which is needed last, if it is needed later than the new one
+    int best = -1;
+    int bestDistance = distance;
+    for (size_t i = 0; i < mSlots.size(); ++i)
+    {
+        const Slot& slot = mSlots[i];
+        if (slot.state != SlotStateReady)
+        {
+            continue;
+        }
+        int d = GetDistance(slot.frameIndex);
+        if (d > bestDistance)
+        {
+            best = (int)i;
+            bestDistance = d;
+        }
+    }
+    return best;
+}
+
+qint64 PlaybackCache::GetSlotBytes(const Slot& slot) const
+{
+    // levels below the composite add up to less than a third of it
+    qint64 imageBytes = slot.level > 0 ? mFrameBytes + mFrameBytes / 3 : mFrameBytes;
+    return (slot.image.isNull() ? 0 : imageBytes) + slot.data.size();
+}
+
+void PlaybackCache::OnJobDone(PlaybackJob* job)
+{
+    QMutexLocker lock(&mMutex);
+    if (job->mSlot >= (int)mSlots.size())
+    {
+        return;
+    }
+
+    Slot& slot = mSlots[job->mSlot];
+    slot.image.swap(job->mImage);
+    std::swap(slot.mips, job->mMips);
+    slot.data.swap(job->mData);
+    slot.bounds = job->mBounds;
+    slot.level = job->mLevel;
+    --mPending;
+
+    if (job->mGeneration == mGeneration && slot.frameIndex == job->mFrameIndex)
+    {
+        slot.state = SlotStateReady;
+    }
+    else
+    {
+        slot.state = SlotStateEmpty;
+        slot.data.clear();
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef PLAYBACKCACHE_H
+#define PLAYBACKCACHE_H
+
+#include <QImage>
+#include <QByteArray>
+#include <QMutex>
+#include <QThreadPool>
+#include <vector>
+#include "animationfile.h"
+#include "mippyramid.h"
+
+class PlaybackJob;
+
+// Composites frames ahead of the playhead on worker threads.
+// The GUI thread only snapshots layers and presents frames which are ready.
+class PlaybackCache
+{
+    friend class PlaybackJob;
+public:
+    PlaybackCache();
+    ~PlaybackCache();
+
+    void SetScene(SceneModel* scene);
+    void SetMemoryBudget(qint64 bytes) { mMemoryBudget = bytes; }
+    qint64 GetMemoryBudget() const { return mMemoryBudget; }
+    qint64 GetMemoryUsage();
+
+    // Frames [first, last] are played in a loop
+    void SetLoopRange(int first, int last);
+    // RAM preview keeps the whole loop range, compressed if it does not fit the budget
+    void SetRamPreview(bool enable) { mRamPreview = enable; }
+    bool IsRamPreview() const { return mRamPreview; }
+
+    void Start(int frameIndex);
+    void Stop();
+    bool IsRunning() const { return mRunning; }
+    void SetPlayhead(int frameIndex);
+    void Invalidate();
+    // Mip level frames are kept ready at for the view, see MipPyramid. Changing it invalidates the frames.
+    void SetLevel(int level);
+
+    bool IsReady(int frameIndex);
+    int GetReadyCount();
+    int GetPendingCount();
+    // Returns false if the frame is not composited yet.
+    // image is at level, which may be below the one set for small scenes. bounds are in scene pixels.
+    bool GetFrame(int frameIndex, QImage& image, QRect& bounds, int& level);
+
+private:
+    enum SlotState
+    {
+        SlotStateEmpty,
+        SlotStatePending,
+        SlotStateReady
+    };
+
+    struct Slot
+    {
+        int frameIndex;
+        int generation;
+        SlotState state;
+        // Raw composite, null once compressed
+        QImage image;
+        // Levels of image, the composite is drawn from when zoomed out
+        MipPyramid mips;
+        int level;
+        // Non-transparent area of image
+        QRect bounds;
+        // qCompress-ed rows of bounds, from the image at level
+        QByteArray data;
+    };
+
+    void Schedule();
+    int GetDistance(int frameIndex) const;
+    int FindSlot(int frameIndex);
+    int AcquireSlot(int distance);
+    qint64 GetSlotBytes(const Slot& slot) const;
+    void OnJobDone(PlaybackJob* job);
+
+private:
+    SceneModel* mScene;
+    QThreadPool mPool;
+    QMutex mMutex;
+    std::vector<Slot> mSlots;
+    qint64 mMemoryBudget;
+    qint64 mFrameBytes;
+    int mFirst;
+    int mLast;
+    int mPlayhead;
+    int mGeneration;
+    int mPending;
+    bool mRamPreview;
+    bool mCompress;
+    bool mRunning;
+    int mLevel;
+    // Compressed frame unpacked for presenting, bounds at mPresentLevel
+    QImage mPresentImage;
+    QRect mPresentBounds;
+    int mPresentFrame;
+    int mPresentLevel;
+};
+
+#endif // PLAYBACKCACHE_H
@@ -0,0 +1,214 @@
+#include "playbackclock.h"
+#include <QTextStream>
+
+static const int sJitterBuckets[JITTER_BUCKETS - 1] = { 1, 2, 4, 8, 16 };
+
+PlaybackClock::PlaybackClock()
+    :mFps(24)
+    ,mPolicy(PolicySkipFrames)
+    ,mRunning(false)
+    ,mAnchorTick(0)
+    ,mAnchorTime(0)
+    ,mPresentedTick(0)
+    ,mPresentedTime(0)
+    ,mStartTime(0)
+{
+    ResetStats();
+}
+
+void PlaybackClock::SetFps(int fps)
+{
+    if (fps < 1)
+    {
+        fps = 1;
+    }
+    if (fps == mFps)
+    {
+        return;
+    }
+
+    if (mRunning)
+    {
+        // keep the current tick on time when the rate changes
+        qint64 tick = GetTargetTick();
+        mAnchorTime = GetDeadline(tick);
+        mAnchorTick = tick;
+    }
+    mFps = fps;
+}
+
+void PlaybackClock::Start(qint64 tick)
+{
+    mTimer.start();
+    mRunning = true;
+    mAnchorTick = tick;
+    mAnchorTime = 0;
+    mPresentedTick = tick;
+    mPresentedTime = 0;
+    mStartTime = 0;
+    ResetStats();
+}
+
+void PlaybackClock::Stop()
+{
+    mRunning = false;
+}
+
+qint64 PlaybackClock::GetFramePeriod() const
+{
+    return 1000000000LL / mFps;
+}
+
+qint64 PlaybackClock::GetDeadline(qint64 tick) const
+{
+    // computed from the anchor every time, rounding does not add up
+    return mAnchorTime + (tick - mAnchorTick) * 1000000000LL / mFps;
+}
+
+qint64 PlaybackClock::GetTargetTick()
+{
+    if (!mRunning)
+    {
+        return mPresentedTick;
+    }
+
+    qint64 now = mTimer.nsecsElapsed();
+    qint64 tick = mAnchorTick + (now - mAnchorTime) * mFps / 1000000000LL;
+    if (mPolicy == PolicyPlayEveryFrame && tick > mPresentedTick + 1)
+    {
+        tick = mPresentedTick + 1;
+    }
+    return tick < mPresentedTick ? mPresentedTick : tick;
+}
+
+int PlaybackClock::GetTimeToTick(qint64 tick)
+{
+    if (!mRunning)
+    {
+        return -1;
+    }
+
+    qint64 wait = GetDeadline(tick) - mTimer.nsecsElapsed();
+    if (wait <= 0)
+    {
+        return 0;
+    }
+    return (int)((wait + 999999) / 1000000);
+}
+
+void PlaybackClock::OnPresented(qint64 tick)
+{
+    if (!mRunning || (tick <= mPresentedTick && mStats.presentedFrames > 0))
+    {
+        return;
+    }
+
+    qint64 now = mTimer.nsecsElapsed();
+    qint64 period = GetFramePeriod();
+    qint64 latency = now - GetDeadline(tick);
+    if (latency < 0)
+    {
+        latency = 0;
+    }
+
+    if (mStats.presentedFrames > 0)
+    {
+        qint64 interval = now - mPresentedTime;
+        qint64 jitter = interval - (tick - mPresentedTick) * period;
+        if (jitter < 0)
+        {
+            jitter = -jitter;
+        }
+        int bucket = 0;
+        while (bucket < JITTER_BUCKETS - 1 && jitter >= sJitterBuckets[bucket] * 1000000LL)
+        {
+            ++bucket;
+        }
+        ++mStats.jitter[bucket];
+        mStats.droppedFrames += (int)(tick - mPresentedTick - 1);
+    }
+    else
+    {
+        mStartTime = now;
+    }
+
+    ++mStats.presentedFrames;
+    mStats.totalLatency += latency;
+    if (latency > mStats.maxLatency)
+    {
+        mStats.maxLatency = latency;
+    }
+    if (latency > period)
+    {
+        ++mStats.lateFrames;
+        if (mPolicy == PolicyPlayEveryFrame)
+        {
+            // continue from here instead of rushing to catch up
+            mAnchorTick = tick;
+            mAnchorTime = now;
+        }
+    }
+
+    mPresentedTick = tick;
+    mPresentedTime = now;
+}
+
+void PlaybackClock::ResetStats()
+{
+    mStats.presentedFrames = 0;
+    mStats.droppedFrames = 0;
+    mStats.lateFrames = 0;
+    mStats.totalLatency = 0;
+    mStats.maxLatency = 0;
+    for (int i = 0; i < JITTER_BUCKETS; ++i)
+    {
+        mStats.jitter[i] = 0;
+    }
+}
+
+QString PlaybackClock::GetSummary() const
+{
+    float fps = 0.0f;
+    float avgLatency = 0.0f;
+    if (mStats.presentedFrames > 1 && mPresentedTime > mStartTime)
+    {
+        fps = (mStats.presentedFrames - 1) * 1e9f / (mPresentedTime - mStartTime);
+    }
+    if (mStats.presentedFrames > 0)
+    {
+        avgLatency = mStats.totalLatency / 1e6f / mStats.presentedFrames;
+    }
+
+    return QString("%1/%2 fps  dropped %3  late %4  latency %5/%6 ms")
+            .arg(fps, 0, 'f', 1)
+            .arg(mFps)
+            .arg(mStats.droppedFrames)
+            .arg(mStats.lateFrames)
+            .arg(avgLatency, 0, 'f', 1)
+            .arg(mStats.maxLatency / 1e6f, 0, 'f', 1);
+}
+
+QString PlaybackClock::Dump() const
+{
+    QString text;
+    QTextStream out(&text);
+    out << "policy: " << (mPolicy == PolicySkipFrames ? "skip frames" : "play every frame") << "\n";
+    out << "fps: " << mFps << "\n";
+    out << "presented: " << mStats.presentedFrames << "\n";
+    out << "dropped: " << mStats.droppedFrames << "\n";
+    out << "late: " << mStats.lateFrames << "\n";
+    out << "summary: " << GetSummary() << "\n";
+    out << "jitter histogram:\n";
+    for (int i = 0; i < JITTER_BUCKETS; ++i)
+    {
+        if (i < JITTER_BUCKETS - 1)
+        {
+            out << "  < " << sJitterBuckets[i] << " ms: " << mStats.jitter[i] << "\n";
+        }
+        else
+        {
+            out << "  >= " << sJitterBuckets[i - 1] << " ms: " << mStats.jitter[i] << "\n";
+        }
+    }
+    return text;
+}
@@ -0,0 +1,74 @@
+#ifndef PLAYBACKCLOCK_H
+#define PLAYBACKCLOCK_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+// Upper bounds in ms of the jitter histogram buckets, the last bucket is open
+#define JITTER_BUCKETS 6
+
+struct PlaybackStats
+{
+    int presentedFrames;
+    int droppedFrames;
+    int lateFrames;
+    // nanoseconds from the frame deadline to its present
+    qint64 totalLatency;
+    qint64 maxLatency;
+    int jitter[JITTER_BUCKETS];
+};
+
+// Derives the frame to show from elapsed time on a monotonic clock,
+// so timer rounding and late timeouts do not accumulate.
+// Ticks count frames since playback started and are not wrapped.
+class PlaybackClock
+{
+public:
+    enum Policy
+    {
+        // Stay on time, frames which are not ready by their deadline are dropped
+        PolicySkipFrames,
+        // Show every frame, the clock waits for late frames
+        PolicyPlayEveryFrame
+    };
+
+    PlaybackClock();
+
+    void SetFps(int fps);
+    int GetFps() const { return mFps; }
+    void SetPolicy(Policy policy) { mPolicy = policy; }
+    Policy GetPolicy() const { return mPolicy; }
+
+    void Start(qint64 tick);
+    void Stop();
+    bool IsRunning() const { return mRunning; }
+
+    // Tick which should be on screen now
+    qint64 GetTargetTick();
+    // Milliseconds until tick is due, 0 if it already is
+    int GetTimeToTick(qint64 tick);
+    void OnPresented(qint64 tick);
+
+    const PlaybackStats& GetStats() const { return mStats; }
+    void ResetStats();
+    QString GetSummary() const;
+    QString Dump() const;
+
+private:
+    qint64 GetDeadline(qint64 tick) const;
+    qint64 GetFramePeriod() const;
+
+private:
+    QElapsedTimer mTimer;
+    int mFps;
+    Policy mPolicy;
+    bool mRunning;
+    qint64 mAnchorTick;
+    qint64 mAnchorTime;
+    qint64 mPresentedTick;
+    qint64 mPresentedTime;
+    qint64 mStartTime;
+    PlaybackStats mStats;
+};
+
+#endif // PLAYBACKCLOCK_H
@@ -1,6 +1,7 @@
 #include "rasterimageeditor.h"
 #include <QMouseEvent>
 #include <list>
+#include <math.h>
 #include "command.h"
 #include "pantool.h"
 #include "zoomtool.h"
@@ -9,6 +10,8 @@
 #include "regiontool.h"
 #include "timeline.h"
 #include "openglrenderer.h"
+#include "animationfile.h"
+#include "strokerecording.h"
 
 
 RasterImageEditor::RasterImageEditor(QWidget *parent)
@@ -22,8 +25,11 @@ RasterImageEditor::RasterImageEditor(QWidget *parent)
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     setAutoFillBackground(false);
 
+    mFrame = NULL;
     mImage = NULL;
     mTempPressure = 1.0f;
+    mUndoStack = NULL;
+    mUndoHistory = NULL;
 
     mZoomKeyDown = false;
     mPanKeyDown = false;
@@ -35,6 +41,10 @@ RasterImageEditor::RasterImageEditor(QWidget *parent)
     setFocusPolicy(Qt::ClickFocus);
     mShowOnionSkin = false;
     mTool = NULL;
+    mTimeline = NULL;
+    mTabletDown = false;
+    mDraining = false;
+    mRecording = NULL;
 
     mScale = 1.0f;
     mRotate = 0.0f;
@@ -46,6 +56,11 @@ RasterImageEditor::~RasterImageEditor()
 
 void RasterImageEditor::mousePressEvent(QMouseEvent *e)
 {
+    // mouse events made from tablet events were timed as those
+    if (e->source() == Qt::MouseEventNotSynthesized)
+    {
+        mLatency.OnInput();
+    }
     if (mPanKeyDown)
     {
         mEditorState = EditorStatePan;
@@ -91,6 +106,7 @@ void RasterImageEditor::mousePressEvent(QMouseEvent *e)
     default:
         if (mTool)
         {
+            Record(TabletSamplePress, e->x(), e->y(), mTempPressure);
             mTool->OnDragBegin(e->x(), e->y(), mTempPressure);
         }
         break;
@@ -99,6 +115,10 @@ void RasterImageEditor::mousePressEvent(QMouseEvent *e)
 
 void RasterImageEditor::mouseReleaseEvent(QMouseEvent *e)
 {
+    if (e->source() == Qt::MouseEventNotSynthesized)
+    {
+        mLatency.OnInput();
+    }
     switch (mEditorState)
     {
     case EditorStatePan:
@@ -119,6 +139,7 @@ void RasterImageEditor::mouseReleaseEvent(QMouseEvent *e)
     default:
         if (mTool)
         {
+            Record(TabletSampleRelease, e->x(), e->y(), mTempPressure);
             mTool->OnDragEnd(e->x(), e->y(), mTempPressure);
         }
         break;
@@ -129,6 +150,10 @@ void RasterImageEditor::mouseReleaseEvent(QMouseEvent *e)
 
 void RasterImageEditor::mouseMoveEvent(QMouseEvent *e)
 {
+    if (e->source() == Qt::MouseEventNotSynthesized)
+    {
+        mLatency.OnInput();
+    }
     switch (mEditorState)
     {
     case EditorStatePan:
@@ -149,6 +174,7 @@ void RasterImageEditor::mouseMoveEvent(QMouseEvent *e)
     default:
         if (mTool)
         {
+            Record(TabletSampleMove, e->x(), e->y(), mTempPressure);
             mTool->OnDrag(e->x(), e->y(), mTempPressure);
         }
         break;
@@ -209,10 +235,32 @@ void RasterImageEditor::keyReleaseEvent(QKeyEvent *e)
     }
 }
 
+CanvasTool* RasterImageEditor::GetActiveTool()
+{
+    switch (mEditorState)
+    {
+    case EditorStatePan:
+        return mPanTool;
+    case EditorStateZoom:
+        return mZoomTool;
+    case EditorStateRotate:
+        return mRotateTool;
+    case EditorStateColor:
+        return mColorTool;
+    case EditorStateErase:
+        return mEraseTool;
+    default:
+        return mTool;
+    }
+}
+
 void RasterImageEditor::paintEvent(QPaintEvent *)
 {
     makeCurrent();
 
+    DrainTablet();
+
+    mLatency.BeginStage(LatencyComposite);
     QPainter p(this);
 
     glClearColor(0.5, 0.5, 0.5, 1);
@@ -225,7 +273,7 @@ void RasterImageEditor::paintEvent(QPaintEvent *)
     if (mImage)
     {
         p.setCompositionMode(QPainter::CompositionMode_Source);
-        p.fillRect(0, 0, mImage->width(), mImage->height(), QColor(0xFF, 0xFF, 0xFF, 0xFF));
+        p.fillRect(mImage->rect().intersected(GetVisibleRect()), QColor(0xFF, 0xFF, 0xFF, 0xFF));
     }
 
     p.setCompositionMode(QPainter::CompositionMode_SourceOver);
@@ -237,71 +285,104 @@ void RasterImageEditor::paintEvent(QPaintEvent *)
 
     mTimeline->Render(p);
 
-    switch (mEditorState)
+    CanvasTool* tool = GetActiveTool();
+    if (tool)
     {
-    case EditorStatePan:
-        mPanTool->OnPaint(p);
-        break;
-    case EditorStateZoom:
-        mZoomTool->OnPaint(p);
-        break;
-    case EditorStateRotate:
-        mRotateTool->OnPaint(p);
-        break;
-    case EditorStateColor:
-        mColorTool->OnPaint(p);
-        break;
-    case EditorStateErase:
-        mEraseTool->OnPaint(p);
-        break;
-    default:
-        if (mTool)
-        {
-            mTool->OnPaint(p);
-        }
-        break;
+        tool->OnPaint(p);
     }
 
+    mLatency.EndStage(LatencyComposite);
+
+    // ending the painter swaps the buffers
+    mLatency.BeginStage(LatencyPresent);
+    p.end();
+    mLatency.EndStage(LatencyPresent);
+    mLatency.OnPresent();
 
     ++mFrameCounter;
-    QString fpsStr;
     if (mFpsClock.elapsed() >= 1000)
     {
         mFps = mFrameCounter;
         mFrameCounter = 0;
         mFpsClock.restart();
     }
-    fpsStr.sprintf("FPS: %d", mFps);
-
-//    p.end();
 }
 
 void RasterImageEditor::tabletEvent(QTabletEvent *e)
 {
-    QWidget::tabletEvent(e);
+    mLatency.OnInput();
     mTempPressure = e->pressure();
-//    QPoint offset = this->pos();
-//    offset = parentWidget()->mapToGlobal(offset);
-//    StrokePoint pt;
-//    pt.x = e->hiResGlobalX() - offset.x();
-//    pt.y = e->hiResGlobalY() - offset.y();
-//    pt.pressure = e->pressure();
-
-//    printf("tablet x=%f, y=%f, p=%f\n", pt.x, pt.y, pt.pressure);fflush(stdout);
-
-//    if (mPoints.size() > 0)
-//    {
-//        if (mPoints.back().x != pt.x || mPoints.back().y != pt.y)
-//        {
-//            mPoints.push_back(pt);
-//            DrawLastStroke();
-//        }
-//    }
-//    else
-//    {
-//        mPoints.push_back(pt);
-//        DrawLastStroke();
-//    }
+
+    TabletSample sample;
+    if (e->type() == QEvent::TabletPress)
+    {
+        // strokes of the tool only, the keys pick other tools from the mouse events
+        bool keyDown = mPanKeyDown || mZoomKeyDown || mRotateKeyDown || mColorKeyDown || mEraseKeyDown;
+        mTabletDown = mTool && !keyDown;
+        sample.type = TabletSamplePress;
+    }
+    else if (e->type() == QEvent::TabletRelease)
+    {
+        sample.type = TabletSampleRelease;
+    }
+    else
+    {
+        sample.type = TabletSampleMove;
+    }
+    if (!mTabletDown)
+    {
+        // ignored, so it comes again as a mouse event
+        QWidget::tabletEvent(e);
+        return;
+    }
+    e->accept();
+
+    sample.x = e->posF().x();
+    sample.y = e->posF().y();
+    sample.pressure = e->pressure();
+    sample.xTilt = e->xTilt();
+    sample.yTilt = e->yTilt();
+    sample.timestamp = e->timestamp();
+    if (mTool)
+    {
+        Record(sample.type, sample.x, sample.y, sample.pressure);
+    }
+    if (sample.type == TabletSampleRelease)
+    {
+        mTabletDown = false;
+        mTempPressure = 1.0f;
+    }
+    if (!mTabletQueue.Push(sample))
+    {
+        // no frame for a long time, draw what is queued now
+        DrainTablet();
+        mTabletQueue.Push(sample);
+    }
+    update();
+}
+
+void RasterImageEditor::DrainTablet()
+{
+    mDraining = true;
+    mTabletQueue.Drain(mTool);
+    mDraining = false;
+}
+
+void RasterImageEditor::UpdateView()
+{
+    if (!mDraining)
+    {
+        update();
+    }
+}
+
+void RasterImageEditor::OnImageChanged()
+{
+    if (mTimeline)
+    {
+        mTimeline->InvalidateCache();
+    }
+    UpdateView();
 }
 
 void RasterImageEditor::SetTool(CanvasTool* tool)
@@ -309,7 +390,41 @@ void RasterImageEditor::SetTool(CanvasTool* tool)
     mTool = tool;
 }
 
-StrokePoint RasterImageEditor::ScreenToLocal(int x, int y, float pressure)
+QImage* RasterImageEditor::GetCompositeImage()
+{
+    return mTimeline ? mTimeline->GetCompositeImage() : NULL;
+}
+
+void RasterImageEditor::SetStrokeRecording(StrokeRecording* recording)
+{
+    mRecording = recording;
+}
+
+void RasterImageEditor::Record(TabletSampleType type, float x, float y, float pressure)
+{
+    if (!mRecording || !mImage)
+    {
+        return;
+    }
+
+    StrokePoint point = ScreenToLocal(x, y, pressure);
+    StrokeToolParams params;
+    if (type == TabletSamplePress && mTool->GetStrokeParams(params))
+    {
+        mRecording->SetCanvasSize(mImage->width(), mImage->height());
+        mRecording->BeginStroke(params, point);
+    }
+    else if (type == TabletSampleMove)
+    {
+        mRecording->AddPoint(point);
+    }
+    else if (type == TabletSampleRelease)
+    {
+        mRecording->EndStroke(point);
+    }
+}
+
+StrokePoint RasterImageEditor::ScreenToLocal(float x, float y, float pressure)
 {
     QTransform p;
     p.translate(mTranslate.x(), mTranslate.y());
@@ -336,21 +451,50 @@ QPoint RasterImageEditor::LocalToScreen(int x, int y)
     return QPoint((int)position.x(), (int)position.y());
 }
 
+QRect RasterImageEditor::GetVisibleRect()
+{
+    QTransform p;
+    p.translate(mTranslate.x(), mTranslate.y());
+    p.scale(mScale, mScale);
+    p.rotate(mRotate);
+    p = p.inverted();
+
+    QRect r = p.mapRect(QRectF(rect())).toAlignedRect();
+    int left = (int)floorf((float)r.left() / CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+    int top = (int)floorf((float)r.top() / CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+    int right = (int)ceilf((float)(r.right() + 1) / CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+    int bottom = (int)ceilf((float)(r.bottom() + 1) / CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE;
+    return QRect(left, top, right - left, bottom - top);
+}
+
 void RasterImageEditor::Clear()
 {
-    QImage* oldImage = new QImage(mImage->width(),mImage->height(), QImage::Format_RGBA8888);
-    QImage* newImage = new QImage(mImage->width(),mImage->height(), QImage::Format_RGBA8888);
+    if (!mImage)
+    {
+        return;
+    }
 
-    QPainter hp(oldImage);
-    hp.setCompositionMode(QPainter::CompositionMode_Source);
-    hp.drawImage(0, 0, *mImage);
-    mUndoStack->push(new DrawCommand(this, newImage, oldImage));
+    QRect rect = mFrame->GetBounds();
+    if (rect.isEmpty())
+    {
+        // nothing drawn, an undo step would change nothing
+        return;
+    }
+    DrawCommand* command = new DrawCommand(this, rect);
+    {
+        QPainter p(mImage);
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        p.fillRect(rect, QColor(0, 0, 0, 0));
+    }
+    command->Finish();
+    mUndoStack->push(command);
 
 }
 
-void RasterImageEditor::Load(QImage* image)
+void RasterImageEditor::Load(RasterFrameModel* frame)
 {
-    mImage = image;
+    mFrame = frame;
+    mImage = frame ? frame->GetImage() : NULL;
     update();
 }
 
@@ -7,9 +7,14 @@
 #include <vector>
 #include <QGLWidget>
 #include <QTime>
-#include "StrokePoint.h"
+#include "strokepoint.h"
 #include <QUndoStack>
 #include "canvastool.h"
+#include "latencyprobe.h"
+#include "tabletqueue.h"
+
+// Visible area is rounded out to tiles of this size
+#define CANVAS_TILE_SIZE 64
 
 class PanTool;
 class ZoomTool;
@@ -21,8 +26,11 @@ class GLTexture;
 class GLRenderTarget;
 class GLRenderer;
 class GLShape;
+class RasterFrameModel;
+class UndoHistory;
+class StrokeRecording;
 
-class RasterImageEditor : public QGLWidget
+class RasterImageEditor : public QGLWidget, public CanvasHost
 {
     Q_OBJECT
 public:
@@ -30,9 +38,17 @@ public:
     virtual ~RasterImageEditor();
 
     QImage* GetImage() { return mImage; }
-    void Load(QImage* image);
+    QImage* GetCompositeImage();
+    RasterFrameModel* GetFrame() { return mFrame; }
+    void Load(RasterFrameModel* frame);
     void SetUndoStack(QUndoStack* stack) { mUndoStack = stack; }
+    UndoHistory* GetUndoHistory() { return mUndoHistory; }
+    void SetUndoHistory(UndoHistory* history) { mUndoHistory = history; }
     void SetTool(CanvasTool* tool);
+    // Tool the editor paints, a held key may have put another one over the set tool
+    CanvasTool* GetActiveTool();
+    // Strokes of the tool are added to recording while it is set, NULL stops recording
+    void SetStrokeRecording(StrokeRecording* recording);
     QPoint GetTranslate() const { return mTranslate; }
     void SetTranslate(int x, int y) { mTranslate.setX(x); mTranslate.setY(y); }
     void ModTranslate(int x, int y);
@@ -42,8 +58,15 @@ public:
     float GetRotate() const { return mRotate; }
     void SetRotate(float value) { mRotate = value; }
     void ModRotate(float value) { mRotate += value; }
-    StrokePoint ScreenToLocal(int x, int y, float pressure);
+    StrokePoint ScreenToLocal(float x, float y, float pressure);
     QPoint LocalToScreen(int x, int y);
+    // Image-space tiles covered by the widget under the current view transform
+    QRect GetVisibleRect();
+    LatencyProbe* GetLatencyProbe() { return &mLatency; }
+    void UpdateView();
+    void OnImageChanged();
+    // Frames painted in the last second
+    int GetFps() const { return mFps; }
     Timeline* GetTimeline() { return mTimeline; }
     void SetTimeline(Timeline* t) { mTimeline = t; }
     bool IsOnionEnabled() const { return mShowOnionSkin; }
@@ -84,12 +107,20 @@ protected:
     void initializeGL();
     void resizeGL(int w, int h);
 
+private:
+    // Hands the queued tablet samples to the tool, moves in one batch per frame
+    void DrainTablet();
+    // Adds input going to the tool to the recording, tablet samples as they are queued
+    void Record(TabletSampleType type, float x, float y, float pressure);
+
 
 private:
     CanvasTool* mTool;
+    RasterFrameModel* mFrame;
     QImage* mImage;
     float mTempPressure;
     QUndoStack* mUndoStack;
+    UndoHistory* mUndoHistory;
     bool mPanKeyDown;
     bool mZoomKeyDown;
     bool mRotateKeyDown;
@@ -106,7 +137,14 @@ private:
     ColorTool* mColorTool;
     RegionTool* mEraseTool;
     Timeline* mTimeline;
+    // Samples of a tablet stroke drawing with the tool, mouse events drive everything else
+    TabletQueue mTabletQueue;
+    bool mTabletDown;
+    // The tool is drawing queued samples inside paintEvent, it needs no repaint
+    bool mDraining;
+    StrokeRecording* mRecording;
 
+    LatencyProbe mLatency;
     QTime mFpsClock;
     int mFps;
     int mFrameCounter;
@@ -5,6 +5,7 @@
 #include <QHBoxLayout>
 #include <QSlider>
 #include <QCheckBox>
+#include <QComboBox>
 #include "timeline.h"
 #include "command.h"
 #include "animationfile.h"
@@ -38,6 +39,11 @@ RasterPropertyWindow::RasterPropertyWindow(Timeline* timeline, RasterLayer* laye
             this, SLOT(EnableOnion(bool)));
     layout()->addWidget(onionBox);
 
+    QComboBox* blendBox = Layer::CreateBlendModeBox(layer->GetBlendMode());
+    connect(blendBox, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(SetBlendMode(int)));
+    layout()->addWidget(blendBox);
+
     setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Fixed);
 }
 
@@ -71,12 +77,18 @@ void RasterPropertyWindow::EnableOnion(bool value)
     mLayer->EnableOnion(value);
 }
 
+void RasterPropertyWindow::SetBlendMode(int value)
+{
+    mLayer->SetBlendMode((BlendMode)value);
+}
+
 RasterLayer::RasterLayer(Timeline* timeline, RasterLayerModel* layerModel, QWidget *parent) :
     Layer(parent),
     mLayerModel(layerModel),
     mTimeline(timeline),
     mWidth(layerModel->GetWidth()),
     mHeight(layerModel->GetHeight()),
+    mUndoStack(NULL),
     mSelected(false),
     mOpacity(0xFF),
     mEnabled(true),
@@ -152,6 +164,19 @@ void RasterLayer::mousePressEvent(QMouseEvent *ev)
 void RasterLayer::mouseReleaseEvent(QMouseEvent *e)
 {
     this->releaseMouse();
+
+    if (mState == EditorStateScale && mEditFrame && mUndoStack)
+    {
+        int delta = mEditFrame->GetExposure() - mEditFrameExposure;
+        if (delta != 0)
+        {
+            // the drag only previewed the exposure, the command applies it
+            mEditFrame->SetExposure(mEditFrameExposure);
+            mUndoStack->push(new ModifyExposureCommand(this, mEditFrameIndex, delta));
+        }
+    }
+    mState = EditorStateMove;
+    mEditFrame = NULL;
 }
 
 void RasterLayer::mouseMoveEvent(QMouseEvent *ev)
@@ -227,24 +252,41 @@ void RasterLayer::paintEvent(QPaintEvent *)
 
 void RasterLayer::AddFrame(int frameIndex)
 {
+    if (mUndoStack)
+    {
+        mUndoStack->push(new AddFrameCommand(this, frameIndex));
+        return;
+    }
     mLayerModel->AddFrame(frameIndex);
-    update();
-    mTimeline->UpdateCanvas();
-    UpdateMaxFrames();
+    UpdateFrames();
 }
 
 void RasterLayer::RemoveFrame(int index)
 {
-    mLayerModel->RemoveFrame(index);
-    update();
-    mTimeline->UpdateCanvas();
-    UpdateMaxFrames();
+    if (mUndoStack)
+    {
+        mUndoStack->push(new RemoveFrameCommand(this, index));
+        return;
+    }
+    delete mLayerModel->RemoveFrame(index);
+    UpdateFrames();
 }
 
 void RasterLayer::ModExposure(int index, int delta)
 {
+    if (mUndoStack)
+    {
+        mUndoStack->push(new ModifyExposureCommand(this, index, delta));
+        return;
+    }
     mLayerModel->ModExposure(index, delta);
+    UpdateFrames();
+}
+
+void RasterLayer::UpdateFrames()
+{
     update();
+    mTimeline->UpdateCanvas();
     UpdateMaxFrames();
 }
 
@@ -341,6 +383,12 @@ int RasterLayer::GetNextImageIndex(int index)
     return idx;
 }
 
+void RasterLayer::GetOnionFrames(int index, int before, int after,
+                                 std::vector<RasterFrameModel*>& prevFrames, std::vector<RasterFrameModel*>& nextFrames)
+{
+    mLayerModel->GetOnionFrames(index, before, after, prevFrames, nextFrames);
+}
+
 void RasterLayer::SetSelected(bool selected)
 {
     mSelected = selected;
@@ -358,6 +406,11 @@ QImage* RasterLayer::GetImage(int frameIndex)
     return mLayerModel->GetImage(frameIndex);
 }
 
+QRect RasterLayer::GetBounds(int frameIndex)
+{
+    return mLayerModel->GetBounds(frameIndex);
+}
+
 
 bool RasterLayer::IsOnionEnabled()
 {
@@ -383,6 +436,7 @@ void RasterLayer::SetOpacity(unsigned char value)
     if (value != mLayerModel->GetOpacity())
     {
         mLayerModel->SetOpacity(value);
+        mTimeline->InvalidateCache();
         mTimeline->UpdateCanvas();
     }
 }
@@ -397,6 +451,22 @@ void RasterLayer::Enable(bool enable)
     if (mLayerModel->IsEnabled() != enable)
     {
         mLayerModel->Enable(enable);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+BlendMode RasterLayer::GetBlendMode()
+{
+    return mLayerModel->GetBlendMode();
+}
+
+void RasterLayer::SetBlendMode(BlendMode value)
+{
+    if (value != mLayerModel->GetBlendMode())
+    {
+        mLayerModel->SetBlendMode(value);
+        mTimeline->InvalidateCache();
         mTimeline->UpdateCanvas();
     }
 }
@@ -28,6 +28,7 @@ public slots:
     void SetOpacity(int value);
     void Enable(bool value);
     void EnableOnion(bool value);
+    void SetBlendMode(int value);
 
 protected:
     QSize sizeHint() const;
@@ -45,6 +46,8 @@ public:
     explicit RasterLayer(Timeline* timeline, RasterLayerModel* layerModel, QWidget *parent = 0);
     ~RasterLayer();
 
+    RasterLayerModel* GetModel() { return mLayerModel; }
+    // Frame edits go through the undo stack when there is one
     void AddFrame(int insertIndex);
     void RemoveFrame(int index);
     void ModExposure(int index, int delta);
@@ -52,9 +55,12 @@ public:
     RasterFrameModel* GetFrameAt(int index);
     int GetPrevImageIndex(int index);
     int GetNextImageIndex(int index);
+    void GetOnionFrames(int index, int before, int after,
+                        std::vector<RasterFrameModel*>& prevFrames, std::vector<RasterFrameModel*>& nextFrames);
     void SetSelected(bool selected);
     void OnFrameChanged(int frameIndex);
     QImage* GetImage(int frameIndex);
+    QRect GetBounds(int frameIndex);
     int GetWidth() const { return mWidth; }
     int GetHeight() const { return mHeight; }
     bool IsOnionEnabled();
@@ -65,6 +71,10 @@ public:
     QWidget* GetPropertyWindow() { return mPropertyWindow; }
     int GetMaxFrames() { return mMaxFrames; }
     void UpdateMaxFrames();
+    // Refreshes the row and the canvas after the frame list changed
+    void UpdateFrames();
+    BlendMode GetBlendMode();
+    void SetBlendMode(BlendMode value);
 
 private:
     std::vector<RasterFrameModel*>::iterator GetFrameIterator(int index);
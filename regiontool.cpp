@@ -2,8 +2,9 @@
 #include "rasterimageeditor.h"
 #include "openglrenderer.h"
 #include "command.h"
+#include "strokerecording.h"
 
-RegionTool::RegionTool(RasterImageEditor* editor, QUndoStack* undoStack)
+RegionTool::RegionTool(CanvasHost* editor, QUndoStack* undoStack)
     :mEditor(editor)
     ,mUndoStack(undoStack)
     ,mBrushSize(1.0f)
@@ -13,59 +14,90 @@ RegionTool::RegionTool(RasterImageEditor* editor, QUndoStack* undoStack)
 }
 
 void RegionTool::OnDragBegin(int x, int y, float pressure)
+{
+    BeginStroke(x, y, pressure);
+}
+
+void RegionTool::OnDrag(int x, int y, float pressure)
 {
     if (!mEditor->GetImage())
     {
         return;
     }
 
-    mPoints.clear();
-    QPainterPath p;
-    mTempPath.swap(p);
     mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
+    DrawLastStroke();
 }
 
-void RegionTool::OnDrag(int x, int y, float pressure)
+void RegionTool::OnDragEnd(int x, int y, float pressure)
 {
-    if (!mEditor->GetImage())
+    EndStroke(x, y, pressure);
+}
+
+// The path is rebuilt from every point, once for the whole batch
+void RegionTool::OnDragSamples(const TabletSample* samples, int count)
+{
+    if (!mEditor->GetImage() || count == 0)
     {
         return;
     }
 
-    mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
+    for (int i = 0; i < count; ++i)
+    {
+        mPoints.push_back(mEditor->ScreenToLocal(samples[i].x, samples[i].y, samples[i].pressure));
+    }
     DrawLastStroke();
 }
 
-void RegionTool::OnDragEnd(int x, int y, float pressure)
+void RegionTool::OnSampleBegin(const TabletSample& sample)
+{
+    BeginStroke(sample.x, sample.y, sample.pressure);
+}
+
+void RegionTool::OnSampleEnd(const TabletSample& sample)
+{
+    EndStroke(sample.x, sample.y, sample.pressure);
+}
+
+void RegionTool::BeginStroke(float x, float y, float pressure)
 {
     if (!mEditor->GetImage())
     {
         return;
     }
 
+    mPoints.clear();
+    QPainterPath p;
+    mTempPath.swap(p);
     mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
-    DrawLastStroke();
+}
 
-    QImage* oldImage = new QImage(mEditor->GetImage()->width(),mEditor->GetImage()->height(), QImage::Format_RGBA8888);
-    QImage* newImage = new QImage(mEditor->GetImage()->width(),mEditor->GetImage()->height(), QImage::Format_RGBA8888);
+void RegionTool::EndStroke(float x, float y, float pressure)
+{
+    if (!mEditor->GetImage())
+    {
+        return;
+    }
 
-    QPainter hp(oldImage);
-    hp.setCompositionMode(QPainter::CompositionMode_Source);
-    hp.drawImage(0, 0, *mEditor->GetImage());
+    mPoints.push_back(mEditor->ScreenToLocal(x, y, pressure));
+    DrawLastStroke();
 
-    QPainter np(newImage);
-    np.setCompositionMode(QPainter::CompositionMode_Source);
-    np.drawImage(0, 0, *mEditor->GetImage());
-    np.setCompositionMode(mBrushMode);
-    np.setRenderHint(QPainter::Antialiasing, true);
-    QBrush brush(mColor);
-    np.fillPath(mTempPath, brush);
-    mUndoStack->push(new DrawCommand(mEditor, newImage, oldImage));
+    QRect rect = mTempPath.boundingRect().toAlignedRect().adjusted(-1, -1, 1, 1);
+    DrawCommand* command = new DrawCommand(mEditor, rect);
+    {
+        QPainter np(mEditor->GetImage());
+        np.setCompositionMode(mBrushMode);
+        np.setRenderHint(QPainter::Antialiasing, true);
+        QBrush brush(mColor);
+        np.fillPath(mTempPath, brush);
+    }
+    command->Finish();
+    mUndoStack->push(command);
 
     mPoints.clear();
     QPainterPath path;
     mTempPath.swap(path);
-    mEditor->update();
+    mEditor->UpdateView();
 }
 
 void RegionTool::OnPaint(QPainter &p)
@@ -80,6 +112,18 @@ void RegionTool::OnPaint(QPainter &p)
     p.fillPath(mTempPath, QBrush(mColor));
 }
 
+bool RegionTool::GetStrokeParams(StrokeToolParams& params)
+{
+    params.tool = StrokeToolRegion;
+    params.brushSize = mBrushSize;
+    params.smooth = mSmooth;
+    params.mode = mBrushMode;
+    params.tip = 0;
+    params.stabilize = 0;
+    params.color = mColor.rgba();
+    return true;
+}
+
 void RegionTool::BuildDrawSegment(const StrokePoint& p0, const StrokePoint& p1, QPainterPath& path)
 {
     QPointF pts[4];
@@ -145,7 +189,7 @@ void RegionTool::DrawLastStroke()
         }
 
         mTempPath.swap(path);
-        mEditor->update();
+        mEditor->UpdateView();
     }
 }
 
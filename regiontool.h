@@ -6,17 +6,19 @@
 #include <vector>
 #include <QUndoStack>
 
-class RasterImageEditor;
-
 class RegionTool : public CanvasTool
 {
 public:
-    RegionTool(RasterImageEditor* editor, QUndoStack* undoStack);
+    RegionTool(CanvasHost* editor, QUndoStack* undoStack);
 
     void OnDragBegin(int x, int y, float pressure);
     void OnDrag(int x, int y, float pressure);
     void OnDragEnd(int x, int y, float pressure);
+    void OnDragSamples(const TabletSample* samples, int count);
+    void OnSampleBegin(const TabletSample& sample);
+    void OnSampleEnd(const TabletSample& sample);
     void OnPaint(QPainter &painter);
+    bool GetStrokeParams(StrokeToolParams& params);
     void SetUndoStack(QUndoStack* stack) { mUndoStack = stack; }
     void SetBrushSize(float value);
     void SetColor(const QColor& color);
@@ -27,6 +29,8 @@ public:
     QPainter::CompositionMode GetMode() { return mBrushMode; }
 
 private:
+    void BeginStroke(float x, float y, float pressure);
+    void EndStroke(float x, float y, float pressure);
     void DrawLastStroke();
     void BuildDrawSegment(const StrokePoint& p0, const StrokePoint& p1, QPainterPath& path);
 
@@ -36,7 +40,7 @@ public slots:
 
 
 private:
-    RasterImageEditor* mEditor;
+    CanvasHost* mEditor;
     QUndoStack* mUndoStack;
     float mBrushSize;
     QColor mColor;
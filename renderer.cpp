@@ -0,0 +1,13 @@
+#include "renderer.h"
+#include "openglrenderer.h"
+#include "softrenderer.h"
+#include <QGLContext>
+
+IRenderer* CreateRenderer()
+{
+    if (QGLContext::currentContext())
+    {
+        return new GLRenderer();
+    }
+    return new SoftRenderer();
+}
@@ -0,0 +1,52 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+// Drawing calls GLRenderer and SoftRenderer share, so a pass runs with or without a GPU.
+// Pixels are straight alpha RGBA8888, bottom row first like GL textures. mvp is column major and
+// maps the quad (0, 0) - (src width, src height). Textures and targets only go back to the
+// renderer which created them.
+
+class ITexture
+{
+public:
+    virtual ~ITexture() {}
+    virtual int GetWidth() const = 0;
+    virtual int GetHeight() const = 0;
+    virtual void ReadTexture(int* data) = 0;
+    virtual void WriteTexture(int* data, int w, int h, bool useMipmap) = 0;
+};
+
+class IRenderTarget
+{
+public:
+    virtual ~IRenderTarget() {}
+    virtual int GetWidth() const = 0;
+    virtual int GetHeight() const = 0;
+    virtual void Blit(IRenderTarget* src, bool smooth) = 0;
+    virtual ITexture* GetTexture() = 0;
+};
+
+class IRenderer
+{
+public:
+    virtual ~IRenderer() {}
+
+    virtual ITexture* CreateTexture(int width, int height, int* data, bool topDownOrder) = 0;
+    virtual IRenderTarget* CreateTarget(int width, int height, int* data, bool topDownOrder) = 0;
+    virtual void SetScreenSize(int width, int height) = 0;
+    // Blends the draws below onto the target with glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+    virtual void EnableBlend(bool enable) = 0;
+
+    // A NULL target is the screen
+    virtual void Clear(IRenderTarget* target, float r, float g, float b, float a) = 0;
+    virtual void BlendSource(IRenderTarget* target, ITexture* src, float* mvp, float r, float g, float b, float a) = 0;
+    virtual void BlendSourceOver(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a) = 0;
+    virtual void BlendMultipy(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a) = 0;
+    virtual void Blur(IRenderTarget* target, IRenderTarget* targetTemp, float* mvp, ITexture* src, int radius) = 0;
+    virtual void Mask(IRenderTarget* target, ITexture* src, float* mvp, ITexture* colorMask, ITexture* alphaMask, float alpha) = 0;
+};
+
+// GLRenderer when a GL context is current, SoftRenderer without one
+IRenderer* CreateRenderer();
+
+#endif // RENDERER_H
@@ -0,0 +1,67 @@
+#include <QAtomicInt>
+#include <new>
+#include <stdlib.h>
+#include "replay.h"
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static QAtomicInt sAllocations;
+
+void* operator new(size_t size)
+{
+    sAllocations.fetchAndAddRelaxed(1);
+    void* p = malloc(size > 0 ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    free(p);
+}
+
+int GetAllocationCount()
+{
+    return sAllocations.load();
+}
+
+qint64 GetPeakMemory()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss;
+#else
+    // kilobytes on Linux
+    return (qint64)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,179 @@
+#include "replay.h"
+#include "dabbrush.h"
+#include <QDir>
+#include <QPointF>
+#include <vector>
+#include <math.h>
+
+#define CORPUS_WIDTH 1920
+#define CORPUS_HEIGHT 1080
+// ms between the points of a 240 Hz pen
+#define CORPUS_POINT_MS 4
+
+// Fixed sequence, so every run writes the same corpus. Draws stay out of argument lists,
+// whose evaluation order is up to the compiler.
+static unsigned int sSeed = 1;
+
+static float Random()
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return ((sSeed >> 8) & 0xFFFF) / 65535.0f;
+}
+
+static StrokeToolParams GetParams(StrokeToolType tool, float brushSize, BrushTip tip)
+{
+    StrokeToolParams params;
+    params.tool = tool;
+    params.brushSize = brushSize;
+    params.smooth = 0;
+    params.mode = QPainter::CompositionMode_SourceOver;
+    params.tip = tip;
+    params.stabilize = 0;
+    params.color = qRgba(40, 80, 160, 0xFF);
+    return params;
+}
+
+static RecordedPoint GetPoint(unsigned int time, float x, float y, float pressure)
+{
+    RecordedPoint p;
+    p.time = time;
+    p.point.x = x;
+    p.point.y = y;
+    p.point.pressure = pressure;
+    return p;
+}
+
+// Wandering stroke with a pressure swell, the way a pen leaves it
+static void AddWander(StrokeRecording& recording, const StrokeToolParams& params, int length)
+{
+    RecordedStroke stroke;
+    stroke.params = params;
+    float x = CORPUS_WIDTH * (0.1f + 0.8f * Random());
+    float y = CORPUS_HEIGHT * (0.1f + 0.8f * Random());
+    float angle = Random() * 6.2831853f;
+    for (int i = 0; i < length; ++i)
+    {
+        float pressure = 0.2f + 0.8f * sinf(3.1415926f * i / (length - 1));
+        stroke.points.push_back(GetPoint(i * CORPUS_POINT_MS, x, y, pressure));
+        angle += (Random() - 0.5f) * 0.3f;
+        float step = 1.0f + 5.0f * Random();
+        x += cosf(angle) * step;
+        y += sinf(angle) * step;
+    }
+    recording.AddStroke(stroke);
+}
+
+// Closed loop around a centre, for regions and for outlines to fill
+static void AddLoop(StrokeRecording& recording, const StrokeToolParams& params, float cx, float cy, float radius)
+{
+    RecordedStroke stroke;
+    stroke.params = params;
+    int length = (int)(radius * 0.8f) + 16;
+    for (int i = 0; i <= length; ++i)
+    {
+        float a = 6.2831853f * i / length;
+        float r = radius * (0.85f + 0.15f * Random());
+        stroke.points.push_back(GetPoint(i * CORPUS_POINT_MS, cx + cosf(a) * r, cy + sinf(a) * r, 1.0f));
+    }
+    recording.AddStroke(stroke);
+}
+
+// Press and release in place
+static void AddClick(StrokeRecording& recording, const StrokeToolParams& params, float x, float y)
+{
+    RecordedStroke stroke;
+    stroke.params = params;
+    stroke.points.push_back(GetPoint(0, x, y, 1.0f));
+    stroke.points.push_back(GetPoint(80, x, y, 1.0f));
+    recording.AddStroke(stroke);
+}
+
+static void Write(StrokeRecording& recording, const QDir& dir, const char* name, int& count)
+{
+    if (recording.Save(dir.filePath(QString(name) + ".strokes")))
+    {
+        ++count;
+    }
+    recording.Clear();
+}
+
+int GenerateCorpus(const QString& path)
+{
+    QDir dir(path);
+    if (!dir.exists() && !dir.mkpath("."))
+    {
+        return 0;
+    }
+
+    int count = 0;
+    StrokeRecording recording;
+    recording.SetCanvasSize(CORPUS_WIDTH, CORPUS_HEIGHT);
+
+    static const BrushTip tips[] = { BrushTipOutline, BrushTipRound, BrushTipTextured, BrushTipPencil };
+    static const char* tipNames[] = { "brush_outline", "brush_round", "brush_textured", "brush_pencil" };
+    for (int t = 0; t < 4; ++t)
+    {
+        sSeed = 1;
+        for (int i = 0; i < 40; ++i)
+        {
+            float size = 4.0f + 36.0f * Random();
+            int length = 50 + (int)(Random() * 400);
+            AddWander(recording, GetParams(StrokeToolBrush, size, tips[t]), length);
+        }
+        Write(recording, dir, tipNames[t], count);
+    }
+
+    // smoothing and the string both keep state along the stroke
+    sSeed = 1;
+    for (int i = 0; i < 40; ++i)
+    {
+        StrokeToolParams params = GetParams(StrokeToolBrush, 12.0f, BrushTipOutline);
+        params.smooth = 20;
+        params.stabilize = 15.0f;
+        AddWander(recording, params, 300);
+    }
+    Write(recording, dir, "brush_stabilized", count);
+
+    sSeed = 1;
+    for (int i = 0; i < 30; ++i)
+    {
+        float x = CORPUS_WIDTH * Random();
+        float y = CORPUS_HEIGHT * Random();
+        float radius = 20.0f + 150.0f * Random();
+        AddLoop(recording, GetParams(StrokeToolRegion, 1.0f, BrushTipOutline), x, y, radius);
+    }
+    Write(recording, dir, "region", count);
+
+    sSeed = 1;
+    for (int i = 0; i < 60; ++i)
+    {
+        float size = 2.0f + 10.0f * Random();
+        float x = CORPUS_WIDTH * Random();
+        float y = CORPUS_HEIGHT * Random();
+        AddClick(recording, GetParams(StrokeToolSpline, size, BrushTipOutline), x, y);
+    }
+    Write(recording, dir, "spline", count);
+
+    // outlines first, then a fill inside each and one outside them all
+    sSeed = 1;
+    std::vector<QPointF> centres;
+    for (int i = 0; i < 12; ++i)
+    {
+        float x = CORPUS_WIDTH * (0.1f + 0.8f * Random());
+        float y = CORPUS_HEIGHT * (0.1f + 0.8f * Random());
+        float radius = 40.0f + 60.0f * Random();
+        AddLoop(recording, GetParams(StrokeToolBrush, 6.0f, BrushTipOutline), x, y, radius);
+        QPointF centre(x, y);
+        centres.push_back(centre);
+    }
+    for (size_t i = 0; i < centres.size(); ++i)
+    {
+        StrokeToolParams params = GetParams(StrokeToolFill, 0.0f, BrushTipOutline);
+        params.color = qRgba(200, 60, 40, 0xFF);
+        AddClick(recording, params, centres[i].x(), centres[i].y());
+    }
+    AddClick(recording, GetParams(StrokeToolFill, 0.0f, BrushTipOutline), 2.0f, 2.0f);
+    Write(recording, dir, "fill", count);
+
+    return count;
+}
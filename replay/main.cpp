@@ -0,0 +1,119 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFileInfo>
+#include <QDir>
+#include <stdio.h>
+#include "replay.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    bool update = false;
+    QString generate;
+    QStringList inputs;
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--update")
+        {
+            update = true;
+        }
+        else if (args[i] == "--generate" && i + 1 < args.size())
+        {
+            generate = args[++i];
+        }
+        else if (args[i].startsWith("--"))
+        {
+            printf("usage: replay [--update] [--generate dir] [recording or dir...]\n");
+            return 1;
+        }
+        else
+        {
+            inputs.append(args[i]);
+        }
+    }
+
+    if (!generate.isEmpty())
+    {
+        printf("wrote %d recordings to %s\n", GenerateCorpus(generate), generate.toUtf8().constData());
+        if (inputs.isEmpty())
+        {
+            inputs.append(generate);
+        }
+    }
+    if (inputs.isEmpty())
+    {
+        inputs.append(REPLAY_CORPUS);
+    }
+
+    QStringList paths;
+    for (int i = 0; i < inputs.size(); ++i)
+    {
+        QFileInfo info(inputs[i]);
+        if (!info.isDir())
+        {
+            paths.append(inputs[i]);
+            continue;
+        }
+        QDir dir(inputs[i]);
+        QStringList names = dir.entryList(QStringList() << "*.strokes", QDir::Files, QDir::Name);
+        for (int j = 0; j < names.size(); ++j)
+        {
+            paths.append(dir.filePath(names[j]));
+        }
+    }
+    if (paths.isEmpty())
+    {
+        printf("no recordings, record some in the editor or use --generate dir\n");
+        return 1;
+    }
+
+    printf("%-24s %8s %8s %10s %10s %12s %10s %16s %s\n",
+           "recording", "strokes", "points", "ms", "strokes/s", "points/s", "allocs", "hash", "result");
+    int failed = 0;
+    for (int i = 0; i < paths.size(); ++i)
+    {
+        QString name = QFileInfo(paths[i]).completeBaseName();
+        StrokeRecording recording;
+        if (!recording.Load(paths[i]))
+        {
+            printf("%-24s cannot be read\n", name.toUtf8().constData());
+            ++failed;
+            continue;
+        }
+
+        ReplayResult result;
+        Replay(recording, result);
+
+        const char* status;
+        quint64 golden = 0;
+        if (update)
+        {
+            status = WriteGolden(paths[i], result.hash) ? "updated" : "cannot write golden";
+        }
+        else if (!ReadGolden(paths[i], golden))
+        {
+            // nothing to compare with is not a pass, goldens are recorded on purpose with --update
+            status = "NO GOLDEN";
+            ++failed;
+        }
+        else if (golden != result.hash)
+        {
+            status = "MISMATCH";
+            ++failed;
+        }
+        else
+        {
+            status = "ok";
+        }
+
+        double seconds = result.nsecs / 1e9;
+        printf("%-24s %8d %8d %10.2f %10.1f %12.0f %10d %016llx %s\n", name.toUtf8().constData(),
+               result.strokes, result.points, result.nsecs / 1e6,
+               seconds > 0 ? result.strokes / seconds : 0.0, seconds > 0 ? result.points / seconds : 0.0,
+               result.allocations, (unsigned long long)result.hash, status);
+    }
+    printf("peak memory %.1f MB\n", GetPeakMemory() / (1024.0 * 1024.0));
+    return failed > 0 ? 1 : 0;
+}
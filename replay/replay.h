@@ -0,0 +1,33 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+#include <QString>
+#include "strokerecording.h"
+
+struct ReplayResult
+{
+    int strokes;
+    int points;
+    qint64 nsecs;
+    // operator new calls while replaying
+    int allocations;
+    // FNV-1a of the pixels of the canvas after the last stroke
+    quint64 hash;
+};
+
+// Draws the strokes on a blank canvas of the recording's size through the tools they were drawn with
+void Replay(const StrokeRecording& recording, ReplayResult& result);
+
+// Golden hash of a recording, kept next to it as name.golden
+bool ReadGolden(const QString& path, quint64& hash);
+bool WriteGolden(const QString& path, quint64 hash);
+
+// Writes synthetic recordings of every tool to dir, as in replay/corpus.
+// Returns the number of files written.
+int GenerateCorpus(const QString& dir);
+
+// operator new calls so far
+int GetAllocationCount();
+// Most memory the process had resident, in bytes
+qint64 GetPeakMemory();
+
+#endif // REPLAY_H
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Headless replay of recorded strokes through the
+# drawing tools, checked against golden hashes, run as
+# replay [--update] [--generate dir] [recording or dir...]
+# with the committed corpus when no recording is given
+#
+#-------------------------------------------------
+
+QT       += core gui xml opengl
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = replay
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+DEFINES += GLEW_STATIC \
+    REPLAY_CORPUS=\\\"$$PWD/corpus\\\"
+
+win32: LIBS += -lpsapi
+
+SOURCES += main.cpp \
+    replayer.cpp \
+    corpus.cpp \
+    allocations.cpp
+
+HEADERS  += replay.h
+
+include(../animbuilder.pri)
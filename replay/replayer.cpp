@@ -0,0 +1,165 @@
+#include "replay.h"
+#include "headlesscanvas.h"
+#include "brushtool.h"
+#include "regiontool.h"
+#include "splinetool.h"
+#include "filltool.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QFile>
+#include <QUndoStack>
+#include <vector>
+
+// Moves within one frame of a 60 Hz display reach the tool in one batch, like tablet samples in the editor
+#define REPLAY_FRAME_RATE 60
+
+static quint64 HashImage(const QImage& image)
+{
+    quint64 hash = 14695981039346656037ULL;
+    int rowBytes = image.width() * 4;
+    for (int y = 0; y < image.height(); ++y)
+    {
+        const uchar* row = image.constScanLine(y);
+        for (int x = 0; x < rowBytes; ++x)
+        {
+            hash = (hash ^ row[x]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static QString GetGoldenPath(const QString& path)
+{
+    QFileInfo info(path);
+    return info.dir().filePath(info.completeBaseName() + ".golden");
+}
+
+bool ReadGolden(const QString& path, quint64& hash)
+{
+    QFile file(GetGoldenPath(path));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return false;
+    }
+    bool ok = false;
+    hash = QString(file.readAll()).trimmed().toULongLong(&ok, 16);
+    return ok;
+}
+
+bool WriteGolden(const QString& path, quint64 hash)
+{
+    QFile file(GetGoldenPath(path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        return false;
+    }
+    file.write(QString("%1\n").arg(hash, 16, 16, QChar('0')).toUtf8());
+    return true;
+}
+
+static TabletSample ToSample(const RecordedPoint& p, TabletSampleType type)
+{
+    TabletSample sample;
+    sample.type = type;
+    sample.x = p.point.x;
+    sample.y = p.point.y;
+    sample.pressure = p.point.pressure;
+    sample.xTilt = 0;
+    sample.yTilt = 0;
+    sample.timestamp = p.time;
+    return sample;
+}
+
+void Replay(const StrokeRecording& recording, ReplayResult& result)
+{
+    result.strokes = 0;
+    result.points = 0;
+    result.nsecs = 0;
+    result.allocations = 0;
+    result.hash = 0;
+
+    HeadlessCanvas canvas(recording.GetWidth(), recording.GetHeight());
+    QUndoStack undoStack;
+    BrushTool brush(&canvas, &undoStack);
+    RegionTool region(&canvas, &undoStack);
+    SplineTool spline(&canvas, &undoStack);
+    FillTool fill(&canvas, &undoStack);
+    std::vector<TabletSample> batch;
+
+    int allocations = GetAllocationCount();
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<RecordedStroke>& strokes = recording.GetStrokes();
+    for (size_t i = 0; i < strokes.size(); ++i)
+    {
+        const RecordedStroke& stroke = strokes[i];
+        const StrokeToolParams& params = stroke.params;
+        QColor color = QColor::fromRgba(params.color);
+        CanvasTool* tool = NULL;
+        switch (params.tool)
+        {
+        case StrokeToolBrush:
+            brush.SetBrushSize(params.brushSize);
+            brush.SetSmooth(params.smooth);
+            brush.SetMode(params.mode);
+            brush.SetTip((BrushTip)params.tip);
+            brush.SetStabilize(params.stabilize);
+            brush.SetColor(color);
+            tool = &brush;
+            break;
+        case StrokeToolRegion:
+            region.SetBrushSize(params.brushSize);
+            region.SetSmooth(params.smooth);
+            region.SetMode(params.mode);
+            region.SetColor(color);
+            tool = &region;
+            break;
+        case StrokeToolSpline:
+            spline.SetBrushSize(params.brushSize);
+            spline.SetMode(params.mode);
+            spline.SetColor(color);
+            tool = &spline;
+            break;
+        case StrokeToolFill:
+            fill.SetSmooth(params.smooth);
+            fill.SetMode(params.mode);
+            fill.SetColor(color);
+            tool = &fill;
+            break;
+        }
+        int n = (int)stroke.points.size();
+        if (!tool || n == 0)
+        {
+            continue;
+        }
+
+        // points are where the pen was on the canvas, press and release keep their fractions like the moves
+        tool->OnSampleBegin(ToSample(stroke.points[0], TabletSamplePress));
+        unsigned int frame = stroke.points[0].time * REPLAY_FRAME_RATE / 1000;
+        for (int j = 1; j < n - 1; ++j)
+        {
+            const RecordedPoint& p = stroke.points[j];
+            unsigned int pointFrame = p.time * REPLAY_FRAME_RATE / 1000;
+            if (pointFrame != frame && !batch.empty())
+            {
+                tool->OnDragSamples(&batch[0], (int)batch.size());
+                batch.clear();
+            }
+            frame = pointFrame;
+            batch.push_back(ToSample(p, TabletSampleMove));
+        }
+        if (!batch.empty())
+        {
+            tool->OnDragSamples(&batch[0], (int)batch.size());
+            batch.clear();
+        }
+        tool->OnSampleEnd(ToSample(stroke.points[n - 1], TabletSampleRelease));
+
+        ++result.strokes;
+        result.points += n;
+    }
+    result.nsecs = timer.nsecsElapsed();
+    result.allocations = GetAllocationCount() - allocations;
+    result.hash = HashImage(*canvas.GetImage());
+}
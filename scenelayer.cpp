@@ -0,0 +1,266 @@
+#include "scenelayer.h"
+#include <QPainter>
+#include <QWidget>
+#include <QMouseEvent>
+#include <QHBoxLayout>
+#include <QSlider>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QComboBox>
+#include "timeline.h"
+#include "animationfile.h"
+
+ScenePropertyWindow::ScenePropertyWindow(Timeline* timeline, SceneLayer* layer)
+    :mTimeline(timeline)
+    ,mLayer(layer)
+{
+    setLayout(new QHBoxLayout);
+    layout()->setMargin(0);
+    layout()->setSpacing(0);
+
+    QSlider* slider = new QSlider(Qt::Horizontal);
+    slider->setMaximum(255);
+    slider->setValue(layer->GetOpacity());
+    layout()->addWidget(slider);
+    connect(slider, SIGNAL(valueChanged(int)),
+            this, SLOT(SetOpacity(int)));
+
+    QCheckBox* enableBox = new QCheckBox;
+    enableBox->setIcon(QIcon(":/icons/visible.png"));
+    enableBox->setChecked(layer->IsEnabled());
+    connect(enableBox, SIGNAL(toggled(bool)),
+            this, SLOT(Enable(bool)));
+    layout()->addWidget(enableBox);
+
+    QSpinBox* offsetBox = new QSpinBox;
+    offsetBox->setRange(-9999, 9999);
+    offsetBox->setValue(layer->GetModel()->GetOffset());
+    offsetBox->setToolTip("Start frame of " + layer->GetModel()->GetScenePath());
+    connect(offsetBox, SIGNAL(valueChanged(int)),
+            this, SLOT(SetOffset(int)));
+    layout()->addWidget(offsetBox);
+
+    // same order as SceneLayerModel::Loop
+    QComboBox* loopBox = new QComboBox;
+    loopBox->addItem("Once");
+    loopBox->addItem("Loop");
+    loopBox->addItem("Ping-pong");
+    loopBox->addItem("Hold");
+    loopBox->setCurrentIndex(layer->GetModel()->GetLoop());
+    connect(loopBox, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(SetLoop(int)));
+    layout()->addWidget(loopBox);
+
+    QComboBox* blendBox = Layer::CreateBlendModeBox(layer->GetBlendMode());
+    connect(blendBox, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(SetBlendMode(int)));
+    layout()->addWidget(blendBox);
+
+    setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Fixed);
+}
+
+ScenePropertyWindow::~ScenePropertyWindow()
+{
+
+}
+
+QSize ScenePropertyWindow::sizeHint() const
+{
+    return QSize(200, mTimeline->GetCellSize().height());
+}
+
+QSize ScenePropertyWindow::minimumSizeHint() const
+{
+    return QSize(200, mTimeline->GetCellSize().height());
+}
+
+void ScenePropertyWindow::SetOpacity(int value)
+{
+    mLayer->SetOpacity((unsigned char) value);
+}
+
+void ScenePropertyWindow::Enable(bool value)
+{
+    mLayer->Enable(value);
+}
+
+void ScenePropertyWindow::SetOffset(int value)
+{
+    mLayer->SetOffset(value);
+}
+
+void ScenePropertyWindow::SetLoop(int value)
+{
+    mLayer->SetLoop(value);
+}
+
+void ScenePropertyWindow::SetBlendMode(int value)
+{
+    mLayer->SetBlendMode((BlendMode)value);
+}
+
+SceneLayer::SceneLayer(Timeline* timeline, SceneLayerModel* layerModel, QWidget *parent) :
+    Layer(parent),
+    mLayerModel(layerModel),
+    mTimeline(timeline),
+    mSelected(false)
+{
+    setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+    mPropertyWindow = new ScenePropertyWindow(timeline, this);
+}
+
+SceneLayer::~SceneLayer()
+{
+}
+
+QSize SceneLayer::sizeHint() const
+{
+    return QSize(mTimeline->GetCellSize().width() * mTimeline->GetMaxFrames(), mTimeline->GetCellSize().height());
+}
+
+QSize SceneLayer::minimumSizeHint() const
+{
+    return QSize(mTimeline->GetCellSize().width() * mTimeline->GetMaxFrames(), mTimeline->GetCellSize().height());
+}
+
+void SceneLayer::mousePressEvent(QMouseEvent *ev)
+{
+    mTimeline->SetLayer(this);
+    mTimeline->SetFrameIndex((ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width());
+    this->grabMouse();
+}
+
+void SceneLayer::mouseReleaseEvent(QMouseEvent *)
+{
+    this->releaseMouse();
+}
+
+void SceneLayer::mouseMoveEvent(QMouseEvent *ev)
+{
+    mTimeline->SetFrameIndex((ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width());
+}
+
+void SceneLayer::paintEvent(QPaintEvent *)
+{
+    QSize cellSize = mTimeline->GetCellSize();
+
+    QPainter p(this);
+    p.setPen(Qt::NoPen);
+    if (mSelected)
+    {
+        p.setBrush(QBrush(QColor(250, 250, 250)));
+    }
+    else
+    {
+        p.setBrush(QBrush(QColor(200, 200, 200)));
+    }
+    p.drawRect(0, 0, width(), cellSize.height());
+
+    // first run solid, what the loop mode shows after it lighter
+    int maxFrames = mTimeline->GetMaxFrames();
+    int offset = mLayerModel->GetOffset();
+    int end = mLayerModel->GetMaxFrames();
+    int x0 = qMax(0, offset) * cellSize.width() - mTimeline->GetOffset();
+    int x1 = qMin(end, maxFrames) * cellSize.width() - mTimeline->GetOffset();
+    int x2 = maxFrames * cellSize.width() - mTimeline->GetOffset();
+    p.setPen(QPen(QColor(0, 0, 0)));
+    if (mLayerModel->GetLoop() != SceneLayerModel::LoopOnce && x2 > x1)
+    {
+        p.setBrush(QBrush(QColor(200, 220, 190)));
+        p.drawRect(x1, 2, x2 - x1 - 1, cellSize.height() - 5);
+    }
+    if (x1 > x0)
+    {
+        p.setBrush(QBrush(QColor(150, 200, 140)));
+        p.drawRect(x0, 2, x1 - x0 - 1, cellSize.height() - 5);
+        p.drawText(QRect(x0 + 4, 0, x1 - x0 - 8, cellSize.height()), Qt::AlignVCenter, mLayerModel->GetScenePath());
+    }
+}
+
+void SceneLayer::SetSelected(bool selected)
+{
+    mSelected = selected;
+    update();
+}
+
+void SceneLayer::OnFrameChanged(int frameIndex)
+{
+
+}
+
+QImage* SceneLayer::GetImage(int frameIndex)
+{
+    return NULL;
+}
+
+unsigned char SceneLayer::GetOpacity()
+{
+    return mLayerModel->GetOpacity();
+}
+
+void SceneLayer::SetOpacity(unsigned char value)
+{
+    if (value != mLayerModel->GetOpacity())
+    {
+        mLayerModel->SetOpacity(value);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+bool SceneLayer::IsEnabled()
+{
+    return mLayerModel->IsEnabled();
+}
+
+void SceneLayer::Enable(bool enable)
+{
+    if (mLayerModel->IsEnabled() != enable)
+    {
+        mLayerModel->Enable(enable);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+int SceneLayer::GetMaxFrames()
+{
+    return mLayerModel->GetMaxFrames();
+}
+
+void SceneLayer::SetOffset(int value)
+{
+    if (value != mLayerModel->GetOffset())
+    {
+        mLayerModel->SetOffset(value);
+        mTimeline->UpdateMaxFrames();
+        mTimeline->UpdateCanvas();
+        update();
+    }
+}
+
+void SceneLayer::SetLoop(int value)
+{
+    if (value != mLayerModel->GetLoop())
+    {
+        mLayerModel->SetLoop((SceneLayerModel::Loop)value);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+        update();
+    }
+}
+
+BlendMode SceneLayer::GetBlendMode()
+{
+    return mLayerModel->GetBlendMode();
+}
+
+void SceneLayer::SetBlendMode(BlendMode value)
+{
+    if (value != mLayerModel->GetBlendMode())
+    {
+        mLayerModel->SetBlendMode(value);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SCENELAYER_H
+#define SCENELAYER_H
+
+#include "layer.h"
+#include <QWidget>
+
+class Timeline;
+class SceneLayer;
+class SceneLayerModel;
+
+class ScenePropertyWindow : public QWidget
+{
+    Q_OBJECT
+public:
+    ScenePropertyWindow(Timeline* timeline, SceneLayer* layer);
+    ~ScenePropertyWindow();
+
+    public slots:
+        void SetOpacity(int value);
+        void Enable(bool value);
+        void SetOffset(int value);
+        void SetLoop(int value);
+        void SetBlendMode(int value);
+
+protected:
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+private:
+    Timeline* mTimeline;
+    SceneLayer* mLayer;
+};
+
+// Row of a nested scene, a bar over each run of the scene
+class SceneLayer : public Layer
+{
+    Q_OBJECT
+public:
+    explicit SceneLayer(Timeline* timeline, SceneLayerModel* layerModel, QWidget *parent = 0);
+    ~SceneLayer();
+
+    SceneLayerModel* GetModel() { return mLayerModel; }
+    LayerType GetType() { return LayerTypeScene; }
+    void SetSelected(bool selected);
+    void OnFrameChanged(int frameIndex);
+    QImage* GetImage(int frameIndex);
+    bool IsOnionEnabled() { return false; }
+    void EnableOnion(bool enable) {}
+    unsigned char GetOpacity();
+    void SetOpacity(unsigned char value);
+    bool IsEnabled();
+    void Enable(bool enable);
+    QWidget* GetPropertyWindow() { return mPropertyWindow; }
+    int GetMaxFrames();
+    void SetOffset(int value);
+    void SetLoop(int value);
+    BlendMode GetBlendMode();
+    void SetBlendMode(BlendMode value);
+
+public:
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+protected:
+    void mousePressEvent(QMouseEvent *);
+    void mouseReleaseEvent(QMouseEvent *);
+    void mouseMoveEvent(QMouseEvent *);
+    void paintEvent(QPaintEvent *);
+
+private:
+    SceneLayerModel* mLayerModel;
+    Timeline* mTimeline;
+    bool mSelected;
+    ScenePropertyWindow* mPropertyWindow;
+};
+
+#endif // SCENELAYER_H
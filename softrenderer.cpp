@@ -0,0 +1,520 @@
+#include "softrenderer.h"
+#include "pixelkernels.h"
+#include "parallel.h"
+#include "fastblur.h"
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+//**************************************SoftTexture**************************************
+SoftTexture::SoftTexture(int width, int height, int* data, bool topDownOrder)
+    :mWidth(width)
+    ,mHeight(height)
+    ,mData(new unsigned char[width * height * 4])
+{
+    int rowSize = width * 4;
+    if (!data)
+    {
+        memset(mData, 0, rowSize * height);
+    }
+    else if (topDownOrder)
+    {
+        const unsigned char* pData = (const unsigned char*)data;
+        for (int i = 0; i < height; ++i)
+        {
+            memcpy(mData + i * rowSize, pData + (height - 1 - i) * rowSize, rowSize);
+        }
+    }
+    else
+    {
+        memcpy(mData, data, rowSize * height);
+    }
+}
+
+SoftTexture::~SoftTexture()
+{
+    delete[] mData;
+}
+
+void SoftTexture::ReadTexture(int* data)
+{
+    memcpy(data, mData, mWidth * mHeight * 4);
+}
+
+void SoftTexture::WriteTexture(int* data, int w, int h, bool)
+{
+    w = w < mWidth ? w : mWidth;
+    h = h < mHeight ? h : mHeight;
+    const unsigned char* pData = (const unsigned char*)data;
+    for (int i = 0; i < h; ++i)
+    {
+        memcpy(GetRow(i), pData + i * w * 4, w * 4);
+    }
+}
+
+// Samples count pixels starting at texel position (x, y) and stepping (dx, dy), clamped to the edge.
+// Returns a pointer into the texture when the span maps 1:1 onto a row, else fills out.
+static const unsigned char* SampleSpan(const SoftTexture* tex, float x, float y, float dx, float dy, int count, bool linear, unsigned char* out)
+{
+    int w = tex->GetWidth();
+    int h = tex->GetHeight();
+
+    if (dy == 0.0f && fabsf(dx - 1.0f) < 1e-6f)
+    {
+        int tx = (int)floorf(x);
+        int ty = (int)floorf(y);
+        if (tx >= 0 && tx + count <= w && ty >= 0 && ty < h)
+        {
+            return tex->GetRow(ty) + tx * 4;
+        }
+    }
+
+    if (!linear)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            int tx = (int)floorf(x + dx * i);
+            int ty = (int)floorf(y + dy * i);
+            tx = tx < 0 ? 0 : (tx >= w ? w - 1 : tx);
+            ty = ty < 0 ? 0 : (ty >= h ? h - 1 : ty);
+            memcpy(out + i * 4, tex->GetRow(ty) + tx * 4, 4);
+        }
+        return out;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        float sx = x + dx * i - 0.5f;
+        float sy = y + dy * i - 0.5f;
+        int x0 = (int)floorf(sx);
+        int y0 = (int)floorf(sy);
+        float fx = sx - x0;
+        float fy = sy - y0;
+        int x1 = x0 + 1;
+        int y1 = y0 + 1;
+        x0 = x0 < 0 ? 0 : (x0 >= w ? w - 1 : x0);
+        x1 = x1 < 0 ? 0 : (x1 >= w ? w - 1 : x1);
+        y0 = y0 < 0 ? 0 : (y0 >= h ? h - 1 : y0);
+        y1 = y1 < 0 ? 0 : (y1 >= h ? h - 1 : y1);
+        const unsigned char* p00 = tex->GetRow(y0) + x0 * 4;
+        const unsigned char* p10 = tex->GetRow(y0) + x1 * 4;
+        const unsigned char* p01 = tex->GetRow(y1) + x0 * 4;
+        const unsigned char* p11 = tex->GetRow(y1) + x1 * 4;
+        for (int c = 0; c < 4; ++c)
+        {
+            float top = p00[c] + (p10[c] - p00[c]) * fx;
+            float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+            out[i * 4 + c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+        }
+    }
+    return out;
+}
+
+//**************************************SoftRenderTarget**************************************
+SoftRenderTarget::SoftRenderTarget(SoftTexture* texture)
+    :mTexture(texture)
+{
+}
+
+SoftRenderTarget::~SoftRenderTarget()
+{
+    delete mTexture;
+}
+
+struct BlitContext
+{
+    SoftTexture* dst;
+    const SoftTexture* src;
+    bool smooth;
+};
+
+static void BlitRows(int begin, int end, void* context)
+{
+    BlitContext* c = (BlitContext*)context;
+    int w = c->dst->GetWidth();
+    float sx = (float)c->src->GetWidth() / w;
+    float sy = (float)c->src->GetHeight() / c->dst->GetHeight();
+    std::vector<unsigned char> scratch(w * 4);
+    for (int y = begin; y < end; ++y)
+    {
+        const unsigned char* row = SampleSpan(c->src, 0.5f * sx, (y + 0.5f) * sy, sx, 0.0f, w, c->smooth, &scratch[0]);
+        memcpy(c->dst->GetRow(y), row, w * 4);
+    }
+}
+
+void SoftRenderTarget::Blit(IRenderTarget* target, bool smooth)
+{
+    SoftRenderTarget* src = static_cast<SoftRenderTarget*>(target);
+    if (!src)
+    {
+        return;
+    }
+
+    BlitContext context;
+    context.dst = mTexture;
+    context.src = src->mTexture;
+    context.smooth = smooth;
+    ParallelFor(mTexture->GetHeight(), BlitRows, &context);
+}
+
+//**************************************SoftRenderer**************************************
+SoftRenderer::SoftRenderer()
+    :mWidth(1)
+    ,mHeight(1)
+    ,mScreen(NULL)
+    ,mBlend(false)
+    ,mExactBlur(false)
+{
+    mScreen = CreateTarget(mWidth, mHeight, NULL, false);
+}
+
+SoftRenderer::~SoftRenderer()
+{
+    delete mScreen;
+}
+
+SoftTexture* SoftRenderer::CreateTexture(int width, int height, int* data, bool topDownOrder)
+{
+    return new SoftTexture(width, height, data, topDownOrder);
+}
+
+SoftRenderTarget* SoftRenderer::CreateTarget(int width, int height, int* data, bool topDownOrder)
+{
+    return new SoftRenderTarget(new SoftTexture(width, height, data, topDownOrder));
+}
+
+void SoftRenderer::SetScreenSize(int width, int height)
+{
+    if (width == mWidth && height == mHeight)
+    {
+        return;
+    }
+    mWidth = width;
+    mHeight = height;
+    delete mScreen;
+    mScreen = CreateTarget(width, height, NULL, false);
+}
+
+SoftRenderTarget* SoftRenderer::GetTarget(IRenderTarget* target)
+{
+    return target ? static_cast<SoftRenderTarget*>(target) : mScreen;
+}
+
+void SoftRenderer::Clear(IRenderTarget* target, float r, float g, float b, float a)
+{
+    SoftTexture* tex = GetTarget(target)->mTexture;
+    unsigned char pixel[4];
+    const float color[4] = { r, g, b, a };
+    for (int c = 0; c < 4; ++c)
+    {
+        float v = color[c] < 0.0f ? 0.0f : (color[c] > 1.0f ? 1.0f : color[c]);
+        pixel[c] = (unsigned char)(v * 255.0f + 0.5f);
+    }
+
+    int n = tex->GetWidth() * tex->GetHeight();
+    unsigned char* p = tex->mData;
+    for (int i = 0; i < n; ++i)
+    {
+        memcpy(p + i * 4, pixel, 4);
+    }
+}
+
+struct DrawContext
+{
+    SoftTexture* target;
+    const SoftTexture* textures[3];
+    int op;
+    const float* color;
+    bool blend;
+    // Texture coordinates of pixel centers: u = u0 + ux * x + uy * y
+    float u0;
+    float ux;
+    float uy;
+    float v0;
+    float vx;
+    float vy;
+};
+
+static bool IsInside(const DrawContext* c, int x, int y)
+{
+    float u = c->u0 + c->ux * x + c->uy * y;
+    float v = c->v0 + c->vx * x + c->vy * y;
+    return u >= 0.0f && u < 1.0f && v >= 0.0f && v < 1.0f;
+}
+
+// Narrows [x0, x1) to the pixels of row y whose center is inside the quad
+static void ClipSpan(const DrawContext* c, int y, float f0, float fx, int& x0, int& x1)
+{
+    if (fx == 0.0f)
+    {
+        if (f0 < 0.0f || f0 >= 1.0f)
+        {
+            x1 = x0;
+        }
+        return;
+    }
+
+    float a = (0.0f - f0) / fx;
+    float b = (1.0f - f0) / fx;
+    if (a > b)
+    {
+        float t = a;
+        a = b;
+        b = t;
+    }
+    int lo = (int)floorf(a) - 1;
+    int hi = (int)ceilf(b) + 1;
+    x0 = lo > x0 ? lo : x0;
+    x1 = hi < x1 ? hi : x1;
+    while (x0 < x1 && !IsInside(c, x0, y))
+    {
+        ++x0;
+    }
+    while (x1 > x0 && !IsInside(c, x1 - 1, y))
+    {
+        --x1;
+    }
+}
+
+static void DrawRows(int begin, int end, void* context)
+{
+    DrawContext* c = (DrawContext*)context;
+    int width = c->target->GetWidth();
+    std::vector<unsigned char> scratch(width * 4 * 4);
+    unsigned char* sampled[3] = { &scratch[0], &scratch[width * 4], &scratch[width * 8] };
+    unsigned char* fragment = &scratch[width * 12];
+
+    for (int y = begin; y < end; ++y)
+    {
+        int x0 = 0;
+        int x1 = width;
+        ClipSpan(c, y, c->u0 + c->uy * y, c->ux, x0, x1);
+        ClipSpan(c, y, c->v0 + c->vy * y, c->vx, x0, x1);
+        int count = x1 - x0;
+        if (count <= 0)
+        {
+            continue;
+        }
+
+        const unsigned char* rows[3] = { NULL, NULL, NULL };
+        float u = c->u0 + c->ux * x0 + c->uy * y;
+        float v = c->v0 + c->vx * x0 + c->vy * y;
+        for (int i = 0; i < 3; ++i)
+        {
+            const SoftTexture* tex = c->textures[i];
+            if (tex)
+            {
+                float w = (float)tex->GetWidth();
+                float h = (float)tex->GetHeight();
+                // GL magnifies nearest and minifies linear
+                bool linear = fabsf(c->ux * w) > 1.0f || fabsf(c->vy * h) > 1.0f;
+                rows[i] = SampleSpan(tex, u * w, v * h, c->ux * w, c->vx * h, count, linear, sampled[i]);
+            }
+        }
+
+        unsigned char* out = c->target->GetRow(y) + x0 * 4;
+        unsigned char* dst = c->blend ? fragment : out;
+        switch (c->op)
+        {
+        case 0:
+            KernelBlendSource(dst, rows[0], count, c->color);
+            break;
+        case 1:
+            KernelBlendSourceOver(dst, rows[1], rows[0], count, c->color);
+            break;
+        case 2:
+            KernelBlendMultiply(dst, rows[1], rows[0], count, c->color);
+            break;
+        case 3:
+            KernelMask(dst, rows[0], rows[1], rows[2], count, c->color[0]);
+            break;
+        }
+
+        if (c->blend)
+        {
+            KernelBlendAlpha(out, fragment, count);
+        }
+    }
+}
+
+void SoftRenderer::Draw(IRenderTarget* target, float* mvp, DrawOp op, ITexture* src, ITexture* tex1, ITexture* tex2, const float* color)
+{
+    SoftTexture* tex = GetTarget(target)->mTexture;
+
+    // 2D part of the column major mvp, the quad is (0, 0) - (src width, src height)
+    float a = mvp[0];
+    float b = mvp[4];
+    float c = mvp[1];
+    float d = mvp[5];
+    float det = a * d - b * c;
+    if (det == 0.0f)
+    {
+        return;
+    }
+
+    float W = (float)tex->GetWidth();
+    float H = (float)tex->GetHeight();
+    float qw = (float)src->GetWidth();
+    float qh = (float)src->GetHeight();
+
+    // pixel center (x, y) -> ndc -> quad position -> texture coordinate
+    float ia = d / det;
+    float ib = -b / det;
+    float ic = -c / det;
+    float id = a / det;
+    float nx0 = 1.0f / W - 1.0f - mvp[12];
+    float ny0 = 1.0f / H - 1.0f - mvp[13];
+    float ndx = 2.0f / W;
+    float ndy = 2.0f / H;
+
+    DrawContext context;
+    context.target = tex;
+    context.textures[0] = static_cast<SoftTexture*>(src);
+    context.textures[1] = static_cast<SoftTexture*>(tex1);
+    context.textures[2] = static_cast<SoftTexture*>(tex2);
+    context.op = op;
+    context.color = color;
+    context.blend = mBlend;
+    context.u0 = (ia * nx0 + ib * ny0) / qw;
+    context.ux = ia * ndx / qw;
+    context.uy = ib * ndy / qw;
+    context.v0 = (ic * nx0 + id * ny0) / qh;
+    context.vx = ic * ndx / qh;
+    context.vy = id * ndy / qh;
+
+    ParallelFor(tex->GetHeight(), DrawRows, &context);
+}
+
+void SoftRenderer::BlendSource(IRenderTarget* target, ITexture* src, float* mvp, float r, float g, float b, float a)
+{
+    const float color[4] = { r, g, b, a };
+    Draw(target, mvp, DrawOpSource, src, NULL, NULL, color);
+}
+
+void SoftRenderer::BlendSourceOver(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a)
+{
+    const float color[4] = { r, g, b, a };
+    Draw(target, mvp, DrawOpSourceOver, src, dst, NULL, color);
+}
+
+void SoftRenderer::BlendMultipy(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a)
+{
+    const float color[4] = { r, g, b, a };
+    Draw(target, mvp, DrawOpMultiply, src, dst, NULL, color);
+}
+
+void SoftRenderer::Mask(IRenderTarget* target, ITexture* src, float* mvp, ITexture* colorMask, ITexture* alphaMask, float alpha)
+{
+    const float color[4] = { alpha, alpha, alpha, alpha };
+    Draw(target, mvp, DrawOpMask, src, colorMask, alphaMask, color);
+}
+
+struct BlurContext
+{
+    const SoftTexture* src;
+    SoftTexture* dst;
+    const float* weights;
+    int radius;
+};
+
+// Same taps as BlurProgram, premultiplied sum of texels clamped to the edge
+static void BlurRowsH(int begin, int end, void* context)
+{
+    BlurContext* c = (BlurContext*)context;
+    int w = c->src->GetWidth();
+    int r = c->radius;
+    std::vector<float> padded((w + 2 * r) * 4);
+    std::vector<float> sum(w * 4);
+    for (int y = begin; y < end; ++y)
+    {
+        const unsigned char* row = c->src->GetRow(y);
+        KernelPremultiply(&padded[r * 4], row, w);
+        for (int x = 0; x < r; ++x)
+        {
+            memcpy(&padded[x * 4], &padded[r * 4], 4 * sizeof(float));
+            memcpy(&padded[(w + r + x) * 4], &padded[(w + r - 1) * 4], 4 * sizeof(float));
+        }
+
+        memset(&sum[0], 0, sum.size() * sizeof(float));
+        for (int k = -r; k <= r; ++k)
+        {
+            KernelAccumulate(&sum[0], &padded[(r + k) * 4], w, c->weights[k + r]);
+        }
+        KernelUnpremultiply(c->dst->GetRow(y), &sum[0], w);
+    }
+}
+
+static void BlurRowsV(int begin, int end, void* context)
+{
+    BlurContext* c = (BlurContext*)context;
+    int w = c->src->GetWidth();
+    int h = c->src->GetHeight();
+    int r = c->radius;
+    std::vector<float> premultiplied(w * 4);
+    std::vector<float> sum(w * 4);
+    for (int y = begin; y < end; ++y)
+    {
+        memset(&sum[0], 0, sum.size() * sizeof(float));
+        for (int k = -r; k <= r; ++k)
+        {
+            int sy = y + k;
+            sy = sy < 0 ? 0 : (sy >= h ? h - 1 : sy);
+            KernelPremultiply(&premultiplied[0], c->src->GetRow(sy), w);
+            KernelAccumulate(&sum[0], &premultiplied[0], w, c->weights[k + r]);
+        }
+        KernelUnpremultiply(c->dst->GetRow(y), &sum[0], w);
+    }
+}
+
+void SoftRenderer::Blur(IRenderTarget* target, IRenderTarget* targetTemp, float* mvp, ITexture* srcTexture, int radius)
+{
+    SoftTexture* src = static_cast<SoftTexture*>(srcTexture);
+    if (radius < 1)
+    {
+        BlendSource(target, src, mvp, 1, 1, 1, 1);
+        return;
+    }
+
+    int w = src->GetWidth();
+    int h = src->GetHeight();
+    if (!mExactBlur)
+    {
+        SoftTexture* blurred = new SoftTexture(w, h, (int*)src->mData, false);
+        FastBlur(blurred->mData, w, h, w * 4, GetBlurSigma(radius));
+        BlendSource(target, blurred, mvp, 1, 1, 1, 1);
+        delete blurred;
+        return;
+    }
+
+    std::vector<float> weights(radius * 2 + 1);
+    GetBlurWeights(radius, &weights[0]);
+
+    // The passes run in texel space of src; the temp target holds the horizontal pass
+    // like on the GPU when it has the size of src, otherwise a scratch texture does
+    SoftTexture* temp = NULL;
+    SoftTexture* tempTexture = targetTemp ? static_cast<SoftRenderTarget*>(targetTemp)->mTexture : NULL;
+    if (tempTexture && tempTexture->GetWidth() == w && tempTexture->GetHeight() == h && tempTexture != src)
+    {
+        temp = tempTexture;
+    }
+    SoftTexture* scratch = temp ? NULL : new SoftTexture(w, h, NULL, false);
+    if (!temp)
+    {
+        temp = scratch;
+    }
+    SoftTexture* blurred = new SoftTexture(w, h, NULL, false);
+
+    BlurContext context;
+    context.weights = &weights[0];
+    context.radius = radius;
+    context.src = src;
+    context.dst = temp;
+    ParallelFor(h, BlurRowsH, &context);
+    context.src = temp;
+    context.dst = blurred;
+    ParallelFor(h, BlurRowsV, &context);
+
+    BlendSource(target, blurred, mvp, 1, 1, 1, 1);
+    delete blurred;
+    delete scratch;
+}
@@ -0,0 +1,90 @@
+#ifndef SOFTRENDERER_H
+#define SOFTRENDERER_H
+#include "renderer.h"
+
+// Software counterparts of GLTexture, GLRenderTarget and GLRenderer for machines without a GPU.
+// The calls and the math match the shaders, on the pixelkernels spans, so it also serves as
+// their reference. Blur runs the box cascade of FastBlur unless exact blur is asked for.
+
+class SoftTexture : public ITexture
+{
+    friend class SoftRenderer;
+    friend class SoftRenderTarget;
+public:
+    ~SoftTexture();
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+    void ReadTexture(int* data);
+    void WriteTexture(int* data, int w, int h, bool useMipmap);
+    unsigned char* GetRow(int y) { return mData + y * mWidth * 4; }
+    const unsigned char* GetRow(int y) const { return mData + y * mWidth * 4; }
+
+private:
+    SoftTexture(int width, int height, int* data, bool topDownOrder);
+
+    int mWidth;
+    int mHeight;
+    unsigned char* mData;
+};
+
+class SoftRenderTarget : public IRenderTarget
+{
+    friend class SoftRenderer;
+public:
+    ~SoftRenderTarget();
+    int GetWidth() const { return mTexture->GetWidth(); }
+    int GetHeight() const { return mTexture->GetHeight(); }
+    void Blit(IRenderTarget* src, bool smooth);
+    SoftTexture* GetTexture() { return mTexture; }
+
+private:
+    SoftRenderTarget(SoftTexture* texture);
+
+    SoftTexture* mTexture;
+};
+
+class SoftRenderer : public IRenderer
+{
+public:
+    SoftRenderer();
+    ~SoftRenderer();
+
+    SoftTexture* CreateTexture(int width, int height, int* data, bool topDownOrder);
+    SoftRenderTarget* CreateTarget(int width, int height, int* data, bool topDownOrder);
+
+    void SetScreenSize(int width, int height);
+    // Drawing to a NULL target lands here, GLRenderer draws it to the window
+    SoftRenderTarget* GetScreen() { return mScreen; }
+    void EnableBlend(bool enable) { mBlend = enable; }
+    // Blur with the cosine kernel of the shader instead of the box cascade, for reference images
+    void SetExactBlur(bool exact) { mExactBlur = exact; }
+
+    void Clear(IRenderTarget* target, float r, float g, float b, float a);
+    void BlendSource(IRenderTarget* target, ITexture* src, float* mvp, float r, float g, float b, float a);
+    void BlendSourceOver(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a);
+    void BlendMultipy(IRenderTarget* target, ITexture* dst, ITexture* src, float* mvp, float r, float g, float b, float a);
+    void Blur(IRenderTarget* target, IRenderTarget* targetTemp, float* mvp, ITexture* src, int radius);
+    void Mask(IRenderTarget* target, ITexture* src, float* mvp, ITexture* colorMask, ITexture* alphaMask, float alpha);
+
+private:
+    enum DrawOp
+    {
+        DrawOpSource,
+        DrawOpSourceOver,
+        DrawOpMultiply,
+        DrawOpMask
+    };
+
+    SoftRenderTarget* GetTarget(IRenderTarget* target);
+    // Draws the quad of src through mvp, textures are sampled at the same texture coordinates
+    void Draw(IRenderTarget* target, float* mvp, DrawOp op, ITexture* src, ITexture* tex1, ITexture* tex2, const float* color);
+
+private:
+    int mWidth;
+    int mHeight;
+    SoftRenderTarget* mScreen;
+    bool mBlend;
+    bool mExactBlur;
+};
+
+#endif // SOFTRENDERER_H
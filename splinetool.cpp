@@ -2,8 +2,9 @@
 #include "rasterimageeditor.h"
 #include "openglrenderer.h"
 #include "command.h"
+#include "strokerecording.h"
 
-SplineTool::SplineTool(RasterImageEditor* editor, QUndoStack* undoStack)
+SplineTool::SplineTool(CanvasHost* editor, QUndoStack* undoStack)
     :mEditor(editor)
     ,mUndoStack(undoStack)
     ,mBrushSize(1.0f)
@@ -13,15 +14,39 @@ SplineTool::SplineTool(RasterImageEditor* editor, QUndoStack* undoStack)
 
 void SplineTool::OnDragBegin(int x, int y, float pressure)
 {
-    if (!mEditor->GetImage())
+    MovePoint(x, y);
+}
+
+void SplineTool::OnDrag(int x, int y, float pressure)
+{
+    MovePoint(x, y);
+}
+
+void SplineTool::OnDragEnd(int x, int y, float pressure)
+{
+    EndStroke(x, y);
+}
+
+void SplineTool::OnDragSamples(const TabletSample* samples, int count)
+{
+    if (count > 0)
     {
-        return;
+        // only where the pen is now matters
+        MovePoint(samples[count - 1].x, samples[count - 1].y);
     }
+}
 
-    DrawLastStroke(mEditor->ScreenToLocal(x, y, 1.0f));
+void SplineTool::OnSampleBegin(const TabletSample& sample)
+{
+    MovePoint(sample.x, sample.y);
 }
 
-void SplineTool::OnDrag(int x, int y, float pressure)
+void SplineTool::OnSampleEnd(const TabletSample& sample)
+{
+    EndStroke(sample.x, sample.y);
+}
+
+void SplineTool::MovePoint(float x, float y)
 {
     if (!mEditor->GetImage())
     {
@@ -31,7 +56,7 @@ void SplineTool::OnDrag(int x, int y, float pressure)
     DrawLastStroke(mEditor->ScreenToLocal(x, y, 1.0f));
 }
 
-void SplineTool::OnDragEnd(int x, int y, float pressure)
+void SplineTool::EndStroke(float x, float y)
 {
     if (!mEditor->GetImage())
     {
@@ -52,26 +77,22 @@ void SplineTool::OnDragEnd(int x, int y, float pressure)
 
         if (mPoints.size() >= 3)
         {
-            QImage* oldImage = new QImage(mEditor->GetImage()->width(),mEditor->GetImage()->height(), QImage::Format_RGBA8888);
-            QImage* newImage = new QImage(mEditor->GetImage()->width(),mEditor->GetImage()->height(), QImage::Format_RGBA8888);
-
-            QPainter hp(oldImage);
-            hp.setCompositionMode(QPainter::CompositionMode_Source);
-            hp.drawImage(0, 0, *mEditor->GetImage());
-
-            QPainter np(newImage);
-            np.setCompositionMode(QPainter::CompositionMode_Source);
-            np.drawImage(0, 0, *mEditor->GetImage());
-            np.setCompositionMode(mBrushMode);
-            np.setRenderHint(QPainter::Antialiasing, true);
-            QBrush brush(mColor);
-            np.fillPath(mTempPath, brush);
-            mUndoStack->push(new DrawCommand(mEditor, newImage, oldImage));
+            QRect rect = mTempPath.boundingRect().toAlignedRect().adjusted(-1, -1, 1, 1);
+            DrawCommand* command = new DrawCommand(mEditor, rect);
+            {
+                QPainter np(mEditor->GetImage());
+                np.setCompositionMode(mBrushMode);
+                np.setRenderHint(QPainter::Antialiasing, true);
+                QBrush brush(mColor);
+                np.fillPath(mTempPath, brush);
+            }
+            command->Finish();
+            mUndoStack->push(command);
 
             mPoints.clear();
             QPainterPath path;
             mTempPath.swap(path);
-            mEditor->update();
+            mEditor->UpdateView();
         }
     }
 }
@@ -88,6 +109,18 @@ void SplineTool::OnPaint(QPainter &p)
     p.fillPath(mTempPath, QBrush(mColor));
 }
 
+bool SplineTool::GetStrokeParams(StrokeToolParams& params)
+{
+    params.tool = StrokeToolSpline;
+    params.brushSize = mBrushSize;
+    params.smooth = 0;
+    params.mode = mBrushMode;
+    params.tip = 0;
+    params.stabilize = 0;
+    params.color = mColor.rgba();
+    return true;
+}
+
 void SplineTool::BuildDrawSegment(const StrokePoint& p0, const StrokePoint& p1, QPainterPath& path)
 {
     QPointF pts[4];
@@ -163,7 +196,7 @@ void SplineTool::DrawLastStroke(const StrokePoint& point)
         }
 
         mTempPath.swap(path);
-        mEditor->update();
+        mEditor->UpdateView();
     }
 }
 
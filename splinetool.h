@@ -6,17 +6,19 @@
 #include <vector>
 #include <QUndoStack>
 
-class RasterImageEditor;
-
 class SplineTool : public CanvasTool
 {
 public:
-    SplineTool(RasterImageEditor* editor, QUndoStack* undoStack);
+    SplineTool(CanvasHost* editor, QUndoStack* undoStack);
 
     void OnDragBegin(int x, int y, float pressure);
     void OnDrag(int x, int y, float pressure);
     void OnDragEnd(int x, int y, float pressure);
+    void OnDragSamples(const TabletSample* samples, int count);
+    void OnSampleBegin(const TabletSample& sample);
+    void OnSampleEnd(const TabletSample& sample);
     void OnPaint(QPainter &painter);
+    bool GetStrokeParams(StrokeToolParams& params);
     void SetUndoStack(QUndoStack* stack) { mUndoStack = stack; }
     void SetBrushSize(float value);
     void SetColor(const QColor& color);
@@ -25,6 +27,8 @@ public:
     QPainter::CompositionMode GetMode() { return mBrushMode; }
 
 private:
+    void MovePoint(float x, float y);
+    void EndStroke(float x, float y);
     void DrawLastStroke(const StrokePoint& point);
     void BuildDrawSegment(const StrokePoint& p0, const StrokePoint& p1, QPainterPath& path);
 
@@ -34,7 +38,7 @@ public slots:
 
 
 private:
-    RasterImageEditor* mEditor;
+    CanvasHost* mEditor;
     QUndoStack* mUndoStack;
     float mBrushSize;
     QColor mColor;
@@ -1,7 +1,13 @@
-#include "StrokePoint.h"
-#include <list>
+#include "strokepoint.h"
 #include "openglrenderer.h"
 
+// Intervals shorter than this in t are not split further, so the sampler goes at most
+// SPLINE_MAX_DEPTH levels deep
+#define SPLINE_MIN_INTERVAL 0.001f
+#define SPLINE_MAX_DEPTH 16
+// Chord length in pixels above which an interval is split
+#define SPLINE_MAX_CHORD 5.0f
+
 struct SplineSamplingContext
 {
     float x0;
@@ -18,12 +24,19 @@ struct SplineSamplingContext
     float z1;
     float z2;
     float z3;
-
-    float tolerance;
-
-    std::list<StrokePoint> points;
 };
 
+static inline StrokePoint Evaluate(const SplineSamplingContext& ctx, float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    StrokePoint pt;
+    pt.x = ctx.x0 + ctx.x1 * t + ctx.x2 * t2 + ctx.x3 * t3;
+    pt.y = ctx.y0 + ctx.y1 * t + ctx.y2 * t2 + ctx.y3 * t3;
+    pt.pressure = ctx.z0 + ctx.z1 * t + ctx.z2 * t2 + ctx.z3 * t3;
+    return pt;
+}
+
 float StrokePoint::DistanceToSq(StrokePoint& p0, StrokePoint& p1, StrokePoint& p)
 {
 
@@ -45,41 +58,6 @@ float StrokePoint::DistanceToSq(StrokePoint& p0, StrokePoint& p1, StrokePoint& p
     return d2;
 }
 
-static void Subdivide(SplineSamplingContext& ctx, std::list<StrokePoint>::iterator endIt, float beginT, float endT)
-{
-    if (endT - beginT < 0.001f)
-    {
-        return;
-    }
-    float t = (beginT + endT) * 0.5f;
-    float t2 = t * t;
-    float t3 = t2 * t;
-    StrokePoint pt;
-    pt.x = ctx.x0 + ctx.x1 * t + ctx.x2 * t2 + ctx.x3 * t3;
-    pt.y = ctx.y0 + ctx.y1 * t + ctx.y2 * t2 + ctx.y3 * t3;
-    pt.pressure = ctx.z0 + ctx.z1 * t + ctx.z2 * t2 + ctx.z3 * t3;
-
-    std::list<StrokePoint>::iterator beginIt = endIt;
-    beginIt--;
-
-    //printf("Subdivide t=(%f,%f) p0=(%f,%f) p1=(%f,%f) pt=(%f,%f)\n", beginT, endT, beginIt->x, beginIt->y, endIt->x, endIt->y, pt.x, pt.y);
-
-//    float tolerance = cosf(1.0f * 3.1415926f / 180.0f);
-    Vector2 v12(endIt->x - beginIt->x, endIt->y - beginIt->y);
-//    Vector2 v1(pt.x - beginIt->x, pt.y - beginIt->y);
-//    Vector2 v2(endIt->x - pt.x, endIt->y - pt.y);
-    //v1.Normalise();
-    //v2.Normalise();
-
-    //if (StrokePoint::DistanceToSq(*(beginIt), *(endIt), pt) > ctx.tolerance * ctx.tolerance)
-    if (v12.Length() > 5.0f)
-    {
-        std::list<StrokePoint>::iterator it = ctx.points.insert(endIt, pt);
-        Subdivide(ctx, it, beginT, t);
-        Subdivide(ctx, endIt, t, endT);
-    }
-}
-
 void StrokePoint::CatmulRomSpline(const StrokePoint& P0, const StrokePoint& P1, const StrokePoint& P2, const StrokePoint& P3, std::vector<StrokePoint>& result)
 {
     SplineSamplingContext ctx;
@@ -98,24 +76,93 @@ void StrokePoint::CatmulRomSpline(const StrokePoint& P0, const StrokePoint& P1,
     ctx.z2 = P0.pressure - 2.5f * P1.pressure + 2.0f * P2.pressure - 0.5f * P3.pressure;
     ctx.z3 = -0.5f * P0.pressure + 1.5f * P1.pressure- 1.5f * P2.pressure + 0.5f * P3.pressure;
 
-    ctx.points.push_back(P1);
-    ctx.points.push_back(P2);
-    ctx.tolerance = 1.0f;
-
-    std::list<StrokePoint>::iterator it = ctx.points.begin();
-    it++;
-    Subdivide(ctx, it, 0.0f, 1.0f);
-    //printf("subdivide points = %d\n", ctx.points.size());
+    // Same samples as splitting [0, 1] at the middle recursively while the chord is longer than
+    // SPLINE_MAX_CHORD, walked in order. The stack holds the right ends of the intervals still to
+    // walk, innermost on top, and the current point is the left end of the top one.
+    float stackT[SPLINE_MAX_DEPTH + 1];
+    StrokePoint stackPoint[SPLINE_MAX_DEPTH + 1];
+    int top = 0;
+    stackT[0] = 1.0f;
+    stackPoint[0] = P2;
+    float t = 0.0f;
+    StrokePoint current = P1;
+    if (result.size() == 0 || result.back() != current)
+    {
+        result.push_back(current);
+    }
 
-    for (std::list<StrokePoint>::iterator i = ctx.points.begin(); i != ctx.points.end(); ++i)
+    while (top >= 0)
     {
-        if (result.size() == 0 || result.back() != *i)
+        float endT = stackT[top];
+        const StrokePoint& end = stackPoint[top];
+        float dx = end.x - current.x;
+        float dy = end.y - current.y;
+        if (endT - t >= SPLINE_MIN_INTERVAL && top < SPLINE_MAX_DEPTH &&
+            dx * dx + dy * dy > SPLINE_MAX_CHORD * SPLINE_MAX_CHORD)
+        {
+            float mid = (t + endT) * 0.5f;
+            ++top;
+            stackT[top] = mid;
+            stackPoint[top] = Evaluate(ctx, mid);
+            continue;
+        }
+
+        current = end;
+        t = endT;
+        --top;
+        if (result.back() != current)
         {
-            result.push_back(*i);
+            result.push_back(current);
         }
     }
 }
 
+static inline int ClampIndex(int i, int n)
+{
+    return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+// Samples 0..n-1 of a stroke, the first count of them in head and the rest in tail.
+// Indexes past either end give the end sample, as Smooth pads the stroke.
+struct StrokeSamples
+{
+    const StrokePoint* head;
+    int count;
+    const StrokePoint* tail;
+    int n;
+
+    const StrokePoint& operator[](int i) const
+    {
+        i = ClampIndex(i, n);
+        return i < count ? head[i] : tail[i - count];
+    }
+};
+
+// Window sums of Smooth. Smooth, Push and Finish all go through these two, so the sums are
+// added in the same order whichever way the samples came and the results are equal to the bit.
+// The sums are double so their error does not grow along the stroke.
+static void BeginWindow(const StrokeSamples& samples, int radius, double& sumX, double& sumY)
+{
+    // window of sample 1, the first one smoothed
+    sumX = 0;
+    sumY = 0;
+    for (int j = 1 - radius; j <= 1 + radius; ++j)
+    {
+        sumX += samples[j].x;
+        sumY += samples[j].y;
+    }
+}
+
+static void SlideWindow(const StrokeSamples& samples, int i, int radius, double& sumX, double& sumY)
+{
+    // the window of i is the one of i - 1 with one sample in and one out, so the cost does not
+    // depend on the radius
+    const StrokePoint& in = samples[i + radius];
+    const StrokePoint& out = samples[i - 1 - radius];
+    sumX += (double)in.x - out.x;
+    sumY += (double)in.y - out.y;
+}
+
 void
 StrokePoint::Smooth(std::vector<StrokePoint>& points, int radius)
 {
@@ -125,33 +172,19 @@ StrokePoint::Smooth(std::vector<StrokePoint>& points, int radius)
         return;
     }
 
-    std::vector<Vector2> result;
-
-    float d = 1.0f / (radius * 2 + 1);
-
+    std::vector<Vector2> result(n - 2);
+    StrokeSamples samples = { &points[0], n, NULL, n };
+    double d = 1.0 / (radius * 2 + 1);
+    double sumX;
+    double sumY;
+    BeginWindow(samples, radius, sumX, sumY);
     for (int i = 1; i < n - 1; ++i)
     {
-        int lower = i - radius;
-        int upper = i + radius;
-
-        Vector2 total;
-        for (int j = lower; j <= upper; ++j)
+        if (i > 1)
         {
-            int idx = j;
-            if(idx < 0)
-            {
-                idx = 0;
-            }
-            else if(idx >= n)
-            {
-                idx = n - 1;
-            }
-            total.x += points[idx].x;
-            total.y += points[idx].y;
+            SlideWindow(samples, i, radius, sumX, sumY);
         }
-
-        total *= d;
-        result.push_back(total);
+        result[i - 1] = Vector2((float)(sumX * d), (float)(sumY * d));
     }
 
     for (int i = 1; i < n - 1; ++i)
@@ -161,4 +194,118 @@ StrokePoint::Smooth(std::vector<StrokePoint>& points, int radius)
     }
 }
 
+StrokeSmoother::StrokeSmoother()
+    :mRadius(0)
+    ,mNext(0)
+    ,mSumX(0)
+    ,mSumY(0)
+{
+}
+
+void StrokeSmoother::Reset(int radius)
+{
+    mRadius = radius;
+    mRaw.clear();
+    mNext = 0;
+    mSumX = 0;
+    mSumY = 0;
+}
+
+void StrokeSmoother::Push(const StrokePoint& p, std::vector<StrokePoint>& out)
+{
+    mRaw.push_back(p);
+    int k = (int)mRaw.size() - 1;
+    if (mRadius < 1 || k == 0)
+    {
+        out.push_back(p);
+        mNext = k + 1;
+        return;
+    }
+    if (k < mNext + mRadius)
+    {
+        return;
+    }
+
+    // the window is all in, so the stroke end does not matter yet
+    int i = mNext;
+    StrokeSamples samples = { &mRaw[0], k + 1, NULL, k + 1 };
+    if (i == 1)
+    {
+        BeginWindow(samples, mRadius, mSumX, mSumY);
+    }
+    else
+    {
+        SlideWindow(samples, i, mRadius, mSumX, mSumY);
+    }
+
+    double d = 1.0 / (mRadius * 2 + 1);
+    StrokePoint s = mRaw[i];
+    s.x = (float)(mSumX * d);
+    s.y = (float)(mSumY * d);
+    out.push_back(s);
+    ++mNext;
+}
+
+void StrokeSmoother::Finish(const StrokePoint* extra, int count, std::vector<StrokePoint>& out) const
+{
+    int raw = (int)mRaw.size();
+    int n = raw + count;
+    StrokeSamples samples = { raw > 0 ? &mRaw[0] : NULL, raw, extra, n };
+    double d = 1.0 / (mRadius * 2 + 1);
+    // go on from the sums of the last sample Push gave
+    double sumX = mSumX;
+    double sumY = mSumY;
+    for (int i = mNext; i < n; ++i)
+    {
+        StrokePoint s = samples[i];
+        if (mRadius < 1 || n < 3 || i == 0 || i == n - 1)
+        {
+            out.push_back(s);
+            continue;
+        }
 
+        if (i == 1)
+        {
+            BeginWindow(samples, mRadius, sumX, sumY);
+        }
+        else
+        {
+            SlideWindow(samples, i, mRadius, sumX, sumY);
+        }
+        s.x = (float)(sumX * d);
+        s.y = (float)(sumY * d);
+        out.push_back(s);
+    }
+}
+
+StrokeStabilizer::StrokeStabilizer()
+    :mLength(0)
+{
+    mPoint.x = 0;
+    mPoint.y = 0;
+    mPoint.pressure = 0;
+}
+
+void StrokeStabilizer::Reset(const StrokePoint& pen, float length)
+{
+    mPoint = pen;
+    mLength = length > 0 ? length : 0;
+}
+
+bool StrokeStabilizer::Pull(const StrokePoint& pen, StrokePoint& point)
+{
+    float dx = pen.x - mPoint.x;
+    float dy = pen.y - mPoint.y;
+    float distance = sqrtf(dx * dx + dy * dy);
+    if (distance <= mLength || distance == 0)
+    {
+        return false;
+    }
+
+    float t = (distance - mLength) / distance;
+    mPoint.x += dx * t;
+    mPoint.y += dy * t;
+    mPoint.pressure = pen.pressure;
+    point = mPoint;
+    return true;
+}
@@ -22,7 +22,48 @@ public:
 
     static float DistanceToSq(StrokePoint& p0, StrokePoint& p1, StrokePoint& p);
     static void CatmulRomSpline(const StrokePoint& P0, const StrokePoint& P1, const StrokePoint& P2, const StrokePoint& P3, std::vector<StrokePoint>& result);
+    // Box filter of 2 * radius + 1 samples over the positions, the end samples stay. O(n).
     static void Smooth(std::vector<StrokePoint>& points, int radius);
 };
 
+// StrokePoint::Smooth fed a sample at a time while the stroke is drawn. A sample comes out once
+// the samples of its window are in, equal to what Smooth gives for it, at O(1) per sample.
+class StrokeSmoother
+{
+public:
+    StrokeSmoother();
+
+    void Reset(int radius);
+    // Appends the samples which came out to out
+    void Push(const StrokePoint& p, std::vector<StrokePoint>& out);
+    // Appends the samples still held back, as Smooth gives them if the stroke ended with the
+    // pushed samples and then extra. Does not change the state, costs O(radius + count).
+    void Finish(const StrokePoint* extra, int count, std::vector<StrokePoint>& out) const;
+
+private:
+    int mRadius;
+    std::vector<StrokePoint> mRaw;
+    // Index of the next sample to come out
+    int mNext;
+    // Window sum of the last sample which came out
+    double mSumX;
+    double mSumY;
+};
+
+// Pulled string stabilizer. The pen drags the stroke point behind it on a string of the given
+// length, so jitter shorter than the string never reaches the stroke. O(1) per sample.
+class StrokeStabilizer
+{
+public:
+    StrokeStabilizer();
+
+    void Reset(const StrokePoint& pen, float length);
+    // Moves the stroke point after pen, returns false if it stayed where it was
+    bool Pull(const StrokePoint& pen, StrokePoint& point);
+
+private:
+    StrokePoint mPoint;
+    float mLength;
+};
+
 #endif // STROKEPOINT_H
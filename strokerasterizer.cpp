@@ -0,0 +1,328 @@
+#include "strokerasterizer.h"
+#include "imageutil.h"
+#include "openglrenderer.h"
+#include <math.h>
+#include <float.h>
+
+// Largest distance of a flattened circle from the true one, in pixels
+#define CIRCLE_TOLERANCE 0.1f
+
+float GetStrokeSegmentOutline(const StrokePoint& p0, const StrokePoint& p1, float brushSize, QPointF quad[4])
+{
+    float r0 = p0.pressure * brushSize * 0.5f;
+    float r1 = p1.pressure * brushSize * 0.5f;
+    Vector2 dir(p1.x - p0.x, p1.y - p0.y);
+    Vector2 perp0 = dir.GetPerpendicular().GetNormalized() * r0;
+    Vector2 perp1 = dir.GetPerpendicular().GetNormalized() * r1;
+
+    quad[0] = QPointF(p0.x - perp0.x, p0.y - perp0.y);
+    quad[1] = QPointF(p1.x - perp1.x, p1.y - perp1.y);
+    quad[2] = QPointF(p1.x + perp1.x, p1.y + perp1.y);
+    quad[3] = QPointF(p0.x + perp0.x, p0.y + perp0.y);
+    return r0 > 3.0f ? r0 : 0.0f;
+}
+
+StrokeRasterizer::StrokeRasterizer()
+{
+    Clear();
+}
+
+void StrokeRasterizer::Clear()
+{
+    mEdges.clear();
+    mMinX = FLT_MAX;
+    mMinY = FLT_MAX;
+    mMaxX = -FLT_MAX;
+    mMaxY = -FLT_MAX;
+}
+
+void StrokeRasterizer::AddPolygon(const QPointF* points, int count)
+{
+    if (count < 3)
+    {
+        return;
+    }
+
+    double area = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const QPointF& a = points[i];
+        const QPointF& b = points[(i + 1) % count];
+        area += a.x() * b.y() - b.x() * a.y();
+    }
+
+    // reversed polygons would cancel the coverage of the others instead of adding to it
+    for (int i = 0; i < count; ++i)
+    {
+        const QPointF& a = points[i];
+        const QPointF& b = points[(i + 1) % count];
+        if (area >= 0)
+        {
+            AddEdge(a.x(), a.y(), b.x(), b.y());
+        }
+        else
+        {
+            AddEdge(b.x(), b.y(), a.x(), a.y());
+        }
+    }
+}
+
+void StrokeRasterizer::AddCircle(const QPointF& center, float radius)
+{
+    if (radius <= 0)
+    {
+        return;
+    }
+
+    int n = 8;
+    if (radius > CIRCLE_TOLERANCE)
+    {
+        n = qMax(n, (int)ceilf(3.14159265f / acosf(1.0f - CIRCLE_TOLERANCE / radius)));
+    }
+    std::vector<QPointF> points(n);
+    for (int i = 0; i < n; ++i)
+    {
+        float a = i * 2.0f * 3.14159265f / n;
+        points[i] = QPointF(center.x() + radius * cosf(a), center.y() + radius * sinf(a));
+    }
+    AddPolygon(&points[0], n);
+}
+
+void StrokeRasterizer::AddStrokeSegment(const StrokePoint& p0, const StrokePoint& p1, float brushSize)
+{
+    QPointF quad[4];
+    float joint = GetStrokeSegmentOutline(p0, p1, brushSize, quad);
+    AddPolygon(quad, 4);
+    if (joint > 0)
+    {
+        AddCircle(QPointF(p0.x, p0.y), joint);
+    }
+}
+
+void StrokeRasterizer::AddEdge(float x0, float y0, float x1, float y1)
+{
+    // horizontal edges cover nothing, NaN from degenerate outlines neither
+    if (y0 == y1 || y0 != y0 || y1 != y1 || x0 != x0 || x1 != x1)
+    {
+        return;
+    }
+
+    Edge edge;
+    edge.dir = y0 < y1 ? 1.0f : -1.0f;
+    edge.x0 = y0 < y1 ? x0 : x1;
+    edge.y0 = y0 < y1 ? y0 : y1;
+    edge.x1 = y0 < y1 ? x1 : x0;
+    edge.y1 = y0 < y1 ? y1 : y0;
+    mEdges.push_back(edge);
+
+    mMinX = qMin(mMinX, qMin(x0, x1));
+    mMaxX = qMax(mMaxX, qMax(x0, x1));
+    mMinY = qMin(mMinY, edge.y0);
+    mMaxY = qMax(mMaxY, edge.y1);
+}
+
+QRect StrokeRasterizer::GetBounds() const
+{
+    if (mEdges.empty())
+    {
+        return QRect();
+    }
+    int x0 = (int)floorf(mMinX);
+    int y0 = (int)floorf(mMinY);
+    int x1 = (int)ceilf(mMaxX);
+    int y1 = (int)ceilf(mMaxY);
+    return QRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+QImage StrokeRasterizer::Rasterize(const QRect& clip, QRect& rect) const
+{
+    rect = GetBounds().intersected(clip);
+    if (rect.isEmpty())
+    {
+        rect = QRect();
+        return QImage();
+    }
+
+    int width = rect.width();
+    int height = rect.height();
+    QImage mask(width, height, QImage::Format_Alpha8);
+    mask.fill(0);
+
+    // edges in the bands they cross, so a band only visits its own
+    int bandCount = (height + STROKE_BAND_HEIGHT - 1) / STROKE_BAND_HEIGHT;
+    std::vector<std::vector<Edge> > bands(bandCount);
+    for (size_t i = 0; i < mEdges.size(); ++i)
+    {
+        Edge edge = mEdges[i];
+        edge.x0 -= rect.left();
+        edge.x1 -= rect.left();
+        edge.y0 -= rect.top();
+        edge.y1 -= rect.top();
+        if (edge.y1 <= 0 || edge.y0 >= height)
+        {
+            continue;
+        }
+        int b0 = qMax(0, (int)floorf(edge.y0) / STROKE_BAND_HEIGHT);
+        int b1 = qMin(bandCount - 1, ((int)ceilf(edge.y1) - 1) / STROKE_BAND_HEIGHT);
+        for (int b = b0; b <= b1; ++b)
+        {
+            bands[b].push_back(edge);
+        }
+    }
+
+    // one cell past the right edge takes the coverage of edges beyond it
+    int stride = width + 2;
+    std::vector<float> cells(stride * STROKE_BAND_HEIGHT, 0.0f);
+    int spanMin[STROKE_BAND_HEIGHT];
+    int spanMax[STROKE_BAND_HEIGHT];
+    for (int b = 0; b < bandCount; ++b)
+    {
+        int top = b * STROKE_BAND_HEIGHT;
+        int bottom = qMin(height, top + STROKE_BAND_HEIGHT);
+        for (int r = 0; r < bottom - top; ++r)
+        {
+            spanMin[r] = width + 1;
+            spanMax[r] = -1;
+        }
+
+        const std::vector<Edge>& edges = bands[b];
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            DrawEdge(&cells[0], stride, width, top, bottom, spanMin, spanMax, edges[i]);
+        }
+
+        // only the cells a row touched are summed, the sum is back to 0 after the last one
+        for (int r = 0; r < bottom - top; ++r)
+        {
+            if (spanMax[r] < spanMin[r])
+            {
+                continue;
+            }
+            float* row = &cells[r * stride];
+            uchar* out = mask.scanLine(top + r);
+            int last = qMin(spanMax[r], width - 1);
+            float acc = 0;
+            for (int x = spanMin[r]; x <= last; ++x)
+            {
+                acc += row[x];
+                float coverage = fabsf(acc);
+                out[x] = coverage >= 1.0f ? 0xFF : (uchar)(coverage * 255.0f + 0.5f);
+            }
+            for (int x = spanMin[r]; x <= spanMax[r]; ++x)
+            {
+                row[x] = 0;
+            }
+        }
+    }
+    return mask;
+}
+
+void StrokeRasterizer::DrawEdge(float* cells, int stride, int width, int top, int bottom,
+                                int* spanMin, int* spanMax, const Edge& edge)
+{
+    float ys = qMax(edge.y0, (float)top);
+    float ye = qMin(edge.y1, (float)bottom);
+    if (ys >= ye)
+    {
+        return;
+    }
+
+    float dxdy = (edge.x1 - edge.x0) / (edge.y1 - edge.y0);
+    float x = edge.x0 + (ys - edge.y0) * dxdy;
+    int yEnd = (int)ceilf(ye);
+    for (int y = (int)floorf(ys); y < yEnd; ++y)
+    {
+        float dy = qMin((float)(y + 1), ye) - qMax((float)y, ys);
+        float xnext = x + dxdy * dy;
+        float* row = cells + (y - top) * stride;
+        float d = dy * edge.dir;
+
+        // parts of the crossing outside the row are folded onto its ends
+        float lo = qMin(x, xnext);
+        float hi = qMax(x, xnext);
+        if (hi <= 0)
+        {
+            row[0] += d;
+            lo = hi = 0;
+        }
+        else if (lo >= width)
+        {
+            row[width] += d;
+            lo = hi = width;
+        }
+        else
+        {
+            if (lo < 0)
+            {
+                float f = -lo / (hi - lo);
+                row[0] += d * f;
+                d -= d * f;
+                lo = 0;
+            }
+            if (hi > width)
+            {
+                float f = (hi - width) / (hi - lo);
+                row[width] += d * f;
+                d -= d * f;
+                hi = width;
+            }
+            DrawLine(row, width, lo, hi, d);
+        }
+
+        int r = y - top;
+        spanMin[r] = qMin(spanMin[r], (int)floorf(lo));
+        spanMax[r] = qMax(spanMax[r], qMin(width, (int)ceilf(hi)));
+        x = xnext;
+    }
+}
+
+// Adds the signed area right of the line x0 -> x1 within one row, x0 <= x1, to the cells
+void StrokeRasterizer::DrawLine(float* row, int width, float x0, float x1, float d)
+{
+    float x0floor = floorf(x0);
+    int x0i = (int)x0floor;
+    float x1ceil = ceilf(x1);
+    int x1i = (int)x1ceil;
+    if (x1i <= x0i + 1)
+    {
+        float xmf = 0.5f * (x0 + x1) - x0floor;
+        row[x0i] += d - d * xmf;
+        row[x0i + 1] += d * xmf;
+        return;
+    }
+
+    float s = 1.0f / (x1 - x0);
+    float x0f = x0 - x0floor;
+    float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+    float x1f = x1 - x1ceil + 1.0f;
+    float am = 0.5f * s * x1f * x1f;
+    row[x0i] += d * a0;
+    if (x1i == x0i + 2)
+    {
+        row[x0i + 1] += d * (1.0f - a0 - am);
+    }
+    else
+    {
+        float a1 = s * (1.5f - x0f);
+        row[x0i + 1] += d * (a1 - a0);
+        for (int xi = x0i + 2; xi < x1i - 1; ++xi)
+        {
+            row[xi] += d * s;
+        }
+        float a2 = a1 + (x1i - x0i - 3) * s;
+        row[x1i - 1] += d * (1.0f - a2 - am);
+    }
+    row[x1i] += d * am;
+}
+
+QRect StrokeRasterizer::Fill(QImage* image, const QColor& color, QPainter::CompositionMode mode) const
+{
+    QRect rect;
+    QImage mask = Rasterize(image->rect(), rect);
+    if (rect.isEmpty())
+    {
+        return QRect();
+    }
+    FillMask(image, rect.topLeft(), mask, color, mode);
+    return rect;
+}
@@ -0,0 +1,64 @@
+#ifndef STROKERASTERIZER_H
+#define STROKERASTERIZER_H
+#include <QImage>
+#include <QRect>
+#include <QPointF>
+#include <QColor>
+#include <QPainter>
+#include <vector>
+#include "strokepoint.h"
+
+// Rows rasterized at a time, the cell buffer holds one band of the bounds
+#define STROKE_BAND_HEIGHT 64
+
+// Quad between the pressure widths at p0 and p1 of a stroke segment. Returns the radius of the
+// round joint at p0, 0 when the segment has none.
+float GetStrokeSegmentOutline(const StrokePoint& p0, const StrokePoint& p1, float brushSize, QPointF quad[4]);
+
+// Scanline rasterizer with exact area coverage, as font rasterizers do it. Edges add their signed
+// area to a cell buffer and each row is resolved by a running sum over the cells it touched.
+// Every polygon is oriented the same way, so pieces which overlap clamp to full coverage and a
+// stroke can be given as the union of its segments without tessellating it.
+class StrokeRasterizer
+{
+public:
+    StrokeRasterizer();
+
+    void Clear();
+    void AddPolygon(const QPointF* points, int count);
+    void AddCircle(const QPointF& center, float radius);
+    // The same outline BrushTool draws for the segment
+    void AddStrokeSegment(const StrokePoint& p0, const StrokePoint& p1, float brushSize);
+
+    // Pixels the outline may cover
+    QRect GetBounds() const;
+    // Coverage inside clip as Format_Alpha8, the top left pixel is rect.topLeft()
+    QImage Rasterize(const QRect& clip, QRect& rect) const;
+    // Draws color through the coverage onto an RGBA8888 image in one blend pass, returns the rect
+    QRect Fill(QImage* image, const QColor& color, QPainter::CompositionMode mode) const;
+
+private:
+    struct Edge
+    {
+        // y0 < y1, dir is -1 if the edge went up
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+        float dir;
+    };
+
+    void AddEdge(float x0, float y0, float x1, float y1);
+    static void DrawEdge(float* cells, int stride, int width, int top, int bottom,
+                         int* spanMin, int* spanMax, const Edge& edge);
+    static void DrawLine(float* cells, int width, float x0, float x1, float dy);
+
+private:
+    std::vector<Edge> mEdges;
+    float mMinX;
+    float mMinY;
+    float mMaxX;
+    float mMaxY;
+};
+
+#endif // STROKERASTERIZER_H
@@ -0,0 +1,183 @@
+#include "strokerecording.h"
+#include <QFile>
+#include <QDataStream>
+
+#define STROKE_RECORDING_MAGIC 0x52534241
+#define STROKE_RECORDING_VERSION 1
+// Bytes a stroke header and a point take in the file
+#define STROKE_RECORDING_STROKE_BYTES 20
+#define STROKE_RECORDING_POINT_BYTES 12
+
+StrokeRecording::StrokeRecording()
+    :mWidth(0)
+    ,mHeight(0)
+    ,mStroking(false)
+{
+}
+
+void StrokeRecording::Clear()
+{
+    mStrokes.clear();
+    mStroke.points.clear();
+    mStroking = false;
+}
+
+void StrokeRecording::SetCanvasSize(int width, int height)
+{
+    mWidth = width;
+    mHeight = height;
+}
+
+int StrokeRecording::GetPointCount() const
+{
+    int count = 0;
+    for (size_t i = 0; i < mStrokes.size(); ++i)
+    {
+        count += (int)mStrokes[i].points.size();
+    }
+    return count;
+}
+
+void StrokeRecording::BeginStroke(const StrokeToolParams& params, const StrokePoint& point)
+{
+    mStroke.params = params;
+    mStroke.points.clear();
+    mStroking = true;
+    mClock.start();
+    AddPoint(point);
+}
+
+void StrokeRecording::AddPoint(const StrokePoint& point)
+{
+    if (!mStroking)
+    {
+        return;
+    }
+    RecordedPoint p;
+    p.time = (unsigned int)mClock.elapsed();
+    p.point = point;
+    mStroke.points.push_back(p);
+}
+
+void StrokeRecording::EndStroke(const StrokePoint& point)
+{
+    if (!mStroking)
+    {
+        return;
+    }
+    AddPoint(point);
+    mStrokes.push_back(mStroke);
+    mStroke.points.clear();
+    mStroking = false;
+}
+
+void StrokeRecording::AddStroke(const RecordedStroke& stroke)
+{
+    mStrokes.push_back(stroke);
+}
+
+bool StrokeRecording::Save(const QString& path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    out << (quint32)STROKE_RECORDING_MAGIC << (quint16)STROKE_RECORDING_VERSION
+        << (qint32)mWidth << (qint32)mHeight << (quint32)mStrokes.size();
+    for (size_t i = 0; i < mStrokes.size(); ++i)
+    {
+        const RecordedStroke& stroke = mStrokes[i];
+        const StrokeToolParams& params = stroke.params;
+        out << (quint8)params.tool << params.brushSize << (quint8)params.smooth << (quint8)params.mode
+            << (quint8)params.tip << params.stabilize << (quint32)params.color << (quint32)stroke.points.size();
+
+        unsigned int time = 0;
+        for (size_t j = 0; j < stroke.points.size(); ++j)
+        {
+            const RecordedPoint& p = stroke.points[j];
+            unsigned int delta = p.time - time;
+            time = p.time;
+            float pressure = p.point.pressure < 0.0f ? 0.0f : (p.point.pressure > 1.0f ? 1.0f : p.point.pressure);
+            out << (quint16)(delta < 0xFFFF ? delta : 0xFFFF) << p.point.x << p.point.y
+                << (quint16)(pressure * 65535.0f + 0.5f);
+        }
+    }
+    return out.status() == QDataStream::Ok;
+}
+
+bool StrokeRecording::Load(const QString& path)
+{
+    Clear();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint32 width = 0;
+    qint32 height = 0;
+    quint32 strokeCount = 0;
+    in >> magic >> version >> width >> height >> strokeCount;
+    if (magic != STROKE_RECORDING_MAGIC || version != STROKE_RECORDING_VERSION || in.status() != QDataStream::Ok)
+    {
+        return false;
+    }
+    mWidth = width;
+    mHeight = height;
+
+    // counts come from the file, a corrupt one must not make us allocate what is not there
+    qint64 remaining = file.size() - file.pos();
+    if (strokeCount > remaining / STROKE_RECORDING_STROKE_BYTES)
+    {
+        return false;
+    }
+
+    for (quint32 i = 0; i < strokeCount; ++i)
+    {
+        RecordedStroke stroke;
+        quint8 tool, smooth, mode, tip;
+        quint32 color, pointCount;
+        in >> tool >> stroke.params.brushSize >> smooth >> mode >> tip >> stroke.params.stabilize >> color >> pointCount;
+        remaining = file.size() - file.pos();
+        if (in.status() != QDataStream::Ok || pointCount > remaining / STROKE_RECORDING_POINT_BYTES)
+        {
+            Clear();
+            return false;
+        }
+        stroke.params.tool = (StrokeToolType)tool;
+        stroke.params.smooth = smooth;
+        stroke.params.mode = (QPainter::CompositionMode)mode;
+        stroke.params.tip = tip;
+        stroke.params.color = color;
+
+        unsigned int time = 0;
+        stroke.points.reserve(pointCount);
+        for (quint32 j = 0; j < pointCount; ++j)
+        {
+            quint16 delta, pressure;
+            RecordedPoint p;
+            in >> delta >> p.point.x >> p.point.y >> pressure;
+            if (in.status() != QDataStream::Ok)
+            {
+                Clear();
+                return false;
+            }
+            time += delta;
+            p.time = time;
+            p.point.pressure = pressure / 65535.0f;
+            stroke.points.push_back(p);
+        }
+        mStrokes.push_back(stroke);
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef STROKERECORDING_H
+#define STROKERECORDING_H
+#include <QString>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <vector>
+#include "strokepoint.h"
+
+enum StrokeToolType
+{
+    StrokeToolBrush,
+    StrokeToolRegion,
+    StrokeToolSpline,
+    StrokeToolFill
+};
+
+// Settings of the tool a stroke was drawn with, tools leave out what they do not have
+struct StrokeToolParams
+{
+    StrokeToolType tool;
+    float brushSize;
+    int smooth;
+    QPainter::CompositionMode mode;
+    // BrushTip of the brush
+    int tip;
+    float stabilize;
+    QRgb color;
+};
+
+struct RecordedPoint
+{
+    // ms since the stroke began
+    unsigned int time;
+    // Canvas position, the first point is the press and the last the release
+    StrokePoint point;
+};
+
+struct RecordedStroke
+{
+    StrokeToolParams params;
+    std::vector<RecordedPoint> points;
+};
+
+// Strokes of a drawing session on one canvas, saved as
+//   header: "ABSR", version, canvas width and height, stroke count
+//   stroke: tool and its settings, point count
+//   point:  ms since the previous point, x and y as floats, pressure in 16 bits
+// all little endian, about 12 bytes a point
+class StrokeRecording
+{
+public:
+    StrokeRecording();
+
+    void Clear();
+    void SetCanvasSize(int width, int height);
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+    const std::vector<RecordedStroke>& GetStrokes() const { return mStrokes; }
+    int GetPointCount() const;
+
+    // A stroke is only kept once it ended, points come in canvas space
+    void BeginStroke(const StrokeToolParams& params, const StrokePoint& point);
+    void AddPoint(const StrokePoint& point);
+    void EndStroke(const StrokePoint& point);
+    bool IsRecordingStroke() const { return mStroking; }
+    // Adds a whole stroke, times and all
+    void AddStroke(const RecordedStroke& stroke);
+
+    bool Save(const QString& path) const;
+    bool Load(const QString& path);
+
+private:
+    int mWidth;
+    int mHeight;
+    std::vector<RecordedStroke> mStrokes;
+    RecordedStroke mStroke;
+    bool mStroking;
+    QElapsedTimer mClock;
+};
+
+#endif // STROKERECORDING_H
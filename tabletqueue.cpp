@@ -0,0 +1,77 @@
+#include "tabletqueue.h"
+#include "canvastool.h"
+
+// Positions count up to twice the size and wrap, so full and empty differ
+#define TABLET_QUEUE_WRAP (TABLET_QUEUE_SIZE * 2 - 1)
+
+TabletQueue::TabletQueue()
+    :mHead(0)
+    ,mTail(0)
+{
+}
+
+bool TabletQueue::Push(const TabletSample& sample)
+{
+    int tail = mTail.load();
+    if (((tail - mHead.loadAcquire()) & TABLET_QUEUE_WRAP) == TABLET_QUEUE_SIZE)
+    {
+        return false;
+    }
+    mSamples[tail & (TABLET_QUEUE_SIZE - 1)] = sample;
+    // the sample is written before the consumer can see it
+    mTail.storeRelease((tail + 1) & TABLET_QUEUE_WRAP);
+    return true;
+}
+
+bool TabletQueue::Pop(TabletSample& sample)
+{
+    int head = mHead.load();
+    if (head == mTail.loadAcquire())
+    {
+        return false;
+    }
+    sample = mSamples[head & (TABLET_QUEUE_SIZE - 1)];
+    // the slot is read before the producer can reuse it
+    mHead.storeRelease((head + 1) & TABLET_QUEUE_WRAP);
+    return true;
+}
+
+bool TabletQueue::IsEmpty() const
+{
+    return mHead.loadAcquire() == mTail.loadAcquire();
+}
+
+void TabletQueue::Drain(CanvasTool* tool)
+{
+    TabletSample sample;
+    while (Pop(sample))
+    {
+        if (!tool)
+        {
+            continue;
+        }
+        if (sample.type == TabletSampleMove)
+        {
+            mBatch.push_back(sample);
+            continue;
+        }
+        if (!mBatch.empty())
+        {
+            tool->OnDragSamples(&mBatch[0], (int)mBatch.size());
+            mBatch.clear();
+        }
+        if (sample.type == TabletSamplePress)
+        {
+            tool->OnSampleBegin(sample);
+        }
+        else
+        {
+            tool->OnSampleEnd(sample);
+        }
+    }
+    if (!mBatch.empty())
+    {
+        tool->OnDragSamples(&mBatch[0], (int)mBatch.size());
+        mBatch.clear();
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TABLETQUEUE_H
+#define TABLETQUEUE_H
+
+#include <QAtomicInt>
+#include <vector>
+
+// Capacity of the queue, a power of two. A second of samples at 1000 Hz.
+#define TABLET_QUEUE_SIZE 1024
+
+enum TabletSampleType
+{
+    TabletSamplePress,
+    TabletSampleMove,
+    TabletSampleRelease
+};
+
+struct TabletSample
+{
+    TabletSampleType type;
+    // Widget position with the sub-pixel part the tablet reports
+    float x;
+    float y;
+    float pressure;
+    // Degrees the pen leans towards +x and +y
+    int xTilt;
+    int yTilt;
+    // ms on the clock of the window system
+    unsigned long timestamp;
+};
+
+class CanvasTool;
+
+// Ring of tablet samples for one producer and one consumer, without locks,
+// so the input side never waits for the tool drawing the samples
+class TabletQueue
+{
+public:
+    TabletQueue();
+
+    // Returns false if the queue is full, the sample is not queued then
+    bool Push(const TabletSample& sample);
+    // Returns false if the queue is empty
+    bool Pop(TabletSample& sample);
+    bool IsEmpty() const;
+    // Pops every sample into tool the way a display frame takes them, the moves between a press
+    // and a release in one batch. Samples are dropped if tool is NULL. Consumer side only.
+    void Drain(CanvasTool* tool);
+
+private:
+    TabletSample mSamples[TABLET_QUEUE_SIZE];
+    // Next sample to pop, only the consumer writes it
+    QAtomicInt mHead;
+    // Next slot to push to, only the producer writes it
+    QAtomicInt mTail;
+    // Moves popped by Drain, only the consumer touches it
+    std::vector<TabletSample> mBatch;
+};
+
+#endif // TABLETQUEUE_H
@@ -0,0 +1,80 @@
+#include "test.h"
+#include "fastblur.h"
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+#define IMAGE_WIDTH 256
+#define IMAGE_HEIGHT 192
+#define IMAGE_STRIDE (IMAGE_WIDTH * 4)
+
+static unsigned int sSeed = 1;
+
+static int Random(int range)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (int)((sSeed >> 8) & 0xFFFF) % range;
+}
+
+// Opaque and translucent rectangles on a transparent background, edges and colors for the blur to spread
+static void BuildImage(std::vector<unsigned char>& image)
+{
+    sSeed = 1;
+    image.assign(IMAGE_STRIDE * IMAGE_HEIGHT, 0);
+    for (int i = 0; i < 40; ++i)
+    {
+        int x0 = Random(IMAGE_WIDTH);
+        int y0 = Random(IMAGE_HEIGHT);
+        int x1 = std::min(IMAGE_WIDTH, x0 + 4 + Random(80));
+        int y1 = std::min(IMAGE_HEIGHT, y0 + 4 + Random(80));
+        unsigned char pixel[4];
+        pixel[0] = (unsigned char)Random(256);
+        pixel[1] = (unsigned char)Random(256);
+        pixel[2] = (unsigned char)Random(256);
+        pixel[3] = (unsigned char)(i % 3 == 0 ? 0xFF : 40 + Random(200));
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = x0; x < x1; ++x)
+            {
+                memcpy(&image[y * IMAGE_STRIDE + x * 4], pixel, 4);
+            }
+        }
+    }
+}
+
+void RunBlurTest()
+{
+    std::vector<unsigned char> source;
+    BuildImage(source);
+
+    // measured on this image with margin, in 8 bit premultiplied levels. Below 2 FastBlur is the gaussian.
+    static const float sigmas[] = { 1.0f, 2.0f, 5.0f, 10.0f, 30.0f };
+    static const float maxErrors[] = { 0.0f, 14.0f, 6.0f, 6.0f, 6.0f };
+    static const float rmsErrors[] = { 0.0f, 1.5f, 1.0f, 1.0f, 1.3f };
+    for (int i = 0; i < 5; ++i)
+    {
+        std::vector<unsigned char> fast = source;
+        std::vector<unsigned char> exact = source;
+        FastBlur(&fast[0], IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_STRIDE, sigmas[i]);
+        GaussianBlur(&exact[0], IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_STRIDE, sigmas[i]);
+        BlurError error = CompareBlur(&fast[0], &exact[0], IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_STRIDE);
+        if (!TEST_CHECK(error.maxError <= maxErrors[i] && error.rmsError <= rmsErrors[i]))
+        {
+            printf("sigma %.0f: max error %.1f rms %.3f\n", sigmas[i], error.maxError, error.rmsError);
+        }
+    }
+
+    // a flat color stays flat, edges are clamped and not faded to transparent
+    std::vector<unsigned char> flat(IMAGE_STRIDE * IMAGE_HEIGHT);
+    for (size_t i = 0; i < flat.size(); i += 4)
+    {
+        flat[i] = 200;
+        flat[i + 1] = 100;
+        flat[i + 2] = 50;
+        flat[i + 3] = 255;
+    }
+    std::vector<unsigned char> blurred = flat;
+    FastBlur(&blurred[0], IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_STRIDE, 10.0f);
+    TEST_CHECK(blurred == flat);
+}
@@ -0,0 +1,73 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <stdio.h>
+#include "test.h"
+
+struct Test
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Test sTests[] =
+{
+    { "recording", RunRecordingTest },
+    { "replay", RunReplayTest },
+    { "smoothing", RunSmoothingTest },
+    { "blur", RunBlurTest },
+    { "kernels", RunPixelKernelsTest },
+    { "renderer", RunRendererTest },
+    { "rasterizer", RunRasterizerTest },
+    { "tabletqueue", RunTabletQueueTest },
+    { "undo", RunUndoTest },
+};
+
+static int sFailures = 0;
+
+bool CheckCondition(bool condition, const char* text, const char* file, int line)
+{
+    if (!condition)
+    {
+        printf("%s:%d: failed %s\n", file, line, text);
+        ++sFailures;
+    }
+    return condition;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    int count = sizeof(sTests) / sizeof(sTests[0]);
+    int run = 0;
+    int failedTests = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (args.size() > 1 && !args.contains(sTests[i].name))
+        {
+            continue;
+        }
+        int failures = sFailures;
+        sTests[i].run();
+        bool passed = sFailures == failures;
+        printf("%-12s %s\n", sTests[i].name, passed ? "ok" : "FAILED");
+        if (!passed)
+        {
+            ++failedTests;
+        }
+        ++run;
+    }
+
+    if (run == 0)
+    {
+        printf("usage: tests [name...]\n");
+        for (int i = 0; i < count; ++i)
+        {
+            printf("  %s\n", sTests[i].name);
+        }
+        return 1;
+    }
+    printf("%d of %d tests failed\n", failedTests, run);
+    return failedTests > 0 ? 1 : 0;
+}
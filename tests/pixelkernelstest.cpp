@@ -0,0 +1,369 @@
+#include "test.h"
+#include "pixelkernels.h"
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+// Kernels against the formulas of the shaders and the blend modes evaluated one channel at a time
+// in double. The kernels work in float, so a channel may round to the neighbouring level.
+
+#define PIXEL_COUNT 4099
+#define LEVEL_TOLERANCE 1
+
+static unsigned int sSeed = 1;
+
+static int Random(int range)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (int)((sSeed >> 8) & 0xFFFF) % range;
+}
+
+// Random straight alpha pixels with the alpha ends and all-zero pixels well represented
+static void RandomPixels(std::vector<unsigned char>& pixels, int count)
+{
+    pixels.resize(count * 4);
+    for (int i = 0; i < count; ++i)
+    {
+        unsigned char* p = &pixels[i * 4];
+        for (int c = 0; c < 4; ++c)
+        {
+            p[c] = (unsigned char)Random(256);
+        }
+        int kind = Random(8);
+        if (kind == 0)
+        {
+            p[3] = 0;
+        }
+        else if (kind == 1)
+        {
+            p[3] = 0xFF;
+        }
+        else if (kind == 2)
+        {
+            p[0] = p[1] = p[2] = p[3] = 0;
+        }
+    }
+}
+
+static unsigned char ToLevel(double v)
+{
+    // NaN from 0 / 0 stores as 0 like the kernels do
+    if (!(v > 0.0))
+    {
+        return 0;
+    }
+    return v >= 1.0 ? 255 : (unsigned char)(v * 255.0 + 0.5);
+}
+
+static bool Near(const unsigned char* a, const unsigned char* b)
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        if (abs(a[c] - b[c]) > LEVEL_TOLERANCE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool CheckPixels(const char* name, const std::vector<unsigned char>& out, const std::vector<unsigned char>& expected)
+{
+    for (size_t i = 0; i < out.size(); i += 4)
+    {
+        if (!Near(&out[i], &expected[i]))
+        {
+            printf("%s: pixel %d is %d %d %d %d, expected %d %d %d %d\n", name, (int)(i / 4),
+                   out[i], out[i + 1], out[i + 2], out[i + 3],
+                   expected[i], expected[i + 1], expected[i + 2], expected[i + 3]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Unpack(const unsigned char* p, double c[4])
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        c[i] = p[i] / 255.0;
+    }
+}
+
+// Premultiplied channel of a layer blend, alpha follows the same formula
+static double BlendChannel(BlendMode mode, double s, double d, double sa, double da, double opacity)
+{
+    switch (mode)
+    {
+    case BlendMultiply:
+        return s * d + s * (1 - da) + d * (1 - sa);
+    case BlendAdd:
+        return s + d < 1 ? s + d : 1;
+    case BlendScreen:
+        return s + d - s * d;
+    case BlendBehind:
+        return d + s * (1 - da);
+    case BlendErase:
+        return d * (1 - sa);
+    case BlendReplace:
+        return s + d * (1 - opacity);
+    default:
+        return s + d * (1 - sa);
+    }
+}
+
+static void TestShaderKernels(const std::vector<unsigned char>& src, const std::vector<unsigned char>& dst)
+{
+    const float color[4] = { 0.9f, 0.5f, 1.0f, 0.75f };
+    std::vector<unsigned char> out(src.size());
+    std::vector<unsigned char> expected(src.size());
+
+    KernelBlendSource(&out[0], &src[0], PIXEL_COUNT, color);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        double s[4];
+        Unpack(&src[i * 4], s);
+        double a = s[3] * color[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            // c.rgb * c.a / c.a, 0 where there is no alpha
+            expected[i * 4 + c] = ToLevel(a > 0 ? s[c] * color[c] : 0);
+        }
+        expected[i * 4 + 3] = ToLevel(a);
+    }
+    TEST_CHECK(CheckPixels("KernelBlendSource", out, expected));
+
+    KernelBlendSourceOver(&out[0], &dst[0], &src[0], PIXEL_COUNT, color);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        double s[4];
+        double d[4];
+        Unpack(&src[i * 4], s);
+        Unpack(&dst[i * 4], d);
+        double sa = s[3] * color[3];
+        double da = d[3] * (1 - sa);
+        double a = sa + da;
+        for (int c = 0; c < 3; ++c)
+        {
+            expected[i * 4 + c] = ToLevel((s[c] * color[c] * sa + d[c] * da) / a);
+        }
+        expected[i * 4 + 3] = ToLevel(a);
+    }
+    TEST_CHECK(CheckPixels("KernelBlendSourceOver", out, expected));
+
+    KernelBlendMultiply(&out[0], &dst[0], &src[0], PIXEL_COUNT, color);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        double s[4];
+        double d[4];
+        Unpack(&src[i * 4], s);
+        Unpack(&dst[i * 4], d);
+        double sa = s[3] * color[3];
+        double da = d[3] * (1 - sa);
+        double a = sa + da;
+        for (int c = 0; c < 3; ++c)
+        {
+            double ps = s[c] * color[c] * sa;
+            double pd = d[c] * d[3];
+            // divided by alpha twice, as the shader does
+            expected[i * 4 + c] = ToLevel((ps * pd * sa + pd * da) / a / a);
+        }
+        expected[i * 4 + 3] = ToLevel(a);
+    }
+    TEST_CHECK(CheckPixels("KernelBlendMultiply", out, expected));
+
+    KernelMask(&out[0], &src[0], &dst[0], &src[0], PIXEL_COUNT, 0.8f);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        double s[4];
+        double d[4];
+        Unpack(&src[i * 4], s);
+        Unpack(&dst[i * 4], d);
+        for (int c = 0; c < 3; ++c)
+        {
+            expected[i * 4 + c] = src[i * 4 + c];
+        }
+        // red of the color mask and alpha of the alpha mask scale alpha
+        expected[i * 4 + 3] = ToLevel(s[3] * 0.8f * d[0] * s[3]);
+    }
+    TEST_CHECK(CheckPixels("KernelMask", out, expected));
+
+    out = dst;
+    KernelBlendAlpha(&out[0], &src[0], PIXEL_COUNT);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        double s[4];
+        double d[4];
+        Unpack(&src[i * 4], s);
+        Unpack(&dst[i * 4], d);
+        for (int c = 0; c < 4; ++c)
+        {
+            expected[i * 4 + c] = ToLevel(s[c] * s[3] + d[c] * (1 - s[3]));
+        }
+    }
+    TEST_CHECK(CheckPixels("KernelBlendAlpha", out, expected));
+}
+
+static void TestLayerKernels(const std::vector<unsigned char>& src, const std::vector<unsigned char>& dst)
+{
+    static const BlendMode modes[] = { BlendNormal, BlendMultiply, BlendAdd, BlendScreen, BlendBehind, BlendErase, BlendReplace };
+    static const char* names[] = { "normal", "multiply", "add", "screen", "behind", "erase", "replace" };
+    static const float opacities[] = { 1.0f, 0.6f };
+    std::vector<unsigned char> out;
+    std::vector<unsigned char> expected(src.size());
+    for (int m = 0; m < 7; ++m)
+    {
+        for (int o = 0; o < 2; ++o)
+        {
+            float opacity = opacities[o];
+            out = dst;
+            KernelBlendLayer(&out[0], &src[0], PIXEL_COUNT, opacity, modes[m]);
+            for (int i = 0; i < PIXEL_COUNT; ++i)
+            {
+                double s[4];
+                double d[4];
+                Unpack(&src[i * 4], s);
+                Unpack(&dst[i * 4], d);
+                if (modes[m] != BlendReplace && src[i * 4 + 3] == 0)
+                {
+                    // an empty layer pixel leaves the composite as it is
+                    memcpy(&expected[i * 4], &dst[i * 4], 4);
+                    continue;
+                }
+                double sa = s[3] * opacity;
+                double da = d[3];
+                double a = BlendChannel(modes[m], sa, da, sa, da, opacity);
+                for (int c = 0; c < 3; ++c)
+                {
+                    expected[i * 4 + c] = ToLevel(BlendChannel(modes[m], s[c] * sa, d[c] * da, sa, da, opacity) / a);
+                }
+                expected[i * 4 + 3] = ToLevel(a);
+            }
+            char name[64];
+            sprintf(name, "KernelBlendLayer %s %.1f", names[m], opacity);
+            TEST_CHECK(CheckPixels(name, out, expected));
+        }
+    }
+
+    // brush dabs, a premultiplied color through coverage onto premultiplied pixels
+    const float color[4] = { 0.3f * 0.7f, 0.6f * 0.7f, 0.2f * 0.7f, 0.7f };
+    std::vector<unsigned char> mask(PIXEL_COUNT);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        mask[i] = src[i * 4];
+    }
+    out = dst;
+    KernelBlendColorPremultiplied(&out[0], &mask[0], PIXEL_COUNT, color);
+    for (int i = 0; i < PIXEL_COUNT; ++i)
+    {
+        double d[4];
+        Unpack(&dst[i * 4], d);
+        double coverage = mask[i] / 255.0;
+        for (int c = 0; c < 4; ++c)
+        {
+            expected[i * 4 + c] = ToLevel(color[c] * coverage + d[c] * (1 - color[3] * coverage));
+        }
+    }
+    TEST_CHECK(CheckPixels("KernelBlendColorPremultiplied", out, expected));
+}
+
+static void TestFloatKernels(const std::vector<unsigned char>& src)
+{
+    // premultiplied and back is the identity wherever alpha keeps the color apart
+    std::vector<float> premultiplied(PIXEL_COUNT * 4);
+    std::vector<unsigned char> out(src.size());
+    KernelPremultiply(&premultiplied[0], &src[0], PIXEL_COUNT);
+    KernelUnpremultiply(&out[0], &premultiplied[0], PIXEL_COUNT);
+    bool same = true;
+    for (int i = 0; i < PIXEL_COUNT && same; ++i)
+    {
+        const unsigned char* s = &src[i * 4];
+        if (s[3] == 0)
+        {
+            same = out[i * 4 + 3] == 0;
+            continue;
+        }
+        double a = s[3] / 255.0;
+        for (int c = 0; c < 3; ++c)
+        {
+            same = same && fabs(premultiplied[i * 4 + c] - s[c] / 255.0 * a) < 1e-6;
+        }
+        same = same && Near(s, &out[i * 4]);
+    }
+    TEST_CHECK(same);
+
+    // running box sum against summing every window
+    static const int radii[] = { 1, 3, 40 };
+    static const int counts[] = { 1, 2, 37, 300 };
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int n = 0; n < 4; ++n)
+        {
+            int radius = radii[r];
+            int count = counts[n];
+            std::vector<float> row(premultiplied.begin(), premultiplied.begin() + count * 4);
+            std::vector<float> box(count * 4);
+            KernelBoxRow(&box[0], &row[0], count, radius);
+            double worst = 0;
+            for (int x = 0; x < count; ++x)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    double sum = 0;
+                    for (int k = x - radius; k <= x + radius; ++k)
+                    {
+                        int idx = k < 0 ? 0 : (k >= count ? count - 1 : k);
+                        sum += row[idx * 4 + c];
+                    }
+                    double error = fabs(box[x * 4 + c] - sum / (2 * radius + 1));
+                    worst = error > worst ? error : worst;
+                }
+            }
+            TEST_CHECK(worst < 1e-4);
+        }
+    }
+}
+
+static void TestSampleBilinear(const std::vector<unsigned char>& src)
+{
+    // at texel centers the samples are the texels, outside the image they fade to transparent
+    const int width = 64;
+    const int height = PIXEL_COUNT / width;
+    std::vector<unsigned char> out(width * 4);
+    std::vector<unsigned char> expected(width * 4);
+    bool same = true;
+    for (int y = 0; y < height && same; ++y)
+    {
+        KernelSampleBilinear(&out[0], &src[0], width, height, width * 4, 0.5f, y + 0.5f, 1.0f, 0.0f, width);
+        for (int x = 0; x < width; ++x)
+        {
+            const unsigned char* s = &src[(y * width + x) * 4];
+            for (int c = 0; c < 3; ++c)
+            {
+                expected[x * 4 + c] = s[3] ? s[c] : 0;
+            }
+            expected[x * 4 + 3] = s[3];
+        }
+        same = CheckPixels("KernelSampleBilinear", out, expected);
+    }
+    TEST_CHECK(same);
+
+    unsigned char outside[4];
+    KernelSampleBilinear(outside, &src[0], width, height, width * 4, -1.0f, -1.0f, 0.0f, 0.0f, 1);
+    TEST_CHECK(outside[3] == 0);
+}
+
+void RunPixelKernelsTest()
+{
+    sSeed = 1;
+    std::vector<unsigned char> src;
+    std::vector<unsigned char> dst;
+    RandomPixels(src, PIXEL_COUNT);
+    RandomPixels(dst, PIXEL_COUNT);
+    TestShaderKernels(src, dst);
+    TestLayerKernels(src, dst);
+    TestFloatKernels(src);
+    TestSampleBilinear(src);
+}
@@ -0,0 +1,131 @@
+#include "test.h"
+#include "strokerecording.h"
+#include "../replay/replay.h"
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <stdio.h>
+
+static RecordedStroke GetStroke(StrokeToolType tool, int count)
+{
+    RecordedStroke stroke;
+    stroke.params.tool = tool;
+    stroke.params.brushSize = 7.25f;
+    stroke.params.smooth = 12;
+    stroke.params.mode = QPainter::CompositionMode_DestinationOut;
+    stroke.params.tip = 2;
+    stroke.params.stabilize = 3.5f;
+    stroke.params.color = qRgba(10, 20, 30, 40);
+    for (int i = 0; i < count; ++i)
+    {
+        RecordedPoint p;
+        p.time = i * 3 + (i == count - 1 ? 70000 : 0);
+        p.point.x = 100.125f + i * 1.5f;
+        p.point.y = -20.0f + i * 0.3f;
+        p.point.pressure = i / (float)count;
+        stroke.points.push_back(p);
+    }
+    return stroke;
+}
+
+void RunRecordingTest()
+{
+    QTemporaryDir dir;
+    TEST_CHECK(dir.isValid());
+    QString path = QDir(dir.path()).filePath("test.strokes");
+
+    StrokeRecording recording;
+    recording.SetCanvasSize(640, 360);
+    recording.AddStroke(GetStroke(StrokeToolBrush, 200));
+    recording.AddStroke(GetStroke(StrokeToolFill, 2));
+    recording.AddStroke(GetStroke(StrokeToolRegion, 0));
+    TEST_CHECK(recording.Save(path));
+
+    StrokeRecording loaded;
+    TEST_CHECK(loaded.Load(path));
+    TEST_CHECK(loaded.GetWidth() == 640 && loaded.GetHeight() == 360);
+    TEST_CHECK(loaded.GetStrokes().size() == recording.GetStrokes().size());
+    TEST_CHECK(loaded.GetPointCount() == recording.GetPointCount());
+    for (size_t i = 0; i < loaded.GetStrokes().size() && i < recording.GetStrokes().size(); ++i)
+    {
+        const RecordedStroke& a = recording.GetStrokes()[i];
+        const RecordedStroke& b = loaded.GetStrokes()[i];
+        TEST_CHECK(a.params.tool == b.params.tool);
+        TEST_CHECK(a.params.brushSize == b.params.brushSize);
+        TEST_CHECK(a.params.smooth == b.params.smooth);
+        TEST_CHECK(a.params.mode == b.params.mode);
+        TEST_CHECK(a.params.tip == b.params.tip);
+        TEST_CHECK(a.params.stabilize == b.params.stabilize);
+        TEST_CHECK(a.params.color == b.params.color);
+        TEST_CHECK(a.points.size() == b.points.size());
+        for (size_t j = 0; j < a.points.size() && j < b.points.size(); ++j)
+        {
+            // deltas over 16 bits are clamped, the 70 s pause before the last point loses the rest
+            unsigned int time = j + 1 == a.points.size() && j > 0 ? b.points[j - 1].time + 0xFFFF : a.points[j].time;
+            TEST_CHECK(b.points[j].time == time);
+            TEST_CHECK(a.points[j].point.x == b.points[j].point.x);
+            TEST_CHECK(a.points[j].point.y == b.points[j].point.y);
+            // pressure is kept in 16 bits
+            TEST_CHECK(qAbs(a.points[j].point.pressure - b.points[j].point.pressure) <= 0.5f / 65535.0f);
+        }
+    }
+
+    // a cut file, a wrong magic and a count larger than the file all fail to load
+    QFile file(path);
+    TEST_CHECK(file.open(QIODevice::ReadOnly));
+    QByteArray bytes = file.readAll();
+    file.close();
+
+    QString cutPath = QDir(dir.path()).filePath("cut.strokes");
+    QFile cut(cutPath);
+    TEST_CHECK(cut.open(QIODevice::WriteOnly));
+    cut.write(bytes.left(bytes.size() - 5));
+    cut.close();
+    TEST_CHECK(!loaded.Load(cutPath));
+    TEST_CHECK(loaded.GetStrokes().empty());
+
+    QByteArray wrong = bytes;
+    wrong[0] = 'X';
+    cut.open(QIODevice::WriteOnly);
+    cut.write(wrong);
+    cut.close();
+    TEST_CHECK(!loaded.Load(cutPath));
+
+    // stroke count at offset 14
+    QByteArray huge = bytes;
+    huge[17] = (char)0x7F;
+    cut.open(QIODevice::WriteOnly);
+    cut.write(huge);
+    cut.close();
+    TEST_CHECK(!loaded.Load(cutPath));
+}
+
+void RunReplayTest()
+{
+    QDir dir(REPLAY_CORPUS);
+    QStringList names = dir.entryList(QStringList() << "*.strokes", QDir::Files, QDir::Name);
+    TEST_CHECK(!names.isEmpty());
+    for (int i = 0; i < names.size(); ++i)
+    {
+        QString path = dir.filePath(names[i]);
+        StrokeRecording recording;
+        if (!TEST_CHECK(recording.Load(path)))
+        {
+            continue;
+        }
+        quint64 golden = 0;
+        if (!TEST_CHECK(ReadGolden(path, golden)))
+        {
+            printf("no golden for %s, record it with replay --update\n", names[i].toUtf8().constData());
+            continue;
+        }
+        ReplayResult result;
+        Replay(recording, result);
+        if (!TEST_CHECK(result.hash == golden))
+        {
+            printf("%s replays to %016llx, golden is %016llx\n", names[i].toUtf8().constData(),
+                   (unsigned long long)result.hash, (unsigned long long)golden);
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#include "test.h"
+#include "softrenderer.h"
+#include "openglrenderer.h"
+#include "pixelkernels.h"
+#include "fastblur.h"
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define TEXTURE_WIDTH 96
+#define TEXTURE_HEIGHT 64
+
+static unsigned int sSeed = 1;
+
+static int Random(int range)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (int)((sSeed >> 8) & 0xFFFF) % range;
+}
+
+// Blocks of random color, bottom row first, so that sampling the wrong texel or row shows
+static void BuildTexture(std::vector<unsigned char>& pixels)
+{
+    sSeed = 1;
+    pixels.resize(TEXTURE_WIDTH * TEXTURE_HEIGHT * 4);
+    for (int by = 0; by < TEXTURE_HEIGHT; by += 8)
+    {
+        for (int bx = 0; bx < TEXTURE_WIDTH; bx += 8)
+        {
+            unsigned char pixel[4] = { (unsigned char)Random(256), (unsigned char)Random(256),
+                                       (unsigned char)Random(256), (unsigned char)(Random(2) ? 0xFF : Random(256)) };
+            for (int y = by; y < by + 8; ++y)
+            {
+                for (int x = bx; x < bx + 8; ++x)
+                {
+                    memcpy(&pixels[(y * TEXTURE_WIDTH + x) * 4], pixel, 4);
+                }
+            }
+        }
+    }
+}
+
+static std::vector<unsigned char> Read(ITexture* texture)
+{
+    std::vector<unsigned char> pixels(texture->GetWidth() * texture->GetHeight() * 4);
+    texture->ReadTexture((int*)&pixels[0]);
+    return pixels;
+}
+
+void RunRendererTest()
+{
+    // no GL context here
+    IRenderer* created = CreateRenderer();
+    TEST_CHECK(dynamic_cast<SoftRenderer*>(created) != NULL);
+    delete created;
+
+    std::vector<unsigned char> pixels;
+    BuildTexture(pixels);
+    SoftRenderer renderer;
+    IRenderer* r = &renderer;
+    ITexture* src = r->CreateTexture(TEXTURE_WIDTH, TEXTURE_HEIGHT, (int*)&pixels[0], false);
+    TEST_CHECK(Read(src) == pixels);
+
+    // top down data is stored flipped, bottom row first
+    ITexture* flipped = r->CreateTexture(TEXTURE_WIDTH, TEXTURE_HEIGHT, (int*)&pixels[0], true);
+    std::vector<unsigned char> flippedPixels = Read(flipped);
+    int rowBytes = TEXTURE_WIDTH * 4;
+    TEST_CHECK(memcmp(&flippedPixels[0], &pixels[(TEXTURE_HEIGHT - 1) * rowBytes], rowBytes) == 0);
+    delete flipped;
+
+    // the quad fills a target of its size texel for texel, through the same kernel
+    Matrix4 mvp = Matrix4::BuildOrtho(0, TEXTURE_WIDTH, 0, TEXTURE_HEIGHT, -1000, 1000);
+    const float white[4] = { 1, 1, 1, 1 };
+    std::vector<unsigned char> expected(pixels.size());
+    KernelBlendSource(&expected[0], &pixels[0], TEXTURE_WIDTH * TEXTURE_HEIGHT, white);
+    IRenderTarget* target = r->CreateTarget(TEXTURE_WIDTH, TEXTURE_HEIGHT, NULL, false);
+    r->BlendSource(target, src, &mvp.m00, 1, 1, 1, 1);
+    TEST_CHECK(Read(target->GetTexture()) == expected);
+
+    // on a target twice the size the quad covers the bottom left quarter, the rest keeps its clear
+    IRenderTarget* large = r->CreateTarget(TEXTURE_WIDTH * 2, TEXTURE_HEIGHT * 2, NULL, false);
+    Matrix4 largeMvp = Matrix4::BuildOrtho(0, TEXTURE_WIDTH * 2, 0, TEXTURE_HEIGHT * 2, -1000, 1000);
+    r->Clear(large, 0, 0, 1, 1);
+    r->BlendSource(large, src, &largeMvp.m00, 1, 1, 1, 1);
+    std::vector<unsigned char> largePixels = Read(large->GetTexture());
+    bool placed = true;
+    for (int y = 0; y < TEXTURE_HEIGHT * 2 && placed; ++y)
+    {
+        for (int x = 0; x < TEXTURE_WIDTH * 2 && placed; ++x)
+        {
+            const unsigned char* p = &largePixels[(y * TEXTURE_WIDTH * 2 + x) * 4];
+            if (x < TEXTURE_WIDTH && y < TEXTURE_HEIGHT)
+            {
+                placed = memcmp(p, &expected[(y * TEXTURE_WIDTH + x) * 4], 4) == 0;
+            }
+            else
+            {
+                placed = p[0] == 0 && p[1] == 0 && p[2] == 0xFF && p[3] == 0xFF;
+            }
+        }
+    }
+    TEST_CHECK(placed);
+    delete large;
+
+    // with blending on the draw goes onto the target like glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+    std::vector<unsigned char> background(pixels.size());
+    for (size_t i = 0; i < background.size(); i += 4)
+    {
+        background[i] = 0xFF;
+        background[i + 1] = 0xFF;
+        background[i + 2] = 0xFF;
+        background[i + 3] = 0xFF;
+    }
+    expected = background;
+    KernelBlendAlpha(&expected[0], &pixels[0], TEXTURE_WIDTH * TEXTURE_HEIGHT);
+    r->Clear(target, 1, 1, 1, 1);
+    r->EnableBlend(true);
+    r->BlendSource(target, src, &mvp.m00, 1, 1, 1, 1);
+    r->EnableBlend(false);
+    TEST_CHECK(Read(target->GetTexture()) == expected);
+
+    // the two texture draws are the kernels too
+    ITexture* dst = r->CreateTexture(TEXTURE_WIDTH, TEXTURE_HEIGHT, (int*)&flippedPixels[0], false);
+    const float tint[4] = { 1.0f, 0.5f, 0.25f, 0.8f };
+    KernelBlendSourceOver(&expected[0], &flippedPixels[0], &pixels[0], TEXTURE_WIDTH * TEXTURE_HEIGHT, tint);
+    r->BlendSourceOver(target, dst, src, &mvp.m00, tint[0], tint[1], tint[2], tint[3]);
+    TEST_CHECK(Read(target->GetTexture()) == expected);
+    KernelBlendMultiply(&expected[0], &flippedPixels[0], &pixels[0], TEXTURE_WIDTH * TEXTURE_HEIGHT, tint);
+    r->BlendMultipy(target, dst, src, &mvp.m00, tint[0], tint[1], tint[2], tint[3]);
+    TEST_CHECK(Read(target->GetTexture()) == expected);
+    delete dst;
+
+    // blur is FastBlur at the sigma of the shader kernel
+    int radius = 12;
+    std::vector<unsigned char> blurred = pixels;
+    FastBlur(&blurred[0], TEXTURE_WIDTH, TEXTURE_HEIGHT, rowBytes, GetBlurSigma(radius));
+    KernelBlendSource(&expected[0], &blurred[0], TEXTURE_WIDTH * TEXTURE_HEIGHT, white);
+    IRenderTarget* temp = r->CreateTarget(TEXTURE_WIDTH, TEXTURE_HEIGHT, NULL, false);
+    r->Blur(target, temp, &mvp.m00, src, radius);
+    std::vector<unsigned char> fast = Read(target->GetTexture());
+    TEST_CHECK(fast == expected);
+
+    // and near the cosine kernel of the shader it stands in for, which is flatter than a gaussian
+    // so the two part most at the hard block edges
+    renderer.SetExactBlur(true);
+    r->Blur(target, temp, &mvp.m00, src, radius);
+    std::vector<unsigned char> exact = Read(target->GetTexture());
+    BlurError error = CompareBlur(&fast[0], &exact[0], TEXTURE_WIDTH, TEXTURE_HEIGHT, rowBytes);
+    if (!TEST_CHECK(error.maxError <= 24.0f && error.rmsError <= 5.0f))
+    {
+        printf("blur radius %d: max error %.1f rms %.3f against the shader kernel\n", radius, error.maxError, error.rmsError);
+    }
+
+    delete temp;
+    delete target;
+    delete src;
+}
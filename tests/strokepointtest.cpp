@@ -0,0 +1,79 @@
+#include "test.h"
+#include "strokepoint.h"
+#include <vector>
+#include <stddef.h>
+#include <math.h>
+
+static unsigned int sSeed = 1;
+
+static float Random()
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return ((sSeed >> 8) & 0xFFFF) / 65535.0f;
+}
+
+static bool Equal(const std::vector<StrokePoint>& a, const std::vector<StrokePoint>& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].pressure != b[i].pressure)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RunSmoothingTest()
+{
+    // magnitudes far apart, so the double sums round and a different order of them shows in the last bits
+    std::vector<StrokePoint> stroke;
+    for (int i = 0; i < 400; ++i)
+    {
+        StrokePoint p;
+        p.x = ldexpf(Random() - 0.5f, (int)(Random() * 40.0f) - 20);
+        p.y = ldexpf(Random() - 0.5f, (int)(Random() * 40.0f) - 20);
+        p.pressure = Random();
+        stroke.push_back(p);
+    }
+
+    static const int radii[] = { 0, 1, 2, 5, 20 };
+    static const int lengths[] = { 0, 1, 2, 3, 4, 7, 30, 400 };
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r)
+    {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l)
+        {
+            int n = lengths[l];
+            std::vector<StrokePoint> expected(stroke.begin(), stroke.begin() + n);
+            StrokePoint::Smooth(expected, radii[r]);
+
+            // every split between pushed samples and the rest handed to Finish
+            for (int pushed = 0; pushed <= n; ++pushed)
+            {
+                StrokeSmoother smoother;
+                smoother.Reset(radii[r]);
+                std::vector<StrokePoint> out;
+                for (int i = 0; i < pushed; ++i)
+                {
+                    smoother.Push(stroke[i], out);
+                }
+                TEST_CHECK((int)out.size() <= pushed);
+                std::vector<StrokePoint> finished = out;
+                smoother.Finish(n > pushed ? &stroke[pushed] : NULL, n - pushed, finished);
+                TEST_CHECK(Equal(finished, expected));
+
+                // Finish leaves the smoother as it was, pushing on gives the same stroke
+                for (int i = pushed; i < n; ++i)
+                {
+                    smoother.Push(stroke[i], out);
+                }
+                smoother.Finish(NULL, 0, out);
+                TEST_CHECK(Equal(out, expected));
+            }
+        }
+    }
+}
@@ -0,0 +1,216 @@
+#include "test.h"
+#include "strokerasterizer.h"
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define CLIP_SIZE 64
+
+// Coverage of a canvas pixel, 0 outside the rasterized rect
+static int GetCoverage(const QImage& mask, const QRect& rect, int x, int y)
+{
+    if (x < rect.left() || x > rect.right() || y < rect.top() || y > rect.bottom())
+    {
+        return 0;
+    }
+    return mask.constScanLine(y - rect.top())[x - rect.left()];
+}
+
+static double GetCoveredArea(const QImage& mask, const QRect& rect)
+{
+    double area = 0;
+    for (int y = 0; y < rect.height(); ++y)
+    {
+        const uchar* row = mask.constScanLine(y);
+        for (int x = 0; x < rect.width(); ++x)
+        {
+            area += row[x] / 255.0;
+        }
+    }
+    return area;
+}
+
+// Area of the polygon inside the pixel at x, y, the polygon clipped to each side of the pixel in turn
+static double GetPixelArea(const QPointF* polygon, int count, int x, int y)
+{
+    std::vector<QPointF> points(polygon, polygon + count);
+    for (int side = 0; side < 4 && !points.empty(); ++side)
+    {
+        std::vector<QPointF> clipped;
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            const QPointF& a = points[i];
+            const QPointF& b = points[(i + 1) % points.size()];
+            // distance inside the side, positive within the pixel
+            double da = side == 0 ? a.x() - x : side == 1 ? x + 1 - a.x() : side == 2 ? a.y() - y : y + 1 - a.y();
+            double db = side == 0 ? b.x() - x : side == 1 ? x + 1 - b.x() : side == 2 ? b.y() - y : y + 1 - b.y();
+            if (da >= 0)
+            {
+                clipped.push_back(a);
+            }
+            if ((da >= 0) != (db >= 0))
+            {
+                double t = da / (da - db);
+                clipped.push_back(QPointF(a.x() + (b.x() - a.x()) * t, a.y() + (b.y() - a.y()) * t));
+            }
+        }
+        points.swap(clipped);
+    }
+
+    double area = 0;
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const QPointF& a = points[i];
+        const QPointF& b = points[(i + 1) % points.size()];
+        area += a.x() * b.y() - b.x() * a.y();
+    }
+    return fabs(area) * 0.5;
+}
+
+static void AddRect(StrokeRasterizer& rasterizer, double x0, double y0, double x1, double y1, bool reversed)
+{
+    QPointF points[4] = { QPointF(x0, y0), QPointF(x1, y0), QPointF(x1, y1), QPointF(x0, y1) };
+    if (reversed)
+    {
+        QPointF t = points[1];
+        points[1] = points[3];
+        points[3] = t;
+    }
+    rasterizer.AddPolygon(points, 4);
+}
+
+// Pixels of the rect x0..x1 * y0..y1 are expected at inside, the rest of the clip at 0
+static bool CheckRect(const QImage& mask, const QRect& rect, int x0, int y0, int x1, int y1, int inside)
+{
+    bool ok = true;
+    for (int y = 0; y < CLIP_SIZE && ok; ++y)
+    {
+        for (int x = 0; x < CLIP_SIZE && ok; ++x)
+        {
+            int expected = x >= x0 && x < x1 && y >= y0 && y < y1 ? inside : 0;
+            int coverage = GetCoverage(mask, rect, x, y);
+            if (!TEST_CHECK(coverage == expected))
+            {
+                printf("pixel %d,%d coverage %d, expected %d\n", x, y, coverage, expected);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+void RunRasterizerTest()
+{
+    QRect clip(0, 0, CLIP_SIZE, CLIP_SIZE);
+    StrokeRasterizer rasterizer;
+    QRect rect;
+
+    // nothing added covers nothing
+    TEST_CHECK(rasterizer.Rasterize(clip, rect).isNull());
+    TEST_CHECK(rect.isEmpty());
+
+    // a rect on pixel edges covers its pixels fully and nothing else, either orientation
+    for (int reversed = 0; reversed < 2; ++reversed)
+    {
+        rasterizer.Clear();
+        AddRect(rasterizer, 5, 7, 21, 30, reversed != 0);
+        QImage mask = rasterizer.Rasterize(clip, rect);
+        TEST_CHECK(mask.format() == QImage::Format_Alpha8);
+        TEST_CHECK(rect == QRect(5, 7, 16, 23));
+        CheckRect(mask, rect, 5, 7, 21, 30, 0xFF);
+    }
+
+    // edges on pixel centres cover the pixels they cross by half
+    rasterizer.Clear();
+    AddRect(rasterizer, 4.5, 10, 12.5, 20, false);
+    {
+        QImage mask = rasterizer.Rasterize(clip, rect);
+        for (int y = 10; y < 20; ++y)
+        {
+            TEST_CHECK(GetCoverage(mask, rect, 4, y) == 128);
+            TEST_CHECK(GetCoverage(mask, rect, 12, y) == 128);
+            for (int x = 5; x < 12; ++x)
+            {
+                TEST_CHECK(GetCoverage(mask, rect, x, y) == 0xFF);
+            }
+        }
+        TEST_CHECK(fabs(GetCoveredArea(mask, rect) - 80.0) < 0.1);
+    }
+
+    // overlapping pieces clamp to full coverage instead of adding up or cancelling
+    rasterizer.Clear();
+    AddRect(rasterizer, 8, 8, 24, 24, false);
+    AddRect(rasterizer, 16, 16, 32, 32, true);
+    AddRect(rasterizer, 8, 8, 24, 24, false);
+    {
+        QImage mask = rasterizer.Rasterize(clip, rect);
+        bool ok = true;
+        for (int y = 0; y < CLIP_SIZE && ok; ++y)
+        {
+            for (int x = 0; x < CLIP_SIZE && ok; ++x)
+            {
+                bool inside = (x >= 8 && x < 24 && y >= 8 && y < 24) || (x >= 16 && x < 32 && y >= 16 && y < 32);
+                ok = TEST_CHECK(GetCoverage(mask, rect, x, y) == (inside ? 0xFF : 0));
+            }
+        }
+    }
+
+    // a polygon larger than the clip fills all of it, edges outside fold onto the border
+    rasterizer.Clear();
+    AddRect(rasterizer, -100, -40, 300, 200, false);
+    {
+        QImage mask = rasterizer.Rasterize(clip, rect);
+        TEST_CHECK(rect == clip);
+        CheckRect(mask, rect, 0, 0, CLIP_SIZE, CLIP_SIZE, 0xFF);
+    }
+
+    // slanted edges, the summed coverage is the area of the polygon
+    rasterizer.Clear();
+    QPointF triangle[3] = { QPointF(3.3, 2.7), QPointF(58.1, 17.4), QPointF(21.6, 61.2) };
+    rasterizer.AddPolygon(triangle, 3);
+    {
+        QImage mask = rasterizer.Rasterize(clip, rect);
+        double area = 0.5 * fabs((58.1 - 3.3) * (61.2 - 2.7) - (21.6 - 3.3) * (17.4 - 2.7));
+        double covered = GetCoveredArea(mask, rect);
+        if (!TEST_CHECK(fabs(covered - area) < area * 0.002))
+        {
+            printf("triangle covers %f, area %f\n", covered, area);
+        }
+
+        // every pixel, also those the edges cross, is covered by the area of the triangle within it
+        bool ok = true;
+        for (int y = 0; y < CLIP_SIZE && ok; ++y)
+        {
+            for (int x = 0; x < CLIP_SIZE && ok; ++x)
+            {
+                double expected = GetPixelArea(triangle, 3, x, y) * 255.0;
+                int coverage = GetCoverage(mask, rect, x, y);
+                if (!TEST_CHECK(fabs(coverage - expected) <= 1.0))
+                {
+                    printf("pixel %d,%d coverage %d, expected %.2f\n", x, y, coverage, expected);
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    // a circle within the flattening tolerance of its area, clipped to the quarter inside the clip
+    rasterizer.Clear();
+    rasterizer.AddCircle(QPointF(CLIP_SIZE, CLIP_SIZE), 40.0f);
+    {
+        QImage mask = rasterizer.Rasterize(clip, rect);
+        TEST_CHECK(rect.right() == CLIP_SIZE - 1 && rect.bottom() == CLIP_SIZE - 1);
+        double area = 3.14159265 * 40.0 * 40.0 / 4;
+        double covered = GetCoveredArea(mask, rect);
+        if (!TEST_CHECK(fabs(covered - area) < area * 0.005))
+        {
+            printf("circle covers %f, area %f\n", covered, area);
+        }
+    }
+
+    // a clip the outline misses entirely
+    rasterizer.Clear();
+    AddRect(rasterizer, 100, 100, 120, 120, false);
+    TEST_CHECK(rasterizer.Rasterize(clip, rect).isNull());
+    TEST_CHECK(rect.isEmpty());
+}
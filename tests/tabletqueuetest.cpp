@@ -0,0 +1,183 @@
+#include "test.h"
+#include "tabletqueue.h"
+#include "canvastool.h"
+#include <QThread>
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+// Samples the producer thread pushes while the test pops them
+#define THREADED_SAMPLES 200000
+
+static TabletSample MakeSample(int index, TabletSampleType type)
+{
+    TabletSample sample;
+    sample.type = type;
+    sample.x = (float)index;
+    sample.y = index * 0.5f;
+    sample.pressure = (index % 100) / 100.0f;
+    sample.xTilt = index % 60;
+    sample.yTilt = -(index % 60);
+    sample.timestamp = (unsigned long)index;
+    return sample;
+}
+
+static bool IsSample(const TabletSample& sample, int index)
+{
+    return sample.x == (float)index && sample.y == index * 0.5f && sample.timestamp == (unsigned long)index;
+}
+
+// Keeps what Drain hands to the tool, one letter per call
+class RecordingTool : public CanvasTool
+{
+public:
+    virtual void OnDragBegin(int, int, float) {}
+    virtual void OnDrag(int, int, float) {}
+    virtual void OnDragEnd(int, int, float) {}
+    virtual void OnPaint(QPainter&) {}
+
+    virtual void OnDragSamples(const TabletSample* samples, int count)
+    {
+        mCalls += 'm';
+        for (int i = 0; i < count; ++i)
+        {
+            mMoves.push_back((int)samples[i].timestamp);
+        }
+    }
+    virtual void OnSampleBegin(const TabletSample&) { mCalls += 'b'; }
+    virtual void OnSampleEnd(const TabletSample&) { mCalls += 'e'; }
+
+    std::string mCalls;
+    std::vector<int> mMoves;
+};
+
+class ProducerThread : public QThread
+{
+public:
+    ProducerThread(TabletQueue* queue)
+        :mQueue(queue)
+    {
+    }
+
+protected:
+    virtual void run()
+    {
+        for (int i = 0; i < THREADED_SAMPLES; ++i)
+        {
+            TabletSample sample = MakeSample(i, TabletSampleMove);
+            while (!mQueue->Push(sample))
+            {
+                yieldCurrentThread();
+            }
+        }
+    }
+
+private:
+    TabletQueue* mQueue;
+};
+
+void RunTabletQueueTest()
+{
+    TabletQueue* queue = new TabletQueue();
+    TabletSample sample;
+    TEST_CHECK(queue->IsEmpty());
+    TEST_CHECK(!queue->Pop(sample));
+
+    // filled up and partly emptied from many offsets, the positions wrap past twice the size many times
+    int next = 0;
+    int popped = 0;
+    for (int round = 0; round < 9; ++round)
+    {
+        int space = TABLET_QUEUE_SIZE - (next - popped);
+        int pushed = 0;
+        while (pushed <= TABLET_QUEUE_SIZE && queue->Push(MakeSample(next + pushed, TabletSampleMove)))
+        {
+            ++pushed;
+        }
+        if (!TEST_CHECK(pushed == space))
+        {
+            printf("round %d took %d samples, %d were free\n", round, pushed, space);
+        }
+        TEST_CHECK(!queue->IsEmpty());
+        next += pushed;
+
+        // a part is popped so the next round starts at another offset
+        int count = round % 2 == 0 ? TABLET_QUEUE_SIZE : 1 + round * 97;
+        for (int i = 0; i < count; ++i)
+        {
+            TEST_CHECK(queue->Pop(sample) && IsSample(sample, popped));
+            ++popped;
+        }
+        TEST_CHECK(queue->IsEmpty() == (popped == next));
+    }
+    while (queue->Pop(sample))
+    {
+        TEST_CHECK(IsSample(sample, popped));
+        ++popped;
+    }
+    TEST_CHECK(popped == next);
+    TEST_CHECK(queue->IsEmpty());
+
+    // one in, one out keeps the queue near empty across the wrap
+    for (int i = 0; i < TABLET_QUEUE_SIZE * 5; ++i)
+    {
+        TEST_CHECK(queue->Push(MakeSample(i, TabletSampleMove)));
+        TEST_CHECK(queue->Pop(sample) && IsSample(sample, i));
+        TEST_CHECK(queue->IsEmpty());
+    }
+
+    // moves between a press and a release come in one batch
+    RecordingTool tool;
+    int index = 0;
+    queue->Push(MakeSample(index++, TabletSamplePress));
+    for (int i = 0; i < 5; ++i)
+    {
+        queue->Push(MakeSample(index++, TabletSampleMove));
+    }
+    queue->Push(MakeSample(index++, TabletSampleRelease));
+    queue->Push(MakeSample(index++, TabletSamplePress));
+    queue->Push(MakeSample(index++, TabletSampleMove));
+    queue->Push(MakeSample(index++, TabletSampleMove));
+    queue->Drain(&tool);
+    TEST_CHECK(tool.mCalls == "bmebm");
+    TEST_CHECK(tool.mMoves.size() == 7);
+    for (size_t i = 0; i < tool.mMoves.size(); ++i)
+    {
+        TEST_CHECK(tool.mMoves[i] == (int)(i < 5 ? i + 1 : i + 3));
+    }
+    TEST_CHECK(queue->IsEmpty());
+
+    // without a tool the samples are dropped
+    queue->Push(MakeSample(0, TabletSamplePress));
+    queue->Drain(NULL);
+    TEST_CHECK(queue->IsEmpty());
+
+    // a producer thread against this one, every sample arrives once and in order
+    ProducerThread producer(queue);
+    producer.start();
+    int received = 0;
+    bool inOrder = true;
+    while (received < THREADED_SAMPLES)
+    {
+        if (!queue->Pop(sample))
+        {
+            // a queue which lost samples would never hand over the rest
+            if (producer.isFinished() && queue->IsEmpty())
+            {
+                break;
+            }
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        if (inOrder && !TEST_CHECK(IsSample(sample, received)))
+        {
+            printf("sample %d arrived as %lu\n", received, sample.timestamp);
+            inOrder = false;
+        }
+        ++received;
+    }
+    producer.wait();
+    TEST_CHECK(received == THREADED_SAMPLES);
+    TEST_CHECK(queue->IsEmpty());
+    delete queue;
+}
@@ -0,0 +1,20 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Counts a failed condition and prints where it is, the test goes on with the next check
+#define TEST_CHECK(condition) CheckCondition((condition), #condition, __FILE__, __LINE__)
+
+bool CheckCondition(bool condition, const char* text, const char* file, int line);
+
+// Each test checks with TEST_CHECK and prints only what failed
+void RunRecordingTest();
+void RunReplayTest();
+void RunSmoothingTest();
+void RunBlurTest();
+void RunPixelKernelsTest();
+void RunRendererTest();
+void RunRasterizerTest();
+void RunTabletQueueTest();
+void RunUndoTest();
+
+#endif // TEST_H
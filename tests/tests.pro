@@ -0,0 +1,38 @@
+#-------------------------------------------------
+#
+# Behaviour checks of the drawing code, run as
+# tests [name...] or make check, exits with 1
+# when a check failed
+#
+#-------------------------------------------------
+
+QT       += core gui xml opengl
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = tests
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+DEFINES += GLEW_STATIC \
+    REPLAY_CORPUS=\\\"$$PWD/../replay/corpus\\\"
+
+win32: LIBS += -lpsapi
+
+SOURCES += main.cpp \
+    recordingtest.cpp \
+    strokepointtest.cpp \
+    blurtest.cpp \
+    pixelkernelstest.cpp \
+    renderertest.cpp \
+    strokerasterizertest.cpp \
+    tabletqueuetest.cpp \
+    undotest.cpp \
+    ../replay/replayer.cpp \
+    ../replay/allocations.cpp
+
+HEADERS  += test.h \
+    ../replay/replay.h
+
+include(../animbuilder.pri)
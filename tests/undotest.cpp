@@ -0,0 +1,273 @@
+#include "test.h"
+#include "headlesscanvas.h"
+#include "brushtool.h"
+#include "command.h"
+#include "undohistory.h"
+#include <QUndoStack>
+#include <QElapsedTimer>
+#include <QThread>
+#include <vector>
+#include <stdio.h>
+
+#define CANVAS_WIDTH 300
+#define CANVAS_HEIGHT 200
+// Brush strokes of the replay test, enough for the chain to take a few snapshots
+#define STROKE_COUNT 40
+
+static unsigned int sSeed = 1;
+
+static int Random(int range)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (int)((sSeed >> 8) & 0xFFFF) % range;
+}
+
+static void FillRandom(QImage* image, const QRect& rect)
+{
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
+    {
+        uchar* row = image->scanLine(y);
+        for (int x = rect.left() * 4; x < (rect.right() + 1) * 4; ++x)
+        {
+            row[x] = (uchar)Random(256);
+        }
+    }
+}
+
+// Waits for the history worker to bring memory within budget, false if it did not in time
+static bool WaitForSpill(UndoHistory* history, qint64 usage)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (history->GetMemoryUsage() > usage)
+    {
+        if (timer.elapsed() > 10000)
+        {
+            return false;
+        }
+        QThread::msleep(1);
+    }
+    return true;
+}
+
+// Tile records: undo gives back the image before each edit, redo the one after it
+static void CheckDrawCommand(bool spill)
+{
+    HeadlessCanvas canvas(CANVAS_WIDTH, CANVAS_HEIGHT);
+    QUndoStack undoStack;
+    QImage* image = canvas.GetImage();
+    FillRandom(image, image->rect());
+    canvas.GetFrame()->UpdateBounds(image->rect());
+
+    std::vector<QImage> states;
+    states.push_back(image->copy());
+    for (int i = 0; i < 12; ++i)
+    {
+        // rects across tile edges, some reaching out of the image, some changing only a part
+        QRect rect(Random(CANVAS_WIDTH) - 20, Random(CANVAS_HEIGHT) - 20, 1 + Random(150), 1 + Random(120));
+        DrawCommand* command = new DrawCommand(&canvas, rect);
+        QRect changed = rect.intersected(image->rect());
+        if (i % 3 == 2)
+        {
+            changed.setHeight((changed.height() + 1) / 2);
+        }
+        FillRandom(image, changed);
+        canvas.GetFrame()->UpdateBounds(changed);
+        command->Finish();
+        undoStack.push(command);
+        states.push_back(image->copy());
+    }
+
+    if (spill)
+    {
+        canvas.GetUndoHistory()->SetMemoryBudget(1);
+        TEST_CHECK(WaitForSpill(canvas.GetUndoHistory(), 0));
+        TEST_CHECK(canvas.GetUndoHistory()->GetDiskUsage() > 0);
+    }
+
+    for (int i = (int)states.size() - 2; i >= 0; --i)
+    {
+        undoStack.undo();
+        if (!TEST_CHECK(*image == states[i]))
+        {
+            printf("undo to state %d differs%s\n", i, spill ? ", spilled" : "");
+            break;
+        }
+    }
+    for (size_t i = 1; i < states.size(); ++i)
+    {
+        undoStack.redo();
+        if (!TEST_CHECK(*image == states[i]))
+        {
+            printf("redo to state %d differs%s\n", (int)i, spill ? ", spilled" : "");
+            break;
+        }
+    }
+}
+
+static void DrawStroke(BrushTool& brush)
+{
+    int x = Random(CANVAS_WIDTH);
+    int y = Random(CANVAS_HEIGHT);
+    brush.OnDragBegin(x, y, 0.5f);
+    int count = 2 + Random(20);
+    for (int i = 0; i < count; ++i)
+    {
+        x += Random(31) - 15;
+        y += Random(31) - 15;
+        brush.OnDrag(x, y, 0.2f + Random(80) / 100.0f);
+    }
+    brush.OnDragEnd(x, y, 0.3f);
+}
+
+// Replayed records: undo restores a snapshot and draws the strokes after it, which must give the same pixels
+static void CheckReplayCommand()
+{
+    HeadlessCanvas canvas(CANVAS_WIDTH, CANVAS_HEIGHT);
+    QUndoStack undoStack;
+    BrushTool brush(&canvas, &undoStack);
+    QImage* image = canvas.GetImage();
+
+    std::vector<QImage> states;
+    states.push_back(image->copy());
+    for (int i = 0; i < STROKE_COUNT; ++i)
+    {
+        brush.SetTip((BrushTip)(i % 4));
+        brush.SetBrushSize(2.0f + Random(30));
+        brush.SetSmooth(Random(4));
+        brush.SetColor(QColor(Random(256), Random(256), Random(256), 64 + Random(192)));
+        brush.SetMode(i % 7 == 6 ? QPainter::CompositionMode_Clear : QPainter::CompositionMode_SourceOver);
+        DrawStroke(brush);
+        states.push_back(image->copy());
+    }
+    TEST_CHECK(undoStack.count() == STROKE_COUNT);
+
+    for (int i = STROKE_COUNT - 1; i >= 0; --i)
+    {
+        undoStack.undo();
+        if (!TEST_CHECK(*image == states[i]))
+        {
+            printf("undo to stroke %d differs\n", i);
+            break;
+        }
+    }
+    for (int i = 1; i <= STROKE_COUNT; ++i)
+    {
+        undoStack.redo();
+        if (!TEST_CHECK(*image == states[i]))
+        {
+            printf("redo to stroke %d differs\n", i);
+            break;
+        }
+    }
+
+    // a stroke drawn after some undos drops the undone ones, the rest still undo
+    int kept = STROKE_COUNT / 2 + 3;
+    for (int i = STROKE_COUNT; i > kept; --i)
+    {
+        undoStack.undo();
+    }
+    TEST_CHECK(*image == states[kept]);
+    brush.SetMode(QPainter::CompositionMode_SourceOver);
+    DrawStroke(brush);
+    QImage branched = image->copy();
+    TEST_CHECK(undoStack.count() == kept + 1);
+    for (int i = kept; i >= 0; --i)
+    {
+        undoStack.undo();
+        if (!TEST_CHECK(*image == states[i]))
+        {
+            printf("undo after the branch to stroke %d differs\n", i);
+            break;
+        }
+    }
+    for (int i = 0; i <= kept; ++i)
+    {
+        undoStack.redo();
+    }
+    TEST_CHECK(*image == branched);
+
+    // an edit by something else than the chain starts a new one, undo goes back across both
+    DrawCommand* command = new DrawCommand(&canvas, image->rect());
+    FillRandom(image, QRect(10, 10, 40, 40));
+    command->Finish();
+    undoStack.push(command);
+    QImage edited = image->copy();
+    DrawStroke(brush);
+    QImage last = image->copy();
+    undoStack.undo();
+    TEST_CHECK(*image == edited);
+    undoStack.undo();
+    TEST_CHECK(*image == branched);
+    undoStack.redo();
+    undoStack.redo();
+    TEST_CHECK(*image == last);
+}
+
+// Records come back as stored from memory, compressed and spilled, also after the file is compacted
+static void CheckUndoHistory()
+{
+    UndoHistory history;
+    std::vector<QByteArray> data;
+    std::vector<int> ids;
+    for (int i = 0; i < 64; ++i)
+    {
+        // half random, half runs, so some records compress and some do not
+        QByteArray record(1000 + Random(20000), 0);
+        for (int j = 0; j < record.size(); ++j)
+        {
+            record[j] = (char)(i % 2 == 0 ? Random(256) : j / 100);
+        }
+        data.push_back(record);
+        ids.push_back(history.Store(record));
+    }
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        TEST_CHECK(history.Load(ids[i]) == data[i]);
+    }
+
+    history.SetMemoryBudget(1);
+    TEST_CHECK(WaitForSpill(&history, 0));
+    TEST_CHECK(history.GetDiskUsage() > 0);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        TEST_CHECK(history.Load(ids[i]) == data[i]);
+    }
+
+    // most of the file dead, the next trim compacts it
+    qint64 disk = history.GetDiskUsage();
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i % 4 != 0)
+        {
+            history.Remove(ids[i]);
+        }
+    }
+    ids.push_back(history.Store(data[1]));
+    data.push_back(data[1]);
+    TEST_CHECK(WaitForSpill(&history, 0));
+    QElapsedTimer timer;
+    timer.start();
+    while (history.GetDiskUsage() >= disk && timer.elapsed() < 10000)
+    {
+        QThread::msleep(1);
+    }
+    TEST_CHECK(history.GetDiskUsage() < disk);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i % 4 == 0 || i + 1 == ids.size())
+        {
+            TEST_CHECK(history.Load(ids[i]) == data[i]);
+        }
+    }
+    TEST_CHECK(history.Load(ids[1]).isEmpty());
+}
+
+void RunUndoTest()
+{
+    sSeed = 1;
+    CheckDrawCommand(false);
+    CheckDrawCommand(true);
+    CheckReplayCommand();
+    CheckUndoHistory();
+}
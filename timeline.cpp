@@ -6,12 +6,19 @@
 #include <QScrollBar>
 #include "rasterlayer.h"
 #include "tracelayer.h"
+#include "blurlayer.h"
+#include "transformlayer.h"
+#include "scenelayer.h"
 #include "soundlayer.h"
 #include "timelinenavbar.h"
 #include "rasterimageeditor.h"
 #include <QScrollArea>
 #include <QtWidgets>
 #include "animationfile.h"
+#include "playbackcache.h"
+#include "playbackclock.h"
+#include "onionskin.h"
+#include "mippyramid.h"
 
 Timeline::Timeline(QWidget *parent) :
     QWidget(parent),
@@ -21,8 +28,17 @@ Timeline::Timeline(QWidget *parent) :
     mLayerIndex(-1),
     mMaxFrames(0),
     mCellSize(8, 16),
+    mUndoStack(NULL),
     mOffset(0),
-    mCompositeImage(NULL)
+    mCompositeImage(NULL),
+    mCompositeMips(new MipPyramid()),
+    mPlaybackCache(new PlaybackCache()),
+    mPlaybackClock(new PlaybackClock()),
+    mOnionSkin(new OnionSkin()),
+    mPlaybackTick(0),
+    mPresentedTick(0),
+    mPlaying(false),
+    mPrimed(false)
 {
 //    QVBoxLayout* l = new QVBoxLayout;
 //    l->setSpacing(2);
@@ -117,7 +133,11 @@ Timeline::Timeline(QWidget *parent) :
 
 Timeline::~Timeline()
 {
+    delete mPlaybackCache;
+    delete mPlaybackClock;
+    delete mOnionSkin;
     delete mCompositeImage;
+    delete mCompositeMips;
 }
 
 void Timeline::mousePressEvent(QMouseEvent *)
@@ -172,7 +192,9 @@ void Timeline::SetScene(SceneModel* scene)
     }
     mLayers.clear();
 
+    StopPlayback();
     mScene = scene;
+    mPlaybackCache->SetScene(scene);
     if (mScene)
     {
         for (size_t i = 0; i < mScene->GetLayers().size(); ++i)
@@ -186,6 +208,7 @@ void Timeline::SetScene(SceneModel* scene)
                         {
                             RasterLayerModel* rlm = (RasterLayerModel*)layerModel;
                             RasterLayer* layer = new RasterLayer(this, rlm);
+                            layer->SetUndoStack(mUndoStack);
                             mLayers.push_back(layer);
                         }
                         break;
@@ -196,11 +219,35 @@ void Timeline::SetScene(SceneModel* scene)
                             mLayers.push_back(layer);
                         }
                         break;
+                    case LayerModel::LayerTypeBlur:
+                        {
+                            BlurLayerModel* lm = (BlurLayerModel*)layerModel;
+                            BlurLayer* layer = new BlurLayer(this, lm);
+                            mLayers.push_back(layer);
+                        }
+                        break;
+                    case LayerModel::LayerTypeTransform:
+                        {
+                            TransformLayerModel* lm = (TransformLayerModel*)layerModel;
+                            TransformLayer* layer = new TransformLayer(this, lm);
+                            mLayers.push_back(layer);
+                        }
+                        break;
+                    case LayerModel::LayerTypeScene:
+                        {
+                            SceneLayerModel* lm = (SceneLayerModel*)layerModel;
+                            SceneLayer* layer = new SceneLayer(this, lm);
+                            mLayers.push_back(layer);
+                        }
+                        break;
                 }
             }
         }
         delete mCompositeImage;
         mCompositeImage = new QImage(scene->GetWidth(), scene->GetHeight(), QImage::Format_RGBA8888);
+        mCompositeImage->fill(0);
+        mCompositeBounds = QRect();
+        *mCompositeMips = MipPyramid();
     }
 
     UpdateLayersUi();
@@ -269,6 +316,7 @@ void Timeline::AddRasterLayer(int index)
         it += index;
         mLayers.insert(it, layer);
         UpdateLayersUi();
+        InvalidateCache();
     }
 }
 
@@ -301,6 +349,90 @@ void Timeline::AddTraceLayer(int index)
     }
 }
 
+void Timeline::AddBlurLayer(int index)
+{
+    if (!mScene)
+    {
+        return;
+    }
+
+    if (index < 0 || index > mLayers.size())
+    {
+        index = mLayers.size();
+    }
+
+    QString name;
+    name.sprintf("layer%d", mLayers.size());
+    BlurLayerModel* layerModel = mScene->AddBlurLayer(index, name, 8);
+    if (layerModel)
+    {
+        BlurLayer* layer = new BlurLayer(this, layerModel);
+
+        std::vector<Layer*>::iterator it = mLayers.begin();
+        it += index;
+        mLayers.insert(it, layer);
+        UpdateLayersUi();
+        InvalidateCache();
+        mEditor->update();
+    }
+}
+
+void Timeline::AddTransformLayer(int index)
+{
+    if (!mScene)
+    {
+        return;
+    }
+
+    if (index < 0 || index > mLayers.size())
+    {
+        index = mLayers.size();
+    }
+
+    QString name;
+    name.sprintf("layer%d", mLayers.size());
+    TransformLayerModel* layerModel = mScene->AddTransformLayer(index, name);
+    if (layerModel)
+    {
+        TransformLayer* layer = new TransformLayer(this, layerModel);
+
+        std::vector<Layer*>::iterator it = mLayers.begin();
+        it += index;
+        mLayers.insert(it, layer);
+        UpdateLayersUi();
+        InvalidateCache();
+        mEditor->update();
+    }
+}
+
+void Timeline::AddSceneLayer(SceneModel* scene, int index)
+{
+    if (!mScene || !scene || scene == mScene)
+    {
+        return;
+    }
+
+    if (index < 0 || index > mLayers.size())
+    {
+        index = mLayers.size();
+    }
+
+    QString name;
+    name.sprintf("layer%d", mLayers.size());
+    SceneLayerModel* layerModel = mScene->AddSceneLayer(index, name, scene);
+    if (layerModel)
+    {
+        SceneLayer* layer = new SceneLayer(this, layerModel);
+
+        std::vector<Layer*>::iterator it = mLayers.begin();
+        it += index;
+        mLayers.insert(it, layer);
+        UpdateLayersUi();
+        UpdateMaxFrames();
+        mEditor->update();
+    }
+}
+
 void Timeline::AddSoundLayer(int index)
 {
 //    if (index < 0 || index > mLayers.size())
@@ -329,9 +461,15 @@ void Timeline::RemoveLayer(int index)
     it += index;
     Layer* l = *it;
     mLayers.erase(it);
+    // commands may hold the layer or its frames
+    if (mUndoStack)
+    {
+        mUndoStack->clear();
+    }
     delete l;
     mScene->RemoveLayer(index);
     UpdateLayersUi();
+    InvalidateCache();
 }
 
 void Timeline::MoveLayer(int modIndex)
@@ -381,6 +519,7 @@ void Timeline::MoveLayer(int modIndex)
     mLayerIndex = newIndex;
 
     UpdateLayersUi();
+    InvalidateCache();
     mEditor->update();
 }
 
@@ -398,6 +537,14 @@ void Timeline::SetFrameIndex(int value)
     if (value != mFrameIndex)
     {
         mFrameIndex = value;
+        if (mPlaying)
+        {
+            mPlaybackCache->SetPlayhead(value);
+        }
+        for (size_t i = 0; i < mLayers.size(); ++i)
+        {
+            mLayers[i]->OnFrameChanged(value);
+        }
         UpdateCanvas();
     }
 }
@@ -482,48 +629,110 @@ void Timeline::ExportFrames(const QString& path)
 
 void Timeline::UpdateCanvas()
 {
-    std::vector<QImage*> layerImages;
-    std::vector<QImage*> onions;
-    QImage* editImage = NULL;
+    RasterFrameModel* editFrame = NULL;
 
-    for (size_t i = 0; i < mLayers.size(); ++i)
+    Layer* layer = GetLayerAt(mLayerIndex);
+    if (layer && layer->IsEnabled() && layer->GetType() == LayerTypeRaster)
     {
-        if (!mLayers[i]->IsEnabled())
+        editFrame = ((RasterLayer*)layer)->GetFrameAt(mFrameIndex);
+    }
+    mEditor->Load(editFrame);
+    update();
+}
+
+// Draws bounds, in full resolution pixels, of an image at mip level
+static void DrawLevel(QPainter& painter, const QImage& image, int level, const QRect& bounds)
+{
+    if (bounds.isEmpty())
+    {
+        return;
+    }
+    if (level == 0)
+    {
+        painter.drawImage(bounds.topLeft(), image, bounds);
+        return;
+    }
+
+    QRect src = MipPyramid::ScaleRect(bounds, level);
+    int s = 1 << level;
+    QRectF target(src.x() * s, src.y() * s, src.width() * s, src.height() * s);
+    painter.drawImage(target, image, QRectF(src));
+}
+
+// Draws the visible part of the bounds of frame from the mip level closest above the view scale
+static void DrawFrame(QPainter& painter, RasterFrameModel* frame, int level, const QRect& visible)
+{
+    QRect bounds = frame->GetBounds().intersected(visible);
+    if (bounds.isEmpty())
+    {
+        return;
+    }
+    const QImage* image = frame->GetMipLevel(level);
+    DrawLevel(painter, *image, level, bounds);
+}
+
+void Timeline::Render(QPainter& painter)
+{
+    // trace markers may lie outside the image
+    QRect view = mEditor->GetVisibleRect();
+    QRect visible = view;
+    if (mScene)
+    {
+        visible = visible.intersected(QRect(0, 0, mScene->GetWidth(), mScene->GetHeight()));
+    }
+
+    int level = MipPyramid::GetLevelForScale(mEditor->GetScale());
+    QImage cachedImage;
+    QRect cachedBounds;
+    int cachedLevel = 0;
+    mPlaybackCache->SetLevel(level);
+    if (mPlaying && mPlaybackCache->GetFrame(mFrameIndex, cachedImage, cachedBounds, cachedLevel))
+    {
+        DrawLevel(painter, cachedImage, cachedLevel, cachedBounds.intersected(visible));
+        if (mPresentedTick != mPlaybackTick)
         {
-            continue;
+            mPresentedTick = mPlaybackTick;
+            mPlaybackClock->OnPresented(mPlaybackTick);
         }
-        QImage* img = mLayers[i]->GetImage(mFrameIndex);
-        if (img)
+        for (size_t i = 0; i < mLayers.size(); ++i)
         {
-            if (mLayerIndex == i)
+            Layer* layer = mLayers[i];
+            if (layer->IsEnabled() && layer->GetType() == LayerTypeTrace)
             {
-                if (mLayers[i]->GetType() == LayerTypeRaster)
-                {
-                    RasterLayer* l = (RasterLayer*)mLayers[i];
-                    QImage* prev = l->GetImage(l->GetPrevImageIndex(mFrameIndex));
-                    if(prev && prev != img)
-                    {
-                        onions.push_back(prev);
-                    }
-                    QImage* next = l->GetImage(l->GetNextImageIndex(mFrameIndex));
-                    if(next && next != img)
-                    {
-                        onions.push_back(next);
-                    }
-                }
-
-                editImage = img;
+                ((TraceLayer*)layer)->Render(painter, view);
             }
-            layerImages.push_back(img);
         }
+        return;
     }
-    mEditor->Load(editImage);
-    update();
-}
 
-void Timeline::Render(QPainter& painter)
-{
-    std::vector<QImage*> onions;
+    std::vector<RasterFrameModel*> prevOnions;
+    std::vector<RasterFrameModel*> nextOnions;
+
+    // Layers up to the topmost adjustment can only be shown composited, it reads what is beneath it.
+    // Nested scenes have no drawing of their own either, and blend modes need the composite beneath.
+    int underlay = -1;
+    for (size_t i = 0; i < mLayers.size(); ++i)
+    {
+        LayerType type = mLayers[i]->GetType();
+        if (mLayers[i]->IsEnabled() && (type == LayerTypeBlur || type == LayerTypeTransform || type == LayerTypeScene ||
+                                        mLayers[i]->GetBlendMode() != BlendNormal))
+        {
+            underlay = (int)i;
+        }
+    }
+    if (underlay >= 0 && mScene && mCompositeImage)
+    {
+        std::vector<CompositeLayer> layers;
+        mScene->GetCompositeLayers(mFrameIndex, layers, underlay + 1);
+        // only what is on screen, the graph pulls in what adjustments read around it
+        QRect changed = mCompositeBounds.united(visible);
+        mCompositeBounds = SceneModel::Composite(layers, mCompositeImage, mCompositeBounds, visible);
+        mCompositeMips->Invalidate(changed.united(mCompositeBounds));
+        int compositeLevel = level;
+        const QImage* composite = mCompositeMips->GetLevel(mCompositeImage, compositeLevel);
+        painter.setOpacity(1.0f);
+        DrawLevel(painter, *composite, compositeLevel, mCompositeBounds.intersected(visible));
+    }
 
     for (size_t i = 0; i < mLayers.size(); ++i)
     {
@@ -534,42 +743,47 @@ void Timeline::Render(QPainter& painter)
         }
         if (layer->GetType() == LayerTypeRaster)
         {
-            QImage* img = mLayers[i]->GetImage(mFrameIndex);
-            if (img)
+            RasterLayer* l = (RasterLayer*)layer;
+            RasterFrameModel* frame = l->GetFrameAt(mFrameIndex);
+            if (frame)
             {
-                if (mEditor->IsOnionEnabled() && mLayerIndex == (int)i)
+                if (mEditor->IsOnionEnabled() && mLayerIndex == (int)i && layer->IsOnionEnabled())
+                {
+                    l->GetOnionFrames(mFrameIndex, mOnionSkin->GetBefore(), mOnionSkin->GetAfter(), prevOnions, nextOnions);
+                }
+
+                if ((int)i > underlay)
                 {
-                    if (layer->GetType() == LayerTypeRaster && layer->IsOnionEnabled())
+                    painter.setOpacity(layer->GetOpacity() / 255.0f);
+                    CanvasTool* tool = frame == mEditor->GetFrame() ? mEditor->GetActiveTool() : NULL;
+                    QRect preview = tool ? tool->GetPreviewRect() : QRect();
+                    if (preview.isEmpty())
                     {
-                        RasterLayer* l = (RasterLayer*)mLayers[i];
-                        QImage* prev = l->GetImage(l->GetPrevImageIndex(mFrameIndex));
-                        if(prev && prev != img)
-                        {
-                            onions.push_back(prev);
-                        }
-                        QImage* next = l->GetImage(l->GetNextImageIndex(mFrameIndex));
-                        if(next && next != img)
-                        {
-                            onions.push_back(next);
-                        }
+                        DrawFrame(painter, frame, level, visible);
+                    }
+                    else
+                    {
+                        // the edit in progress replaces the frame where it draws, so erasing and
+                        // painting behind show as they will be committed
+                        painter.save();
+                        painter.setClipRegion(QRegion(visible).subtracted(preview), Qt::IntersectClip);
+                        DrawFrame(painter, frame, level, visible);
+                        painter.restore();
+                        tool->DrawPreview(painter);
                     }
                 }
-
-                painter.setOpacity(layer->GetOpacity() / 255.0f);
-                painter.drawImage(0, 0, *img);
             }
         }
         else if (layer->GetType() == LayerTypeTrace)
         {
             TraceLayer* tl = (TraceLayer*)layer;
-            tl->Render(painter);
+            tl->Render(painter, view);
         }
     }
 
-    painter.setOpacity(0.25f);
-    for (size_t i = 0; i < onions.size(); ++i)
+    if (mScene)
     {
-        painter.drawImage(0, 0, *onions[i]);
+        mOnionSkin->Render(painter, mScene->GetWidth(), mScene->GetHeight(), visible, prevOnions, nextOnions);
     }
 }
 
@@ -587,6 +801,8 @@ void Timeline::UpdateMaxFrames()
     }
     mMaxFrames = maxFrames;
     mTimeScroll->setMaximum(maxFrames * mCellSize.width());
+    mPlaybackCache->SetLoopRange(0, maxFrames - 1);
+    InvalidateCache();
 }
 
 QImage* Timeline::GetCompositeImage()
@@ -601,7 +817,9 @@ QImage* Timeline::GetCompositeImage(int index)
         return NULL;
     }
 
-    mScene->GetCompositeImage(index, mCompositeImage);
+    QRect bounds = mCompositeBounds;
+    mCompositeBounds = mScene->GetCompositeImage(index, mCompositeImage, mCompositeBounds);
+    mCompositeMips->Invalidate(bounds.united(mCompositeBounds));
 
     return mCompositeImage;
 }
@@ -611,3 +829,80 @@ void Timeline::OnTimeScroll(int value)
     mOffset = value;
     update();
 }
+
+void Timeline::StartPlayback(bool ramPreview)
+{
+    if (!mScene)
+    {
+        return;
+    }
+    mPlaybackCache->SetLoopRange(0, mMaxFrames - 1);
+    mPlaybackCache->SetRamPreview(ramPreview);
+    mPlaybackCache->Start(mFrameIndex);
+    mPlaying = true;
+    mPrimed = false;
+}
+
+void Timeline::StopPlayback()
+{
+    if (mPlaying)
+    {
+        mPlaybackClock->Stop();
+        mPlaybackCache->Stop();
+        mPlaying = false;
+        UpdateCanvas();
+    }
+}
+
+int Timeline::UpdatePlayback()
+{
+    if (!mPlaying || mMaxFrames <= 0)
+    {
+        return -1;
+    }
+
+    // keeps the workers busy with frames finished since the last update
+    mPlaybackCache->SetPlayhead(mFrameIndex);
+
+    if (!mPrimed)
+    {
+        if (mPlaybackCache->IsRamPreview() &&
+            mPlaybackCache->GetReadyCount() < mMaxFrames && mPlaybackCache->GetPendingCount() > 0)
+        {
+            return 10;
+        }
+        mPrimed = true;
+        mPlaybackTick = mFrameIndex;
+        mPresentedTick = mFrameIndex;
+        mPlaybackClock->SetFps(GetFps());
+        mPlaybackClock->Start(mFrameIndex);
+    }
+
+    qint64 tick = mPlaybackClock->GetTargetTick();
+    if (tick > mPlaybackTick)
+    {
+        int frameIndex = (int)(tick % mMaxFrames);
+        if (!mPlaybackCache->IsReady(frameIndex))
+        {
+            // poll until the worker delivers it, the clock decides whether it is still due
+            return 1;
+        }
+        mPlaybackTick = tick;
+        SetFrameIndex(frameIndex);
+        mEditor->update();
+    }
+    // the tick after the scheduled one, the scheduled one is due already until it is painted
+    return mPlaybackClock->GetTimeToTick(mPlaybackTick + 1);
+}
+
+void Timeline::InvalidateCache()
+{
+    if (mScene)
+    {
+        mScene->NotifyChanged();
+    }
+    if (mPlaying)
+    {
+        mPlaybackCache->Invalidate();
+    }
+}
@@ -11,6 +11,10 @@ class RasterImageEditor;
 class RasterLayer;
 class SceneModel;
 class RasterLayerModel;
+class PlaybackCache;
+class PlaybackClock;
+class OnionSkin;
+class MipPyramid;
 
 class Timeline : public QWidget
 {
@@ -47,11 +51,26 @@ public:
     QImage* GetCompositeImage(int index);
     int GetOffset() const { return mOffset; }
 
+    void StartPlayback(bool ramPreview);
+    void StopPlayback();
+    bool IsPlaying() const { return mPlaying; }
+    // Shows the frame due on the playback clock if it is composited,
+    // returns milliseconds until it should be called again
+    int UpdatePlayback();
+    bool IsCaching() const { return mPlaying && !mPrimed; }
+    void InvalidateCache();
+    PlaybackCache* GetPlaybackCache() { return mPlaybackCache; }
+    PlaybackClock* GetPlaybackClock() { return mPlaybackClock; }
+    OnionSkin* GetOnionSkin() { return mOnionSkin; }
+
 signals:
 
 public slots:
     void AddRasterLayer(int index = -1);
     void AddTraceLayer(int index = -1);
+    void AddBlurLayer(int index = -1);
+    void AddTransformLayer(int index = -1);
+    void AddSceneLayer(SceneModel* scene, int index = -1);
     void AddSoundLayer(int index = -1);
     void RemoveLayer(int index = -1);
     void SetFrameIndex(int value);
@@ -83,6 +102,19 @@ private:
     QScrollBar* mTimeScroll;
     int mOffset;
     QImage* mCompositeImage;
+    // Area of mCompositeImage which may hold non-transparent pixels
+    QRect mCompositeBounds;
+    // Levels of mCompositeImage for drawing the underlay zoomed out
+    MipPyramid* mCompositeMips;
+    PlaybackCache* mPlaybackCache;
+    PlaybackClock* mPlaybackClock;
+    OnionSkin* mOnionSkin;
+    // Clock tick of the frame handed to the canvas, and of the last one painted
+    qint64 mPlaybackTick;
+    qint64 mPresentedTick;
+    bool mPlaying;
+    // RAM preview holds the first frame until the loop is cached
+    bool mPrimed;
 };
 
 #endif // TIMELINE_H
@@ -189,7 +189,7 @@ void TraceLayer::paintEvent(QPaintEvent *)
     }
 }
 
-void TraceLayer::Render(QPainter& p)
+void TraceLayer::Render(QPainter& p, const QRect& visible)
 {
     int range = 5;
     int index = mTimeline->GetFrameIndex();
@@ -200,7 +200,7 @@ void TraceLayer::Render(QPainter& p)
     for(int i = idxMin; i <= idxMax; ++i)
     {
         QPoint* pt = mLayerModel->GetFrameAt(i);
-        if (pt)
+        if (pt && visible.intersects(QRect(pt->x() - 7, pt->y() - 7, 14, 14)))
         {
             int d = i - index;
             d = d * d * 5;
@@ -52,7 +52,8 @@ public:
     QWidget* GetPropertyWindow() { return mPropertyWindow; }
     int GetMaxFrames() { return mMaxFrames; }
     void UpdateMaxFrames();
-    void Render(QPainter& painter);
+    // Only markers which intersect visible are drawn
+    void Render(QPainter& painter, const QRect& visible);
 
 private:
     int GetFrameIndex(int x, int y);
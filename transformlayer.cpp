@@ -0,0 +1,293 @@
+#include "transformlayer.h"
+#include <QPainter>
+#include <QWidget>
+#include <QMouseEvent>
+#include <QHBoxLayout>
+#include <QSlider>
+#include <QCheckBox>
+#include <QDoubleSpinBox>
+#include "timeline.h"
+#include "animationfile.h"
+
+static QDoubleSpinBox* CreateSpinBox(double minimum, double maximum, double step, const QString& toolTip)
+{
+    QDoubleSpinBox* box = new QDoubleSpinBox;
+    box->setRange(minimum, maximum);
+    box->setSingleStep(step);
+    box->setDecimals(2);
+    box->setToolTip(toolTip);
+    box->setButtonSymbols(QAbstractSpinBox::NoButtons);
+    return box;
+}
+
+TransformPropertyWindow::TransformPropertyWindow(Timeline* timeline, TransformLayer* layer)
+    :mTimeline(timeline)
+    ,mLayer(layer)
+    ,mUpdating(false)
+{
+    setLayout(new QHBoxLayout);
+    layout()->setMargin(0);
+    layout()->setSpacing(0);
+
+    QSlider* slider = new QSlider(Qt::Horizontal);
+    slider->setMaximum(255);
+    slider->setValue(layer->GetOpacity());
+    layout()->addWidget(slider);
+    connect(slider, SIGNAL(valueChanged(int)),
+            this, SLOT(SetOpacity(int)));
+
+    QCheckBox* enableBox = new QCheckBox;
+    enableBox->setIcon(QIcon(":/icons/visible.png"));
+    enableBox->setChecked(layer->IsEnabled());
+    connect(enableBox, SIGNAL(toggled(bool)),
+            this, SLOT(Enable(bool)));
+    layout()->addWidget(enableBox);
+
+    mX = CreateSpinBox(-100000, 100000, 1, "Translate X");
+    mY = CreateSpinBox(-100000, 100000, 1, "Translate Y");
+    mRotation = CreateSpinBox(-3600, 3600, 1, "Rotation in degrees");
+    mScale = CreateSpinBox(0.01, 100, 0.05, "Scale");
+    QDoubleSpinBox* boxes[4] = { mX, mY, mRotation, mScale };
+    for (int i = 0; i < 4; ++i)
+    {
+        layout()->addWidget(boxes[i]);
+        connect(boxes[i], SIGNAL(valueChanged(double)),
+                this, SLOT(SetKeyValues()));
+    }
+    UpdateValues(timeline->GetFrameIndex());
+
+    setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Fixed);
+}
+
+TransformPropertyWindow::~TransformPropertyWindow()
+{
+
+}
+
+QSize TransformPropertyWindow::sizeHint() const
+{
+    return QSize(200, mTimeline->GetCellSize().height());
+}
+
+QSize TransformPropertyWindow::minimumSizeHint() const
+{
+    return QSize(200, mTimeline->GetCellSize().height());
+}
+
+void TransformPropertyWindow::UpdateValues(int frameIndex)
+{
+    TransformLayerModel::Key key = mLayer->GetModel()->GetKeyAt(frameIndex);
+    mUpdating = true;
+    mX->setValue(key.x);
+    mY->setValue(key.y);
+    mRotation->setValue(key.rotation);
+    mScale->setValue(key.scale);
+    mUpdating = false;
+}
+
+void TransformPropertyWindow::SetOpacity(int value)
+{
+    mLayer->SetOpacity((unsigned char) value);
+}
+
+void TransformPropertyWindow::Enable(bool value)
+{
+    mLayer->Enable(value);
+}
+
+void TransformPropertyWindow::SetKeyValues()
+{
+    if (mUpdating)
+    {
+        return;
+    }
+    mLayer->SetKey(mTimeline->GetFrameIndex(), (float)mX->value(), (float)mY->value(),
+                   (float)mRotation->value(), (float)mScale->value());
+}
+
+TransformLayer::TransformLayer(Timeline* timeline, TransformLayerModel* layerModel, QWidget *parent) :
+    Layer(parent),
+    mLayerModel(layerModel),
+    mTimeline(timeline),
+    mSelected(false),
+    mState(EditorStateMove)
+{
+    setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+    mPropertyWindow = new TransformPropertyWindow(timeline, this);
+}
+
+TransformLayer::~TransformLayer()
+{
+}
+
+QSize TransformLayer::sizeHint() const
+{
+    return QSize(mTimeline->GetCellSize().width() * mTimeline->GetMaxFrames(), mTimeline->GetCellSize().height());
+}
+
+QSize TransformLayer::minimumSizeHint() const
+{
+    return QSize(mTimeline->GetCellSize().width() * mTimeline->GetMaxFrames(), mTimeline->GetCellSize().height());
+}
+
+void TransformLayer::mousePressEvent(QMouseEvent *ev)
+{
+    mTimeline->SetLayer(this);
+    int frameIndex = (ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width();
+    this->grabMouse();
+
+    mState = ev->button() == Qt::RightButton ? EditorStateErase : EditorStateMove;
+    if (mState == EditorStateMove)
+    {
+        mTimeline->SetFrameIndex(frameIndex);
+    }
+    else
+    {
+        RemoveKey(frameIndex);
+    }
+}
+
+void TransformLayer::mouseReleaseEvent(QMouseEvent *)
+{
+    this->releaseMouse();
+}
+
+void TransformLayer::mouseMoveEvent(QMouseEvent *ev)
+{
+    int frameIndex = (ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width();
+    if (mState == EditorStateMove)
+    {
+        mTimeline->SetFrameIndex(frameIndex);
+    }
+    else
+    {
+        RemoveKey(frameIndex);
+    }
+}
+
+void TransformLayer::mouseDoubleClickEvent(QMouseEvent *ev)
+{
+    // keys the interpolated values so the motion is unchanged until edited
+    int frameIndex = (ev->x() + mTimeline->GetOffset()) / mTimeline->GetCellSize().width();
+    TransformLayerModel::Key key = mLayerModel->GetKeyAt(frameIndex);
+    SetKey(frameIndex, key.x, key.y, key.rotation, key.scale);
+}
+
+void TransformLayer::paintEvent(QPaintEvent *)
+{
+    QSize cellSize = mTimeline->GetCellSize();
+    int offset = mTimeline->GetOffset();
+
+    QPainter p(this);
+    p.setPen(Qt::NoPen);
+    if (mSelected)
+    {
+        p.setBrush(QBrush(QColor(250, 250, 250)));
+    }
+    else
+    {
+        p.setBrush(QBrush(QColor(200, 200, 200)));
+    }
+    p.drawRect(0, 0, width(), cellSize.height());
+
+    int w = cellSize.width();
+    int idxMin = offset / w;
+    int idxMax = (offset + width() + w) / w;
+    int r = w / 2 - 1;
+    int cy = cellSize.height() / 2;
+
+    p.setPen(QPen(QColor(0, 0, 0)));
+    p.setBrush(QBrush(QColor(80, 80, 80)));
+    const std::vector<TransformLayerModel::Key>& keys = mLayerModel->GetKeys();
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        int index = keys[i].frameIndex;
+        if (index < idxMin || index > idxMax)
+        {
+            continue;
+        }
+        int cx = index * w - offset + w / 2;
+        QPoint diamond[4] = { QPoint(cx, cy - r), QPoint(cx + r, cy), QPoint(cx, cy + r), QPoint(cx - r, cy) };
+        p.drawPolygon(diamond, 4);
+    }
+}
+
+void TransformLayer::SetSelected(bool selected)
+{
+    mSelected = selected;
+    update();
+}
+
+void TransformLayer::OnFrameChanged(int frameIndex)
+{
+    mPropertyWindow->UpdateValues(frameIndex);
+}
+
+QImage* TransformLayer::GetImage(int frameIndex)
+{
+    return NULL;
+}
+
+unsigned char TransformLayer::GetOpacity()
+{
+    return mLayerModel->GetOpacity();
+}
+
+void TransformLayer::SetOpacity(unsigned char value)
+{
+    if (value != mLayerModel->GetOpacity())
+    {
+        mLayerModel->SetOpacity(value);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+bool TransformLayer::IsEnabled()
+{
+    return mLayerModel->IsEnabled();
+}
+
+void TransformLayer::Enable(bool enable)
+{
+    if (mLayerModel->IsEnabled() != enable)
+    {
+        mLayerModel->Enable(enable);
+        mTimeline->InvalidateCache();
+        mTimeline->UpdateCanvas();
+    }
+}
+
+int TransformLayer::GetMaxFrames()
+{
+    return mLayerModel->GetMaxFrames();
+}
+
+void TransformLayer::SetKey(int frameIndex, float x, float y, float rotation, float scale)
+{
+    TransformLayerModel::Key key;
+    key.frameIndex = frameIndex;
+    key.x = x;
+    key.y = y;
+    key.rotation = rotation;
+    key.scale = scale;
+    mLayerModel->SetKey(key);
+    OnKeysChanged();
+}
+
+void TransformLayer::RemoveKey(int frameIndex)
+{
+    if (mLayerModel->HasKey(frameIndex))
+    {
+        mLayerModel->RemoveKey(frameIndex);
+        OnKeysChanged();
+    }
+}
+
+void TransformLayer::OnKeysChanged()
+{
+    mPropertyWindow->UpdateValues(mTimeline->GetFrameIndex());
+    update();
+    mTimeline->UpdateMaxFrames();
+    mTimeline->UpdateCanvas();
+}
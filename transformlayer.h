@@ -0,0 +1,93 @@
+#ifndef TRANSFORMLAYER_H
+#define TRANSFORMLAYER_H
+
+#include "layer.h"
+#include <QWidget>
+
+class Timeline;
+class TransformLayer;
+class TransformLayerModel;
+class QDoubleSpinBox;
+
+// Edits the key of the current frame, a key is added when a value changes between keys
+class TransformPropertyWindow : public QWidget
+{
+    Q_OBJECT
+public:
+    TransformPropertyWindow(Timeline* timeline, TransformLayer* layer);
+    ~TransformPropertyWindow();
+
+    void UpdateValues(int frameIndex);
+
+    public slots:
+        void SetOpacity(int value);
+        void Enable(bool value);
+        void SetKeyValues();
+
+protected:
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+private:
+    Timeline* mTimeline;
+    TransformLayer* mLayer;
+    QDoubleSpinBox* mX;
+    QDoubleSpinBox* mY;
+    QDoubleSpinBox* mRotation;
+    QDoubleSpinBox* mScale;
+    bool mUpdating;
+};
+
+class TransformLayer : public Layer
+{
+    Q_OBJECT
+public:
+    explicit TransformLayer(Timeline* timeline, TransformLayerModel* layerModel, QWidget *parent = 0);
+    ~TransformLayer();
+
+    TransformLayerModel* GetModel() { return mLayerModel; }
+    LayerType GetType() { return LayerTypeTransform; }
+    void SetSelected(bool selected);
+    void OnFrameChanged(int frameIndex);
+    QImage* GetImage(int frameIndex);
+    bool IsOnionEnabled() { return false; }
+    void EnableOnion(bool enable) {}
+    unsigned char GetOpacity();
+    void SetOpacity(unsigned char value);
+    bool IsEnabled();
+    void Enable(bool enable);
+    QWidget* GetPropertyWindow() { return mPropertyWindow; }
+    int GetMaxFrames();
+    void SetKey(int frameIndex, float x, float y, float rotation, float scale);
+    void RemoveKey(int frameIndex);
+
+public:
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+protected:
+    void mousePressEvent(QMouseEvent *);
+    void mouseReleaseEvent(QMouseEvent *);
+    void mouseMoveEvent(QMouseEvent *);
+    void mouseDoubleClickEvent(QMouseEvent *);
+    void paintEvent(QPaintEvent *);
+
+private:
+    void OnKeysChanged();
+
+private:
+    enum EditorState
+    {
+        EditorStateMove,
+        EditorStateErase
+    };
+
+private:
+    TransformLayerModel* mLayerModel;
+    Timeline* mTimeline;
+    bool mSelected;
+    EditorState mState;
+    TransformPropertyWindow* mPropertyWindow;
+};
+
+#endif // TRANSFORMLAYER_H
@@ -0,0 +1,340 @@
+#include "undohistory.h"
+#include <QRunnable>
+#include <QMutexLocker>
+#include <vector>
+
+// Spilled bytes a job copies to the compacted file before it lets the trims run again
+#define UNDO_COMPACT_BYTES (4 * 1024 * 1024)
+
+class UndoHistoryJob : public QRunnable
+{
+public:
+    UndoHistoryJob(UndoHistory* history)
+        :mHistory(history)
+    {
+    }
+
+    void run()
+    {
+        while (mHistory->Trim())
+        {
+        }
+        mHistory->Compact();
+    }
+
+    UndoHistory* mHistory;
+};
+
+UndoHistory::UndoHistory()
+    :mMemoryBudget(256 * 1024 * 1024)
+    ,mMemoryUsage(0)
+    ,mDiskUsage(0)
+    ,mDeadBytes(0)
+    ,mNextId(0)
+    ,mScheduled(false)
+    ,mStopping(false)
+    ,mFile(new QTemporaryFile())
+    ,mFileEnd(0)
+    ,mCompacting(false)
+    ,mCompactFile(NULL)
+    ,mCompactEnd(0)
+{
+    mPool.setMaxThreadCount(1);
+}
+
+UndoHistory::~UndoHistory()
+{
+    mMutex.lock();
+    mStopping = true;
+    mMutex.unlock();
+
+    mPool.waitForDone();
+    delete mCompactFile;
+    delete mFile;
+}
+
+void UndoHistory::SetMemoryBudget(qint64 bytes)
+{
+    QMutexLocker lock(&mMutex);
+    mMemoryBudget = bytes;
+    Schedule();
+}
+
+qint64 UndoHistory::GetMemoryUsage()
+{
+    QMutexLocker lock(&mMutex);
+    return mMemoryUsage;
+}
+
+qint64 UndoHistory::GetDiskUsage()
+{
+    QMutexLocker lock(&mMutex);
+    return mDiskUsage + mDeadBytes;
+}
+
+int UndoHistory::Store(const QByteArray& data)
+{
+    QMutexLocker lock(&mMutex);
+    int id = mNextId++;
+    Record& record = mRecords[id];
+    record.state = RecordStateRaw;
+    record.data = data;
+    record.offset = 0;
+    record.size = data.size();
+    mMemoryUsage += data.size();
+    Schedule();
+    return id;
+}
+
+QByteArray UndoHistory::Load(int id)
+{
+    mMutex.lock();
+    std::map<int, Record>::iterator it = mRecords.find(id);
+    if (it == mRecords.end())
+    {
+        mMutex.unlock();
+        return QByteArray();
+    }
+    Record record = it->second;
+    if (record.state != RecordStateSpilled)
+    {
+        mMutex.unlock();
+        return record.state == RecordStateRaw ? record.data : qUncompress(record.data);
+    }
+
+    // the file lock is taken before the offset can go stale by a compaction
+    QByteArray packed;
+    mFileMutex.lock();
+    mMutex.unlock();
+    if (mFile->seek(record.offset))
+    {
+        packed = mFile->read(record.size);
+    }
+    mFileMutex.unlock();
+    return qUncompress(packed);
+}
+
+void UndoHistory::Remove(int id)
+{
+    QMutexLocker lock(&mMutex);
+    std::map<int, Record>::iterator it = mRecords.find(id);
+    if (it == mRecords.end())
+    {
+        return;
+    }
+
+    Record& record = it->second;
+    if (record.state == RecordStateSpilled)
+    {
+        mDiskUsage -= record.size;
+        mDeadBytes += record.size;
+    }
+    else
+    {
+        mMemoryUsage -= record.data.size();
+    }
+    mRecords.erase(it);
+
+    // the temp file is append only, start over once nothing refers to it
+    if (mRecords.empty())
+    {
+        QMutexLocker fileLock(&mFileMutex);
+        if (mFile->isOpen())
+        {
+            mFile->resize(0);
+        }
+        mFileEnd = 0;
+        mDeadBytes = 0;
+    }
+    Schedule();
+}
+
+void UndoHistory::Schedule()
+{
+    if (mScheduled || mStopping || (mMemoryUsage <= mMemoryBudget / 2 && mDeadBytes <= mDiskUsage && !mCompacting))
+    {
+        return;
+    }
+    mScheduled = true;
+    mPool.start(new UndoHistoryJob(this));
+}
+
+bool UndoHistory::Trim()
+{
+    mMutex.lock();
+    int id = -1;
+    if (!mStopping && mMemoryUsage > mMemoryBudget / 2)
+    {
+        for (std::map<int, Record>::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
+        {
+            if (it->second.state == RecordStateRaw)
+            {
+                id = it->first;
+                break;
+            }
+        }
+    }
+    if (id < 0 && !mStopping && mMemoryUsage > mMemoryBudget)
+    {
+        for (std::map<int, Record>::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
+        {
+            if (it->second.state == RecordStateCompressed)
+            {
+                id = it->first;
+                break;
+            }
+        }
+    }
+    if (id < 0)
+    {
+        mScheduled = false;
+        mMutex.unlock();
+        return false;
+    }
+    RecordState state = mRecords[id].state;
+    QByteArray data = mRecords[id].data;
+    mMutex.unlock();
+
+    // the record may be removed meanwhile, results are only kept if it is still there
+    if (state == RecordStateRaw)
+    {
+        QByteArray packed = qCompress(data, 1);
+
+        QMutexLocker lock(&mMutex);
+        std::map<int, Record>::iterator it = mRecords.find(id);
+        if (it != mRecords.end() && it->second.state == RecordStateRaw)
+        {
+            mMemoryUsage += packed.size() - it->second.data.size();
+            it->second.data = packed;
+            it->second.state = RecordStateCompressed;
+        }
+        return true;
+    }
+
+    qint64 offset = 0;
+    bool written = false;
+    {
+        QMutexLocker fileLock(&mFileMutex);
+        if (mFile->isOpen() || mFile->open())
+        {
+            offset = mFileEnd;
+            written = mFile->seek(offset) && mFile->write(data) == data.size();
+            if (written)
+            {
+                mFileEnd += data.size();
+            }
+        }
+    }
+
+    QMutexLocker lock(&mMutex);
+    if (!written)
+    {
+        // disk is full or not writable, compressed records stay in memory
+        mScheduled = false;
+        return false;
+    }
+    std::map<int, Record>::iterator it = mRecords.find(id);
+    if (it != mRecords.end() && it->second.state == RecordStateCompressed)
+    {
+        Record& record = it->second;
+        mMemoryUsage -= record.data.size();
+        mDiskUsage += record.data.size();
+        record.state = RecordStateSpilled;
+        record.offset = offset;
+        record.size = record.data.size();
+        record.data = QByteArray();
+    }
+    else
+    {
+        mDeadBytes += data.size();
+    }
+    return true;
+}
+
+void UndoHistory::Compact()
+{
+    std::vector<std::pair<int, Record> > spilled;
+    {
+        QMutexLocker lock(&mMutex);
+        if (mStopping || (!mCompacting && mDeadBytes <= mDiskUsage))
+        {
+            return;
+        }
+        mCompacting = true;
+        qint64 bytes = 0;
+        for (std::map<int, Record>::iterator it = mRecords.begin(); it != mRecords.end() && bytes < UNDO_COMPACT_BYTES; ++it)
+        {
+            if (it->second.state == RecordStateSpilled && mCompactOffsets.find(it->first) == mCompactOffsets.end())
+            {
+                spilled.push_back(*it);
+                bytes += it->second.size;
+            }
+        }
+    }
+
+    // only this thread spills, so the records can be copied without holding up Store and Remove
+    if (!mCompactFile)
+    {
+        mCompactFile = new QTemporaryFile();
+        mCompactEnd = 0;
+    }
+    bool copied = mCompactFile->isOpen() || mCompactFile->open();
+    for (size_t i = 0; copied && i < spilled.size(); ++i)
+    {
+        Record& record = spilled[i].second;
+        QByteArray data;
+        {
+            QMutexLocker fileLock(&mFileMutex);
+            if (mFile->seek(record.offset))
+            {
+                data = mFile->read(record.size);
+            }
+        }
+        copied = data.size() == record.size && mCompactFile->write(data) == data.size();
+        record.offset = mCompactEnd;
+        mCompactEnd += record.size;
+    }
+
+    QTemporaryFile* old;
+    {
+        QMutexLocker lock(&mMutex);
+        if (!copied)
+        {
+            // the old file stays, with its dead bytes
+            delete mCompactFile;
+            mCompactFile = NULL;
+            mCompactOffsets.clear();
+            mCompacting = false;
+            return;
+        }
+        for (size_t i = 0; i < spilled.size(); ++i)
+        {
+            mCompactOffsets[spilled[i].first] = spilled[i].second.offset;
+        }
+        if (!spilled.empty())
+        {
+            // the next job copies on, after the trims that came in meanwhile
+            Schedule();
+            return;
+        }
+
+        QMutexLocker fileLock(&mFileMutex);
+        for (std::map<int, qint64>::iterator it = mCompactOffsets.begin(); it != mCompactOffsets.end(); ++it)
+        {
+            std::map<int, Record>::iterator record = mRecords.find(it->first);
+            if (record != mRecords.end())
+            {
+                record->second.offset = it->second;
+            }
+        }
+        old = mFile;
+        mFile = mCompactFile;
+        mFileEnd = mCompactEnd;
+        // records removed while copying are dead in the new file too
+        mDeadBytes = mCompactEnd - mDiskUsage;
+        mCompactFile = NULL;
+        mCompactOffsets.clear();
+        mCompacting = false;
+    }
+    delete old;
+}
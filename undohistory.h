@@ -0,0 +1,83 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QThreadPool>
+#include <QTemporaryFile>
+#include <map>
+
+class UndoHistoryJob;
+
+// Holds the pixel data of undo commands within a RAM budget.
+// Once half the budget is used the oldest records are compressed on a worker thread,
+// past the whole budget compressed records are moved to a temp file. Load is transparent.
+// The file is appended to, and rewritten with only the live records once most of it is dead.
+// The rewrite goes a few MB per worker job, so trims queued meanwhile are not held up by it.
+class UndoHistory
+{
+    friend class UndoHistoryJob;
+public:
+    UndoHistory();
+    ~UndoHistory();
+
+    void SetMemoryBudget(qint64 bytes);
+    qint64 GetMemoryBudget() const { return mMemoryBudget; }
+    qint64 GetMemoryUsage();
+    // Size of the temp file, dead bytes included
+    qint64 GetDiskUsage();
+
+    // Returns the id to load the data back with
+    int Store(const QByteArray& data);
+    QByteArray Load(int id);
+    void Remove(int id);
+
+private:
+    enum RecordState
+    {
+        RecordStateRaw,
+        RecordStateCompressed,
+        RecordStateSpilled
+    };
+
+    struct Record
+    {
+        RecordState state;
+        // Raw or qCompress-ed data, empty once spilled
+        QByteArray data;
+        // Position of the qCompress-ed data in mFile
+        qint64 offset;
+        int size;
+    };
+
+    void Schedule();
+    // Compresses or spills one record, returns false if nothing is over budget
+    bool Trim();
+    // Copies the next spilled records to a new file if more of the old one is dead than live.
+    // Switches to the new file once all are copied, until then schedules another job.
+    void Compact();
+
+private:
+    QThreadPool mPool;
+    QMutex mMutex;
+    // Ids grow, so the map is ordered oldest first
+    std::map<int, Record> mRecords;
+    qint64 mMemoryBudget;
+    qint64 mMemoryUsage;
+    qint64 mDiskUsage;
+    // Bytes of the file which belong to removed records
+    qint64 mDeadBytes;
+    int mNextId;
+    bool mScheduled;
+    bool mStopping;
+    QMutex mFileMutex;
+    QTemporaryFile* mFile;
+    qint64 mFileEnd;
+    // File being compacted into, used by the worker only, and the offsets of the records copied to it
+    bool mCompacting;
+    QTemporaryFile* mCompactFile;
+    qint64 mCompactEnd;
+    std::map<int, qint64> mCompactOffsets;
+};
+
+#endif // UNDOHISTORY_H